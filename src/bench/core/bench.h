@@ -40,6 +40,24 @@ void bjoin(cbench_state_t *state);
 
 void bpatinsert(cbench_state_t *state);
 
+void bpatsearchbest(cbench_state_t *state);
+
+void bpatsearchbestpacked(cbench_state_t *state);
+
+void bpatsearchbest6(cbench_state_t *state);
+
+void bpatsearchbest6packed(cbench_state_t *state);
+
+void bpatsearchbestchurned(cbench_state_t *state);
+
+void bpatsearchbestcompacted(cbench_state_t *state);
+
+void bcpatsearch1(cbench_state_t *state);
+
+void bcpatsearch4(cbench_state_t *state);
+
+void bcpatsearch4w(cbench_state_t *state);
+
 void bprefixeqwithmask(cbench_state_t *state);
 
 void bppathcompwithmask(cbench_state_t *state);
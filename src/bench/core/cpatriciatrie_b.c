@@ -0,0 +1,150 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#include "../../ubgp/cpatriciatrie.h"
+#include "../../ubgp/endian.h"
+
+#include <cbench/cbench.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+enum {
+    NUM_PREFIXES = 65536,
+    MAX_THREADS  = 8
+};
+
+typedef struct {
+    cpatricia_trie_t trie;
+    netaddr_t *prefixes;
+    int done;
+} scaling_t;
+
+static void mkpfx(netaddr_t *p, uint32_t i)
+{
+    // spread prefixes over the address space, mixing /16s and /24s
+    uint32_t addr = beswap32((i * 2654435761u) & ((i & 1) ? 0xffffff00u : 0xffff0000u));
+    makenaddr(p, AF_INET, &addr, (i & 1) ? 24 : 16);
+}
+
+static void *lookupthread(void *arg)
+{
+    scaling_t *s = arg;
+
+    cpatricia_reader_t *r = cpatreaderget(&s->trie);
+    if (!r)
+        return NULL;
+
+    uint32_t i = 0;
+    while (!ATOMIC_LOAD_ACQ(s->done)) {
+        cpatreadbegin(&s->trie, r);
+        cpatsearchbest(&s->trie, &s->prefixes[i++ % NUM_PREFIXES]);
+        cpatreadend(r);
+    }
+
+    cpatreaderput(r);
+    return NULL;
+}
+
+static void *writerthread(void *arg)
+{
+    scaling_t *s = arg;
+
+    // continuously withdraw and announce the upper half of the prefixes,
+    // the writer does not share the trie with any other writer
+    uint32_t i = 0;
+    while (!ATOMIC_LOAD_ACQ(s->done)) {
+        netaddr_t *p = &s->prefixes[NUM_PREFIXES / 2 + i++ % (NUM_PREFIXES / 2)];
+
+        cpatremove(&s->trie, p);
+        cpatinsert(&s->trie, p, p, NULL);
+        if (i % 1024 == 0)
+            cpatsynchronize(&s->trie);
+    }
+
+    return NULL;
+}
+
+// lookups performed by the benchmarking thread, while nreaders - 1 threads
+// do the same, optionally along with a writer
+static void cpatscaling(cbench_state_t *state, uint nreaders, bool writer)
+{
+    scaling_t *s = malloc(sizeof(*s));
+    if (!s)
+        return;
+
+    s->prefixes = malloc(NUM_PREFIXES * sizeof(*s->prefixes));
+    if (!s->prefixes) {
+        free(s);
+        return;
+    }
+
+    s->done = 0;
+    cpatinit(&s->trie, AF_INET);
+    for (uint32_t i = 0; i < NUM_PREFIXES; i++) {
+        mkpfx(&s->prefixes[i], i);
+        cpatinsert(&s->trie, &s->prefixes[i], &s->prefixes[i], NULL);
+    }
+
+    pthread_t threads[MAX_THREADS];
+    uint nthreads = 0;
+    for (uint i = 1; i < nreaders && nthreads < MAX_THREADS; i++) {
+        if (pthread_create(&threads[nthreads], NULL, lookupthread, s) == 0)
+            nthreads++;
+    }
+    if (writer && nthreads < MAX_THREADS) {
+        if (pthread_create(&threads[nthreads], NULL, writerthread, s) == 0)
+            nthreads++;
+    }
+
+    cpatricia_reader_t *r = cpatreaderget(&s->trie);
+
+    while (cbench_next_iteration(state)) {
+        cpatreadbegin(&s->trie, r);
+        cpatsearchbest(&s->trie, &s->prefixes[state->curiter % NUM_PREFIXES]);
+        cpatreadend(r);
+    }
+
+    cpatreaderput(r);
+
+    ATOMIC_STORE_REL(s->done, 1);
+    for (uint i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+
+    cpatsynchronize(&s->trie);
+    cpatdestroy(&s->trie);
+    free(s->prefixes);
+    free(s);
+}
+
+void bcpatsearch1(cbench_state_t *state)
+{
+    cpatscaling(state, 1, false);
+}
+
+void bcpatsearch4(cbench_state_t *state)
+{
+    cpatscaling(state, 4, false);
+}
+
+void bcpatsearch4w(cbench_state_t *state)
+{
+    cpatscaling(state, 4, true);
+}
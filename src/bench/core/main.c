@@ -58,6 +58,33 @@ int main(void)
 
     if (!cbench_add_bench(suite, "patinsert", bpatinsert, NULL))
         goto out;
+
+    if (!cbench_add_bench(suite, "patsearchbest", bpatsearchbest, NULL))
+        goto out;
+
+    if (!cbench_add_bench(suite, "patsearchbestpacked", bpatsearchbestpacked, NULL))
+        goto out;
+
+    if (!cbench_add_bench(suite, "patsearchbest6", bpatsearchbest6, NULL))
+        goto out;
+
+    if (!cbench_add_bench(suite, "patsearchbest6packed", bpatsearchbest6packed, NULL))
+        goto out;
+
+    if (!cbench_add_bench(suite, "patsearchbestchurned", bpatsearchbestchurned, NULL))
+        goto out;
+
+    if (!cbench_add_bench(suite, "patsearchbestcompacted", bpatsearchbestcompacted, NULL))
+        goto out;
+
+    if (!cbench_add_bench(suite, "cpatsearch1", bcpatsearch1, NULL))
+        goto out;
+
+    if (!cbench_add_bench(suite, "cpatsearch4", bcpatsearch4, NULL))
+        goto out;
+
+    if (!cbench_add_bench(suite, "cpatsearch4w", bcpatsearch4w, NULL))
+        goto out;
     
     if (!cbench_add_bench(suite, "bprefixeqwithmask", bprefixeqwithmask, NULL))
         goto out;
@@ -23,6 +23,9 @@
 #include "../../ubgp/patriciatrie.h"
 
 #include <cbench/cbench.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
 
 void bpatinsert(cbench_state_t *state)
 {
@@ -42,3 +45,146 @@ void bpatinsert(cbench_state_t *state)
 
     patdestroy(&trie);
 }
+
+enum {
+    NUM_TABLE_PREFIXES = 1 << 18,
+    NUM_QUERIES        = 1 << 16
+};
+
+// a synthetic full-table-like trie, along with random host queries
+static void filltable(patricia_trie_t *trie, netaddr_t *queries, sa_family_t family)
+{
+    uint32_t seed = 0x2545f491u;
+
+    patinit(trie, family);
+    for (uint i = 0; i < NUM_TABLE_PREFIXES + NUM_QUERIES; i++) {
+        seed = seed * 1103515245u + 12345u;
+
+        uint32_t r = seed ^ (seed >> 15);
+        uint32_t words[4] = { 0 };
+
+        netaddr_t pfx;
+        netaddr_t *p = (i < NUM_TABLE_PREFIXES) ? &pfx : &queries[i - NUM_TABLE_PREFIXES];
+        if (family == AF_INET) {
+            words[0] = beswap32(r);
+            makenaddr(p, AF_INET, words, (i < NUM_TABLE_PREFIXES) ? 16 + (r & 0x7) + ((r & 0x8) ? 1 : 0) : 32);
+            if (i < NUM_TABLE_PREFIXES)
+                p->u32[0] &= beswap32(~0u << (32 - p->bitlen));
+        } else {
+            words[0] = beswap32(0x20000000u | (r >> 4));
+            words[1] = beswap32(r * 2654435761u);
+            makenaddr(p, AF_INET6, words, (i < NUM_TABLE_PREFIXES) ? 32 + (r & 0x1f) : 128);
+            if (i < NUM_TABLE_PREFIXES && p->bitlen < 64)
+                p->u32[1] &= beswap32((uint32_t) (~0ull << (64 - p->bitlen)));
+        }
+
+        if (i < NUM_TABLE_PREFIXES)
+            patinsert(trie, p, NULL);
+    }
+}
+
+// remove and reinsert half of the prefixes in random order, scattering nodes across pages
+static void churntable(patricia_trie_t *trie)
+{
+    netaddr_t *prefixes = malloc(trie->nprefs * sizeof(*prefixes));
+    if (!prefixes)
+        return;
+
+    uint n = 0;
+    patiterator_t it;
+    for (patiteratorinit(&it, trie); !patiteratorend(&it); patiteratornext(&it))
+        prefixes[n++] = patiteratorget(&it)->prefix;
+
+    uint32_t seed = 0x9e3779b9u;
+    for (uint i = n - 1; i > 0; i--) {
+        seed = seed * 1103515245u + 12345u;
+
+        uint j = (seed ^ (seed >> 15)) % (i + 1);
+        netaddr_t t = prefixes[i];
+        prefixes[i] = prefixes[j];
+        prefixes[j] = t;
+    }
+
+    for (uint i = 0; i < n / 2; i++)
+        patremove(trie, &prefixes[i]);
+    for (uint i = n / 2; i-- > 0; )
+        patinsert(trie, &prefixes[i], NULL);
+
+    free(prefixes);
+}
+
+enum {
+    SEARCH_PLAIN,
+    SEARCH_PACKED,
+    SEARCH_CHURNED,
+    SEARCH_COMPACTED
+};
+
+static void searchbest(cbench_state_t *state, sa_family_t family, int mode, const char *name)
+{
+    patricia_trie_t trie;
+    netaddr_t *queries = malloc(NUM_QUERIES * sizeof(*queries));
+    if (!queries)
+        return;
+
+    filltable(&trie, queries, family);
+    if (mode == SEARCH_CHURNED || mode == SEARCH_COMPACTED)
+        churntable(&trie);
+    if (mode == SEARCH_COMPACTED)
+        patcompact(&trie, 0);
+    if (mode == SEARCH_PACKED)
+        patpack(&trie);
+
+    size_t inuse, reserved;
+    patmemusage(&trie, &inuse, &reserved);
+    fprintf(stderr, "patricia: %-20s %u prefixes, %zu bytes of nodes, %zu bytes reserved\n",
+                    name, trie.nprefs, inuse, reserved);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    ullong nlookups = 0;
+    while (cbench_next_iteration(state)) {
+        patsearchbest(&trie, &queries[state->curiter & (NUM_QUERIES - 1)]);
+        nlookups++;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+    if (secs > 0.0)
+        fprintf(stderr, "patricia: %-20s %14.0f lookups/s\n", name, nlookups / secs);
+
+    patdestroy(&trie);
+    free(queries);
+}
+
+void bpatsearchbest(cbench_state_t *state)
+{
+    searchbest(state, AF_INET, SEARCH_PLAIN, "searchbest");
+}
+
+void bpatsearchbestpacked(cbench_state_t *state)
+{
+    searchbest(state, AF_INET, SEARCH_PACKED, "searchbest packed");
+}
+
+void bpatsearchbest6(cbench_state_t *state)
+{
+    searchbest(state, AF_INET6, SEARCH_PLAIN, "searchbest6");
+}
+
+void bpatsearchbest6packed(cbench_state_t *state)
+{
+    searchbest(state, AF_INET6, SEARCH_PACKED, "searchbest6 packed");
+}
+
+void bpatsearchbestchurned(cbench_state_t *state)
+{
+    searchbest(state, AF_INET, SEARCH_CHURNED, "searchbest churned");
+}
+
+void bpatsearchbestcompacted(cbench_state_t *state)
+{
+    searchbest(state, AF_INET, SEARCH_COMPACTED, "searchbest compacted");
+}
@@ -0,0 +1,47 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#ifndef UBGP_MRT_BENCH_H_
+#define UBGP_MRT_BENCH_H_
+
+#include <cbench/cbench.h>
+
+// corpus setup, environment variables MRTBENCH_* override the default parameters
+int  mrtbenchsetup(void);
+void mrtbenchteardown(void);
+
+// TABLE_DUMPV2 stages
+void bmrttdwrite(cbench_state_t *state);
+void bmrttdread(cbench_state_t *state);
+void bmrttdribbatch(cbench_state_t *state);
+void bmrttdrebuild(cbench_state_t *state);
+void bmrttdfilter(cbench_state_t *state);
+void bmrttdfilterbatch(cbench_state_t *state);
+void bmrttdprint(cbench_state_t *state);
+
+// BGP4MP stages
+void bmrtbgp4mpwrite(cbench_state_t *state);
+void bmrtbgp4mpread(cbench_state_t *state);
+void bmrtbgp4mpfilter(cbench_state_t *state);
+void bmrtbgp4mpprint(cbench_state_t *state);
+
+#endif
+
@@ -0,0 +1,73 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#include <locale.h>
+#include <stdlib.h>
+
+#include "bench.h"
+
+int main(void)
+{
+    setlocale(LC_ALL, "");
+
+    if (mrtbenchsetup() != 0)
+        return EXIT_FAILURE;
+
+    if (cbench_initialize() != CB_SUCCESS) {
+        mrtbenchteardown();
+        return EXIT_FAILURE;
+    }
+
+    cbench_suite_t *suite = cbench_add_suite("mrt");
+    if (!suite)
+        goto out;
+
+    if (!cbench_add_bench(suite, "tablemrtwrite", bmrttdwrite, NULL))
+        goto out;
+    if (!cbench_add_bench(suite, "tablemrtread", bmrttdread, NULL))
+        goto out;
+    if (!cbench_add_bench(suite, "tablemrtribbatch", bmrttdribbatch, NULL))
+        goto out;
+    if (!cbench_add_bench(suite, "tablemrtrebuild", bmrttdrebuild, NULL))
+        goto out;
+    if (!cbench_add_bench(suite, "tablemrtfilter", bmrttdfilter, NULL))
+        goto out;
+    if (!cbench_add_bench(suite, "tablemrtbatch", bmrttdfilterbatch, NULL))
+        goto out;
+    if (!cbench_add_bench(suite, "tablemrtprint", bmrttdprint, NULL))
+        goto out;
+    if (!cbench_add_bench(suite, "bgp4mpwrite", bmrtbgp4mpwrite, NULL))
+        goto out;
+    if (!cbench_add_bench(suite, "bgp4mpread", bmrtbgp4mpread, NULL))
+        goto out;
+    if (!cbench_add_bench(suite, "bgp4mpfilter", bmrtbgp4mpfilter, NULL))
+        goto out;
+    if (!cbench_add_bench(suite, "bgp4mpprint", bmrtbgp4mpprint, NULL))
+        goto out;
+
+    cbench_run();
+
+out:
+    cbench_cleanup();
+    mrtbenchteardown();
+    return cbench_get_error();
+}
+
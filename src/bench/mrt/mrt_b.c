@@ -0,0 +1,556 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#include "../../ubgp/bgp.h"
+#include "../../ubgp/dumppacket.h"
+#include "../../ubgp/filterintrin.h"
+#include "../../ubgp/filterpacket.h"
+#include "../../ubgp/mrt.h"
+#include "../../ubgp/patriciatrie.h"
+#include "bench.h"
+#include "mrtgen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+enum {
+    MRT_HDRSIZ = 12
+};
+
+typedef struct {
+    byte  *data;
+    size_t size;
+    ullong records;
+} corpus_t;
+
+typedef enum {
+    STAGE_READ,     // MRT framing and RIB entries (or BGP4MP unwrapping)
+    STAGE_REBUILD,  // + BGP message rebuild from RIB entries
+    STAGE_FILTER,   // + filter VM
+    STAGE_PRINT     // + bgpgrep-like output formatting
+} stage_t;
+
+// an mrtprocess-like reader cycling over an in-memory corpus
+typedef struct {
+    const corpus_t *corpus;
+    io_rw_t         io;
+    bool            seen_pi;
+    umrt_msg_s      pi;
+    ullong          bytes;
+    ullong          records;
+    struct timespec start;
+} reader_t;
+
+static mrtgen_params_t params = MRTGEN_DEFAULT_PARAMS;
+
+static corpus_t tabledump, bgp4mp;
+
+static filter_vm_t vm;
+static FILE       *devnull;
+
+static umrt_msg_s curmrt;
+static ubgp_msg_s curbgp;
+
+static ubgp_msg_s batchbgp[FILTER_BATCH_LANES];
+static uint       nbatch;
+
+static rib_batch_t ribbatch;
+
+static void envparam(const char *name, uint *dst)
+{
+    const char *val = getenv(name);
+    if (val && *val != '\0')
+        *dst = strtoul(val, NULL, 0);
+}
+
+static size_t countwrite(io_rw_t *io, const void *src, size_t n)
+{
+    USED(io);
+    USED(src);
+
+    return n;
+}
+
+static int gencorpus(corpus_t *corpus, int (*gen)(io_rw_t *, const mrtgen_params_t *, mrtgen_stats_t *))
+{
+    FILE *f = tmpfile();
+    if (!f)
+        return -1;
+
+    io_rw_t io;
+    io_file_init(&io, f);
+
+    mrtgen_stats_t stats;
+
+    int res = -1;
+    if (gen(&io, &params, &stats) != 0 || fflush(f) != 0)
+        goto out;
+
+    corpus->size    = stats.bytes;
+    corpus->records = stats.records;
+    corpus->data    = malloc(corpus->size);
+    if (!corpus->data)
+        goto out;
+
+    rewind(f);
+    if (fread(corpus->data, 1, corpus->size, f) != corpus->size)
+        goto out;
+
+    res = 0;
+
+out:
+    fclose(f);
+    return res;
+}
+
+static int setupfilter(void)
+{
+    static const char *const pfxs[] = {
+        "8.0.0.0/6", "64.0.0.0/3", "193.0.0.0/8", "2001::/16", "2a00::/12"
+    };
+
+    filter_init(&vm);
+
+    int trie  = vm_newtrie(&vm.prog, AF_INET);
+    int trie6 = vm_newtrie(&vm.prog, AF_INET6);
+    if (trie < 0 || trie6 < 0)
+        return -1;
+
+    for (uint i = 0; i < countof(pfxs); i++) {
+        netaddr_t addr;
+        if (stonaddr(&addr, pfxs[i]) != 0)
+            return -1;
+
+        patricia_trie_t *pt = &vm.prog.tries[(addr.family == AF_INET6) ? trie6 : trie];
+        if (!patinsert(pt, &addr, NULL))
+            return -1;
+    }
+
+    // equivalent to: bgpgrep -t COMMUNITY -e ... -e ...
+    vm_emit(&vm.prog, FOPC_BLK);
+    vm_emit(&vm.prog, vm_makeop(FOPC_HASATTR, COMMUNITY_CODE));
+    vm_emit(&vm.prog, FOPC_ENDBLK);
+    vm_emit(&vm.prog, FOPC_NOT);
+    vm_emit(&vm.prog, FOPC_CFAIL);
+
+    vm_emit(&vm.prog, vm_makeop(FOPC_SETTRIE,  trie));
+    vm_emit(&vm.prog, vm_makeop(FOPC_SETTRIE6, trie6));
+    vm_emit(&vm.prog, FOPC_BLK);
+    vm_emit(&vm.prog, vm_makeop(FOPC_SUBNET, FOPC_ACCESS_SETTLE | FOPC_ACCESS_ALL | FOPC_ACCESS_NLRI));
+    vm_emit(&vm.prog, FOPC_CPASS);
+    vm_emit(&vm.prog, vm_makeop(FOPC_SUBNET, FOPC_ACCESS_SETTLE | FOPC_ACCESS_ALL | FOPC_ACCESS_WITHDRAWN));
+    vm_emit(&vm.prog, FOPC_ENDBLK);
+    vm_emit(&vm.prog, FOPC_NOT);
+    vm_emit(&vm.prog, FOPC_CFAIL);
+
+    vm_emit(&vm.prog, vm_makeop(FOPC_LOAD, true));
+    return 0;
+}
+
+int mrtbenchsetup(void)
+{
+    envparam("MRTBENCH_SEED",     &params.seed);
+    envparam("MRTBENCH_PEERS",    &params.npeers);
+    envparam("MRTBENCH_PREFIXES", &params.nprefixes);
+    envparam("MRTBENCH_V6",       &params.v6percent);
+    envparam("MRTBENCH_ASPATH",   &params.aspathmax);
+    envparam("MRTBENCH_COMMS",    &params.commdensity);
+    envparam("MRTBENCH_UPDATES",  &params.nupdates);
+
+    uint addpath = params.addpath;
+    envparam("MRTBENCH_ADDPATH", &addpath);
+    params.addpath = (addpath != 0);
+
+    if (params.aspathmin > params.aspathmax)
+        params.aspathmin = params.aspathmax;
+
+    devnull = fopen("/dev/null", "w");
+    if (!devnull)
+        return -1;
+
+    if (gencorpus(&tabledump, mrtgentabledump) != 0)
+        return -1;
+    if (gencorpus(&bgp4mp, mrtgenbgp4mp) != 0)
+        return -1;
+
+    fprintf(stderr, "mrt: TABLE_DUMPV2 corpus: %llu records, %zu bytes\n", tabledump.records, tabledump.size);
+    fprintf(stderr, "mrt: BGP4MP corpus: %llu records, %zu bytes\n", bgp4mp.records, bgp4mp.size);
+
+    return setupfilter();
+}
+
+void mrtbenchteardown(void)
+{
+    filter_destroy(&vm);
+    ribbatchclose(&ribbatch);
+
+    free(tabledump.data);
+    free(bgp4mp.data);
+    if (devnull)
+        fclose(devnull);
+}
+
+static void report(const char *name, ullong records, ullong bytes, const struct timespec *start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double secs = (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) * 1e-9;
+    if (secs <= 0.0)
+        return;
+
+    fprintf(stderr, "mrt: %-16s %14.0f records/s %10.2f MB/s\n",
+                    name,
+                    records / secs,
+                    bytes / secs / (1024.0 * 1024.0));
+}
+
+static void readerinit(reader_t *rd, const corpus_t *corpus)
+{
+    memset(rd, 0, sizeof(*rd));
+    rd->corpus = corpus;
+    io_mem_rdinit(&rd->io, corpus->data, corpus->size);
+    clock_gettime(CLOCK_MONOTONIC, &rd->start);
+}
+
+static void readerfinish(reader_t *rd, const char *name)
+{
+    report(name, rd->records, rd->bytes, &rd->start);
+    if (rd->seen_pi)
+        mrtclose(&rd->pi);
+}
+
+// read next record, rewind at end of corpus
+static mrt_header_t *readnext(reader_t *rd)
+{
+    if (setmrtreadfrom(&curmrt, &rd->io) != MRT_ENOERR) {
+        io_mem_rdinit(&rd->io, rd->corpus->data, rd->corpus->size);
+        if (setmrtreadfrom(&curmrt, &rd->io) != MRT_ENOERR)
+            abort();  // corpus is corrupted
+    }
+
+    mrt_header_t *hdr = getmrtheader(&curmrt);
+    rd->records++;
+    rd->bytes += MRT_HDRSIZ + hdr->len;
+    return hdr;
+}
+
+static void tabledumpstage(cbench_state_t *state, stage_t stage, const char *name)
+{
+    reader_t rd;
+
+    readerinit(&rd, &tabledump);
+    while (cbench_next_iteration(state)) {
+        mrt_header_t *hdr = readnext(&rd);
+        if (hdr->subtype == MRT_TABLE_DUMPV2_PEER_INDEX_TABLE) {
+            if (rd.seen_pi)
+                mrtclose(&rd.pi);
+
+            mrtcopy(&rd.pi, &curmrt);
+            rd.seen_pi = true;
+            mrtclose(&curmrt);
+            continue;
+        }
+
+        uint ribflags = BGPF_GUESSMRT | BGPF_STRIPUNREACH;
+        if (hdr->subtype == MRT_TABLE_DUMPV2_RIB_IPV4_UNICAST_ADDPATH ||
+            hdr->subtype == MRT_TABLE_DUMPV2_RIB_IPV6_UNICAST_ADDPATH)
+            ribflags |= BGPF_ADDPATH;
+
+        setribpi(&curmrt, &rd.pi);
+
+        const rib_entry_t *rib;
+
+        startribents(&curmrt, NULL);
+        while ((rib = nextribent(&curmrt)) != NULL) {
+            if (stage == STAGE_READ)
+                continue;
+
+            uint flags = ribflags;
+            if (rib->peer->as_size == sizeof(uint32_t))
+                flags |= BGPF_ASN32BIT;
+
+            netaddrap_t addrap;
+            addrap.pfx    = rib->nlri;
+            addrap.pathid = rib->pathid;
+
+            const void *nlri = (flags & BGPF_ADDPATH) ? (const void *) &addrap : (const void *) &rib->nlri;
+            if (rebuildbgpfrommrt(&curbgp, nlri, rib->attrs, rib->attr_length, flags) != BGP_ENOERR)
+                abort();  // corpus is corrupted
+
+            int res = true;
+            if (stage >= STAGE_FILTER)
+                res = bgp_filter(&curbgp, &vm);
+            if (stage >= STAGE_PRINT && res > 0)
+                printbgp(devnull, &curbgp, "#rF*t", &rib->peer->addr, rib->peer->as, &rib->originated);
+
+            bgpclose(&curbgp);
+        }
+
+        endribents(&curmrt);
+        mrtclose(&curmrt);
+    }
+
+    readerfinish(&rd, name);
+}
+
+static void flushbatch(void)
+{
+    ubgp_msg_s *msgs[FILTER_BATCH_LANES];
+    uint64_t results[1];
+
+    for (uint i = 0; i < nbatch; i++)
+        msgs[i] = &batchbgp[i];
+
+    bgp_filter_batch(msgs, nbatch, &vm.prog, &vm.ctx, results);
+    for (uint i = 0; i < nbatch; i++)
+        bgpclose(&batchbgp[i]);
+
+    nbatch = 0;
+}
+
+// same as STAGE_FILTER, but entries sharing a prefix are filtered in batch
+static void tabledumpbatchstage(cbench_state_t *state, const char *name)
+{
+    reader_t rd;
+
+    readerinit(&rd, &tabledump);
+    while (cbench_next_iteration(state)) {
+        mrt_header_t *hdr = readnext(&rd);
+        if (hdr->subtype == MRT_TABLE_DUMPV2_PEER_INDEX_TABLE) {
+            if (rd.seen_pi)
+                mrtclose(&rd.pi);
+
+            mrtcopy(&rd.pi, &curmrt);
+            rd.seen_pi = true;
+            mrtclose(&curmrt);
+            continue;
+        }
+
+        uint ribflags = BGPF_GUESSMRT | BGPF_STRIPUNREACH;
+        if (hdr->subtype == MRT_TABLE_DUMPV2_RIB_IPV4_UNICAST_ADDPATH ||
+            hdr->subtype == MRT_TABLE_DUMPV2_RIB_IPV6_UNICAST_ADDPATH)
+            ribflags |= BGPF_ADDPATH;
+
+        setribpi(&curmrt, &rd.pi);
+
+        const rib_entry_t *rib;
+
+        startribents(&curmrt, NULL);
+        while ((rib = nextribent(&curmrt)) != NULL) {
+            uint flags = ribflags;
+            if (rib->peer->as_size == sizeof(uint32_t))
+                flags |= BGPF_ASN32BIT;
+
+            netaddrap_t addrap;
+            addrap.pfx    = rib->nlri;
+            addrap.pathid = rib->pathid;
+
+            const void *nlri = (flags & BGPF_ADDPATH) ? (const void *) &addrap : (const void *) &rib->nlri;
+            if (rebuildbgpfrommrt(&batchbgp[nbatch++], nlri, rib->attrs, rib->attr_length, flags) != BGP_ENOERR)
+                abort();  // corpus is corrupted
+
+            if (nbatch == FILTER_BATCH_LANES)
+                flushbatch();
+        }
+
+        endribents(&curmrt);
+        mrtclose(&curmrt);
+        flushbatch();
+    }
+
+    readerfinish(&rd, name);
+}
+
+// same as STAGE_READ, but RIB entries are decoded with getribbatch()
+static void tabledumpribbatchstage(cbench_state_t *state, const char *name)
+{
+    reader_t rd;
+
+    readerinit(&rd, &tabledump);
+    while (cbench_next_iteration(state)) {
+        mrt_header_t *hdr = readnext(&rd);
+        if (hdr->subtype == MRT_TABLE_DUMPV2_PEER_INDEX_TABLE) {
+            if (rd.seen_pi)
+                mrtclose(&rd.pi);
+
+            mrtcopy(&rd.pi, &curmrt);
+            rd.seen_pi = true;
+            mrtclose(&curmrt);
+            continue;
+        }
+
+        setribpi(&curmrt, &rd.pi);
+        if (getribbatch(&curmrt, &ribbatch) != MRT_ENOERR)
+            abort();  // corpus is corrupted
+
+        // touch every column, as a consumer would
+        uint32_t sum = 0;
+        for (size_t i = 0; i < ribbatch.count; i++)
+            sum += ribbatch.peer_idx[i] + ribbatch.originated[i] + ribbatch.pathid[i] + ribbatch.attr_len[i];
+
+        if (ribbatch.count > 0 && sum == 0)
+            abort();  // corpus is corrupted
+
+        mrtclose(&curmrt);
+    }
+
+    readerfinish(&rd, name);
+}
+
+static void bgp4mpstage(cbench_state_t *state, stage_t stage, const char *name)
+{
+    reader_t rd;
+
+    readerinit(&rd, &bgp4mp);
+    while (cbench_next_iteration(state)) {
+        mrt_header_t *hdr = readnext(&rd);
+
+        uint flags = BGPF_NOCOPY | BGPF_ASN32BIT;
+        if (hdr->subtype == BGP4MP_MESSAGE_AS4_ADDPATH)
+            flags |= BGPF_ADDPATH;
+
+        const bgp4mp_header_t *bgphdr = getbgp4mpheader(&curmrt);
+
+        size_t n;
+        void *data = unwrapbgp4mp(&curmrt, &n);
+        if (!bgphdr || !data || setbgpread(&curbgp, data, n, flags) != BGP_ENOERR)
+            abort();  // corpus is corrupted
+
+        if (stage == STAGE_READ) {
+            // walk the message to make the reading stage meaningful
+            uint count = 0;
+
+            startallnlri(&curbgp);
+            while (nextnlri(&curbgp))
+                count++;
+
+            endnlri(&curbgp);
+            startallwithdrawn(&curbgp);
+            while (nextwithdrawn(&curbgp))
+                count++;
+
+            endwithdrawn(&curbgp);
+            startbgpattribs(&curbgp);
+            while (nextbgpattrib(&curbgp))
+                count++;
+
+            endbgpattribs(&curbgp);
+            if (count == 0)
+                abort();  // corpus is corrupted
+        }
+
+        int res = true;
+        if (stage >= STAGE_FILTER)
+            res = bgp_filter(&curbgp, &vm);
+        if (stage >= STAGE_PRINT && res > 0)
+            printbgp(devnull, &curbgp, "rF*T", &bgphdr->peer_addr, bgphdr->peer_as, &hdr->stamp);
+
+        bgpclose(&curbgp);
+        mrtclose(&curmrt);
+    }
+
+    readerfinish(&rd, name);
+}
+
+static void writestage(cbench_state_t *state, int (*gen)(io_rw_t *, const mrtgen_params_t *, mrtgen_stats_t *), const char *name)
+{
+    io_rw_t io = { .write = countwrite };
+
+    // generate small corpora, so each iteration has a bounded cost
+    mrtgen_params_t p = params;
+    p.nprefixes = 64;
+    p.nupdates  = 64;
+
+    ullong records = 0, bytes = 0;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (cbench_next_iteration(state)) {
+        mrtgen_stats_t stats;
+
+        p.seed = params.seed + state->curiter;
+        if (gen(&io, &p, &stats) != 0)
+            abort();
+
+        records += stats.records;
+        bytes   += stats.bytes;
+    }
+
+    report(name, records, bytes, &start);
+}
+
+void bmrttdwrite(cbench_state_t *state)
+{
+    writestage(state, mrtgentabledump, "tablemrtwrite");
+}
+
+void bmrttdread(cbench_state_t *state)
+{
+    tabledumpstage(state, STAGE_READ, "tablemrtread");
+}
+
+void bmrttdribbatch(cbench_state_t *state)
+{
+    tabledumpribbatchstage(state, "tablemrtribbatch");
+}
+
+void bmrttdrebuild(cbench_state_t *state)
+{
+    tabledumpstage(state, STAGE_REBUILD, "tablemrtrebuild");
+}
+
+void bmrttdfilter(cbench_state_t *state)
+{
+    tabledumpstage(state, STAGE_FILTER, "tablemrtfilter");
+}
+
+void bmrttdfilterbatch(cbench_state_t *state)
+{
+    tabledumpbatchstage(state, "tablemrtbatch");
+}
+
+void bmrttdprint(cbench_state_t *state)
+{
+    tabledumpstage(state, STAGE_PRINT, "tablemrtprint");
+}
+
+void bmrtbgp4mpwrite(cbench_state_t *state)
+{
+    writestage(state, mrtgenbgp4mp, "bgp4mpwrite");
+}
+
+void bmrtbgp4mpread(cbench_state_t *state)
+{
+    bgp4mpstage(state, STAGE_READ, "bgp4mpread");
+}
+
+void bmrtbgp4mpfilter(cbench_state_t *state)
+{
+    bgp4mpstage(state, STAGE_FILTER, "bgp4mpfilter");
+}
+
+void bmrtbgp4mpprint(cbench_state_t *state)
+{
+    bgp4mpstage(state, STAGE_PRINT, "bgp4mpprint");
+}
+
@@ -0,0 +1,657 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#include "../../ubgp/bgp.h"
+#include "../../ubgp/bgpattribs.h"
+#include "../../ubgp/endian.h"
+#include "../../ubgp/mrt.h"
+#include "mrtgen.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    BASE_STAMP = 1546300800,  // 2019-01-01T00:00:00Z
+
+    ATTRBUFSIZ = ATTR_EXTENDED_HEADER_SIZE + ATTR_EXTENDED_LENGTH_MAX,
+    RIBATTRSIZ = UINT16_MAX   // attributes of a RIB entry
+};
+
+// well known transit ASes, used to populate the middle of AS paths
+static const uint32_t transit_ases[] = {
+    174, 209, 701, 1273, 1299, 2914, 3257, 3356, 3491, 4637,
+    5511, 6453, 6461, 6762, 6939, 7018, 9002, 12956, 20485, 37100
+};
+
+typedef struct {
+    netaddr_t pfx;
+    uint32_t  origin;
+} genprefix_t;
+
+typedef struct {
+    io_rw_t out;  // counts the writer output and forwards it to io, must be first
+    io_rw_t *io;
+    mrt_writer_t w;
+
+    const mrtgen_params_t *params;
+
+    uint32_t rng;
+
+    peer_entry_t *peers;
+    genprefix_t  *pool[2];  // 0 = IPv4, 1 = IPv6
+    uint          npool[2];
+
+    ubgp_msg_s *bgp;  // if not NULL, attributes are written here, otherwise to ribattrs
+
+    size_t ribattrslen;
+    bool   ribattrsover;  // attributes don't fit a RIB entry
+
+    mrtgen_stats_t stats;
+
+    byte attrbuf[ATTRBUFSIZ];
+    byte ribattrs[RIBATTRSIZ];
+} mrtgen_t;
+
+static uint32_t nextrand(mrtgen_t *g)
+{
+    // xorshift32
+    uint32_t x = g->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    g->rng = x;
+    return x;
+}
+
+static uint randrange(mrtgen_t *g, uint lo, uint hi)
+{
+    return lo + nextrand(g) % (hi - lo + 1);
+}
+
+static bool chance(mrtgen_t *g, uint percent)
+{
+    return nextrand(g) % 100 < percent;
+}
+
+static void maskprefix(netaddr_t *pfx)
+{
+    for (uint i = 0; i < sizeof(pfx->bytes); i++) {
+        uint bit = i * 8;
+        if (bit >= pfx->bitlen)
+            pfx->bytes[i] = 0;
+        else if (bit + 8 > pfx->bitlen)
+            pfx->bytes[i] &= 0xff << (8 - (pfx->bitlen - bit));
+    }
+}
+
+static void genprefix4(mrtgen_t *g, netaddr_t *pfx)
+{
+    // roughly mimic the prefix length distribution of a full IPv4 table
+    uint r = nextrand(g) % 100;
+
+    uint bitlen;
+    if (r < 55)
+        bitlen = 24;
+    else if (r < 65)
+        bitlen = 23;
+    else if (r < 75)
+        bitlen = 22;
+    else if (r < 85)
+        bitlen = randrange(g, 19, 21);
+    else if (r < 97)
+        bitlen = randrange(g, 16, 18);
+    else
+        bitlen = randrange(g, 8, 15);
+
+    uint32_t u = nextrand(g);
+    pfx->family = AF_INET;
+    pfx->bitlen = bitlen;
+    memset(pfx->bytes, 0, sizeof(pfx->bytes));
+    memcpy(pfx->bytes, &u, sizeof(u));
+    pfx->bytes[0] = randrange(g, 1, 223);
+    if (pfx->bytes[0] == 10 || pfx->bytes[0] == 127)
+        pfx->bytes[0]++;
+
+    maskprefix(pfx);
+}
+
+static void genprefix6(mrtgen_t *g, netaddr_t *pfx)
+{
+    uint r = nextrand(g) % 100;
+
+    uint bitlen;
+    if (r < 50)
+        bitlen = 48;
+    else if (r < 65)
+        bitlen = 32;
+    else if (r < 85)
+        bitlen = randrange(g, 40, 47);
+    else
+        bitlen = randrange(g, 29, 64);
+
+    pfx->family = AF_INET6;
+    pfx->bitlen = bitlen;
+    for (uint i = 0; i < countof(pfx->u32); i++)
+        pfx->u32[i] = nextrand(g);
+
+    pfx->bytes[0] = 0x20 | (pfx->bytes[0] & 0x1f);  // 2000::/3
+    maskprefix(pfx);
+}
+
+static uint32_t genas(mrtgen_t *g)
+{
+    if (chance(g, 25))
+        return randrange(g, 131072, 401308);  // 32-bit only ASN
+
+    return randrange(g, 1, 64495);
+}
+
+static bool genpools(mrtgen_t *g)
+{
+    const mrtgen_params_t *p = g->params;
+
+    g->npool[1] = (ullong) p->nprefixes * p->v6percent / 100;
+    g->npool[0] = p->nprefixes - g->npool[1];
+
+    g->peers   = malloc(MAX(p->npeers, 1u) * sizeof(*g->peers));
+    g->pool[0] = malloc(MAX(g->npool[0], 1u) * sizeof(*g->pool[0]));
+    g->pool[1] = malloc(MAX(g->npool[1], 1u) * sizeof(*g->pool[1]));
+    if (unlikely(!g->peers || !g->pool[0] || !g->pool[1]))
+        return false;
+
+    for (uint i = 0; i < p->npeers; i++) {
+        peer_entry_t *peer = &g->peers[i];
+
+        peer->as_size   = sizeof(uint32_t);
+        peer->as        = genas(g);
+        peer->id.s_addr = beswap32(0xc0a80000 | i);
+        memset(&peer->addr, 0, sizeof(peer->addr));
+        if (i % 4 == 3) {
+            // one peer out of 4 is an IPv6 session
+            peer->addr.family = AF_INET6;
+            peer->addr.bitlen = 128;
+            peer->addr.u16[0] = BIG16_C(0x2001);
+            peer->addr.u16[1] = BIG16_C(0x0db8);
+            peer->addr.u32[3] = beswap32(i + 1);
+        } else {
+            peer->addr.family = AF_INET;
+            peer->addr.bitlen = 32;
+            peer->addr.u32[0] = beswap32(0x0a000000 | (i + 1));
+        }
+    }
+    for (uint i = 0; i < g->npool[0]; i++) {
+        genprefix4(g, &g->pool[0][i].pfx);
+        g->pool[0][i].origin = genas(g);
+    }
+    for (uint i = 0; i < g->npool[1]; i++) {
+        genprefix6(g, &g->pool[1][i].pfx);
+        g->pool[1][i].origin = genas(g);
+    }
+    return true;
+}
+
+static size_t outwrite(io_rw_t *out, const void *buf, size_t n)
+{
+    mrtgen_t *g = (mrtgen_t *) out;
+
+    n = g->io->write(g->io, buf, n);
+    g->stats.bytes += n;
+    return n;
+}
+
+static bool mrtgeninit(mrtgen_t *g, io_rw_t *io, const mrtgen_params_t *params)
+{
+    memset(g, 0, sizeof(*g));
+
+    g->out.write = outwrite;
+    g->io        = io;
+    mrtwriterinit(&g->w, NULL, 0, &g->out);
+
+    g->params = params;
+    g->rng    = params->seed ? params->seed : 1;
+
+    return genpools(g);
+}
+
+static umrt_err mrtgendestroy(mrtgen_t *g, mrtgen_stats_t *stats)
+{
+    umrt_err err = mrtwriterclose(&g->w);
+    if (stats)
+        *stats = g->stats;
+
+    free(g->peers);
+    free(g->pool[0]);
+    free(g->pool[1]);
+    return err;
+}
+
+// attribute generation
+
+static bgpattr_t *startattr(mrtgen_t *g, int flags, int code)
+{
+    bgpattr_t *attr = (bgpattr_t *) g->attrbuf;
+
+    attr->flags = flags;
+    attr->code  = code;
+    attr->len   = 0;
+    if (flags & ATTR_EXTENDED_LENGTH)
+        attr->exlen[1] = 0;
+
+    return attr;
+}
+
+static void emitattr(mrtgen_t *g, const bgpattr_t *attr)
+{
+    if (g->bgp) {
+        putbgpattrib(g->bgp, attr);
+        return;
+    }
+
+    size_t len;
+    const byte *data = getattrlen(attr, &len);
+    len += data - (const byte *) attr;
+    if (unlikely(g->ribattrslen + len > sizeof(g->ribattrs))) {
+        g->ribattrsover = true;
+        return;
+    }
+
+    memcpy(&g->ribattrs[g->ribattrslen], attr, len);
+    g->ribattrslen += len;
+}
+
+static uint genaspath(mrtgen_t *g, uint32_t *path, const peer_entry_t *peer, uint32_t origin)
+{
+    const mrtgen_params_t *p = g->params;
+
+    // triangular distribution between aspathmin and aspathmax
+    uint span = p->aspathmax - p->aspathmin;
+    uint len  = p->aspathmin + (randrange(g, 0, span) + randrange(g, 0, span)) / 2;
+    if (len == 0)
+        len = 1;
+
+    uint n = 0;
+    path[n++] = peer->as;
+    while (n + 1 < len) {
+        if (chance(g, 70))
+            path[n++] = transit_ases[nextrand(g) % countof(transit_ases)];
+        else
+            path[n++] = genas(g);
+    }
+    if (len > 1)
+        path[n++] = origin;
+    if (chance(g, p->prependpercent)) {
+        uint prepend = randrange(g, 1, 3);
+        while (prepend-- > 0) {
+            path[n] = path[n - 1];
+            n++;
+        }
+    }
+    return n;
+}
+
+static void mpnexthop(struct in6_addr *nh, const peer_entry_t *peer)
+{
+    if (peer->addr.family == AF_INET6) {
+        *nh = peer->addr.sin6;
+        return;
+    }
+
+    // IPv4-mapped address for IPv4 sessions
+    memset(nh, 0, sizeof(*nh));
+    nh->s6_addr[10] = nh->s6_addr[11] = 0xff;
+    memcpy(&nh->s6_addr[12], &peer->addr.sin, sizeof(peer->addr.sin));
+}
+
+static void genattrs(mrtgen_t *g, const peer_entry_t *peer, const genprefix_t *gp, bool abbrevmpreach)
+{
+    const mrtgen_params_t *p = g->params;
+
+    bgpattr_t *attr;
+
+    uint r = nextrand(g) % 100;
+    attr = startattr(g, DEFAULT_ORIGIN_FLAGS, ORIGIN_CODE);
+    attr->len = ORIGIN_LENGTH;
+    setorigin(attr, (r < 80) ? ORIGIN_IGP : (r < 95) ? ORIGIN_INCOMPLETE : ORIGIN_EGP);
+    emitattr(g, attr);
+
+    uint32_t path[p->aspathmax + 4];
+    uint n = genaspath(g, path, peer, gp->origin);
+
+    int flags = DEFAULT_AS_PATH_FLAGS;
+    if (AS_SEGMENT_HEADER_SIZE + n * sizeof(*path) > ATTR_LENGTH_MAX)
+        flags = EXTENDED_AS_PATH_FLAGS;
+
+    attr = startattr(g, flags, AS_PATH_CODE);
+    for (uint i = 0; i < n; i += AS_SEGMENT_COUNT_MAX)
+        putasseg32(attr, AS_SEGMENT_SEQ, &path[i], MIN(n - i, (uint) AS_SEGMENT_COUNT_MAX));
+
+    emitattr(g, attr);
+
+    if (gp->pfx.family == AF_INET) {
+        struct in_addr nh = peer->addr.sin;
+        if (peer->addr.family != AF_INET)
+            nh.s_addr = beswap32(0x0a000000 | (peer->id.s_addr & 0xffff));
+
+        attr = startattr(g, DEFAULT_NEXT_HOP_FLAGS, NEXT_HOP_CODE);
+        attr->len = NEXT_HOP_LENGTH;
+        setnexthop(attr, nh);
+        emitattr(g, attr);
+    } else if (abbrevmpreach) {
+        // RFC 6396 TABLE_DUMPV2 abbreviated MP_REACH_NLRI: next hop only
+        struct in6_addr nh;
+        mpnexthop(&nh, peer);
+
+        attr = startattr(g, DEFAULT_MP_REACH_NLRI_FLAGS, MP_REACH_NLRI_CODE);
+        attr->len     = 1 + sizeof(nh);
+        attr->data[0] = sizeof(nh);
+        memcpy(&attr->data[1], &nh, sizeof(nh));
+        emitattr(g, attr);
+    }
+
+    if (chance(g, 30)) {
+        attr = startattr(g, ATTR_OPTIONAL, MULTI_EXIT_DISC_CODE);
+        attr->len = MULTI_EXIT_DISC_LENGTH;
+        setmultiexitdisc(attr, randrange(g, 0, 1000));
+        emitattr(g, attr);
+    }
+
+    uint ncomms = (p->commdensity > 0) ? randrange(g, 0, 2 * p->commdensity) : 0;
+    if (ncomms > 0) {
+        flags = DEFAULT_COMMUNITY_FLAGS;
+        if (ncomms * sizeof(community_t) > ATTR_LENGTH_MAX)
+            flags = EXTENDED_COMMUNITY_FLAGS;
+
+        attr = startattr(g, flags, COMMUNITY_CODE);
+        for (uint i = 0; i < ncomms; i++) {
+            uint32_t as = (i == 0) ? peer->as : transit_ases[nextrand(g) % countof(transit_ases)];
+            if (as > UINT16_MAX)
+                as = AS_TRANS;
+
+            putcommunities(attr, (as << 16) | randrange(g, 1, 3999));
+        }
+
+        emitattr(g, attr);
+    }
+
+    if (chance(g, 5)) {
+        struct in_addr in;
+        in.s_addr = beswap32(0xc0000200 | (gp->origin & 0xff));
+
+        attr = startattr(g, ATTR_OPTIONAL | ATTR_TRANSITIVE, AGGREGATOR_CODE);
+        attr->len = AGGREGATOR_AS32_LENGTH;
+        setaggregator(attr, gp->origin, sizeof(uint32_t), in);
+        emitattr(g, attr);
+    }
+}
+
+// TABLE_DUMPV2
+
+static umrt_err genpeerindex(mrtgen_t *g)
+{
+    struct in_addr collector;
+    collector.s_addr = beswap32(0xc0a8ffff);
+
+    umrt_err err = mrtputpeeridx(&g->w, BASE_STAMP, collector, "synthetic", g->peers, g->params->npeers);
+    if (likely(err == MRT_ENOERR))
+        g->stats.records++;
+
+    return err;
+}
+
+static umrt_err genribentry(mrtgen_t *g, uint16_t idx, uint32_t pathid, const genprefix_t *gp)
+{
+    const peer_entry_t *peer = &g->peers[idx];
+
+    time_t originated = BASE_STAMP - randrange(g, 0, 30 * 24 * 3600);
+
+    g->ribattrslen  = 0;
+    g->ribattrsover = false;
+    genattrs(g, peer, gp, true);
+    if (unlikely(g->ribattrsover))
+        return MRT_EINVOP;
+
+    umrt_err err = mrtputribent(&g->w, idx, originated, pathid, g->ribattrs, g->ribattrslen);
+    if (likely(err == MRT_ENOERR))
+        g->stats.routes++;
+
+    return err;
+}
+
+static umrt_err genrib(mrtgen_t *g, int subtype, uint32_t seqno, const genprefix_t *gp)
+{
+    const mrtgen_params_t *p = g->params;
+
+    umrt_err err = mrtstartrib(&g->w, BASE_STAMP, subtype, seqno, &gp->pfx);
+    if (unlikely(err != MRT_ENOERR))
+        return err;
+
+    uint count = 0;
+    for (uint i = 0; i < p->npeers && count < UINT16_MAX; i++) {
+        // make sure every prefix has at least one route
+        bool last = (i == p->npeers - 1 && count == 0);
+        if (!last && !chance(g, p->peerpercent))
+            continue;
+
+        err = genribentry(g, i, 1, gp);
+        if (unlikely(err != MRT_ENOERR))
+            return err;
+
+        count++;
+        if (p->addpath && count < UINT16_MAX && chance(g, 25)) {
+            // a second path from the same peer
+            err = genribentry(g, i, 2, gp);
+            if (unlikely(err != MRT_ENOERR))
+                return err;
+
+            count++;
+        }
+    }
+
+    err = mrtendrib(&g->w);
+    if (likely(err == MRT_ENOERR))
+        g->stats.records++;
+
+    return err;
+}
+
+int mrtgentabledump(io_rw_t *io, const mrtgen_params_t *params, mrtgen_stats_t *stats)
+{
+    mrtgen_t *g = malloc(sizeof(*g));
+    if (unlikely(!g))
+        return -1;
+
+    int res = -1;
+    if (unlikely(!mrtgeninit(g, io, params)))
+        goto out;
+
+    if (genpeerindex(g) != MRT_ENOERR)
+        goto out;
+
+    uint32_t seqno = 0;
+    for (uint afi = 0; afi < 2; afi++) {
+        int subtype;
+        if (afi == 0)
+            subtype = params->addpath ? MRT_TABLE_DUMPV2_RIB_IPV4_UNICAST_ADDPATH : MRT_TABLE_DUMPV2_RIB_IPV4_UNICAST;
+        else
+            subtype = params->addpath ? MRT_TABLE_DUMPV2_RIB_IPV6_UNICAST_ADDPATH : MRT_TABLE_DUMPV2_RIB_IPV6_UNICAST;
+
+        for (uint i = 0; i < g->npool[afi]; i++) {
+            if (genrib(g, subtype, seqno++, &g->pool[afi][i]) != MRT_ENOERR)
+                goto out;
+        }
+    }
+
+    res = 0;
+
+out:
+    if (mrtgendestroy(g, stats) != MRT_ENOERR)
+        res = -1;
+
+    free(g);
+    return res;
+}
+
+// BGP4MP
+
+static void genupdate(mrtgen_t *g, ubgp_msg_s *msg, const peer_entry_t *peer)
+{
+    const mrtgen_params_t *p = g->params;
+
+    uint afi = chance(g, p->v6percent) ? 1 : 0;
+    if (g->npool[afi] == 0)
+        afi = !afi;
+
+    uint n = randrange(g, 1, MAX(p->maxnlri, 1u));
+    uint start = nextrand(g) % g->npool[afi];
+    bool withdrawn = chance(g, p->withdrawnpercent);
+
+    // pick n prefixes from a random neighbourhood of the pool
+    netaddrap_t pfxs[n];
+    for (uint i = 0; i < n; i++) {
+        pfxs[i].pfx    = g->pool[afi][(start + i) % g->npool[afi]].pfx;
+        pfxs[i].pathid = p->addpath ? randrange(g, 1, 2) : 0;
+    }
+
+    const genprefix_t *gp = &g->pool[afi][start];
+
+    uint flags = BGPF_ASN32BIT;
+    if (p->addpath)
+        flags |= BGPF_ADDPATH;
+
+    setbgpwrite(msg, BGP_UPDATE, flags);
+    if (afi == 0 && withdrawn) {
+        startwithdrawn(msg);
+        for (uint i = 0; i < n; i++)
+            putwithdrawn(msg, &pfxs[i]);
+
+        endwithdrawn(msg);
+    } else if (afi == 0) {
+        g->bgp = msg;
+        startbgpattribs(msg);
+        genattrs(g, peer, gp, false);
+        endbgpattribs(msg);
+        g->bgp = NULL;
+
+        startnlri(msg);
+        for (uint i = 0; i < n; i++)
+            putnlri(msg, &pfxs[i]);
+
+        endnlri(msg);
+    } else {
+        bgpattr_t *attr;
+
+        g->bgp = msg;
+        startbgpattribs(msg);
+        if (!withdrawn)
+            genattrs(g, peer, gp, false);
+
+        // MP_REACH_NLRI/MP_UNREACH_NLRI last, so genattrs() doesn't clobber it
+        if (withdrawn) {
+            attr = startattr(g, EXTENDED_MP_UNREACH_NLRI_FLAGS, MP_UNREACH_NLRI_CODE);
+            attr->exlen[1] = MP_UNREACH_BASE_LEN;
+            setmpafisafi(attr, AFI_IPV6, SAFI_UNICAST);
+        } else {
+            struct in6_addr nh;
+            mpnexthop(&nh, peer);
+
+            attr = startattr(g, EXTENDED_MP_REACH_NLRI_FLAGS, MP_REACH_NLRI_CODE);
+            attr->exlen[1] = MP_REACH_BASE_LEN - 1;  // no reserved byte yet
+            setmpafisafi(attr, AFI_IPV6, SAFI_UNICAST);
+            attr->exdata[sizeof(uint16_t) + sizeof(uint8_t)] = 0;  // next hop length
+            putmpnexthop(attr, AF_INET6, &nh);
+
+            size_t len;
+            byte *data = getattrlen(attr, &len);
+            data[len++] = 0;  // reserved (SNPA count)
+            attr->exlen[0] = len >> 8;
+            attr->exlen[1] = len & 0xff;
+        }
+        for (uint i = 0; i < n; i++) {
+            if (p->addpath)
+                putmpnlriap(attr, &pfxs[i]);
+            else
+                putmpnlri(attr, &pfxs[i].pfx);
+        }
+
+        emitattr(g, attr);
+        endbgpattribs(msg);
+        g->bgp = NULL;
+    }
+
+    g->stats.routes += n;
+}
+
+int mrtgenbgp4mp(io_rw_t *io, const mrtgen_params_t *params, mrtgen_stats_t *stats)
+{
+    mrtgen_t *g = malloc(sizeof(*g));
+    ubgp_msg_s *msg = malloc(sizeof(*msg));
+    if (unlikely(!g || !msg)) {
+        free(g);
+        free(msg);
+        return -1;
+    }
+
+    int res = -1;
+    if (unlikely(!mrtgeninit(g, io, params) || params->npeers == 0))
+        goto out;
+
+    int subtype = params->addpath ? BGP4MP_MESSAGE_AS4_ADDPATH : BGP4MP_MESSAGE_AS4;
+    struct timespec stamp = { .tv_sec = BASE_STAMP };
+    for (uint i = 0; i < params->nupdates; i++) {
+        const peer_entry_t *peer = &g->peers[nextrand(g) % params->npeers];
+
+        genupdate(g, msg, peer);
+
+        size_t n;
+        void *data = bgpfinish(msg, &n);
+        if (unlikely(!data)) {
+            bgpclose(msg);
+            goto out;
+        }
+
+        bgp4mp_header_t hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.peer_as    = peer->as;
+        hdr.local_as   = 65000;
+        hdr.peer_addr  = peer->addr;
+        hdr.local_addr = peer->addr;  // same family as the peer's
+
+        // a few updates per second
+        stamp.tv_sec += (nextrand(g) % 8 == 0);
+
+        umrt_err err = mrtputbgp4mp(&g->w, &stamp, MRT_BGP4MP, subtype, &hdr, data, n);
+        bgpclose(msg);
+        if (err != MRT_ENOERR)
+            goto out;
+
+        g->stats.records++;
+    }
+
+    res = 0;
+
+out:
+    if (mrtgendestroy(g, stats) != MRT_ENOERR)
+        res = -1;
+
+    free(msg);
+    free(g);
+    return res;
+}
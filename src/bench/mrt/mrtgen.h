@@ -0,0 +1,120 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#ifndef UBGP_MRTGEN_H_
+#define UBGP_MRTGEN_H_
+
+#include "../../ubgp/io.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * mrtgen_params_t:
+ * @seed:             PRNG seed, the same parameters always yield the same corpus
+ * @npeers:           number of peers in the PEER_INDEX_TABLE (or BGP4MP sessions)
+ * @nprefixes:        number of distinct prefixes in the generated RIB
+ * @v6percent:        percentage of IPv6 prefixes
+ * @peerpercent:      percentage of peers carrying a route to each prefix
+ * @aspathmin:        minimum AS_PATH length
+ * @aspathmax:        maximum AS_PATH length, lengths are triangularly distributed
+ *                    between @aspathmin and @aspathmax
+ * @prependpercent:   percentage of AS_PATHs with a prepended origin
+ * @commdensity:      average number of COMMUNITY values per route
+ * @nupdates:         number of BGP4MP UPDATE messages to generate
+ * @maxnlri:          maximum prefixes announced (or withdrawn) per UPDATE
+ * @withdrawnpercent: percentage of UPDATE messages that are withdrawals
+ * @addpath:          generate ADDPATH RIB entries and BGP4MP messages
+ *
+ * Synthetic MRT corpus parameters.
+ */
+typedef struct {
+    uint32_t seed;
+    uint     npeers;
+    uint     nprefixes;
+    uint     v6percent;
+    uint     peerpercent;
+    uint     aspathmin, aspathmax;
+    uint     prependpercent;
+    uint     commdensity;
+    uint     nupdates;
+    uint     maxnlri;
+    uint     withdrawnpercent;
+    bool     addpath;
+} mrtgen_params_t;
+
+/**
+ * mrtgen_stats_t:
+ * @records: MRT records written
+ * @routes:  RIB entries (or UPDATE prefixes) written
+ * @bytes:   total bytes written
+ */
+typedef struct {
+    ullong records;
+    ullong routes;
+    ullong bytes;
+} mrtgen_stats_t;
+
+#define MRTGEN_DEFAULT_PARAMS { \
+    .seed             = 0x5eed, \
+    .npeers           = 32,     \
+    .nprefixes        = 20000,  \
+    .v6percent        = 15,     \
+    .peerpercent      = 60,     \
+    .aspathmin        = 2,      \
+    .aspathmax        = 9,      \
+    .prependpercent   = 10,     \
+    .commdensity      = 4,      \
+    .nupdates         = 50000,  \
+    .maxnlri          = 16,     \
+    .withdrawnpercent = 20,     \
+    .addpath          = false   \
+}
+
+/**
+ * mrtgentabledump:
+ * @io:     destination
+ * @params: corpus parameters
+ * @stats:  (nullable): if not %NULL, filled with statistics about the dump
+ *
+ * Write a deterministic synthetic TABLE_DUMPV2 RIB dump: one PEER_INDEX_TABLE
+ * followed by one RIB_IPV4_UNICAST or RIB_IPV6_UNICAST record per prefix
+ * (their ADDPATH variants if @params requests so).
+ *
+ * Returns: 0 on success, -1 on write error.
+ */
+int mrtgentabledump(io_rw_t *io, const mrtgen_params_t *params, mrtgen_stats_t *stats);
+
+/**
+ * mrtgenbgp4mp:
+ * @io:     destination
+ * @params: corpus parameters
+ * @stats:  (nullable): if not %NULL, filled with statistics about the dump
+ *
+ * Write a deterministic synthetic BGP4MP updates dump made of
+ * BGP4MP_MESSAGE_AS4 (or BGP4MP_MESSAGE_AS4_ADDPATH) records,
+ * drawing prefixes from the same pool used by mrtgentabledump().
+ *
+ * Returns: 0 on success, -1 on write error.
+ */
+int mrtgenbgp4mp(io_rw_t *io, const mrtgen_params_t *params, mrtgen_stats_t *stats);
+
+#endif
@@ -0,0 +1,366 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * bgpgrep is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * bgpgrep is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with bgpgrep.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#include "../ubgp/branch.h"
+#include "../ubgp/strutil.h"
+
+#include "follow.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+
+enum {
+    DIR_EVENTS  = IN_CREATE | IN_MOVED_TO | IN_CLOSE_WRITE | IN_MODIFY |
+                  IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR,
+    FILE_EVENTS = IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF
+};
+
+static int addpending(follower_t *fw, const char *name)
+{
+    if (fw->cur && strcmp(name, fw->cur) <= 0)
+        return 0;  // already read, or too old to matter
+
+    size_t lo = 0, hi = fw->npending;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        int c = strcmp(fw->pending[mid], name);
+        if (c == 0)
+            return 0;
+        if (c < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (fw->npending == fw->cappending) {
+        size_t newcap = (fw->cappending > 0) ? 2 * fw->cappending : 16;
+        char **pending = realloc(fw->pending, newcap * sizeof(*pending));
+        if (unlikely(!pending))
+            goto oom;
+
+        fw->pending    = pending;
+        fw->cappending = newcap;
+    }
+
+    char *s = strdup(name);
+    if (unlikely(!s))
+        goto oom;
+
+    memmove(&fw->pending[lo + 1], &fw->pending[lo], (fw->npending - lo) * sizeof(*fw->pending));
+    fw->pending[lo] = s;
+    fw->npending++;
+    return 0;
+
+oom:
+    fw->err = ENOMEM;
+    return -1;
+}
+
+static int scandirectory(follower_t *fw)
+{
+    DIR *dir = opendir(fw->path);
+    if (!dir) {
+        fw->err = errno;
+        return -1;
+    }
+
+    int res = 0;
+
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        struct stat st;
+
+        // skip hidden and temporary files, along with anything that isn't a regular file
+        if (de->d_name[0] == '.')
+            continue;
+        if (fstatat(dirfd(dir), de->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode))
+            continue;
+
+        res = addpending(fw, de->d_name);
+        if (res != 0)
+            break;
+    }
+
+    closedir(dir);
+    return res;
+}
+
+// block until something happens to the followed path
+static int followevents(follower_t *fw)
+{
+    _Alignas(struct inotify_event) char buf[4096];
+
+    ssize_t n = read(fw->ifd, buf, sizeof(buf));
+    if (n < 0) {
+        if (errno == EINTR)
+            return 0;
+
+        fw->err = errno;
+        return -1;
+    }
+
+    const struct inotify_event *ev;
+    for (char *ptr = buf; ptr < buf + n; ptr += sizeof(*ev) + ev->len) {
+        ev = (const struct inotify_event *) ptr;
+
+        if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+            fw->gone = true;
+
+        if (ev->mask & IN_Q_OVERFLOW) {
+            // lost track of the directory, have a fresh look
+            if (fw->isdir && scandirectory(fw) != 0)
+                return -1;
+
+            continue;
+        }
+
+        if (!fw->isdir) {
+            // the file we hold open doesn't go away until we close it
+            struct stat st;
+            if ((ev->mask & IN_ATTRIB) && fw->fd >= 0 && fstat(fw->fd, &st) == 0 && st.st_nlink == 0)
+                fw->gone = true;
+
+            continue;
+        }
+
+        if (ev->len == 0 || (ev->mask & IN_ISDIR) || ev->name[0] == '.')
+            continue;
+
+        // uncompressed files are read while written, compressed ones only once complete
+        uint32_t ready = IN_MOVED_TO | IN_CLOSE_WRITE;
+        if (!followcompressed(ev->name))
+            ready |= IN_CREATE;
+
+        if ((ev->mask & ready) && addpending(fw, ev->name) != 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+int followinit(follower_t *fw, const char *path)
+{
+    int err;
+
+    memset(fw, 0, sizeof(*fw));
+    fw->ifd = -1;
+    fw->wd  = -1;
+    fw->fd  = -1;
+
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return -1;
+
+    fw->isdir = S_ISDIR(st.st_mode);
+    fw->path  = strdup(path);
+    if (unlikely(!fw->path))
+        goto fail;
+
+    fw->ifd = inotify_init1(IN_CLOEXEC);
+    if (fw->ifd < 0)
+        goto fail;
+
+    // watch before looking around, so nothing added meanwhile goes unnoticed
+    fw->wd = inotify_add_watch(fw->ifd, path, fw->isdir ? DIR_EVENTS : FILE_EVENTS);
+    if (fw->wd < 0)
+        goto fail;
+
+    if (fw->isdir ? scandirectory(fw) : addpending(fw, path)) {
+        errno = fw->err;
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+    err = errno;
+
+    followdestroy(fw);
+    errno = err;
+    return -1;
+}
+
+char *follownext(follower_t *fw)
+{
+    while (fw->npending == 0) {
+        if (fw->gone || !fw->isdir || fw->err != 0)
+            return NULL;
+
+        fflush(stdout);
+        followevents(fw);
+    }
+
+    free(fw->cur);
+    fw->cur = fw->pending[0];
+    memmove(&fw->pending[0], &fw->pending[1], --fw->npending * sizeof(*fw->pending));
+    if (!fw->isdir)
+        return fw->cur;
+
+    free(fw->curpath);
+    fw->curpath = malloc(strlen(fw->path) + 1 + strlen(fw->cur) + 1);
+    if (unlikely(!fw->curpath)) {
+        fw->err = ENOMEM;
+        return NULL;
+    }
+
+    sprintf(fw->curpath, "%s/%s", fw->path, fw->cur);
+    return fw->curpath;
+}
+
+static size_t followread(io_rw_t *io, void *dst, size_t n)
+{
+    follower_t *fw = io->ptr;
+
+    char  *ptr = dst;
+    size_t nr  = 0;
+    while (nr < n && fw->err == 0) {
+        ssize_t res = read(fw->fd, ptr + nr, n - nr);
+        if (res > 0) {
+            nr += res;
+            continue;
+        }
+        if (res < 0) {
+            if (errno != EINTR)
+                fw->err = errno;
+
+            continue;
+        }
+
+        // the writer moved on once a newer file appears, and any event we
+        // collected was queued before the read() that just returned 0
+        if (fw->npending > 0 || fw->gone)
+            break;
+
+        // a partial record stays here until the rest is written,
+        // meanwhile readers of our output shouldn't wait for the buffer to fill
+        fflush(stdout);
+        followevents(fw);
+    }
+
+    return nr;
+}
+
+#else
+
+int followinit(follower_t *fw, const char *path)
+{
+    USED(path);
+
+    memset(fw, 0, sizeof(*fw));
+    fw->ifd = -1;
+    fw->wd  = -1;
+    fw->fd  = -1;
+
+    errno = ENOSYS;
+    return -1;
+}
+
+char *follownext(follower_t *fw)
+{
+    USED(fw);
+    return NULL;
+}
+
+static size_t followread(io_rw_t *io, void *dst, size_t n)
+{
+    USED(io);
+    USED(dst);
+    USED(n);
+
+    return 0;
+}
+
+#endif
+
+bool followcompressed(const char *name)
+{
+    const char *ext = strpathext(name);
+
+    return strcasecmp(ext, ".gz")  == 0 ||
+           strcasecmp(ext, ".z")   == 0 ||
+           strcasecmp(ext, ".bz2") == 0 ||
+           strcasecmp(ext, ".xz")  == 0;
+}
+
+static size_t followwrite(io_rw_t *io, const void *src, size_t n)
+{
+    follower_t *fw = io->ptr;
+
+    USED(src);
+    USED(n);
+
+    fw->err = EBADF;
+    return 0;
+}
+
+static int followerror(io_rw_t *io)
+{
+    follower_t *fw = io->ptr;
+    return fw->err != 0;
+}
+
+static int followclose(io_rw_t *io)
+{
+    follower_t *fw = io->ptr;
+
+    int res = close(fw->fd);
+    fw->fd  = -1;
+    return res;
+}
+
+void followio(follower_t *fw, io_rw_t *io, int fd)
+{
+    fw->fd = fd;
+
+    io->ptr   = fw;
+    io->read  = followread;
+    io->write = followwrite;
+    io->error = followerror;
+    io->close = followclose;
+}
+
+void followdestroy(follower_t *fw)
+{
+    if (fw->fd >= 0)
+        close(fw->fd);
+    if (fw->ifd >= 0)
+        close(fw->ifd);  // drops the watch as well
+
+    for (size_t i = 0; i < fw->npending; i++)
+        free(fw->pending[i]);
+
+    free(fw->pending);
+    free(fw->cur);
+    free(fw->curpath);
+    free(fw->path);
+}
@@ -0,0 +1,62 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * bgpgrep is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * bgpgrep is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with bgpgrep.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#ifndef UBGP_FOLLOW_H_
+#define UBGP_FOLLOW_H_
+
+#include "../ubgp/funcattribs.h"
+#include "../ubgp/io.h"
+
+#include <stdbool.h>
+
+// follow a growing MRT file, or a directory where MRT files are added over time
+typedef struct {
+    int    ifd;       // inotify instance
+    int    wd;        // watch on the followed file or directory
+    bool   isdir;
+    bool   gone;      // followed path was removed or renamed
+    int    fd;        // file being read, -1 if none
+    int    err;
+    char  *path;      // followed path
+    char  *cur;       // name of the last file returned by follownext()
+    char  *curpath;   // and its full path
+    char **pending;   // directory entries waiting to be read, sorted by name
+    size_t npending, cappending;
+} follower_t;
+
+// start following path, returns 0 on success, -1 on error (errno is set)
+CHECK_NONNULL(1, 2) int followinit(follower_t *fw, const char *path);
+
+// wait for the next file to read and return its path, NULL when there is nothing more to follow
+// or on error (fw->err is set), the path is valid until the next call
+CHECK_NONNULL(1) char *follownext(follower_t *fw);
+
+// whether name is compressed, only uncompressed files are read while they grow
+CHECK_NONNULL(1) bool followcompressed(const char *name);
+
+// read fd as it grows, until a newer file shows up or the followed path goes away,
+// io->close() closes fd
+CHECK_NONNULL(1, 2) void followio(follower_t *fw, io_rw_t *io, int fd);
+
+// stop following and release every resource
+CHECK_NONNULL(1) void followdestroy(follower_t *fw);
+
+#endif
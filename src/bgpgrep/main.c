@@ -20,9 +20,11 @@
  */
 
 #include "../ubgp/bitops.h"
+#include "../ubgp/dumppacket.h"
 #include "../ubgp/filterintrin.h"
 #include "../ubgp/filterpacket.h"
 #include "../ubgp/branch.h"
+#include "../ubgp/ingest.h"
 #include "../ubgp/netaddr.h"
 #include "../ubgp/patriciatrie.h"
 #include "../ubgp/strutil.h"
@@ -30,37 +32,85 @@
 
 #include "parse.h"
 #include "progutil.h"
+#include "follow.h"
 #include "mrtdataread.h"
+#include "mrtstats.h"
 
 #include <errno.h>
 #include <fcntl.h>
+#include <getopt.h>
 #include <libgen.h>
+#include <netdb.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
 static void usage(void)
 {
     fprintf(stderr, "%s: MRT data reader and filtering utility\n", programnam);
     fprintf(stderr, "Usage:\n");
-    fprintf(stderr, "\t%s [-cdlL] [-mM COMMSTRING] [-pP PATHEXPR] [-i ADDR] [-I FILE] [-a AS] [-A FILE] [-e PREFIX] [-E FILE] [-t ATTR_CODE] [-T FILE] [-o FILE] [FILE...]\n", programnam);
-    fprintf(stderr, "\t%s [-cdlL] [-mM COMMSTRING] [-pP PATHEXPR] [-i ADDR] [-I FILE] [-a AS] [-A FILE] [-s PREFIX] [-S FILE] [-t ATTR_CODE] [-T FILE] [-o FILE] [FILE...]\n", programnam);
-    fprintf(stderr, "\t%s [-cdlL] [-mM COMMSTRING] [-pP PATHEXPR] [-i ADDR] [-I FILE] [-a AS] [-A FILE] [-u PREFIX] [-U FILE] [-t ATTR_CODE] [-T FILE] [-o FILE] [FILE...]\n", programnam);
-    fprintf(stderr, "\t%s [-cdlL] [-mM COMMSTRING] [-pP PATHEXPR] [-i ADDR] [-I FILE] [-a AS] [-A FILE] [-r PREFIX] [-R FILE] [-t ATTR_CODE] [-T FILE] [-o FILE] [FILE...]\n", programnam);
+    fprintf(stderr, "\t%s [-cdlL] [--profile] [-mM COMMSTRING] [-pP PATHEXPR] [-i ADDR] [-I FILE] [-a AS] [-A FILE] [-e PREFIX] [-E FILE] [-t ATTR_CODE] [-T FILE] [-o FILE] [FILE...]\n", programnam);
+    fprintf(stderr, "\t%s [-cdlL] [--profile] [-mM COMMSTRING] [-pP PATHEXPR] [-i ADDR] [-I FILE] [-a AS] [-A FILE] [-s PREFIX] [-S FILE] [-t ATTR_CODE] [-T FILE] [-o FILE] [FILE...]\n", programnam);
+    fprintf(stderr, "\t%s [-cdlL] [--profile] [-mM COMMSTRING] [-pP PATHEXPR] [-i ADDR] [-I FILE] [-a AS] [-A FILE] [-u PREFIX] [-U FILE] [-t ATTR_CODE] [-T FILE] [-o FILE] [FILE...]\n", programnam);
+    fprintf(stderr, "\t%s [-cdlL] [--profile] [-mM COMMSTRING] [-pP PATHEXPR] [-i ADDR] [-I FILE] [-a AS] [-A FILE] [-r PREFIX] [-R FILE] [-t ATTR_CODE] [-T FILE] [-o FILE] [FILE...]\n", programnam);
     fprintf(stderr, "\n");
     fprintf(stderr, "Available options:\n");
     fprintf(stderr, "\t-a <feeder AS>\n");
     fprintf(stderr, "\t\tPrint only entries coming from the given feeder AS\n");
     fprintf(stderr, "\t-A <file>\n");
     fprintf(stderr, "\t\tPrint only entries coming from the feeder ASes contained in file\n");
+    fprintf(stderr, "\t--bmp\n");
+    fprintf(stderr, "\t\tRead files as BMP message streams rather than MRT dumps, Route Monitoring messages are\n");
+    fprintf(stderr, "\t\tfiltered as updates, Peer Up and Peer Down as state changes\n");
     fprintf(stderr, "\t-c\n");
     fprintf(stderr, "\t\tDump packets in hexadecimal C array format\n");
     fprintf(stderr, "\t-d\n");
     fprintf(stderr, "\t\tDump packet filter bytecode to stderr (debug option)\n");
+    fprintf(stderr, "\t--aslinks\n");
+    fprintf(stderr, "\t\tPrint a sorted list of the AS links found in the AS PATH of the entries passing the filter, rather than\n");
+    fprintf(stderr, "\t\tthe entries themselves, each row holds the two ASes, first and last seen timestamps and number of peers\n");
+    fprintf(stderr, "\t--aslinks-csr\n");
+    fprintf(stderr, "\t\tLike --aslinks, but print the AS graph in binary compressed sparse row format\n");
+    fprintf(stderr, "\t--stats <seconds>\n");
+    fprintf(stderr, "\t\tPrint per peer update statistics in CSV format, rather than the updates themselves,\n");
+    fprintf(stderr, "\t\tone row per peer every given number of seconds\n");
+    fprintf(stderr, "\t--stats-json <seconds>\n");
+    fprintf(stderr, "\t\tLike --stats, but print one JSON object per row\n");
+    fprintf(stderr, "\t--hijacks <file>\n");
+    fprintf(stderr, "\t\tPrint MOAS conflicts and new subnets of the prefixes contained in file as they're announced,\n");
+    fprintf(stderr, "\t\trather than the entries themselves, RIB entries are used as a baseline\n");
+    fprintf(stderr, "\t--hijack-ttl <seconds>\n");
+    fprintf(stderr, "\t\tForget origins not announced for the given number of seconds, defaults to one day\n");
+    fprintf(stderr, "\t--flaps\n");
+    fprintf(stderr, "\t\tPrint routes starting or ceasing to flap, rather than the updates themselves,\n");
+    fprintf(stderr, "\t\tusing RFC 2439 dampening penalties\n");
+    fprintf(stderr, "\t--flap-threshold <penalty>\n");
+    fprintf(stderr, "\t\tPenalty above which a route is flapping, defaults to 2000\n");
+    fprintf(stderr, "\t--follow\n");
+    fprintf(stderr, "\t\tKeep reading the last file as it grows, if it's a directory read its files in name order,\n");
+    fprintf(stderr, "\t\tthen wait for new ones\n");
+    fprintf(stderr, "\t--listen <[address:]port>\n");
+    fprintf(stderr, "\t\tRather than reading files, accept TCP connections streaming BGP messages on the given address,\n");
+    fprintf(stderr, "\t\tmay be repeated to listen on many addresses\n");
+    fprintf(stderr, "\t--limit <count>\n");
+    fprintf(stderr, "\t\tStop reading input and exit once the given number of messages, RIB entries or events are printed\n");
+    fprintf(stderr, "\t--sample <rate>\n");
+    fprintf(stderr, "\t\tProcess a random sample of the records carrying routes, each one with the given probability,\n");
+    fprintf(stderr, "\t\texpressed as a fraction or a percentage, such as 0.01 or 1%%\n");
+    fprintf(stderr, "\t--sample-seed <seed>\n");
+    fprintf(stderr, "\t\tSeed the sampling random generator, to draw the same sample again\n");
+    fprintf(stderr, "\t--pfx2as\n");
+    fprintf(stderr, "\t\tPrint a sorted prefix to origin AS table of the RIB entries passing the filter, rather than\n");
+    fprintf(stderr, "\t\tthe entries themselves, each row holds a prefix, an origin and the number of peers announcing it\n");
+    fprintf(stderr, "\t--profile\n");
+    fprintf(stderr, "\t\tProfile packet filter execution, bytecode is dumped to stderr annotated with\n");
+    fprintf(stderr, "\t\tper instruction counts and cycles once every file is processed (debug option)\n");
     fprintf(stderr, "\t-e <subnet>\n");
     fprintf(stderr, "\t\tPrint only entries containing the exact given subnet of interest\n");
     fprintf(stderr, "\t-E <file>\n");
@@ -116,17 +166,76 @@ enum {
     FILTER_BY_SUPERNET  = 1 << 8,
     KEEP_AS_LOOPS       = 1 << 9,
     DISCARD_AS_LOOPS    = 1 << 10,
+    DBG_PROFILE         = 1 << 11,
+    PFX2AS              = 1 << 12,
+    ASLINKS             = 1 << 13,
+    ASLINKS_CSR         = 1 << 14,
+    STATS               = 1 << 15,
+    HIJACKS             = 1 << 16,
+    FLAPS               = 1 << 17,
+    FOLLOW              = 1 << 18,
+    LISTEN              = 1 << 19,
+    BMP                 = 1 << 20,
+    LIMIT               = 1 << 21,
+    SAMPLE              = 1 << 22,
 
     FILTER_MASK  = (FILTER_EXACT | FILTER_RELATED | FILTER_BY_SUBNET | FILTER_BY_SUPERNET),
     AS_LOOP_MASK = KEEP_AS_LOOPS | DISCARD_AS_LOOPS
 };
 
+// long only options, values are out of char range to avoid clashing with short ones
+enum {
+    PROFILE_OPT = 0x100,
+    PFX2AS_OPT,
+    ASLINKS_OPT,
+    ASLINKS_CSR_OPT,
+    STATS_OPT,
+    STATS_JSON_OPT,
+    HIJACKS_OPT,
+    HIJACK_TTL_OPT,
+    FLAPS_OPT,
+    FLAP_THRESHOLD_OPT,
+    FOLLOW_OPT,
+    LISTEN_OPT,
+    BMP_OPT,
+    LIMIT_OPT,
+    SAMPLE_OPT,
+    SAMPLE_SEED_OPT
+};
+
+static const struct option long_options[] = {
+    { "profile",        no_argument,       NULL, PROFILE_OPT        },
+    { "pfx2as",         no_argument,       NULL, PFX2AS_OPT         },
+    { "aslinks",        no_argument,       NULL, ASLINKS_OPT        },
+    { "aslinks-csr",    no_argument,       NULL, ASLINKS_CSR_OPT    },
+    { "stats",          required_argument, NULL, STATS_OPT          },
+    { "stats-json",     required_argument, NULL, STATS_JSON_OPT     },
+    { "hijacks",        required_argument, NULL, HIJACKS_OPT        },
+    { "hijack-ttl",     required_argument, NULL, HIJACK_TTL_OPT     },
+    { "flaps",          no_argument,       NULL, FLAPS_OPT          },
+    { "flap-threshold", required_argument, NULL, FLAP_THRESHOLD_OPT },
+    { "follow",         no_argument,       NULL, FOLLOW_OPT         },
+    { "listen",         required_argument, NULL, LISTEN_OPT         },
+    { "bmp",            no_argument,       NULL, BMP_OPT            },
+    { "limit",          required_argument, NULL, LIMIT_OPT          },
+    { "sample",         required_argument, NULL, SAMPLE_OPT         },
+    { "sample-seed",    required_argument, NULL, SAMPLE_SEED_OPT    },
+    { NULL,             0,                 NULL, 0                  }
+};
+
 enum {
     ADDRS_GROWSTEP = 128,
     ASES_GROWSTEP  = 256
 };
 
 static filter_vm_t vm;
+
+enum {
+    HIJACK_DEFAULT_TTL = 24 * 60 * 60
+};
+
+static hijack_detector_t hijacks;
+static flap_table_t      flaps;
 static uint flags            = 0;
 static int trie_idx          = -1;
 static int trie6_idx         = -1;
@@ -141,15 +250,11 @@ static mrt_dump_fmt_t format = MRT_DUMP_ROW;
 // attribute of interest mask, only meaningful if attr_count > 0
 
 enum {
-    MAX_ATTRS_BITSET_SIZE = 0xff / (sizeof(uint32_t) * CHAR_BIT)
+    ATTR_BITSET_SHIFT = 6,
+    ATTR_BITSET_MASK  = 0x3f
 };
 
-enum {
-    ATTR_BITSET_SHIFT = 5,
-    ATTR_BITSET_MASK  = 0x1f
-};
-
-static uint32_t attr_mask[MAX_ATTRS_BITSET_SIZE];
+static uint64_t attr_mask[BGP_ATTRMASK_WORDS];
 static uint     attr_count = 0;
 
 typedef struct community_match_s {
@@ -191,9 +296,9 @@ static bool add_trie_address(const char *s)
 
     void *node;
     if (addr.family == AF_INET)
-        node = patinsert(&vm.tries[trie_idx], &addr, NULL);
+        node = patinsert(&vm.prog.tries[trie_idx], &addr, NULL);
     else
-        node = patinsert(&vm.tries[trie6_idx], &addr, NULL);
+        node = patinsert(&vm.prog.tries[trie6_idx], &addr, NULL);
 
     if (!node)
         exprintf(EXIT_FAILURE, "out of memory");
@@ -201,6 +306,19 @@ static bool add_trie_address(const char *s)
     return true;
 }
 
+static bool add_monitored_prefix(const char *s)
+{
+    netaddr_t addr;
+
+    if (stonaddr(&addr, s) != 0)
+        return false;
+
+    if (!hijackmonitor(&hijacks, &addr))
+        exprintf(EXIT_FAILURE, "out of memory");
+
+    return true;
+}
+
 static bool add_peer_as(const char *s)
 {
     char *end;
@@ -223,6 +341,33 @@ static bool add_peer_as(const char *s)
     return true;
 }
 
+static llong parse_positive(const char *s, const char *what)
+{
+    char *end;
+
+    llong n = strtoll(s, &end, 10);
+    if (*end != '\0' || s == end || n <= 0)
+        exprintf(EXIT_FAILURE, "'%s': bad %s", s, what);
+
+    return n;
+}
+
+// parse a sampling rate, either a fraction in (0, 1] or a percentage
+static double parse_rate(const char *s)
+{
+    char *end;
+
+    double rate = strtod(s, &end);
+    if (*end == '%') {
+        rate /= 100.0;
+        end++;
+    }
+    if (*end != '\0' || s == end || !(rate > 0.0 && rate <= 1.0))
+        exprintf(EXIT_FAILURE, "'%s': bad sampling rate", s);
+
+    return rate;
+}
+
 static bool add_peer_address(const char *s)
 {
     netaddr_t addr;
@@ -315,8 +460,8 @@ static bool add_interesting_attr(const char *s)
         code = val;
     }
 
-    if ((attr_mask[code >> ATTR_BITSET_SHIFT] & (1 << (code & ATTR_BITSET_MASK))) == 0) {
-        attr_mask[code >> ATTR_BITSET_SHIFT] |= 1 << (code & ATTR_BITSET_MASK);
+    if ((attr_mask[code >> ATTR_BITSET_SHIFT] & (1ull << (code & ATTR_BITSET_MASK))) == 0) {
+        attr_mask[code >> ATTR_BITSET_SHIFT] |= 1ull << (code & ATTR_BITSET_MASK);
         attr_count++;
     }
     return true;
@@ -344,13 +489,13 @@ static void parse_file(const char  *filename,
         exprintf(EXIT_FAILURE, "read error while parsing: %s:", filename);
 }
 
-static void mrt_accumulate_addrs(filter_vm_t *vm)
+static void mrt_accumulate_addrs(filter_ctx_t *vm)
 {
     for (uint i = 0; i < addrs_count; i++)
         vm_pushaddr(vm, &peer_addrs[i]);
 }
 
-static void mrt_accumulate_ases(filter_vm_t *vm)
+static void mrt_accumulate_ases(filter_ctx_t *vm)
 {
     for (uint i = 0; i < ases_count; i++)
         vm_pushas(vm, peer_ases[i]);
@@ -360,7 +505,7 @@ enum {
     ASPATHSIZ = 32
 };
 
-static void mrt_find_as_loops(filter_vm_t *vm)
+static void mrt_find_as_loops(filter_ctx_t *vm)
 {
 
     vm_exec_settle(vm);  // force iterators settle (not really necessary... but whatever)
@@ -412,98 +557,108 @@ static void mrt_find_as_loops(filter_vm_t *vm)
 static void setup_filter(void)
 {
     if (flags & FILTER_BY_PEER_AS) {
-        vm_emit(&vm, vm_makeop(FOPC_CALL, MRT_ACCUMULATE_ASES_FN));
-        vm_emit(&vm, vm_makeop(FOPC_ASCONTAINS, K_PEER_AS));
-        vm_emit(&vm, FOPC_NOT);
-        vm_emit(&vm, FOPC_CFAIL);
+        vm_emit(&vm.prog, vm_makeop(FOPC_CALL, MRT_ACCUMULATE_ASES_FN));
+        vm_emit(&vm.prog, vm_makeop(FOPC_ASCONTAINS, K_PEER_AS));
+        vm_emit(&vm.prog, FOPC_NOT);
+        vm_emit(&vm.prog, FOPC_CFAIL);
     }
     if (flags & FILTER_BY_PEER_ADDR) {
-        vm_emit(&vm, vm_makeop(FOPC_CALL, MRT_ACCUMULATE_ADDRS_FN));
-        vm_emit(&vm, vm_makeop(FOPC_ADDRCONTAINS, K_PEER_ADDR));
-        vm_emit(&vm, FOPC_NOT);
-        vm_emit(&vm, FOPC_CFAIL);
+        vm_emit(&vm.prog, vm_makeop(FOPC_CALL, MRT_ACCUMULATE_ADDRS_FN));
+        vm_emit(&vm.prog, vm_makeop(FOPC_ADDRCONTAINS, K_PEER_ADDR));
+        vm_emit(&vm.prog, FOPC_NOT);
+        vm_emit(&vm.prog, FOPC_CFAIL);
     }
     if (attr_count > 0) {
-        // filter by attribute of interest
-        uint n = 0;
+        // filter by attribute of interest, the whole mask is tested at once
+        intptr_t heapptr = vm_heap_alloc(&vm.prog, sizeof(attr_mask));
+        if (unlikely(heapptr == VM_BAD_HEAP_PTR))
+            exprintf(EXIT_FAILURE, "out of memory");
 
-        vm_emit(&vm, FOPC_BLK);
-        for (uint i = 0; i < 256 && n < attr_count; i++) {
-            if (attr_mask[i >> ATTR_BITSET_SHIFT] & (1 << (i & ATTR_BITSET_MASK))) {
-                vm_emit(&vm, vm_makeop(FOPC_HASATTR, i));
-                n++;
+        memcpy(vm_prog_heap_ptr(&vm.prog, heapptr), attr_mask, sizeof(attr_mask));
 
-                if (n < attr_count)
-                    vm_emit(&vm, FOPC_CPASS);
-            }
-        }
+        int kidx = vm_newk(&vm.prog);
+        if (kidx == -1)
+            exprintf(EXIT_FAILURE, "out of memory");
 
-        vm_emit(&vm, FOPC_ENDBLK);
-        vm_emit(&vm, FOPC_NOT);
-        vm_emit(&vm, FOPC_CFAIL);
+        vm.prog.kp[kidx].base  = heapptr;
+        vm.prog.kp[kidx].elsiz = sizeof(*attr_mask);
+        vm.prog.kp[kidx].nels  = BGP_ATTRMASK_WORDS;
+
+        vm_emit_ex(&vm.prog, FOPC_HASANYATTR, kidx);
+        vm_emit(&vm.prog, FOPC_NOT);
+        vm_emit(&vm.prog, FOPC_CFAIL);
     }
     if (community_matches) {
         // filter by community, each community_match_t is ORed
-        vm_emit(&vm, FOPC_BLK);
+        vm_emit(&vm.prog, FOPC_BLK);
         for (community_match_t *i = community_matches; i; i = i->next) {
-            vm_emit(&vm, vm_makeop(FOPC_LOADK, i->kidx));
-            vm_emit(&vm, FOPC_UNPACK);
-            vm_emit(&vm, FOPC_COMMEXACT);
+            vm_emit(&vm.prog, vm_makeop(FOPC_LOADK, i->kidx));
+            vm_emit(&vm.prog, FOPC_UNPACK);
+            vm_emit(&vm.prog, FOPC_COMMEXACT);
             if (i->neg)
-                vm_emit(&vm, FOPC_NOT);
+                vm_emit(&vm.prog, FOPC_NOT);
             if (i->next)
-                vm_emit(&vm, FOPC_CPASS);
+                vm_emit(&vm.prog, FOPC_CPASS);
         }
-        vm_emit(&vm, FOPC_ENDBLK);
-        vm_emit(&vm, FOPC_NOT);
-        vm_emit(&vm, FOPC_CFAIL);
+        vm_emit(&vm.prog, FOPC_ENDBLK);
+        vm_emit(&vm.prog, FOPC_NOT);
+        vm_emit(&vm.prog, FOPC_CFAIL);
     }
 
     if (path_match_head) {
         // include the AS PATH filtering logic
-        vm_emit(&vm, FOPC_BLK);
+        vm_emit(&vm.prog, FOPC_BLK);
         for (as_path_match_t *i = path_match_head; i; i = i->or_next) {
             // compile the AND chain
-            vm_emit(&vm, FOPC_BLK);
+            vm_emit(&vm.prog, FOPC_BLK);
             for (as_path_match_t *j = i; j; j = j->and_next) {
                 uint access = FOPC_ACCESS_REAL_AS_PATH;
                 if (j == i)
                     access |= FOPC_ACCESS_SETTLE; // rewind the AS PATH on first test
 
-                vm_emit(&vm, vm_makeop(FOPC_LOADK, j->kidx));
-                vm_emit(&vm, FOPC_UNPACK);
-                vm_emit(&vm, vm_makeop(j->opcode, access));
+                vm_emit(&vm.prog, vm_makeop(FOPC_LOADK, j->kidx));
+                vm_emit(&vm.prog, FOPC_UNPACK);
+                vm_emit(&vm.prog, vm_makeop(j->opcode, access));
                 if (j->and_next) {  // omit the last AND term for optimization
-                    vm_emit(&vm, FOPC_NOT);
-                    vm_emit(&vm, FOPC_CFAIL);
+                    vm_emit(&vm.prog, FOPC_NOT);
+                    vm_emit(&vm.prog, FOPC_CFAIL);
                 }
             }
-            vm_emit(&vm, FOPC_ENDBLK);
+            vm_emit(&vm.prog, FOPC_ENDBLK);
             if (i->neg)
-                vm_emit(&vm, FOPC_NOT);
+                vm_emit(&vm.prog, FOPC_NOT);
 
             if (i->or_next)
-                vm_emit(&vm, FOPC_CPASS);
+                vm_emit(&vm.prog, FOPC_CPASS);
             /*
             if (i->or_next) {                // omit the conditional on last OR term
-                vm_emit(&vm, FOPC_CPASS);  // if the block was successful, the entire OR succeeded
+                vm_emit(&vm.prog, FOPC_CPASS);  // if the block was successful, the entire OR succeeded
             }*/
         }
 
-        vm_emit(&vm, FOPC_ENDBLK);
+        vm_emit(&vm.prog, FOPC_ENDBLK);
         // must fail if none of the OR clauses was satisfied
-        vm_emit(&vm, FOPC_NOT);
-        vm_emit(&vm, FOPC_CFAIL);
+        vm_emit(&vm.prog, FOPC_NOT);
+        vm_emit(&vm.prog, FOPC_CFAIL);
     }
 
     if (flags & FILTER_MASK) {
         // only one filter may be set (otherwise it's an option conflict)
-        vm_emit(&vm, vm_makeop(FOPC_SETTRIE,  trie_idx));
-        vm_emit(&vm, vm_makeop(FOPC_SETTRIE6, trie6_idx));
+        vm_emit(&vm.prog, vm_makeop(FOPC_SETTRIE,  trie_idx));
+        vm_emit(&vm.prog, vm_makeop(FOPC_SETTRIE6, trie6_idx));
+
+        // tries are complete by now, switch them to their packed layout
+        if (!patpack(&vm.prog.tries[trie_idx]) || !patpack(&vm.prog.tries[trie6_idx]))
+            exprintf(EXIT_FAILURE, "out of memory");
 
         bytecode_t opcode;
-        if (flags & FILTER_EXACT)
+        if (flags & FILTER_EXACT) {
+            // most prefixes miss, let a Bloom filter reject them early
+            if (!patbloom(&vm.prog.tries[trie_idx]) || !patbloom(&vm.prog.tries[trie6_idx]))
+                exprintf(EXIT_FAILURE, "out of memory");
+
             opcode = FOPC_EXACT;
+        }
         if (flags & FILTER_RELATED)
             opcode = FOPC_RELATED;
         if (flags & FILTER_BY_SUBNET)
@@ -511,23 +666,23 @@ static void setup_filter(void)
         if (flags & FILTER_BY_SUPERNET)
             opcode = FOPC_SUPERNET;
 
-        vm_emit(&vm, FOPC_BLK);
-        vm_emit(&vm, vm_makeop(opcode, FOPC_ACCESS_SETTLE | FOPC_ACCESS_ALL | FOPC_ACCESS_NLRI));
-        vm_emit(&vm, FOPC_CPASS);
-        vm_emit(&vm, vm_makeop(opcode, FOPC_ACCESS_SETTLE | FOPC_ACCESS_ALL | FOPC_ACCESS_WITHDRAWN));
-        vm_emit(&vm, FOPC_ENDBLK);
-        vm_emit(&vm, FOPC_NOT);
-        vm_emit(&vm, FOPC_CFAIL);
+        vm_emit(&vm.prog, FOPC_BLK);
+        vm_emit(&vm.prog, vm_makeop(opcode, FOPC_ACCESS_SETTLE | FOPC_ACCESS_ALL | FOPC_ACCESS_NLRI));
+        vm_emit(&vm.prog, FOPC_CPASS);
+        vm_emit(&vm.prog, vm_makeop(opcode, FOPC_ACCESS_SETTLE | FOPC_ACCESS_ALL | FOPC_ACCESS_WITHDRAWN));
+        vm_emit(&vm.prog, FOPC_ENDBLK);
+        vm_emit(&vm.prog, FOPC_NOT);
+        vm_emit(&vm.prog, FOPC_CFAIL);
     }
     if (flags & AS_LOOP_MASK) {
         // also call the AS loop filtering logic...
-        vm_emit(&vm, vm_makeop(FOPC_CALL, MRT_FIND_AS_LOOPS_FN));
+        vm_emit(&vm.prog, vm_makeop(FOPC_CALL, MRT_FIND_AS_LOOPS_FN));
         if (flags & KEEP_AS_LOOPS)
-            vm_emit(&vm, FOPC_NOT);
+            vm_emit(&vm.prog, FOPC_NOT);
 
-        vm_emit(&vm, FOPC_CFAIL);
+        vm_emit(&vm.prog, FOPC_CFAIL);
     }
-    vm_emit(&vm, vm_makeop(FOPC_LOAD, true));
+    vm_emit(&vm.prog, vm_makeop(FOPC_LOAD, true));
 }
 
 static bool iswildcard(char c)
@@ -636,20 +791,20 @@ static void parse_as_match_expr(const char *expr, bool negate)
         // populate AS match subexpression
         match->opcode = opcode;
         // add the AS path segment to VM heap
-        intptr_t heapptr = vm_heap_alloc(&vm, count * sizeof(*buf), VM_HEAP_PERM);
+        intptr_t heapptr = vm_heap_alloc(&vm.prog, count * sizeof(*buf));
         if (unlikely(heapptr == VM_BAD_HEAP_PTR))
             exprintf(EXIT_FAILURE, "out of memory");
 
-        memcpy(vm_heap_ptr(&vm, heapptr), buf, count * sizeof(*buf));
+        memcpy(vm_prog_heap_ptr(&vm.prog, heapptr), buf, count * sizeof(*buf));
 
         // generate a K constant with the heap array address
-        int kidx = vm_newk(&vm);
+        int kidx = vm_newk(&vm.prog);
         if (kidx == -1)
             exprintf(EXIT_FAILURE, "out of memory");
 
-        vm.kp[kidx].base  = heapptr;
-        vm.kp[kidx].elsiz = sizeof(*buf);
-        vm.kp[kidx].nels  = count;
+        vm.prog.kp[kidx].base  = heapptr;
+        vm.prog.kp[kidx].elsiz = sizeof(*buf);
+        vm.prog.kp[kidx].nels  = count;
 
         match->kidx = kidx;
         match->neg = negate;
@@ -715,20 +870,20 @@ static void parse_communities(const char *expr, bool negate)
         exprintf(EXIT_FAILURE, "out of memory");
 
     // add the community segment to VM heap
-    intptr_t heapptr = vm_heap_alloc(&vm, count * sizeof(*buf), VM_HEAP_PERM);
+    intptr_t heapptr = vm_heap_alloc(&vm.prog, count * sizeof(*buf));
     if (unlikely(heapptr == VM_BAD_HEAP_PTR))
         exprintf(EXIT_FAILURE, "out of memory");
 
-    memcpy(vm_heap_ptr(&vm, heapptr), buf, count * sizeof(*buf));
+    memcpy(vm_prog_heap_ptr(&vm.prog, heapptr), buf, count * sizeof(*buf));
 
     // generate a K constant with the heap array address
-    int kidx = vm_newk(&vm);
+    int kidx = vm_newk(&vm.prog);
     if (kidx == -1)
         exprintf(EXIT_FAILURE, "out of memory");
 
-    vm.kp[kidx].base  = heapptr;
-    vm.kp[kidx].elsiz = sizeof(*buf);
-    vm.kp[kidx].nels  = count;
+    vm.prog.kp[kidx].base  = heapptr;
+    vm.prog.kp[kidx].elsiz = sizeof(*buf);
+    vm.prog.kp[kidx].nels  = count;
 
     m->neg  = negate;
     m->kidx = kidx;
@@ -736,6 +891,276 @@ static void parse_communities(const char *expr, bool negate)
     community_matches = m;
 }
 
+// pfx2as builds a partial table out of each file, all merged into this one
+static pfx2as_t pfx2as;
+static bool     has_pfx2as = false;
+
+// same goes for AS links
+static aslinks_t aslinks;
+static bool      has_aslinks = false;
+
+static uint nerrors = 0;
+
+// addresses given to --listen
+static char  **listen_addrs  = NULL;
+static size_t  nlisten_addrs = 0;
+
+static void process_file(char *filename, follower_t *fw)
+{
+    io_rw_t io;
+    int fd;
+
+    io_rw_t *iop = NULL;
+
+    char *ext = strpathext(filename);
+    if (fw && !followcompressed(filename)) {
+        // read as the file grows
+        fd = open(filename, O_RDONLY);
+        if (fd >= 0) {
+            followio(fw, &io, fd);
+            iop = &io;
+        }
+
+    } else if (strcasecmp(ext, ".gz") == 0 || strcasecmp(ext, ".z") == 0) {
+        fd = open(filename, O_RDONLY);
+        if (fd >= 0)
+            iop = io_zopen(fd, BUFSIZ, "r");
+
+    } else if (strcasecmp(ext, ".bz2") == 0) {
+        fd = open(filename, O_RDONLY);
+        if (fd >= 0)
+            iop = io_bz2open(fd, BUFSIZ, "r");
+
+#ifdef UBGP_IO_XZ
+    } else if (strcasecmp(ext, ".xz") == 0) {
+        fd = open(filename, O_RDONLY);
+        if (fd >= 0)
+            iop = io_xzopen(fd, BUFSIZ, "r");
+#endif
+
+    } else if (strcmp(filename, "-") == 0) {
+        io_file_init(&io, stdin);
+        iop = &io;
+        fd = STDIN_FILENO;
+
+        // rename argument to (stdin) to improve logging quality
+        filename = "(stdin)";
+    } else {
+        FILE *file = fopen(filename, "rb");
+
+        fd = -1;
+        if (file) {
+            io_file_init(&io, file);
+            iop = &io;
+
+            fd = fileno(file);
+        }
+    }
+
+    if (fd == -1) {
+        eprintf("cannot open '%s':", filename);
+        nerrors++;
+        return;
+    }
+    if (!iop) {
+        eprintf("'%s': not a valid %s file", filename, ext);
+        nerrors++;
+        return;
+    }
+
+#ifdef _POSIX_ADVISORY_INFO
+    if (fd != STDIN_FILENO)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    int res;
+    if (flags & ONLY_PEERS) {
+        res = mrtprintpeeridx(filename, iop, &vm);
+    } else if (flags & PFX2AS) {
+        pfx2as_t part;
+
+        pfx2asinit(&part);
+        res = mrtpfx2as(filename, iop, &vm, &part);
+        if (!has_pfx2as) {
+            pfx2as = part;
+            has_pfx2as = true;
+        } else {
+            if (!pfx2asmerge(&pfx2as, &part))
+                exprintf(EXIT_FAILURE, "out of memory");
+
+            pfx2asdestroy(&part);
+        }
+    } else if (flags & FLAPS) {
+        res = mrtflaps(filename, iop, &vm, &flaps);
+    } else if (flags & HIJACKS) {
+        res = mrthijacks(filename, iop, &vm, &hijacks);
+    } else if (flags & STATS) {
+        res = mrtstats(filename, iop, &vm);
+    } else if (flags & ASLINKS) {
+        aslinks_t part;
+
+        aslinksinit(&part);
+        res = mrtaslinks(filename, iop, &vm, &part);
+        if (!has_aslinks) {
+            aslinks = part;
+            has_aslinks = true;
+        } else {
+            if (!aslinksmerge(&aslinks, &part))
+                exprintf(EXIT_FAILURE, "out of memory");
+
+            aslinksdestroy(&part);
+        }
+    } else {
+        res = mrtprocess(filename, iop, &vm, format);
+    }
+
+    if (res != 0)
+        nerrors++;
+
+    if (fd != STDIN_FILENO)
+        iop->close(iop);
+}
+
+static void add_listen_addr(char *s)
+{
+    char **addrs = realloc(listen_addrs, (nlisten_addrs + 1) * sizeof(*addrs));
+    if (!addrs)
+        exprintf(EXIT_FAILURE, "out of memory");
+
+    addrs[nlisten_addrs++] = s;
+    listen_addrs = addrs;
+}
+
+// open a listening TCP socket for an address in the form [ADDR]:PORT, ADDR:PORT or PORT
+static int open_listener(const char *s)
+{
+    char buf[256];
+    if (strlen(s) >= sizeof(buf))
+        exprintf(EXIT_FAILURE, "'%s': bad listening address", s);
+
+    strcpy(buf, s);
+
+    char *host = NULL;
+    char *port = strrchr(buf, ':');
+    if (port) {
+        *port++ = '\0';
+
+        host = buf;
+        size_t n = strlen(host);
+        if (n >= 2 && host[0] == '[' && host[n - 1] == ']') {
+            host[n - 1] = '\0';
+            host++;
+        }
+        if (*host == '\0')
+            host = NULL;  // any address
+    } else {
+        port = buf;
+    }
+
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = AI_PASSIVE;
+
+    int err = getaddrinfo(host, port, &hints, &res);
+    if (err != 0)
+        exprintf(EXIT_FAILURE, "'%s': %s", s, gai_strerror(err));
+
+    int fd = -1;
+    for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd == -1)
+            continue;
+
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0)
+            break;
+
+        err = errno;
+        close(fd);
+        errno = err;
+        fd = -1;
+    }
+
+    err = errno;
+    freeaddrinfo(res);
+    if (fd == -1) {
+        errno = err;
+        exprintf(EXIT_FAILURE, "cannot listen on '%s':", s);
+    }
+
+    return fd;
+}
+
+static void ingest_known(ingest_session_t *s, filter_ctx_t *ctx, void *user)
+{
+    USED(user);
+
+    ctx->known[K_PEER_AS].as = s->as;
+    memcpy(&ctx->known[K_PEER_ADDR].addr, &s->addr, sizeof(ctx->known[K_PEER_ADDR].addr));
+}
+
+static void ingest_batch(ingest_session_t *s, ubgp_msg_s *const *msgs, size_t n, void *user)
+{
+    USED(user);
+
+    // messages carry no timestamp, use the time they were received
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    const char *fmt = (format == MRT_DUMP_CHEX) ? "xF*T" : "rF*T";
+    for (size_t i = 0; i < n && !mrtlimitreached(); i++) {
+        printbgp(stdout, msgs[i], fmt, &s->addr, s->as, &now);
+        mrtcountbgp(msgs[i], format);
+    }
+}
+
+static void ingest_close(ingest_session_t *s, void *user)
+{
+    USED(user);
+
+    if (s->err != 0) {
+        errno = s->err;
+        eprintf("%s port %u: session closed:", naddrtos(&s->addr, NADDR_PLAIN), (uint) s->port);
+        nerrors++;
+    }
+}
+
+// serve --listen addresses, until an unrecoverable error occurs or --limit is reached
+static void listen_sessions(void)
+{
+    static const ingest_ops_t ops = {
+        .batch = ingest_batch,
+        .known = ingest_known,
+        .close = ingest_close
+    };
+
+    ingest_t ing;
+    if (ingestinit(&ing, &ops, NULL) != 0)
+        exprintf(EXIT_FAILURE, "cannot listen:");
+
+    ingestfilter(&ing, &vm.prog, &vm.ctx);
+    for (size_t i = 0; i < nlisten_addrs; i++) {
+        if (ingestlisten(&ing, open_listener(listen_addrs[i])) != 0)
+            exprintf(EXIT_FAILURE, "cannot listen on '%s':", listen_addrs[i]);
+    }
+
+    while (!mrtlimitreached()) {
+        int n = ingestpoll(&ing, -1);
+        if (n < 0) {
+            eprintf("cannot receive any further:");
+            nerrors++;
+            break;
+        }
+        if (n > 0)
+            fflush(stdout);
+    }
+
+    ingestdestroy(&ing);
+}
+
 int main(int argc, char **argv)
 {
     setprogramnam(argv[0]);
@@ -743,16 +1168,25 @@ int main(int argc, char **argv)
     // setup VM environment
     filter_init(&vm);
 
-    trie_idx  = vm_newtrie(&vm, AF_INET);
-    trie6_idx = vm_newtrie(&vm, AF_INET6);
+    trie_idx  = vm_newtrie(&vm.prog, AF_INET);
+    trie6_idx = vm_newtrie(&vm.prog, AF_INET6);
+
+    vm.prog.funcs[MRT_ACCUMULATE_ADDRS_FN] = mrt_accumulate_addrs;
+    vm.prog.funcs[MRT_ACCUMULATE_ASES_FN]  = mrt_accumulate_ases;
+    vm.prog.funcs[MRT_FIND_AS_LOOPS_FN] = mrt_find_as_loops;
+
+    const char *hijacks_file = NULL;
+    time_t hijack_ttl = HIJACK_DEFAULT_TTL;
+
+    double   sample_rate = 1.0;
+    uint64_t sample_seed = 0;  // pick one unless given
 
-    vm.funcs[MRT_ACCUMULATE_ADDRS_FN] = mrt_accumulate_addrs;
-    vm.funcs[MRT_ACCUMULATE_ASES_FN]  = mrt_accumulate_ases;
-    vm.funcs[MRT_FIND_AS_LOOPS_FN] = mrt_find_as_loops;
+    flap_params_t flap_params;
+    flapdefaults(&flap_params);
 
     // parse command line
     int c;
-    while ((c = getopt(argc, argv, "A:a:cdE:e:fi:I:lLm:M:o:p:P:R:r:S:s:t:T:U:u:")) != -1) {
+    while ((c = getopt_long(argc, argv, "A:a:cdE:e:fi:I:lLm:M:o:p:P:R:r:S:s:t:T:U:u:", long_options, NULL)) != -1) {
         switch (c) {
         case 'a':
             if (!add_peer_as(optarg))
@@ -774,6 +1208,77 @@ int main(int argc, char **argv)
             flags |= DBG_DUMP;
             break;
 
+        case PROFILE_OPT:
+            flags |= DBG_PROFILE;
+            break;
+
+        case PFX2AS_OPT:
+            flags |= PFX2AS;
+            break;
+
+        case ASLINKS_OPT:
+            flags |= ASLINKS;
+            break;
+
+        case ASLINKS_CSR_OPT:
+            flags |= ASLINKS | ASLINKS_CSR;
+            break;
+
+        case STATS_OPT:
+            statsinit(parse_positive(optarg, "statistics interval"), STATS_CSV);
+            flags |= STATS;
+            break;
+
+        case STATS_JSON_OPT:
+            statsinit(parse_positive(optarg, "statistics interval"), STATS_JSON);
+            flags |= STATS;
+            break;
+
+        case HIJACKS_OPT:
+            hijacks_file = optarg;
+            flags |= HIJACKS;
+            break;
+
+        case HIJACK_TTL_OPT:
+            hijack_ttl = parse_positive(optarg, "time-to-live");
+            break;
+
+        case FLAPS_OPT:
+            flags |= FLAPS;
+            break;
+
+        case FLAP_THRESHOLD_OPT:
+            flap_params.suppress = parse_positive(optarg, "flap threshold");
+            flap_params.reuse    = MIN(flap_params.reuse, flap_params.suppress);
+            break;
+
+        case FOLLOW_OPT:
+            flags |= FOLLOW;
+            break;
+
+        case LISTEN_OPT:
+            add_listen_addr(optarg);
+            flags |= LISTEN;
+            break;
+
+        case BMP_OPT:
+            flags |= BMP;
+            break;
+
+        case LIMIT_OPT:
+            mrtsetlimit(parse_positive(optarg, "limit"));
+            flags |= LIMIT;
+            break;
+
+        case SAMPLE_OPT:
+            sample_rate = parse_rate(optarg);
+            flags |= SAMPLE;
+            break;
+
+        case SAMPLE_SEED_OPT:
+            sample_seed = parse_positive(optarg, "sampling seed");
+            break;
+
         case 'o':
             if (!freopen(optarg, "w", stdout))
                 exprintf(EXIT_FAILURE, "cannot open '%s':", optarg);
@@ -873,11 +1378,72 @@ int main(int argc, char **argv)
         }
     }
 
+    // each file is read once, by a single analysis
+    uint modes = flags & (ONLY_PEERS | PFX2AS | ASLINKS | STATS | HIJACKS | FLAPS);
+    if (modes & (modes - 1))
+        exprintf(EXIT_FAILURE, "only one of -f, --pfx2as, --aslinks, --stats, --hijacks or --flaps may be given");
+
+    if (flags & FOLLOW) {
+        if (optind == argc)
+            exprintf(EXIT_FAILURE, "--follow requires a file or directory");
+        if (flags & (PFX2AS | ASLINKS))
+            exprintf(EXIT_FAILURE, "--follow never ends, so it can't be used along with --pfx2as or --aslinks");
+    }
+
+    if (flags & LISTEN) {
+        if (optind != argc || (flags & FOLLOW))
+            exprintf(EXIT_FAILURE, "--listen can't be used along with files");
+        if (flags & (ONLY_PEERS | PFX2AS | ASLINKS | STATS | HIJACKS | FLAPS))
+            exprintf(EXIT_FAILURE, "--listen only prints messages, so it can't be used along with -f, --pfx2as, --aslinks, --stats, --hijacks or --flaps");
+    }
+
+    if (flags & BMP) {
+        if (flags & LISTEN)
+            exprintf(EXIT_FAILURE, "--listen expects BGP messages, so it can't be used along with --bmp");
+        if (flags & (ONLY_PEERS | PFX2AS))
+            exprintf(EXIT_FAILURE, "BMP streams carry no RIBs, so --bmp can't be used along with -f or --pfx2as");
+
+        mrtsetbmp(true);
+    }
+
+    if (flags & LIMIT) {
+        if (flags & (ONLY_PEERS | PFX2AS | ASLINKS | STATS))
+            exprintf(EXIT_FAILURE, "--limit only applies to printed messages and events, so it can't be used along with -f, --pfx2as, --aslinks or --stats");
+    }
+
+    if (flags & SAMPLE) {
+        if (flags & LISTEN)
+            exprintf(EXIT_FAILURE, "--sample only applies to files, so it can't be used along with --listen");
+
+        if (sample_seed == 0) {
+            struct timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+
+            sample_seed = ((uint64_t) now.tv_sec << 32) ^ (uint64_t) now.tv_nsec ^ (uint64_t) getpid();
+        }
+
+        mrtsetsample(sample_rate, sample_seed);
+    }
+
+    if (flags & HIJACKS) {
+        // time-to-live may come after the file, so wait for every option
+        hijackinit(&hijacks, hijack_ttl);
+        parse_file(hijacks_file, add_monitored_prefix);
+    }
+
+    if (flags & FLAPS)
+        flapinit(&flaps, &flap_params);
+
     setup_filter();
-    if (flags & DBG_DUMP)
+    if (flags & DBG_PROFILE) {
+        // bytecode is dumped along with the profile when we're done
+        if (filter_profile_enable(&vm.ctx) != 0)
+            exprintf(EXIT_FAILURE, "out of memory");
+    } else if (flags & DBG_DUMP) {
         filter_dump(stderr, &vm);
+    }
 
-    if (optind == argc) {
+    if (optind == argc && (flags & LISTEN) == 0) {
         // no file arguments, process stdin
         // we apply an innocent trick to simulate a "-" argument
         // NOTE argv will *NOT* be NULL terminated anymore
@@ -886,83 +1452,58 @@ int main(int argc, char **argv)
     }
 
     // apply to required files
-    uint nerrors = 0;
-    for (int i = optind; i < argc; i++) {
-        io_rw_t io;
-        int fd;
-
-        io_rw_t *iop = NULL;
-
-        char *ext = strpathext(argv[i]);
-        if (strcasecmp(ext, ".gz") == 0 || strcasecmp(ext, ".z") == 0) {
-            fd = open(argv[i], O_RDONLY);
-            if (fd >= 0)
-                iop = io_zopen(fd, BUFSIZ, "r");
-
-        } else if (strcasecmp(ext, ".bz2") == 0) {
-            fd = open(argv[i], O_RDONLY);
-            if (fd >= 0)
-                iop = io_bz2open(fd, BUFSIZ, "r");
-
-#ifdef UBGP_IO_XZ
-        } else if (strcasecmp(ext, ".xz") == 0) {
-            fd = open(argv[i], O_RDONLY);
-            if (fd >= 0)
-                iop = io_xzopen(fd, BUFSIZ, "r");
-#endif
+    int last = argc;
+    if (flags & FOLLOW)
+        last--;  // followed separately
 
-        } else if (strcmp(argv[i], "-") == 0) {
-            io_file_init(&io, stdin);
-            iop = &io;
-            fd = STDIN_FILENO;
+    for (int i = optind; i < last && !mrtlimitreached(); i++)
+        process_file(argv[i], NULL);
 
-            // rename argument to (stdin) to improve logging quality
-            argv[i] = "(stdin)";
-        } else {
-            FILE *file = fopen(argv[i], "rb");
+    if ((flags & FOLLOW) && !mrtlimitreached()) {
+        follower_t fw;
+        if (followinit(&fw, argv[last]) != 0)
+            exprintf(EXIT_FAILURE, "cannot follow '%s':", argv[last]);
 
-            fd = -1;
-            if (file) {
-                io_file_init(&io, file);
-                iop = &io;
-
-                fd = fileno(file);
-            }
-        }
+        char *filename;
+        while (!mrtlimitreached() && (filename = follownext(&fw)) != NULL)
+            process_file(filename, &fw);
 
-        if (fd == -1) {
-            eprintf("cannot open '%s':", argv[i]);
+        if (fw.err != 0) {
+            errno = fw.err;
+            eprintf("%s: cannot follow any further:", argv[last]);
             nerrors++;
-            continue;
-        }
-        if (!iop) {
-            eprintf("'%s': not a valid %s file", argv[i], ext);
-            nerrors++;
-            continue;
         }
 
-#ifdef _POSIX_ADVISORY_INFO
-        if (fd != STDIN_FILENO)
-            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
-#endif
+        followdestroy(&fw);
+    }
+    if (flags & LISTEN)
+        listen_sessions();
 
-        int res;
-        if (flags & ONLY_PEERS)
-            res = mrtprintpeeridx(argv[i], iop, &vm);
-        else
-            res = mrtprocess(argv[i], iop, &vm, format);
+    if (has_pfx2as) {
+        mrtprintpfx2as(&pfx2as);
+        pfx2asdestroy(&pfx2as);
+    }
+    if (flags & FLAPS)
+        flapdestroy(&flaps);
+    if (flags & HIJACKS)
+        hijackdestroy(&hijacks);
+    if (flags & STATS)
+        mrtprintstats();
+    if (has_aslinks) {
+        mrtprintaslinks(&aslinks, (flags & ASLINKS_CSR) != 0);
+        aslinksdestroy(&aslinks);
+    }
 
-        if (res != 0)
-            nerrors++;
+    mrtcleanup();
 
-        if (fd != STDIN_FILENO)
-            iop->close(iop);
-    }
+    if (flags & DBG_PROFILE)
+        filter_dump(stderr, &vm);
 
     // cleanup and exit
     filter_destroy(&vm);
     free(peer_ases);
     free(peer_addrs);
+    free(listen_addrs);
     while (path_match_head) {
         as_path_match_t *t = path_match_head;
         while (t->and_next) {
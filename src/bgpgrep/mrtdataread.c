@@ -20,12 +20,17 @@
  */
 
 #include "../ubgp/bgp.h"
+#include "../ubgp/bmp.h"
 #include "../ubgp/dumppacket.h"
+#include "../ubgp/endian.h"
 #include "../ubgp/filterintrin.h"
 #include "../ubgp/hexdump.h"
 #include "../ubgp/mrt.h"
+#include "../ubgp/patriciatrie.h"
+#include "../ubgp/strutil.h"
 
 #include "mrtdataread.h"
+#include "mrtstats.h"
 #include "progutil.h"
 
 #include <errno.h>
@@ -58,6 +63,257 @@ static uint32_t peerrefs[MAX_PEERREF_BITSET_SIZE];
 // packets used during analysis
 static umrt_msg_s curmrt, curpi;
 static ubgp_msg_s curbgp;
+static ubmp_msg_s curbmp;
+
+// read BMP messages rather than MRT records, see mrtsetbmp()
+static bool bmpinput;
+
+// ADD-PATH state of BMP monitored peers, by peer identifier, learnt from Peer Up
+static bool    *bmpaddpath;
+static uint32_t bmpaddpathsiz;
+
+// origins table, only used with MRT_PFX2AS
+static pfx2as_t *curpfx2as;
+
+// links table, only used with MRT_ASLINKS
+static aslinks_t *curaslinks;
+
+// hijack detector, only used with MRT_HIJACKS
+static hijack_detector_t *curhijacks;
+
+// flap tracking table, only used with MRT_FLAPS
+static flap_table_t *curflaps;
+
+// rows left to print, only meaningful if limitrows is set, see mrtsetlimit()
+static bool   limitrows;
+static ullong rowsleft;
+
+// sampling threshold and generator state, see mrtsetsample()
+static bool     samplerecs;
+static uint64_t samplethres;
+static uint64_t samplestate;
+
+// peer identifiers by address, used with MRT_PFX2AS, MRT_ASLINKS, MRT_STATS and MRT_FLAPS
+static patricia_trie_t peerids[2];
+static uint32_t        npeerids;
+
+static uint32_t getpeerid(const netaddr_t *addr)
+{
+    if (npeerids == 0) {
+        patinit(&peerids[0], AF_INET);
+        patinit(&peerids[1], AF_INET6);
+    }
+
+    trienode_t *n = patinsert(&peerids[addr->family == AF_INET6], addr, NULL);
+    if (unlikely(!n))
+        exprintf(EXIT_FAILURE, "out of memory");
+
+    // payload holds the identifier plus one, so NULL marks a new peer
+    if (!n->payload)
+        n->payload = (void *) (uintptr_t) ++npeerids;
+
+    return (uint32_t) (uintptr_t) n->payload - 1;
+}
+
+
+static bool limitreached(void)
+{
+    return limitrows && rowsleft == 0;
+}
+
+static void countrow(void)
+{
+    if (limitrows)
+        rowsleft--;
+}
+
+// account for a message dumped by printbgp(), rows only report updates
+static void countbgp(ubgp_msg_s *msg, mrt_dump_fmt_t format)
+{
+    if (format == MRT_DUMP_CHEX || getbgptype(msg) == BGP_UPDATE)
+        countrow();
+}
+
+static uint64_t nextrandom(void)
+{
+    // splitmix64
+    uint64_t x = (samplestate += 0x9e3779b97f4a7c15ull);
+
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+// Bernoulli trial for a record carrying routes, false if it should be skipped
+static bool sampled(void)
+{
+    return !samplerecs || nextrandom() < samplethres;
+}
+
+// true for records which carry routes, others are always processed
+static bool issampled(const mrt_header_t *hdr)
+{
+    switch (hdr->type) {
+    case MRT_BGP:
+        return hdr->subtype == MRT_BGP_UPDATE;
+    case MRT_TABLE_DUMP:
+        return true;
+    case MRT_TABLE_DUMPV2:
+        return hdr->subtype != MRT_TABLE_DUMPV2_PEER_INDEX_TABLE;
+    case MRT_BGP4MP:
+    case MRT_BGP4MP_ET:
+        return hdr->subtype != BGP4MP_STATE_CHANGE && hdr->subtype != BGP4MP_STATE_CHANGE_AS4;
+    default:
+        return false;
+    }
+}
+
+static void addaslinks(const char *filename, const netaddr_t *peer, time_t stamp)
+{
+    ubgp_err err = aslinksaddpath(curaslinks, &curbgp, getpeerid(peer), stamp);
+    if (unlikely(err == BGP_ENOMEM))
+        exprintf(EXIT_FAILURE, "out of memory");
+    if (unlikely(err != BGP_ENOERR))
+        eprintf("%s: bad AS path (%s)", filename, bgpstrerror(err));
+}
+
+static void printhijack(const hijack_event_t *ev, const netaddr_t *peer, uint32_t peeras)
+{
+    char buf[digsof(ullong) + 1];
+
+    // TYPE|TIME|PREFIX|ORIGIN|COVERING|KNOWN ORIGINS|PEER
+    fputs((ev->type == HIJACK_MOAS) ? "MOAS|" : "SUBPREFIX|", stdout);
+    fputs(ultoa(buf, NULL, ev->stamp), stdout);
+    putchar('|');
+    fputs(naddrtos(&ev->pfx, NADDR_CIDR), stdout);
+    putchar('|');
+    fputs(ultoa(buf, NULL, ev->origin), stdout);
+    putchar('|');
+    fputs(naddrtos(&ev->covering, NADDR_CIDR), stdout);
+    putchar('|');
+    for (uint i = 0; i < ev->norigins; i++) {
+        if (i > 0)
+            putchar(' ');
+
+        fputs(ultoa(buf, NULL, ev->origins[i]), stdout);
+    }
+    putchar('|');
+    fputs(naddrtos(peer, NADDR_PLAIN), stdout);
+    putchar(' ');
+    fputs(ultoa(buf, NULL, peeras), stdout);
+    putchar('\n');
+
+    // alerts are only useful as long as they're timely
+    fflush(stdout);
+}
+
+static void addhijacks(const char      *filename,
+                       const netaddr_t *peer,
+                       uint32_t         peeras,
+                       time_t           stamp,
+                       bool             report)
+{
+    as_origin_t origin;
+
+    ubgp_err err = getrealoriginas(&curbgp, &origin);
+    if (unlikely(err != BGP_ENOERR)) {
+        eprintf("%s: bad AS path (%s)", filename, bgpstrerror(err));
+        return;
+    }
+    if (origin.type != AS_SEGMENT_SEQ)
+        return;  // no origin or AS_SET, which is ambiguous anyway
+
+    const netaddr_t *pfx;
+
+    startallnlri(&curbgp);
+    while ((pfx = nextnlri(&curbgp)) != NULL) {
+        hijack_event_t events[HIJACK_EVENTS_MAX];
+
+        int n = hijackannounce(curhijacks, pfx, origin.as, stamp, events);
+        if (unlikely(n < 0))
+            exprintf(EXIT_FAILURE, "out of memory");
+
+        for (int i = 0; report && i < n && !limitreached(); i++) {
+            printhijack(&events[i], peer, peeras);
+            countrow();
+        }
+    }
+
+    err = endnlri(&curbgp);
+    if (unlikely(err != BGP_ENOERR))
+        eprintf("%s: bad NLRI (%s)", filename, bgpstrerror(err));
+}
+
+static void flaproute(uint32_t         peerid,
+                      const netaddr_t *peer,
+                      uint32_t         peeras,
+                      const void      *p,
+                      bool             withdrawn,
+                      time_t           stamp)
+{
+    char buf[digsof(ullong) + 1];
+
+    // nextnlri() and nextwithdrawn() return a netaddrap_t on ADD-PATH messages
+    uint32_t pathid = isbgpaddpath(&curbgp) ? ((const netaddrap_t *) p)->pathid : 0;
+
+    float penalty;
+    int ev = flapupdate(curflaps, peerid, p, pathid, withdrawn, stamp, &penalty);
+    if (unlikely(ev < 0))
+        exprintf(EXIT_FAILURE, "out of memory");
+    if (ev == FLAP_NONE || limitreached())
+        return;
+
+    // TYPE|TIME|PREFIX|PATH ID|PENALTY|PEER
+    fputs((ev == FLAP_SUPPRESS) ? "SUPPRESS|" : "REUSE|", stdout);
+    fputs(ultoa(buf, NULL, stamp), stdout);
+    putchar('|');
+    fputs(naddrtos(p, NADDR_CIDR), stdout);
+    putchar('|');
+    fputs(ultoa(buf, NULL, pathid), stdout);
+    putchar('|');
+    fputs(ultoa(buf, NULL, (ulong) penalty), stdout);
+    putchar('|');
+    fputs(naddrtos(peer, NADDR_PLAIN), stdout);
+    putchar(' ');
+    fputs(ultoa(buf, NULL, peeras), stdout);
+    putchar('\n');
+    countrow();
+}
+
+static void addflaps(const char *filename, filter_vm_t *vm, time_t stamp)
+{
+    const netaddr_t *peer   = &vm->ctx.known[K_PEER_ADDR].addr;
+    uint32_t         peeras = vm->ctx.known[K_PEER_AS].as;
+    uint32_t         peerid = getpeerid(peer);
+
+    const void *p;
+
+    startallwithdrawn(&curbgp);
+    while ((p = nextwithdrawn(&curbgp)) != NULL)
+        flaproute(peerid, peer, peeras, p, true, stamp);
+
+    ubgp_err err = endwithdrawn(&curbgp);
+    if (unlikely(err != BGP_ENOERR))
+        eprintf("%s: bad withdrawn (%s)", filename, bgpstrerror(err));
+
+    startallnlri(&curbgp);
+    while ((p = nextnlri(&curbgp)) != NULL)
+        flaproute(peerid, peer, peeras, p, false, stamp);
+
+    err = endnlri(&curbgp);
+    if (unlikely(err != BGP_ENOERR))
+        eprintf("%s: bad NLRI (%s)", filename, bgpstrerror(err));
+}
+
+static void addstats(filter_vm_t *vm, time_t stamp)
+{
+    const netaddr_t *addr = &vm->ctx.known[K_PEER_ADDR].addr;
+
+    statsupdate(getpeerid(addr), addr, vm->ctx.known[K_PEER_AS].as, &curbgp, stamp);
+}
 
 static ubgp_err close_bgp_packet(const char *filename)
 {
@@ -113,8 +369,8 @@ static process_result_t processbgp4mp(const char         *filename,
         return PROCESS_CORRUPTED;
     }
 
-    vm->kp[K_PEER_AS].as = bgphdr->peer_as;
-    memcpy(&vm->kp[K_PEER_ADDR].addr, &bgphdr->peer_addr, sizeof(vm->kp[K_PEER_ADDR].addr));
+    vm->ctx.known[K_PEER_AS].as = bgphdr->peer_as;
+    memcpy(&vm->ctx.known[K_PEER_ADDR].addr, &bgphdr->peer_addr, sizeof(vm->ctx.known[K_PEER_ADDR].addr));
 
     int res;
 
@@ -127,7 +383,18 @@ static process_result_t processbgp4mp(const char         *filename,
         as_size = sizeof(uint32_t);
         FALLTHROUGH;
     case BGP4MP_STATE_CHANGE:
-        printstatechange(stdout, bgphdr, "A*F*T", as_size, &vm->kp[K_PEER_ADDR].addr, vm->kp[K_PEER_AS].as, &hdr->stamp);
+        if (format == MRT_STATS) {
+            statsstatechange(getpeerid(&vm->ctx.known[K_PEER_ADDR].addr),
+                             &vm->ctx.known[K_PEER_ADDR].addr,
+                             vm->ctx.known[K_PEER_AS].as,
+                             hdr->stamp.tv_sec);
+            break;
+        }
+        if (format == MRT_ASLINKS || format == MRT_HIJACKS || format == MRT_FLAPS)
+            break;
+
+        printstatechange(stdout, bgphdr, "A*F*T", as_size, &vm->ctx.known[K_PEER_ADDR].addr, vm->ctx.known[K_PEER_AS].as, &hdr->stamp);
+        countrow();
         break;
 
     case BGP4MP_MESSAGE_AS4_ADDPATH:
@@ -166,13 +433,30 @@ static process_result_t processbgp4mp(const char         *filename,
                                        filename,
                                        filter_strerror(res));
         }
-        if (res > 0) {
+        if (res > 0 && format == MRT_ASLINKS) {
+            if (getbgptype(&curbgp) == BGP_UPDATE)
+                addaslinks(filename, &vm->ctx.known[K_PEER_ADDR].addr, hdr->stamp.tv_sec);
+
+        } else if (res > 0 && format == MRT_STATS) {
+            if (getbgptype(&curbgp) == BGP_UPDATE)
+                addstats(vm, hdr->stamp.tv_sec);
+
+        } else if (res > 0 && format == MRT_HIJACKS) {
+            if (getbgptype(&curbgp) == BGP_UPDATE)
+                addhijacks(filename, &vm->ctx.known[K_PEER_ADDR].addr, vm->ctx.known[K_PEER_AS].as, hdr->stamp.tv_sec, true);
+
+        } else if (res > 0 && format == MRT_FLAPS) {
+            if (getbgptype(&curbgp) == BGP_UPDATE)
+                addflaps(filename, vm, hdr->stamp.tv_sec);
+
+        } else if (res > 0) {
             const char *fmt = (format == MRT_DUMP_CHEX) ? "xF*T" : "rF*T";
 
             printbgp(stdout, &curbgp,
                              fmt,
-                             &vm->kp[K_PEER_ADDR].addr,
-                             vm->kp[K_PEER_AS].as, &hdr->stamp);
+                             &vm->ctx.known[K_PEER_ADDR].addr,
+                             vm->ctx.known[K_PEER_AS].as, &hdr->stamp);
+            countbgp(&curbgp, format);
         }
 
         err = close_bgp_packet(filename);
@@ -207,15 +491,15 @@ static process_result_t processzebra(const char         *filename,
         return PROCESS_CORRUPTED;
     }
 
-    vm->kp[K_PEER_AS].as = zhdr->peer_as;
-    memcpy(&vm->kp[K_PEER_ADDR].addr, &zhdr->peer_addr, sizeof(vm->kp[K_PEER_ADDR].addr));
+    vm->ctx.known[K_PEER_AS].as = zhdr->peer_as;
+    memcpy(&vm->ctx.known[K_PEER_ADDR].addr, &zhdr->peer_addr, sizeof(vm->ctx.known[K_PEER_ADDR].addr));
 
     int res;
 
     ubgp_err err = BGP_ENOERR;
     switch (hdr->subtype) {
     case MRT_BGP_STATE_CHANGE:
-        // FIXME printstatechange(stdout, bgphdr, "A*F*T", sizeof(uint16_t), &vm->kp[K_PEER_ADDR].addr, vm->kp[K_PEER_AS].as, &hdr->stamp);
+        // FIXME printstatechange(stdout, bgphdr, "A*F*T", sizeof(uint16_t), &vm->ctx.known[K_PEER_ADDR].addr, vm->ctx.known[K_PEER_AS].as, &hdr->stamp);
         break;
 
 
@@ -247,13 +531,26 @@ static process_result_t processzebra(const char         *filename,
                                    filename,
                                    filter_strerror(res));
         }
-        if (res > 0) {
+        if (res > 0 && format == MRT_ASLINKS) {
+            addaslinks(filename, &vm->ctx.known[K_PEER_ADDR].addr, hdr->stamp.tv_sec);
+
+        } else if (res > 0 && format == MRT_STATS) {
+            addstats(vm, hdr->stamp.tv_sec);
+
+        } else if (res > 0 && format == MRT_HIJACKS) {
+            addhijacks(filename, &vm->ctx.known[K_PEER_ADDR].addr, vm->ctx.known[K_PEER_AS].as, hdr->stamp.tv_sec, true);
+
+        } else if (res > 0 && format == MRT_FLAPS) {
+            addflaps(filename, vm, hdr->stamp.tv_sec);
+
+        } else if (res > 0) {
             const char *fmt = (format == MRT_DUMP_CHEX) ? "xF*T" : "rF*T";
 
             printbgp(stdout, &curbgp,
                              fmt,
-                             &vm->kp[K_PEER_ADDR].addr,
-                             vm->kp[K_PEER_AS].as, &hdr->stamp);
+                             &vm->ctx.known[K_PEER_ADDR].addr,
+                             vm->ctx.known[K_PEER_AS].as, &hdr->stamp);
+            countbgp(&curbgp, format);
         }
 
         err = close_bgp_packet(filename);
@@ -274,7 +571,7 @@ static process_result_t processzebra(const char         *filename,
 
 static bool istrivialfilter(filter_vm_t *vm)
 {
-    return vm->codesiz == 1 && vm->code[0] == vm_makeop(FOPC_LOAD, true);
+    return vm->prog.codesiz == 1 && vm->prog.code[0] == vm_makeop(FOPC_LOAD, true);
 }
 
 enum {
@@ -352,15 +649,15 @@ static process_result_t processtabledump(const char         *filename,
 
     case TABLE_DUMP_SUBTYPE_MARKER:
         startribents(&curmrt, NULL);
-        while ((rib = nextribent(&curmrt)) != NULL) {
+        while (!limitreached() && (rib = nextribent(&curmrt)) != NULL) {
             int res = true;  // assume packet passes
             bool must_close_bgp = false;
 
             // we want to avoid rebuilding a BGP packet in case we don't want to dump it
             // or we don't want to filter it (think about a peer-index dump without any filtering)
             if (format != MRT_NO_DUMP || !istrivialfilter(vm)) {
-                vm->kp[K_PEER_AS].as = rib->peer->as;
-                memcpy(&vm->kp[K_PEER_ADDR].addr, &rib->peer->addr, sizeof(vm->kp[K_PEER_ADDR].addr));
+                vm->ctx.known[K_PEER_AS].as = rib->peer->as;
+                memcpy(&vm->ctx.known[K_PEER_ADDR].addr, &rib->peer->addr, sizeof(vm->ctx.known[K_PEER_ADDR].addr));
 
                 if (rib->peer->as_size == sizeof(uint32_t))
                     ribflags |= BGPF_ASN32BIT;
@@ -391,15 +688,31 @@ static process_result_t processtabledump(const char         *filename,
             if (res > 0) {
                 // update peer index references
                 refpeeridx(rib->peer_idx);
-                // dump BGP if needed
-                if (format != MRT_NO_DUMP) {
+
+                if (format == MRT_PFX2AS) {
+                    as_origin_t origin;
+                    if (getrealoriginas(&curbgp, &origin) != BGP_ENOERR)
+                        report_bad_rib(filename, bgperror(&curbgp), rib);
+                    else if (!pfx2asadd(curpfx2as, &rib->nlri, &origin, getpeerid(&rib->peer->addr)))
+                        exprintf(EXIT_FAILURE, "out of memory");
+
+                } else if (format == MRT_ASLINKS) {
+                    addaslinks(filename, &rib->peer->addr, hdr->stamp.tv_sec);
+
+                } else if (format == MRT_HIJACKS) {
+                    // RIBs only establish the baseline
+                    addhijacks(filename, &rib->peer->addr, rib->peer->as, hdr->stamp.tv_sec, false);
+
+                } else if (format != MRT_NO_DUMP) {
+                    // dump BGP
                     const char *fmt = (format == MRT_DUMP_ROW) ? "#rF*t" : "#xF*t";
 
                     printbgp(stdout, &curbgp,
                                      fmt,
-                                     &vm->kp[K_PEER_ADDR].addr,
-                                     vm->kp[K_PEER_AS].as,
+                                     &vm->ctx.known[K_PEER_ADDR].addr,
+                                     vm->ctx.known[K_PEER_AS].as,
                                      rib->originated);
+                    countrow();
                 }
             }
 
@@ -482,17 +795,237 @@ done:
     return retval;
 }
 
+static void setbmpaddpath(uint32_t peerid, bool addpath)
+{
+    if (peerid >= bmpaddpathsiz) {
+        uint32_t siz = bmpaddpathsiz ? bmpaddpathsiz : 64;
+        while (siz <= peerid)
+            siz *= 2;
+
+        bool *p = realloc(bmpaddpath, siz * sizeof(*p));
+        if (unlikely(!p))
+            exprintf(EXIT_FAILURE, "out of memory");
+
+        memset(p + bmpaddpathsiz, 0, (siz - bmpaddpathsiz) * sizeof(*p));
+        bmpaddpath    = p;
+        bmpaddpathsiz = siz;
+    }
+
+    bmpaddpath[peerid] = addpath;
+}
+
+static process_result_t processbmppeer(const char              *filename,
+                                       const bmp_peer_header_t *ph,
+                                       filter_vm_t             *vm,
+                                       mrt_dump_fmt_t           format)
+{
+    // report Peer Up/Down as BGP4MP state changes would
+    bgp4mp_header_t bgphdr;
+    memset(&bgphdr, 0, sizeof(bgphdr));
+    bgphdr.peer_as = ph->peer_as;
+    memcpy(&bgphdr.peer_addr, &ph->peer_addr, sizeof(bgphdr.peer_addr));
+
+    uint32_t peerid = getpeerid(&ph->peer_addr);
+    if (getbmptype(&curbmp) == BMP_PEER_UP) {
+        const bmp_peer_up_t *up = getbmppeerup(&curbmp);
+        if (unlikely(!up)) {
+            eprintf("%s: corrupted BMP Peer Up (%s)",
+                    filename,
+                    bmpstrerror(bmperror(&curbmp)));
+            return PROCESS_BAD;
+        }
+
+        setbmpaddpath(peerid, (up->bgpflags & BGPF_ADDPATH) != 0);
+
+        memcpy(&bgphdr.local_addr, &up->local_addr, sizeof(bgphdr.local_addr));
+        bgphdr.old_state = BGP_FSM_OPENCONFIRM;
+        bgphdr.new_state = BGP_FSM_ESTABLISHED;
+    } else {
+        if (unlikely(!getbmppeerdown(&curbmp))) {
+            eprintf("%s: corrupted BMP Peer Down (%s)",
+                    filename,
+                    bmpstrerror(bmperror(&curbmp)));
+            return PROCESS_BAD;
+        }
+
+        setbmpaddpath(peerid, false);
+
+        bgphdr.old_state = BGP_FSM_ESTABLISHED;
+        bgphdr.new_state = BGP_FSM_IDLE;
+    }
+
+    if (format == MRT_STATS) {
+        statsstatechange(peerid, &ph->peer_addr, ph->peer_as, ph->stamp.tv_sec);
+        return PROCESS_SUCCESS;
+    }
+    if (format == MRT_ASLINKS || format == MRT_HIJACKS || format == MRT_FLAPS)
+        return PROCESS_SUCCESS;
+
+    printstatechange(stdout, &bgphdr, "A*F*T", (int) sizeof(uint32_t), &vm->ctx.known[K_PEER_ADDR].addr, vm->ctx.known[K_PEER_AS].as, &ph->stamp);
+    countrow();
+    return PROCESS_SUCCESS;
+}
+
+static process_result_t processbmp(const char     *filename,
+                                   filter_vm_t    *vm,
+                                   mrt_dump_fmt_t  format)
+{
+    int type = getbmptype(&curbmp);
+    switch (type) {
+    case BMP_ROUTE_MONITORING:
+        if (!sampled())
+            return PROCESS_SUCCESS;  // only framed
+
+        break;
+
+    case BMP_PEER_DOWN:
+    case BMP_PEER_UP:
+        break;
+
+    case BMP_STATS_REPORT:
+    case BMP_INITIATION:
+    case BMP_TERMINATION:
+    case BMP_ROUTE_MIRRORING:
+        return PROCESS_SUCCESS;  // nothing to filter
+
+    default:
+        // skip message, but not necessarily wrong
+        eprintf("%s: unhandled BMP message of type: %#x", filename, (uint) type);
+        return PROCESS_SUCCESS;
+    }
+
+    const bmp_peer_header_t *ph = getbmppeerheader(&curbmp);
+    if (unlikely(!ph)) {
+        eprintf("%s: corrupted BMP per-peer header (%s)",
+                filename,
+                bmpstrerror(bmperror(&curbmp)));
+        return PROCESS_BAD;
+    }
+
+    vm->ctx.known[K_PEER_AS].as = ph->peer_as;
+    memcpy(&vm->ctx.known[K_PEER_ADDR].addr, &ph->peer_addr, sizeof(vm->ctx.known[K_PEER_ADDR].addr));
+
+    if (type != BMP_ROUTE_MONITORING)
+        return processbmppeer(filename, ph, vm, format);
+
+    uint32_t peerid = getpeerid(&ph->peer_addr);
+    uint flags = (peerid < bmpaddpathsiz && bmpaddpath[peerid]) ? BGPF_ADDPATH : 0;
+
+    ubmp_err err = unwrapbmp(&curbmp, &curbgp, flags);
+    if (unlikely(err != BMP_ENOERR)) {
+        eprintf("%s: corrupted BMP Route Monitoring (%s)",
+                filename,
+                bmpstrerror(err));
+        return PROCESS_BAD;
+    }
+
+    int res = bgp_filter(&curbgp, vm);
+    if (res < 0 && res != VM_BAD_PACKET)
+        exprintf(EXIT_FAILURE, "%s: unexpected filter failure (%s)",
+                               filename,
+                               filter_strerror(res));
+
+    if (res > 0 && format == MRT_ASLINKS) {
+        addaslinks(filename, &vm->ctx.known[K_PEER_ADDR].addr, ph->stamp.tv_sec);
+    } else if (res > 0 && format == MRT_STATS) {
+        addstats(vm, ph->stamp.tv_sec);
+    } else if (res > 0 && format == MRT_HIJACKS) {
+        addhijacks(filename, &vm->ctx.known[K_PEER_ADDR].addr, vm->ctx.known[K_PEER_AS].as, ph->stamp.tv_sec, true);
+    } else if (res > 0 && format == MRT_FLAPS) {
+        addflaps(filename, vm, ph->stamp.tv_sec);
+    } else if (res > 0) {
+        const char *fmt = (format == MRT_DUMP_CHEX) ? "xF*T" : "rF*T";
+
+        printbgp(stdout, &curbgp,
+                         fmt,
+                         &vm->ctx.known[K_PEER_ADDR].addr,
+                         vm->ctx.known[K_PEER_AS].as, &ph->stamp);
+        countbgp(&curbgp, format);
+    }
+
+    if (unlikely(close_bgp_packet(filename) != BGP_ENOERR))
+        return PROCESS_BAD;
+
+    return PROCESS_SUCCESS;
+}
+
+static int bmpprocess(const char     *filename,
+                      io_rw_t        *rw,
+                      filter_vm_t    *vm,
+                      mrt_dump_fmt_t  format)
+{
+    int retval = 0;
+    while (!limitreached()) {
+        ubmp_err err = setbmpreadfrom(&curbmp, rw);
+        if (err == BMP_EIO)
+            break;
+        if (unlikely(err != BMP_ENOERR)) {
+            // message boundaries are lost, can't resynchronize
+            eprintf("%s: corrupted BMP message: %s, skipping rest of file", filename, bmpstrerror(err));
+            retval = -1;
+            break;
+        }
+
+        process_result_t result = processbmp(filename, vm, format);
+        bmpclose(&curbmp);
+
+        if (result != PROCESS_SUCCESS)
+            retval = -1;  // propagate error to the caller
+        if (unlikely(result == PROCESS_CORRUPTED))
+            break;
+    }
+
+    if (rw->error(rw)) {
+        eprintf("%s: read error or corrupted data, skipping rest of file", filename);
+        retval = -1;
+    }
+
+    return retval;
+}
+
+void mrtsetbmp(bool bmp)
+{
+    bmpinput = bmp;
+}
+
+void mrtsetlimit(ullong n)
+{
+    limitrows = true;
+    rowsleft  = n;
+}
+
+void mrtcountbgp(ubgp_msg_s *msg, mrt_dump_fmt_t format)
+{
+    countbgp(msg, format);
+}
+
+bool mrtlimitreached(void)
+{
+    return limitreached();
+}
+
+void mrtsetsample(double rate, uint64_t seed)
+{
+    // rate is a fraction of 2^64, keep every record if it doesn't fit
+    samplerecs  = rate < 1.0;
+    samplethres = samplerecs ? (uint64_t) (rate * 0x1p64) : UINT64_MAX;
+    samplestate = seed;
+}
+
 int mrtprocess(const char     *filename,
                io_rw_t        *rw,
                filter_vm_t    *vm,
                mrt_dump_fmt_t  format)
 {
+    if (bmpinput)
+        return bmpprocess(filename, rw, vm, format);
+
     seen_ribpi = false;
     pkgseq     = 0;
     // don't care about peerrefs
 
     int retval = 0;
-    while (true) {
+    while (!limitreached()) {
         bool prev_seen_rib_pi = seen_ribpi;
 
         umrt_err err = setmrtreadfrom(&curmrt, rw);
@@ -507,7 +1040,11 @@ int mrtprocess(const char     *filename,
         const mrt_header_t *hdr = getmrtheader(&curmrt);
 
         process_result_t result = PROCESS_BAD;  // assume bad record unless stated otherwise
-        if (hdr != NULL) {
+        if (hdr != NULL && issampled(hdr) && !sampled()) {
+            result = PROCESS_SUCCESS;  // only framed
+        } else if (hdr != NULL && format == MRT_PFX2AS && hdr->type != MRT_TABLE_DUMP && hdr->type != MRT_TABLE_DUMPV2) {
+            result = PROCESS_SUCCESS;  // only RIBs carry origins
+        } else if (hdr != NULL) {
             switch (hdr->type) {
             case MRT_BGP:
                 result = processzebra(filename, hdr, vm, format);
@@ -515,6 +1052,11 @@ int mrtprocess(const char     *filename,
 
             case MRT_TABLE_DUMP:
             case MRT_TABLE_DUMPV2:
+                if (format == MRT_STATS || format == MRT_FLAPS) {
+                    result = PROCESS_SUCCESS;  // RIBs carry no update activity
+                    break;
+                }
+
                 result = processtabledump(filename, hdr, vm, format);
                 break;
 
@@ -555,3 +1097,169 @@ int mrtprocess(const char     *filename,
 
     return retval;
 }
+
+int mrtpfx2as(const char  *filename,
+              io_rw_t     *rw,
+              filter_vm_t *vm,
+              pfx2as_t    *tab)
+{
+    curpfx2as = tab;
+    int retval = mrtprocess(filename, rw, vm, MRT_PFX2AS);
+    curpfx2as = NULL;
+
+    return retval;
+}
+
+void mrtprintpfx2as(pfx2as_t *tab)
+{
+    char buf[digsof(ulong) + 1];
+
+    pfx2as_iterator_t it;
+    pfx2asiterinit(&it, tab);
+
+    const netaddr_t *pfx;
+    const pfx2as_origin_t *origins;
+    size_t n;
+    while ((pfx = pfx2asiternext(&it, &origins, &n)) != NULL) {
+        // one PREFIX|ORIGIN|PEERS row per origin
+        const char *pfxstr = naddrtos(pfx, NADDR_CIDR);
+        for (size_t i = 0; i < n; i++) {
+            fputs(pfxstr, stdout);
+            putchar('|');
+
+            if (origins[i].isset) {
+                size_t count;
+                const uint32_t *set = pfx2asset(tab, origins[i].as, &count);
+
+                putchar('{');
+                for (size_t j = 0; j < count; j++) {
+                    if (j > 0)
+                        putchar(',');
+
+                    fputs(ultoa(buf, NULL, set[j]), stdout);
+                }
+                putchar('}');
+            } else {
+                fputs(ultoa(buf, NULL, origins[i].as), stdout);
+            }
+
+            putchar('|');
+            fputs(ultoa(buf, NULL, origins[i].npeers), stdout);
+            putchar('\n');
+        }
+    }
+}
+
+int mrtaslinks(const char  *filename,
+               io_rw_t     *rw,
+               filter_vm_t *vm,
+               aslinks_t   *tab)
+{
+    curaslinks = tab;
+    int retval = mrtprocess(filename, rw, vm, MRT_ASLINKS);
+    curaslinks = NULL;
+
+    return retval;
+}
+
+static void putbe32(uint32_t v)
+{
+    v = beswap32(v);
+    fwrite(&v, sizeof(v), 1, stdout);
+}
+
+void mrtprintaslinks(aslinks_t *tab, bool csr)
+{
+    size_t n;
+    aslink_t *links = aslinkslist(tab, &n);
+    if (unlikely(!links && n > 0))
+        exprintf(EXIT_FAILURE, "out of memory");
+
+    if (csr) {
+        // "ASLK", version, vertexes and adjacency count, followed by
+        // the AS, offset and adjacency arrays, all big endian
+        aslinks_csr_t g;
+        if (unlikely(!aslinkscsr(&g, links, n)))
+            exprintf(EXIT_FAILURE, "out of memory");
+
+        fputs("ASLK", stdout);
+        putbe32(1);
+        putbe32(g.nverts);
+        putbe32(g.nadj);
+        for (size_t i = 0; i < g.nverts; i++)
+            putbe32(g.ases[i]);
+        for (size_t i = 0; i <= g.nverts; i++)
+            putbe32(g.offs[i]);
+        for (size_t i = 0; i < g.nadj; i++)
+            putbe32(g.adj[i]);
+
+        aslinksfreecsr(&g);
+    } else {
+        char buf[digsof(ulong) + 1];
+
+        // one AS1|AS2|FIRST|LAST|PEERS row per link
+        for (size_t i = 0; i < n; i++) {
+            fputs(ultoa(buf, NULL, links[i].a), stdout);
+            putchar('|');
+            fputs(ultoa(buf, NULL, links[i].b), stdout);
+            putchar('|');
+            fputs(ultoa(buf, NULL, links[i].first), stdout);
+            putchar('|');
+            fputs(ultoa(buf, NULL, links[i].last), stdout);
+            putchar('|');
+            fputs(ultoa(buf, NULL, links[i].npeers), stdout);
+            putchar('\n');
+        }
+    }
+
+    free(links);
+}
+
+int mrtstats(const char  *filename,
+             io_rw_t     *rw,
+             filter_vm_t *vm)
+{
+    return mrtprocess(filename, rw, vm, MRT_STATS);
+}
+
+void mrtprintstats(void)
+{
+    statsflush();
+}
+
+int mrthijacks(const char        *filename,
+               io_rw_t           *rw,
+               filter_vm_t       *vm,
+               hijack_detector_t *det)
+{
+    curhijacks = det;
+    int retval = mrtprocess(filename, rw, vm, MRT_HIJACKS);
+    curhijacks = NULL;
+
+    return retval;
+}
+
+int mrtflaps(const char   *filename,
+             io_rw_t      *rw,
+             filter_vm_t  *vm,
+             flap_table_t *tab)
+{
+    curflaps = tab;
+    int retval = mrtprocess(filename, rw, vm, MRT_FLAPS);
+    curflaps = NULL;
+
+    return retval;
+}
+
+void mrtcleanup(void)
+{
+    if (npeerids > 0) {
+        patdestroy(&peerids[0]);
+        patdestroy(&peerids[1]);
+        npeerids = 0;
+    }
+
+    free(bmpaddpath);
+    bmpaddpath    = NULL;
+    bmpaddpathsiz = 0;
+}
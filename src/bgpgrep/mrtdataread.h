@@ -22,8 +22,12 @@
 #ifndef UBGP_MRTDATAREAD_H_
 #define UBGP_MRTDATAREAD_H_
 
+#include "../ubgp/aslinks.h"
 #include "../ubgp/filterpacket.h"
+#include "../ubgp/flap.h"
+#include "../ubgp/hijack.h"
 #include "../ubgp/io.h"
+#include "../ubgp/pfx2as.h"
 
 enum {
     K_PEER_AS,
@@ -41,12 +45,69 @@ enum {
 typedef enum {
     MRT_NO_DUMP   = '\0',
     MRT_DUMP_CHEX = 'x',
-    MRT_DUMP_ROW  = 'r'
+    MRT_DUMP_ROW  = 'r',
+    MRT_PFX2AS    = 'a',  // aggregate prefix origins rather than dumping, see mrtpfx2as()
+    MRT_ASLINKS   = 'l',  // extract AS links rather than dumping, see mrtaslinks()
+    MRT_STATS     = 's',  // collect per peer statistics rather than dumping, see mrtstats()
+    MRT_HIJACKS   = 'h',  // print hijack events rather than dumping, see mrthijacks()
+    MRT_FLAPS     = 'f'   // print flapping routes rather than dumping, see mrtflaps()
 } mrt_dump_fmt_t;
 
+// treat input as a stream of BMP messages rather than MRT records, Route
+// Monitoring messages are processed as BGP4MP updates and Peer Up/Down
+// as state changes, BMP input carries no RIBs, so mrtpfx2as() and
+// mrtprintpeeridx() are not affected
+void mrtsetbmp(bool bmp);
+
+// stop reading input once n more messages, RIB entries or events are printed,
+// processing functions return early as soon as mrtlimitreached() holds
+void mrtsetlimit(ullong n);
+
+// account for a message printed by printbgp() outside of this module
+void mrtcountbgp(ubgp_msg_s *msg, mrt_dump_fmt_t format);
+
+bool mrtlimitreached(void);
+
+// process each record carrying routes with probability rate, seeding
+// the generator with seed, skipped records are only framed,
+// TABLE_DUMPV2 is sampled by RIB record, so each prefix keeps all its
+// entries, PEER_INDEX_TABLE records and state changes are always processed
+void mrtsetsample(double rate, uint64_t seed);
+
 int mrtprintpeeridx(const char *filename, io_rw_t *rw, filter_vm_t *vm);
 
 int mrtprocess(const char *filename, io_rw_t *rw, filter_vm_t *vm, mrt_dump_fmt_t format);
 
+// aggregate the origins of RIB entries passing the filter into tab, update messages are skipped,
+// peers are identified consistently across calls, so tables can be merged
+int mrtpfx2as(const char *filename, io_rw_t *rw, filter_vm_t *vm, pfx2as_t *tab);
+
+void mrtprintpfx2as(pfx2as_t *tab);
+
+// collect the AS links of RIB entries and updates passing the filter into tab,
+// peers are identified consistently across calls, so tables can be merged
+int mrtaslinks(const char *filename, io_rw_t *rw, filter_vm_t *vm, aslinks_t *tab);
+
+// print tab as an edge list, or as a binary CSR graph if csr is true
+void mrtprintaslinks(aslinks_t *tab, bool csr);
+
+// account updates and state changes passing the filter into the statistics
+// started by statsinit(), RIB entries are skipped
+int mrtstats(const char *filename, io_rw_t *rw, filter_vm_t *vm);
+
+// print the last statistics bucket, see statsflush()
+void mrtprintstats(void);
+
+// feed routes passing the filter to det, RIB entries silently build the baseline,
+// while update messages print events as soon as they're raised
+int mrthijacks(const char *filename, io_rw_t *rw, filter_vm_t *vm, hijack_detector_t *det);
+
+// track routes of the updates passing the filter in tab, printing the ones
+// starting or ceasing to flap as soon as they do, RIB entries are skipped
+int mrtflaps(const char *filename, io_rw_t *rw, filter_vm_t *vm, flap_table_t *tab);
+
+// release state shared among files, once every file is processed
+void mrtcleanup(void);
+
 #endif
 
@@ -0,0 +1,239 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * bgpgrep is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * bgpgrep is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with bgpgrep.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#include "../ubgp/bloom.h"
+#include "../ubgp/branch.h"
+#include "../ubgp/hll.h"
+
+#include "mrtstats.h"
+#include "progutil.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    STATS_HIST_BINS = 8  // seconds with 1, 2-3, 4-7, ... 128+ updates
+};
+
+typedef struct {
+    netaddr_t addr;
+    uint32_t  as;
+    bool      active;        // seen during the current bucket
+    ullong    updates, announced, withdrawn, statechanges;
+    ullong    pathlen, npaths;
+    hll_t     prefixes;      // distinct prefixes announced or withdrawn
+    time_t    cursec;        // second being counted for the rate histogram
+    ullong    persec;        // updates during cursec
+    ullong    hist[STATS_HIST_BINS];
+} peerstats_t;
+
+static peerstats_t *peers;
+static uint32_t     npeers;
+
+static time_t      interval;
+static time_t      curbucket;
+static bool        hasbucket, hasheader;
+static stats_fmt_t outfmt;
+
+void statsinit(time_t secs, stats_fmt_t fmt)
+{
+    interval  = secs;
+    outfmt    = fmt;
+    hasbucket = false;
+    hasheader = false;
+}
+
+static void closesecond(peerstats_t *p)
+{
+    if (p->persec == 0)
+        return;
+
+    uint bin = bsr64(p->persec) - 1;
+    p->hist[MIN(bin, STATS_HIST_BINS - 1u)]++;
+    p->persec = 0;
+}
+
+static void printcsv(const peerstats_t *p, double avgpath)
+{
+    if (!hasheader) {
+        puts("time,peer,as,updates,announcements,withdrawals,prefixes,avg_path_len,state_changes,rate_hist");
+        hasheader = true;
+    }
+
+    printf("%lld,%s,%lu,%llu,%llu,%llu,%llu,%.2f,%llu,",
+           (long long) curbucket, naddrtos(&p->addr, NADDR_PLAIN), (ulong) p->as,
+           p->updates, p->announced, p->withdrawn,
+           (ullong) hllcount(&p->prefixes), avgpath, p->statechanges);
+
+    for (int i = 0; i < STATS_HIST_BINS; i++)
+        printf((i > 0) ? ";%llu" : "%llu", p->hist[i]);
+
+    putchar('\n');
+}
+
+static void printjson(const peerstats_t *p, double avgpath)
+{
+    printf("{\"time\":%lld,\"peer\":\"%s\",\"as\":%lu,\"updates\":%llu,"
+           "\"announcements\":%llu,\"withdrawals\":%llu,\"prefixes\":%llu,"
+           "\"avg_path_len\":%.2f,\"state_changes\":%llu,\"rate_hist\":[",
+           (long long) curbucket, naddrtos(&p->addr, NADDR_PLAIN), (ulong) p->as,
+           p->updates, p->announced, p->withdrawn,
+           (ullong) hllcount(&p->prefixes), avgpath, p->statechanges);
+
+    for (int i = 0; i < STATS_HIST_BINS; i++)
+        printf((i > 0) ? ",%llu" : "%llu", p->hist[i]);
+
+    puts("]}");
+}
+
+static void printbucket(void)
+{
+    for (uint32_t i = 0; i < npeers; i++) {
+        peerstats_t *p = &peers[i];
+        if (!p->active)
+            continue;
+
+        closesecond(p);
+
+        double avgpath = (p->npaths > 0) ? (double) p->pathlen / p->npaths : 0.0;
+        if (outfmt == STATS_JSON)
+            printjson(p, avgpath);
+        else
+            printcsv(p, avgpath);
+
+        p->active = false;
+    }
+}
+
+static peerstats_t *getpeerstats(uint32_t peer, const netaddr_t *addr, uint32_t as, time_t stamp)
+{
+    // close the current bucket as soon as a record falls out of it,
+    // input is expected in chronological order
+    time_t bucket = stamp - stamp % interval;
+    if (hasbucket && bucket != curbucket)
+        printbucket();
+
+    curbucket = bucket;
+    hasbucket = true;
+
+    if (peer >= npeers) {
+        uint32_t n = MAX(peer + 1, 2 * npeers);
+
+        peerstats_t *p = realloc(peers, n * sizeof(*p));
+        if (unlikely(!p))
+            exprintf(EXIT_FAILURE, "out of memory");
+
+        memset(&p[npeers], 0, (n - npeers) * sizeof(*p));
+        peers  = p;
+        npeers = n;
+    }
+
+    peerstats_t *p = &peers[peer];
+    if (!p->prefixes.regs && !hllinit(&p->prefixes, HLL_DEFAULT_PRECISION))
+        exprintf(EXIT_FAILURE, "out of memory");
+
+    if (!p->active) {
+        hll_t prefixes = p->prefixes;
+
+        hllclear(&prefixes);
+        memset(p, 0, sizeof(*p));
+        p->prefixes = prefixes;
+        p->active   = true;
+    }
+
+    p->addr = *addr;
+    p->as   = as;
+    return p;
+}
+
+void statsupdate(uint32_t peer, const netaddr_t *addr, uint32_t as, ubgp_msg_s *msg, time_t stamp)
+{
+    peerstats_t *p = getpeerstats(peer, addr, as, stamp);
+
+    if (p->persec > 0 && p->cursec != stamp)
+        closesecond(p);
+
+    p->cursec = stamp;
+    p->persec++;
+    p->updates++;
+
+    const netaddr_t *pfx;
+
+    ullong announced = 0;
+    startallnlri(msg);
+    while ((pfx = nextnlri(msg)) != NULL) {
+        hlladd(&p->prefixes, bloomhash(pfx));
+        announced++;
+    }
+    endnlri(msg);
+
+    startallwithdrawn(msg);
+    while ((pfx = nextwithdrawn(msg)) != NULL) {
+        hlladd(&p->prefixes, bloomhash(pfx));
+        p->withdrawn++;
+    }
+    endwithdrawn(msg);
+
+    p->announced += announced;
+    if (announced == 0)
+        return;
+
+    // path length as in RFC 4271 9.1.2.2, an AS_SET counts as one
+    uint len = 0;
+    int  segno = -1;
+
+    as_pathent_t *ent;
+    startrealaspath(msg);
+    while ((ent = nextaspath(msg)) != NULL) {
+        if (ent->type == AS_SEGMENT_SEQ)
+            len++;
+        else if (ent->type == AS_SEGMENT_SET && ent->segno != segno)
+            len++;
+
+        segno = ent->segno;
+    }
+    if (endaspath(msg) == BGP_ENOERR) {
+        p->pathlen += len;
+        p->npaths++;
+    }
+}
+
+void statsstatechange(uint32_t peer, const netaddr_t *addr, uint32_t as, time_t stamp)
+{
+    peerstats_t *p = getpeerstats(peer, addr, as, stamp);
+    p->statechanges++;
+}
+
+void statsflush(void)
+{
+    if (hasbucket)
+        printbucket();
+
+    for (uint32_t i = 0; i < npeers; i++)
+        hlldestroy(&peers[i].prefixes);
+
+    free(peers);
+    peers     = NULL;
+    npeers    = 0;
+    hasbucket = false;
+}
@@ -0,0 +1,52 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * bgpgrep is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * bgpgrep is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with bgpgrep.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#ifndef UBGP_MRTSTATS_H_
+#define UBGP_MRTSTATS_H_
+
+#include "../ubgp/bgp.h"
+#include "../ubgp/netaddr.h"
+
+#include <stdint.h>
+#include <time.h>
+
+typedef enum {
+    STATS_CSV,
+    STATS_JSON
+} stats_fmt_t;
+
+// start collecting per peer statistics, in buckets of interval seconds
+void statsinit(time_t interval, stats_fmt_t fmt);
+
+// account an UPDATE message received from peer (an identifier) at stamp
+void statsupdate(uint32_t         peer,
+                 const netaddr_t *addr,
+                 uint32_t         as,
+                 ubgp_msg_s      *msg,
+                 time_t           stamp);
+
+// account a state change of peer at stamp
+void statsstatechange(uint32_t peer, const netaddr_t *addr, uint32_t as, time_t stamp);
+
+// print the last bucket and release every resource
+void statsflush(void);
+
+#endif
@@ -0,0 +1,453 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#include "../../ubgp/bgp.h"
+#include "../../ubgp/filterintrin.h"
+#include "../../ubgp/filterpacket.h"
+#include "../../ubgp/ubgpdef.h"
+#include "test.h"
+
+#include <CUnit/CUnit.h>
+
+#include <stdint.h>
+#include <string.h>
+
+static const byte commattrs[] = {
+    0x40, ORIGIN_CODE, 0x01, ORIGIN_IGP,
+    0x40, AS_PATH_CODE, 0x06, AS_SEGMENT_SEQ, 0x02, 0x00, 0x64, 0x00, 0xc8,
+    0x40, NEXT_HOP_CODE, 0x04, 0x0a, 0x00, 0x00, 0x01,
+    0xc0, COMMUNITY_CODE, 0x04, 0x00, 0x64, 0x00, 0x01
+};
+
+static const byte plainattrs[] = {
+    0x40, ORIGIN_CODE, 0x01, ORIGIN_IGP,
+    0x40, AS_PATH_CODE, 0x06, AS_SEGMENT_SEQ, 0x02, 0x00, 0x64, 0x00, 0xc8,
+    0x40, NEXT_HOP_CODE, 0x04, 0x0a, 0x00, 0x00, 0x01,
+    0x80, MULTI_EXIT_DISC_CODE, 0x04, 0x00, 0x00, 0x00, 0x0a
+};
+
+static const byte nlri[] = {
+    0x18, 0xc0, 0x00, 0x02  // 192.0.2.0/24
+};
+
+// store an attribute code set as an array constant, as bgpgrep does
+static int putattrmask(filter_prog_t *prog, const uint64_t *mask)
+{
+    intptr_t heapptr = vm_heap_alloc(prog, BGP_ATTRMASK_WORDS * sizeof(*mask));
+    CU_ASSERT_FATAL(heapptr != VM_BAD_HEAP_PTR);
+
+    memcpy(vm_prog_heap_ptr(prog, heapptr), mask, BGP_ATTRMASK_WORDS * sizeof(*mask));
+
+    int kidx = vm_newk(prog);
+    CU_ASSERT_FATAL(kidx != -1);
+
+    prog->kp[kidx].base  = heapptr;
+    prog->kp[kidx].elsiz = sizeof(*mask);
+    prog->kp[kidx].nels  = BGP_ATTRMASK_WORDS;
+    return kidx;
+}
+
+void testfilterhasanyattr(void)
+{
+    byte buf1[BGPBUFSIZ], buf2[BGPBUFSIZ];
+    ubgp_msg_s msg1, msg2;
+
+    size_t n = mkupdate(buf1, sizeof(buf1), NULL, 0, commattrs, sizeof(commattrs), nlri, sizeof(nlri));
+    CU_ASSERT_FATAL(n > 0);
+    setbgpread(&msg1, buf1, n, BGPF_DEFAULT);
+
+    n = mkupdate(buf2, sizeof(buf2), NULL, 0, plainattrs, sizeof(plainattrs), nlri, sizeof(nlri));
+    CU_ASSERT_FATAL(n > 0);
+    setbgpread(&msg2, buf2, n, BGPF_DEFAULT);
+
+    uint64_t mask[BGP_ATTRMASK_WORDS] = {0};
+    mask[0] = (1ull << COMMUNITY_CODE) | (1ull << LARGE_COMMUNITY_CODE);
+
+    filter_vm_t vm;
+    filter_init(&vm);
+
+    vm_emit_ex(&vm.prog, FOPC_HASANYATTR, putattrmask(&vm.prog, mask));
+
+    CU_ASSERT_EQUAL(bgp_filter(&msg1, &vm), true);
+    CU_ASSERT_EQUAL(bgp_filter(&msg2, &vm), false);
+
+    // same results column-wise
+    ubgp_msg_s *msgs[] = { &msg1, &msg2 };
+    uint64_t results = 0;
+
+    CU_ASSERT_EQUAL(bgp_filter_batch(msgs, countof(msgs), &vm.prog, &vm.ctx, &results), 1);
+    CU_ASSERT_EQUAL(results, 1);
+
+    // and the same as a chain of HASATTR
+    filter_destroy(&vm);
+    filter_init(&vm);
+
+    vm_emit(&vm.prog, vm_makeop(FOPC_HASATTR, COMMUNITY_CODE));
+    vm_emit(&vm.prog, FOPC_CPASS);
+    vm_emit(&vm.prog, vm_makeop(FOPC_HASATTR, LARGE_COMMUNITY_CODE));
+
+    CU_ASSERT_EQUAL(bgp_filter(&msg1, &vm), true);
+    CU_ASSERT_EQUAL(bgp_filter(&msg2, &vm), false);
+
+    // the negated set passes anything but msg1
+    filter_destroy(&vm);
+    filter_init(&vm);
+
+    vm_emit_ex(&vm.prog, FOPC_HASANYATTR, putattrmask(&vm.prog, mask));
+    vm_emit(&vm.prog, FOPC_NOT);
+
+    CU_ASSERT_EQUAL(bgp_filter(&msg1, &vm), false);
+    CU_ASSERT_EQUAL(bgp_filter(&msg2, &vm), true);
+
+    // a constant that isn't a set of attribute codes is rejected
+    filter_destroy(&vm);
+    filter_init(&vm);
+
+    int kidx = putattrmask(&vm.prog, mask);
+    vm.prog.kp[kidx].nels = BGP_ATTRMASK_WORDS - 1;
+    vm_emit_ex(&vm.prog, FOPC_HASANYATTR, kidx);
+
+    CU_ASSERT_EQUAL(bgp_filter(&msg1, &vm), VM_BAD_ARRAY);
+
+    filter_destroy(&vm);
+
+    bgpclose(&msg1);
+    bgpclose(&msg2);
+}
+
+enum { NBATCHMSGS = 2 * FILTER_BATCH_LANES + 22 };
+
+// check bgp_filter_batch() against bgp_filter() on the first n msgs
+static void checkbatch(filter_vm_t *vm, ubgp_msg_s **msgs, size_t n)
+{
+    uint64_t results[(NBATCHMSGS + FILTER_BATCH_LANES - 1) / FILTER_BATCH_LANES];
+    memset(results, 0xff, sizeof(results));
+
+    int expected = 0;
+    for (size_t i = 0; i < n; i++) {
+        int res = bgp_filter(msgs[i], vm);
+        CU_ASSERT(res >= 0);
+        if (res > 0)
+            expected++;
+    }
+
+    CU_ASSERT_EQUAL(bgp_filter_batch(msgs, n, &vm->prog, &vm->ctx, results), expected);
+    for (size_t i = 0; i < n; i++) {
+        bool passed = (results[i / FILTER_BATCH_LANES] & (1ull << (i % FILTER_BATCH_LANES))) != 0;
+        CU_ASSERT_EQUAL(passed, bgp_filter(msgs[i], vm) > 0);
+    }
+
+    // lanes past the last message are cleared
+    size_t last = (n - 1) / FILTER_BATCH_LANES;
+    for (size_t i = n; i < (last + 1) * FILTER_BATCH_LANES; i++)
+        CU_ASSERT_EQUAL(results[last] & (1ull << (i % FILTER_BATCH_LANES)), 0);
+}
+
+void testfilterbatch(void)
+{
+    static byte bufs[NBATCHMSGS][BGPBUFSIZ];
+    static ubgp_msg_s msgbuf[NBATCHMSGS];
+
+    ubgp_msg_s *msgs[NBATCHMSGS];
+    for (int i = 0; i < NBATCHMSGS; i++) {
+        // alternate attributes and vary the last AS and prefix of each message
+        byte attrs[sizeof(commattrs)];
+        memcpy(attrs, (i % 3 == 0) ? plainattrs : commattrs, sizeof(attrs));
+        attrs[11] = i >> 8;
+        attrs[12] = i & 0xff;
+
+        const byte pfx[] = { 0x10, 0x0a, i };  // 10.i.0.0/16
+
+        size_t n = mkupdate(bufs[i], sizeof(bufs[i]), NULL, 0, attrs, sizeof(attrs), pfx, sizeof(pfx));
+        CU_ASSERT_FATAL(n > 0);
+        setbgpread(&msgbuf[i], bufs[i], n, BGPF_DEFAULT);
+        msgs[i] = &msgbuf[i];
+    }
+
+    static const size_t sizes[] = { 1, FILTER_BATCH_LANES - 1, FILTER_BATCH_LANES, FILTER_BATCH_LANES + 1, NBATCHMSGS };
+
+    filter_vm_t vm;
+    filter_init(&vm);
+
+    // passes messages with COMMUNITY
+    vm_emit(&vm.prog, vm_makeop(FOPC_HASATTR, COMMUNITY_CODE));
+
+    for (size_t i = 0; i < countof(sizes); i++)
+        checkbatch(&vm, msgs, sizes[i]);
+
+    // lanes leaving early on CPASS
+    filter_destroy(&vm);
+    filter_init(&vm);
+
+    vm_emit(&vm.prog, vm_makeop(FOPC_HASATTR, MULTI_EXIT_DISC_CODE));
+    vm_emit(&vm.prog, FOPC_CPASS);
+    vm_emit(&vm.prog, vm_makeop(FOPC_HASATTR, COMMUNITY_CODE));
+    vm_emit(&vm.prog, FOPC_NOT);
+
+    for (size_t i = 0; i < countof(sizes); i++)
+        checkbatch(&vm, msgs, sizes[i]);
+
+    // rejects everything, half on CFAIL and half at the end
+    filter_destroy(&vm);
+    filter_init(&vm);
+
+    vm_emit(&vm.prog, vm_makeop(FOPC_HASATTR, COMMUNITY_CODE));
+    vm_emit(&vm.prog, FOPC_NOT);
+    vm_emit(&vm.prog, FOPC_CFAIL);
+    vm_emit(&vm.prog, vm_makeop(FOPC_HASATTR, COMMUNITY_CODE));
+    vm_emit(&vm.prog, FOPC_NOT);
+
+    for (size_t i = 0; i < countof(sizes); i++)
+        checkbatch(&vm, msgs, sizes[i]);
+
+    uint64_t results[(NBATCHMSGS + FILTER_BATCH_LANES - 1) / FILTER_BATCH_LANES];
+    CU_ASSERT_EQUAL(bgp_filter_batch(msgs, NBATCHMSGS, &vm.prog, &vm.ctx, results), 0);
+    for (size_t i = 0; i < countof(results); i++)
+        CU_ASSERT_EQUAL(results[i], 0);
+
+    // writes to the temporary tries run one message at a time
+    filter_destroy(&vm);
+    filter_init(&vm);
+
+    vm_emit(&vm.prog, vm_makeop(FOPC_HASATTR, COMMUNITY_CODE));
+    CU_ASSERT_FALSE(vm.prog.writestries);
+
+    vm_emit(&vm.prog, FOPC_CFAIL);
+    vm_emit(&vm.prog, vm_makeop(FOPC_CALL, VM_NLRI_INSERT_FN));
+    vm_emit(&vm.prog, vm_makeop(FOPC_EXACT, FOPC_ACCESS_NLRI));
+    CU_ASSERT_TRUE(vm.prog.writestries);
+
+    for (size_t i = 0; i < countof(sizes); i++)
+        checkbatch(&vm, msgs, sizes[i]);
+
+    filter_destroy(&vm);
+
+    for (int i = 0; i < NBATCHMSGS; i++)
+        bgpclose(&msgbuf[i]);
+}
+
+void testfiltersharedprog(void)
+{
+    byte buf[BGPBUFSIZ];
+    ubgp_msg_s msg;
+
+    size_t n = mkupdate(buf, sizeof(buf), NULL, 0, commattrs, sizeof(commattrs), nlri, sizeof(nlri));
+    CU_ASSERT_FATAL(n > 0);
+    setbgpread(&msg, buf, n, BGPF_DEFAULT);
+
+    // pass messages from peer AS 200 at 192.0.2.1, known variable 0 and 1
+    filter_prog_t prog;
+    filter_prog_init(&prog);
+
+    int kas = vm_newk(&prog);
+    CU_ASSERT_FATAL(kas != -1);
+    prog.kp[kas].as = 200;
+
+    int kaddr = vm_newk(&prog);
+    CU_ASSERT_FATAL(kaddr != -1);
+    CU_ASSERT_FATAL(stonaddr(&prog.kp[kaddr].addr, "192.0.2.1") == 0);
+
+    vm_emit(&prog, vm_makeop(FOPC_LOADK, 0));
+    vm_emit_ex(&prog, FOPC_ASCMP, kas);
+    vm_emit(&prog, FOPC_NOT);
+    vm_emit(&prog, FOPC_CFAIL);
+    vm_emit(&prog, vm_makeop(FOPC_LOADK, 1));
+    vm_emit_ex(&prog, FOPC_ADDRCMP, kaddr);
+
+    bytecode_t code[16];
+    CU_ASSERT_FATAL(prog.codesiz <= countof(code));
+    memcpy(code, prog.code, prog.codesiz * sizeof(*code));
+
+    filter_ctx_t a, b;
+    filter_ctx_init(&a);
+    filter_ctx_init(&b);
+
+    a.known[0].as = 200;
+    b.known[0].as = 300;
+    CU_ASSERT_FATAL(stonaddr(&a.known[1].addr, "192.0.2.1") == 0);
+    CU_ASSERT_FATAL(stonaddr(&b.known[1].addr, "192.0.2.1") == 0);
+
+    // interleaved executions only see their own known variables
+    for (int i = 0; i < 2; i++) {
+        CU_ASSERT_EQUAL(bgp_filter_ctx(&msg, &prog, &a), true);
+        CU_ASSERT_EQUAL(bgp_filter_ctx(&msg, &prog, &b), false);
+    }
+
+    b.known[0].as = 200;
+    CU_ASSERT_FATAL(stonaddr(&b.known[1].addr, "192.0.2.2") == 0);
+
+    CU_ASSERT_EQUAL(bgp_filter_ctx(&msg, &prog, &b), false);
+    CU_ASSERT_EQUAL(bgp_filter_ctx(&msg, &prog, &a), true);
+
+    ubgp_msg_s *msgs[] = { &msg, &msg, &msg };
+    uint64_t results;
+    CU_ASSERT_EQUAL(bgp_filter_batch(msgs, countof(msgs), &prog, &a, &results), 3);
+    CU_ASSERT_EQUAL(results, 7);
+    CU_ASSERT_EQUAL(bgp_filter_batch(msgs, countof(msgs), &prog, &b, &results), 0);
+    CU_ASSERT_EQUAL(results, 0);
+
+    // the program itself is never modified
+    CU_ASSERT_EQUAL(prog.kp[kas].as, 200);
+    CU_ASSERT_EQUAL(memcmp(code, prog.code, prog.codesiz * sizeof(*code)), 0);
+
+    filter_ctx_destroy(&a);
+    filter_ctx_destroy(&b);
+    filter_prog_destroy(&prog);
+
+    bgpclose(&msg);
+}
+
+void testfilterprofile(void)
+{
+    byte buf1[BGPBUFSIZ], buf2[BGPBUFSIZ];
+    ubgp_msg_s msg1, msg2;
+
+    size_t n = mkupdate(buf1, sizeof(buf1), NULL, 0, commattrs, sizeof(commattrs), nlri, sizeof(nlri));
+    CU_ASSERT_FATAL(n > 0);
+    setbgpread(&msg1, buf1, n, BGPF_DEFAULT);
+
+    n = mkupdate(buf2, sizeof(buf2), NULL, 0, plainattrs, sizeof(plainattrs), nlri, sizeof(nlri));
+    CU_ASSERT_FATAL(n > 0);
+    setbgpread(&msg2, buf2, n, BGPF_DEFAULT);
+
+    // msg1 passes on CPASS, msg2 reaches the end and fails
+    filter_vm_t vm;
+    filter_init(&vm);
+
+    vm_emit(&vm.prog, vm_makeop(FOPC_HASATTR, COMMUNITY_CODE));
+    vm_emit(&vm.prog, FOPC_CPASS);
+    vm_emit(&vm.prog, vm_makeop(FOPC_HASATTR, MULTI_EXIT_DISC_CODE));
+    vm_emit(&vm.prog, FOPC_NOT);
+
+    CU_ASSERT_FATAL(filter_profile_enable(&vm.ctx) == 0);
+
+    filter_profile_t *prof = vm.ctx.prof;
+    CU_ASSERT_PTR_NOT_NULL_FATAL(prof);
+
+    for (int i = 0; i < 2; i++)
+        CU_ASSERT_EQUAL(bgp_filter(&msg1, &vm), true);
+    for (int i = 0; i < 3; i++)
+        CU_ASSERT_EQUAL(bgp_filter(&msg2, &vm), false);
+
+    CU_ASSERT_EQUAL(prof->runs,   5);
+    CU_ASSERT_EQUAL(prof->passes, 2);
+    CU_ASSERT_EQUAL(prof->errors, 0);
+
+    CU_ASSERT_FATAL(prof->codesiz >= 4);
+    CU_ASSERT_EQUAL(prof->count[0], 5);
+    CU_ASSERT_EQUAL(prof->count[1], 5);
+    CU_ASSERT_EQUAL(prof->count[2], 3);
+    CU_ASSERT_EQUAL(prof->count[3], 3);
+    CU_ASSERT_EQUAL(prof->shortcircuits[0], 0);
+    CU_ASSERT_EQUAL(prof->shortcircuits[1], 2);
+
+    CU_ASSERT_EQUAL(prof->opcount[FOPC_HASATTR], 8);
+    CU_ASSERT_EQUAL(prof->opcount[FOPC_CPASS],   5);
+    CU_ASSERT_EQUAL(prof->opcount[FOPC_NOT],     3);
+    CU_ASSERT_EQUAL(prof->opcount[FOPC_CFAIL],   0);
+
+    // profiled batches run one message at a time, accumulating on the same counters
+    ubgp_msg_s *msgs[] = { &msg1, &msg2 };
+    uint64_t results;
+    CU_ASSERT_EQUAL(bgp_filter_batch(msgs, countof(msgs), &vm.prog, &vm.ctx, &results), 1);
+    CU_ASSERT_EQUAL(results, 1);
+
+    CU_ASSERT_EQUAL(prof->runs,   7);
+    CU_ASSERT_EQUAL(prof->passes, 3);
+    CU_ASSERT_EQUAL(prof->count[0], 7);
+    CU_ASSERT_EQUAL(prof->count[3], 4);
+    CU_ASSERT_EQUAL(prof->opcount[FOPC_HASATTR], 11);
+
+    // aborted executions
+    filter_destroy(&vm);
+    filter_init(&vm);
+
+    vm_emit(&vm.prog, FOPC_NOT);  // stack underflow
+
+    CU_ASSERT_FATAL(filter_profile_enable(&vm.ctx) == 0);
+    prof = vm.ctx.prof;
+
+    CU_ASSERT_EQUAL(bgp_filter(&msg1, &vm), VM_STACK_UNDERFLOW);
+    CU_ASSERT_EQUAL(prof->runs,   1);
+    CU_ASSERT_EQUAL(prof->passes, 0);
+    CU_ASSERT_EQUAL(prof->errors, 1);
+    CU_ASSERT_EQUAL(prof->opcount[FOPC_NOT], 1);
+
+    filter_destroy(&vm);
+
+    bgpclose(&msg1);
+    bgpclose(&msg2);
+}
+
+void testfilterprogtrie(void)
+{
+    byte buf[BGPBUFSIZ];
+    ubgp_msg_s msg;
+
+    size_t n = mkupdate(buf, sizeof(buf), NULL, 0, plainattrs, sizeof(plainattrs), nlri, sizeof(nlri));
+    CU_ASSERT_FATAL(n > 0);
+    setbgpread(&msg, buf, n, BGPF_DEFAULT);
+
+    filter_vm_t vm;
+    filter_init(&vm);
+
+    int trie = vm_newtrie(&vm.prog, AF_INET);
+    CU_ASSERT_FATAL(trie != -1);
+
+    int kaddr = vm_newk(&vm.prog);
+    CU_ASSERT_FATAL(kaddr != -1);
+    CU_ASSERT_FATAL(stonaddr(&vm.prog.kp[kaddr].addr, "192.0.2.1") == 0);
+
+    // STORE to a program trie is rejected, the trie is left untouched
+    vm_emit(&vm.prog, vm_makeop(FOPC_SETTRIE, trie));
+    vm_emit_ex(&vm.prog, FOPC_LOADK, kaddr);
+    vm_emit(&vm.prog, FOPC_STORE);
+
+    CU_ASSERT_EQUAL(bgp_filter(&msg, &vm), VM_TRIE_READONLY);
+    CU_ASSERT_EQUAL(vm.prog.tries[trie].nnodes, 0);
+
+    // so are the other writes
+    vm.prog.codesiz = 0;
+    vm_emit(&vm.prog, vm_makeop(FOPC_SETTRIE, trie));
+    vm_emit(&vm.prog, FOPC_CLRTRIE);
+
+    CU_ASSERT_EQUAL(bgp_filter(&msg, &vm), VM_TRIE_READONLY);
+
+    vm.prog.codesiz = 0;
+    vm_emit(&vm.prog, vm_makeop(FOPC_SETTRIE, trie));
+    vm_emit(&vm.prog, vm_makeop(FOPC_CALL, VM_NLRI_INSERT_FN));
+
+    CU_ASSERT_EQUAL(bgp_filter(&msg, &vm), VM_TRIE_READONLY);
+    CU_ASSERT_EQUAL(vm.prog.tries[trie].nnodes, 0);
+
+    // the temporary tries are still writable
+    vm.prog.codesiz = 0;
+    vm_emit(&vm.prog, vm_makeop(FOPC_SETTRIE, VM_TMPTRIE));
+    vm_emit(&vm.prog, vm_makeop(FOPC_CALL, VM_NLRI_INSERT_FN));
+    vm_emit(&vm.prog, vm_makeop(FOPC_EXACT, FOPC_ACCESS_NLRI));
+
+    CU_ASSERT_EQUAL(bgp_filter(&msg, &vm), true);
+    CU_ASSERT_EQUAL(vm.prog.tries[trie].nnodes, 0);
+
+    filter_destroy(&vm);
+
+    bgpclose(&msg);
+}
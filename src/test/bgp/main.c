@@ -41,6 +41,39 @@ int main(void)
     if (!CU_add_test(suite, "test for simple open packet read", testopenread))
         goto error;
 
+    if (!CU_add_test(suite, "test for open capabilities over several parameters", testopensplitparams))
+        goto error;
+
+    if (!CU_add_test(suite, "test for unaligned capability tuples", testcaptuplesunaligned))
+        goto error;
+
+    if (!CU_add_test(suite, "test for direct attribute access", testgetbgpattrib))
+        goto error;
+
+    if (!CU_add_test(suite, "test for direct access to bad attributes", testgetbgpattribbad))
+        goto error;
+
+    if (!CU_add_test(suite, "test for bulk prefix decoding", testgetallnlri))
+        goto error;
+
+    if (!CU_add_test(suite, "test for AS path iteration", testaspathiter))
+        goto error;
+
+    if (!CU_add_test(suite, "test for filter HASANYATTR", testfilterhasanyattr))
+        goto error;
+
+    if (!CU_add_test(suite, "test for column-wise filtering", testfilterbatch))
+        goto error;
+
+    if (!CU_add_test(suite, "test for a filter program shared by several contexts", testfiltersharedprog))
+        goto error;
+
+    if (!CU_add_test(suite, "test for filter profiling", testfilterprofile))
+        goto error;
+
+    if (!CU_add_test(suite, "test for filter writes to program tries", testfilterprogtrie))
+        goto error;
+
     if (!CU_add_test(suite, "test for string to community", testcommunityconv))
         goto error;
 
@@ -234,20 +234,213 @@ void testopenread(void)
     CU_ASSERT_EQUAL(memcmp(&(getbgpopen(&curbgp)->iden), &iden, sizeof(iden)), 0);
 
     startbgpcaps(&curbgp);
+
+    afi_safi_t tuples[2];
+    size_t n;
+    int ncaps = 0;
     bgpcap_t *cap;
     while ((cap = nextbgpcap(&curbgp)) != NULL) {
         switch (cap->code) {
         case MULTIPROTOCOL_CODE:
+            CU_ASSERT_EQUAL(ncaps, 0);
             CU_ASSERT_EQUAL(cap->len, MULTIPROTOCOL_LENGTH);
             CU_ASSERT_EQUAL(getmultiprotocol(cap).afi, AFI_IPV4);
             CU_ASSERT_EQUAL(getmultiprotocol(cap).safi, SAFI_UNICAST);
             break;
+        case 128:  // Cisco route refresh
+            CU_ASSERT_EQUAL(ncaps, 1);
+            CU_ASSERT_EQUAL(cap->len, 0);
+            break;
+        case ROUTE_REFRESH_CODE:
+            CU_ASSERT_EQUAL(ncaps, 2);
+            CU_ASSERT_EQUAL(cap->len, 0);
+            break;
+        case ASN32BIT_CODE:
+            CU_ASSERT_EQUAL(ncaps, 3);
+            CU_ASSERT_EQUAL(cap->len, ASN32BIT_LENGTH);
+            CU_ASSERT_EQUAL(getasn32bit(cap), 65517);
+            break;
+        case ADD_PATH_CODE:
+            CU_ASSERT_EQUAL(ncaps, 4);
+            CU_ASSERT_EQUAL(cap->len, sizeof(*tuples));
+
+            n = getaddpathtuples(tuples, countof(tuples), cap);
+
+            CU_ASSERT_EQUAL(n, 1);
+            CU_ASSERT_EQUAL(tuples->afi, AFI_IPV4);
+            CU_ASSERT_EQUAL(tuples->safi, SAFI_UNICAST);
+            CU_ASSERT_EQUAL(tuples->flags, ADD_PATH_RX | ADD_PATH_TX);
+            break;
+        case FQDN_CODE:
+            CU_ASSERT_EQUAL(ncaps, 5);
+            CU_ASSERT_EQUAL(cap->len, 6);
+            CU_ASSERT_EQUAL(cap->data[0], 4);
+            CU_ASSERT_EQUAL(memcmp(&cap->data[1], "bgpd", 4), 0);
+            CU_ASSERT_EQUAL(cap->data[5], 0);
+            break;
+        case GRACEFUL_RESTART_CODE:
+            CU_ASSERT_EQUAL(ncaps, 6);
+            CU_ASSERT_EQUAL(cap->len, GRACEFUL_RESTART_BASE_LENGTH);
+            CU_ASSERT_EQUAL(getgracefulrestartflags(cap), 0);
+            CU_ASSERT_EQUAL(getgracefulrestarttime(cap), 120);
+
+            n = getgracefulrestarttuples(tuples, countof(tuples), cap);
+            CU_ASSERT_EQUAL(n, 0);
+            break;
         default:
             CU_FAIL_FATAL("unexpected capability");
         }
+
+        ncaps++;
     }
-    endbgpcaps(&curbgp);
+    CU_ASSERT_EQUAL(ncaps, 7);
+    CU_ASSERT_EQUAL(endbgpcaps(&curbgp), BGP_ENOERR);
 
     bgpclose(&curbgp);
 }
 
+/*
+
+Capabilities spread over several optional parameters, mixed with
+a non-capability parameter that must be skipped:
+
+    Optional Parameters Length: 40
+        Optional Parameter: Capability (2), Length: 10
+            Support for 4-octet AS number capability (65), AS Number: 65537
+            Route refresh capability (2)
+            Enhanced route refresh capability (70)
+        Optional Parameter: Authentication (1), Length: 2
+        Optional Parameter: Capability (2), Length: 6
+            Multiprotocol extensions capability (1), AFI: IPv6, SAFI: Unicast
+        Optional Parameter: Capability (2), Length: 14
+            Support for Additional Paths (69)
+                AFI: IPv4, SAFI: Unicast, Send/Receive: Both
+                AFI: IPv6, SAFI: Unicast, Send/Receive: Receive
+            Graceful Restart capability (64), Restart: Yes, Time: 90
+
+*/
+void testopensplitparams(void)
+{
+    static const int expect[] = {
+        ASN32BIT_CODE,
+        ROUTE_REFRESH_CODE,
+        ENHANCED_ROUTE_REFRESH_CODE,
+        MULTIPROTOCOL_CODE,
+        ADD_PATH_CODE,
+        GRACEFUL_RESTART_CODE
+    };
+
+    byte buf[] = {
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0x00, 0x45, 0x01, 0x04, 0x5b, 0xa0, 0x00, 0xb4,
+        0x0a, 0x00, 0x00, 0x01, 0x28, 0x02, 0x0a, 0x41, 0x04, 0x00, 0x01, 0x00,
+        0x01, 0x02, 0x00, 0x46, 0x00, 0x01, 0x02, 0xaa, 0xbb, 0x02, 0x06, 0x01,
+        0x04, 0x00, 0x02, 0x00, 0x01, 0x02, 0x0e, 0x45, 0x08, 0x00, 0x01, 0x01,
+        0x03, 0x00, 0x02, 0x01, 0x01, 0x40, 0x02, 0x80, 0x5a
+    };
+
+    setbgpread(&curbgp, buf, sizeof(buf), BGPF_DEFAULT);
+
+    CU_ASSERT_EQUAL(getbgptype(&curbgp), BGP_OPEN);
+    CU_ASSERT_EQUAL(getbgpopen(&curbgp)->my_as, AS_TRANS);
+
+    startbgpcaps(&curbgp);
+
+    afi_safi_t tuples[2];
+    size_t n;
+    size_t ncaps = 0;
+    bgpcap_t *cap;
+    while ((cap = nextbgpcap(&curbgp)) != NULL) {
+        CU_ASSERT_FATAL(ncaps < countof(expect));
+        CU_ASSERT_EQUAL(cap->code, expect[ncaps]);
+
+        switch (cap->code) {
+        case ASN32BIT_CODE:
+            CU_ASSERT_EQUAL(getasn32bit(cap), 65537);
+            break;
+        case MULTIPROTOCOL_CODE:
+            CU_ASSERT_EQUAL(getmultiprotocol(cap).afi, AFI_IPV6);
+            CU_ASSERT_EQUAL(getmultiprotocol(cap).safi, SAFI_UNICAST);
+            break;
+        case ADD_PATH_CODE:
+            n = getaddpathtuples(tuples, countof(tuples), cap);
+
+            CU_ASSERT_EQUAL(n, 2);
+            CU_ASSERT_EQUAL(tuples[0].afi, AFI_IPV4);
+            CU_ASSERT_EQUAL(tuples[0].safi, SAFI_UNICAST);
+            CU_ASSERT_EQUAL(tuples[0].flags, ADD_PATH_RX | ADD_PATH_TX);
+            CU_ASSERT_EQUAL(tuples[1].afi, AFI_IPV6);
+            CU_ASSERT_EQUAL(tuples[1].safi, SAFI_UNICAST);
+            CU_ASSERT_EQUAL(tuples[1].flags, ADD_PATH_RX);
+            break;
+        case GRACEFUL_RESTART_CODE:
+            CU_ASSERT_EQUAL(getgracefulrestartflags(cap), RESTART_FLAG);
+            CU_ASSERT_EQUAL(getgracefulrestarttime(cap), 90);
+            break;
+        default:
+            CU_ASSERT_EQUAL(cap->len, 0);
+            break;
+        }
+
+        ncaps++;
+    }
+    CU_ASSERT_EQUAL(ncaps, countof(expect));
+    CU_ASSERT_EQUAL(endbgpcaps(&curbgp), BGP_ENOERR);
+
+    CU_ASSERT_EQUAL(bgpclose(&curbgp), BGP_ENOERR);
+}
+
+void testcaptuplesunaligned(void)
+{
+    // capabilities are byte aligned inside packets, place both at an odd address,
+    // with room for the whole bgpcap_t they are viewed as
+    byte addpath[1 + sizeof(bgpcap_t)] = {
+        0x00,
+        ADD_PATH_CODE, 0x08,
+        0x00, 0x01, 0x01, 0x03,
+        0x00, 0x02, 0x01, 0x01
+    };
+    byte restart[1 + sizeof(bgpcap_t)] = {
+        0x00,
+        GRACEFUL_RESTART_CODE, 0x0a,
+        0x80, 0x5a,
+        0x00, 0x01, 0x01, 0x80,
+        0x00, 0x02, 0x01, 0x00
+    };
+
+    afi_safi_t tuples[2];
+
+    const bgpcap_t *cap = (const bgpcap_t *) &addpath[1];
+    size_t n = getaddpathtuples(tuples, countof(tuples), cap);
+
+    CU_ASSERT_EQUAL(n, 2);
+    CU_ASSERT_EQUAL(tuples[0].afi, AFI_IPV4);
+    CU_ASSERT_EQUAL(tuples[0].safi, SAFI_UNICAST);
+    CU_ASSERT_EQUAL(tuples[0].flags, ADD_PATH_RX | ADD_PATH_TX);
+    CU_ASSERT_EQUAL(tuples[1].afi, AFI_IPV6);
+    CU_ASSERT_EQUAL(tuples[1].safi, SAFI_UNICAST);
+    CU_ASSERT_EQUAL(tuples[1].flags, ADD_PATH_RX);
+
+    // a short destination only receives the first tuple, but the count is total
+    memset(tuples, 0, sizeof(tuples));
+    n = getaddpathtuples(tuples, 1, cap);
+
+    CU_ASSERT_EQUAL(n, 2);
+    CU_ASSERT_EQUAL(tuples[0].afi, AFI_IPV4);
+    CU_ASSERT_EQUAL(tuples[1].afi, 0);
+
+    cap = (const bgpcap_t *) &restart[1];
+    CU_ASSERT_EQUAL(getgracefulrestartflags(cap), RESTART_FLAG);
+    CU_ASSERT_EQUAL(getgracefulrestarttime(cap), 90);
+
+    n = getgracefulrestarttuples(tuples, countof(tuples), cap);
+
+    CU_ASSERT_EQUAL(n, 2);
+    CU_ASSERT_EQUAL(tuples[0].afi, AFI_IPV4);
+    CU_ASSERT_EQUAL(tuples[0].safi, SAFI_UNICAST);
+    CU_ASSERT_EQUAL(tuples[0].flags, FORWARDING_STATE);
+    CU_ASSERT_EQUAL(tuples[1].afi, AFI_IPV6);
+    CU_ASSERT_EQUAL(tuples[1].safi, SAFI_UNICAST);
+    CU_ASSERT_EQUAL(tuples[1].flags, 0);
+}
+
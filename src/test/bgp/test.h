@@ -22,12 +22,52 @@
 #ifndef UBGP_TEST_H_
 #define UBGP_TEST_H_
 
+#include <stddef.h>
+
+/**
+ * mkupdate:
+ *
+ * Assemble a BGP UPDATE message from its raw fields into @buf.
+ *
+ * Returns: the message size, 0 if it doesn't fit into @size bytes.
+ */
+size_t mkupdate(unsigned char *buf,
+                size_t         size,
+                const void    *withdrawn,
+                size_t         nwithdrawn,
+                const void    *attrs,
+                size_t         nattrs,
+                const void    *nlri,
+                size_t         nnlri);
+
 void testopencreate(void);
 
 void testopenread(void);
 
+void testopensplitparams(void);
+
+void testcaptuplesunaligned(void);
+
 void testupdateread(void);
 
+void testgetbgpattrib(void);
+
+void testgetbgpattribbad(void);
+
+void testgetallnlri(void);
+
+void testaspathiter(void);
+
+void testfilterhasanyattr(void);
+
+void testfilterbatch(void);
+
+void testfiltersharedprog(void);
+
+void testfilterprofile(void);
+
+void testfilterprogtrie(void);
+
 void testcommunityconv(void);
 
 void testlargecommunityconv(void);
@@ -23,6 +23,8 @@
 #include "../../ubgp/bgpparams.h"
 #include "../../ubgp/ubgpdef.h"
 
+#include "test.h"
+
 #include <CUnit/CUnit.h>
 
 #include <stdbool.h>
@@ -30,8 +32,492 @@
 #include <stdlib.h>
 #include <string.h>
 
+static ubgp_msg_s curbgp;
+
+size_t mkupdate(byte       *buf,
+                size_t      size,
+                const void *withdrawn,
+                size_t      nwithdrawn,
+                const void *attrs,
+                size_t      nattrs,
+                const void *nlri,
+                size_t      nnlri)
+{
+    static const byte header[] = {
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0x00, 0x00, 0x02
+    };
+
+    size_t n = sizeof(header) + 2 + nwithdrawn + 2 + nattrs + nnlri;
+    if (n > size)
+        return 0;
+
+    byte *ptr = buf;
+    memcpy(ptr, header, sizeof(header));
+    ptr[16] = n >> 8;
+    ptr[17] = n & 0xff;
+    ptr += sizeof(header);
+
+    *ptr++ = nwithdrawn >> 8;
+    *ptr++ = nwithdrawn & 0xff;
+    if (nwithdrawn > 0)
+        memcpy(ptr, withdrawn, nwithdrawn);
+    ptr += nwithdrawn;
+
+    *ptr++ = nattrs >> 8;
+    *ptr++ = nattrs & 0xff;
+    if (nattrs > 0)
+        memcpy(ptr, attrs, nattrs);
+    ptr += nattrs;
+
+    if (nnlri > 0)
+        memcpy(ptr, nlri, nnlri);
+    return n;
+}
+
 void testupdateread(void)
 {
     // TODO
 }
 
+void testgetbgpattrib(void)
+{
+    static const byte attrs[] = {
+        0x40, ORIGIN_CODE, 0x01, ORIGIN_IGP,
+        0x40, AS_PATH_CODE, 0x06, AS_SEGMENT_SEQ, 0x02, 0x00, 0x64, 0x00, 0xc8,
+        0x40, NEXT_HOP_CODE, 0x04, 0x0a, 0x00, 0x00, 0x01,
+        0xc0, COMMUNITY_CODE, 0x04, 0x00, 0x64, 0x00, 0x01,
+        // a duplicate attribute, only the first one is visible
+        0xc0, COMMUNITY_CODE, 0x04, 0x00, 0xc8, 0x00, 0x02,
+        // unknown attribute, with extended length
+        0xd0, 0xc8, 0x00, 0x03, 0xaa, 0xbb, 0xcc,
+        0xc0, RESERVED_CODE, 0x00
+    };
+    static const byte nlri[] = {
+        0x18, 0xc0, 0x00, 0x02  // 192.0.2.0/24
+    };
+
+    byte buf[BGPBUFSIZ];
+    size_t n = mkupdate(buf, sizeof(buf), NULL, 0, attrs, sizeof(attrs), nlri, sizeof(nlri));
+    CU_ASSERT_FATAL(n > 0);
+
+    setbgpread(&curbgp, buf, n, BGPF_DEFAULT);
+    CU_ASSERT_EQUAL(getbgptype(&curbgp), BGP_UPDATE);
+
+    // lookups don't affect an ongoing iteration
+    CU_ASSERT_EQUAL(startbgpattribs(&curbgp), BGP_ENOERR);
+
+    bgpattr_t *attr = nextbgpattrib(&curbgp);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(attr);
+    CU_ASSERT_EQUAL(attr->code, ORIGIN_CODE);
+    CU_ASSERT_PTR_EQUAL(getbgporigin(&curbgp), attr);
+
+    attr = getbgpattrib(&curbgp, COMMUNITY_CODE);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(attr);
+    CU_ASSERT_PTR_EQUAL(getbgpcommunities(&curbgp), attr);
+    CU_ASSERT_EQUAL(attr->len, 4);
+    CU_ASSERT_EQUAL(attr->data[1], 0x64);
+
+    attr = getbgpattrib(&curbgp, 0xc8);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(attr);
+    CU_ASSERT_EQUAL(attr->flags, ATTR_OPTIONAL | ATTR_TRANSITIVE | ATTR_EXTENDED_LENGTH);
+
+    size_t len;
+    byte *data = getattrlen(attr, &len);
+    CU_ASSERT_EQUAL(len, 3);
+    CU_ASSERT_EQUAL(data[0], 0xaa);
+    CU_ASSERT_EQUAL(data[2], 0xcc);
+
+    attr = getbgpattrib(&curbgp, RESERVED_CODE);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(attr);
+    CU_ASSERT_EQUAL(attr->len, 0);
+
+    CU_ASSERT_PTR_NOT_NULL(getbgpaspath(&curbgp));
+    CU_ASSERT_PTR_NOT_NULL(getbgpnexthop(&curbgp));
+    CU_ASSERT_PTR_NULL(getbgpattrib(&curbgp, MULTI_EXIT_DISC_CODE));
+    CU_ASSERT_PTR_NULL(getbgpmpreach(&curbgp));
+    CU_ASSERT_PTR_NULL(getbgpattrib(&curbgp, 0xc9));
+    CU_ASSERT_EQUAL(bgperror(&curbgp), BGP_ENOERR);
+
+    int nattrs = 1;
+    while (nextbgpattrib(&curbgp))
+        nattrs++;
+
+    CU_ASSERT_EQUAL(nattrs, 7);
+    CU_ASSERT_EQUAL(endbgpattribs(&curbgp), BGP_ENOERR);
+
+    uint64_t mask[BGP_ATTRMASK_WORDS] = {0};
+    CU_ASSERT_FALSE(hasanybgpattrib(&curbgp, mask));
+
+    mask[0] = (1ull << MULTI_EXIT_DISC_CODE) | (1ull << LOCAL_PREF_CODE);
+    CU_ASSERT_FALSE(hasanybgpattrib(&curbgp, mask));
+
+    mask[0xc9 / 64] |= 1ull << (0xc9 % 64);
+    CU_ASSERT_FALSE(hasanybgpattrib(&curbgp, mask));
+
+    mask[0xc8 / 64] |= 1ull << (0xc8 % 64);
+    CU_ASSERT_TRUE(hasanybgpattrib(&curbgp, mask));
+
+    memset(mask, 0, sizeof(mask));
+    mask[RESERVED_CODE / 64] = 1ull << (RESERVED_CODE % 64);
+    CU_ASSERT_TRUE(hasanybgpattrib(&curbgp, mask));
+
+    CU_ASSERT_EQUAL(bgpclose(&curbgp), BGP_ENOERR);
+}
+
+void testgetbgpattribbad(void)
+{
+    static const byte attrs[] = {
+        0x40, ORIGIN_CODE, 0x01, ORIGIN_IGP,
+        0x40, NEXT_HOP_CODE, 0x08, 0x0a, 0x00, 0x00, 0x01  // truncated
+    };
+
+    byte buf[BGPBUFSIZ];
+    size_t n = mkupdate(buf, sizeof(buf), NULL, 0, attrs, sizeof(attrs), NULL, 0);
+    CU_ASSERT_FATAL(n > 0);
+
+    uint64_t mask[BGP_ATTRMASK_WORDS] = {0};
+    mask[0] = 1ull << ORIGIN_CODE;
+
+    setbgpread(&curbgp, buf, n, BGPF_DEFAULT);
+    CU_ASSERT_FALSE(hasanybgpattrib(&curbgp, mask));
+    CU_ASSERT_EQUAL(bgperror(&curbgp), BGP_EBADATTR);
+    CU_ASSERT_PTR_NULL(getbgpattrib(&curbgp, ORIGIN_CODE));
+    bgpclose(&curbgp);
+
+    // only UPDATE messages have attributes
+    static const byte keepalive[] = {
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0x00, 0x13, 0x04
+    };
+
+    setbgpread(&curbgp, keepalive, sizeof(keepalive), BGPF_DEFAULT);
+    CU_ASSERT_EQUAL(getbgptype(&curbgp), BGP_KEEPALIVE);
+    CU_ASSERT_PTR_NULL(getbgpattrib(&curbgp, ORIGIN_CODE));
+    CU_ASSERT_EQUAL(bgperror(&curbgp), BGP_EINVOP);
+    bgpclose(&curbgp);
+}
+
+
+// check getallnlri() and getallwithdrawn() against the prefix iterators
+static void checkallpfxs(ubgp_msg_s *msg, bool nlri, size_t expected)
+{
+    netaddrap_t pfxs[16];
+    size_t n = nlri ? getallnlri(msg, pfxs, countof(pfxs)) : getallwithdrawn(msg, pfxs, countof(pfxs));
+    CU_ASSERT_EQUAL(bgperror(msg), BGP_ENOERR);
+    CU_ASSERT_EQUAL_FATAL(n, expected);
+
+    bool addpath = isbgpaddpath(msg);
+    CU_ASSERT_EQUAL(nlri ? startallnlri(msg) : startallwithdrawn(msg), BGP_ENOERR);
+
+    size_t i = 0;
+    netaddr_t *addr;
+    while ((addr = nlri ? nextnlri(msg) : nextwithdrawn(msg)) != NULL) {
+        CU_ASSERT_FATAL(i < n);
+        CU_ASSERT_EQUAL(pfxs[i].pfx.family, addr->family);
+        CU_ASSERT_EQUAL(pfxs[i].pfx.bitlen, addr->bitlen);
+        CU_ASSERT(prefixeqwithmask(&pfxs[i].pfx, addr, addr->bitlen));
+        CU_ASSERT_EQUAL(pfxs[i].pathid, addpath ? ((netaddrap_t *) addr)->pathid : 0);
+
+        // an ongoing iteration isn't affected
+        netaddrap_t tmp[1];
+        CU_ASSERT_EQUAL(nlri ? getallnlri(msg, tmp, 1) : getallwithdrawn(msg, tmp, 1), n);
+        i++;
+    }
+    CU_ASSERT_EQUAL(i, n);
+    CU_ASSERT_EQUAL(nlri ? endnlri(msg) : endwithdrawn(msg), BGP_ENOERR);
+
+    // short buffers get the first prefixes and the full count
+    if (n > 1) {
+        netaddrap_t head[countof(pfxs)];
+        memset(head, 0, sizeof(head));
+        CU_ASSERT_EQUAL(nlri ? getallnlri(msg, head, 1) : getallwithdrawn(msg, head, 1), n);
+        CU_ASSERT_EQUAL(head[0].pfx.bitlen, pfxs[0].pfx.bitlen);
+        CU_ASSERT(prefixeqwithmask(&head[0].pfx, &pfxs[0].pfx, pfxs[0].pfx.bitlen));
+        CU_ASSERT_EQUAL(head[1].pfx.bitlen, 0);
+    }
+}
+
+void testgetallnlri(void)
+{
+    static const byte withdrawn[] = {
+        0x08, 0x0a,                    // 10.0.0.0/8
+        0x20, 0xc0, 0x00, 0x02, 0x01   // 192.0.2.1/32
+    };
+    static const byte attrs[] = {
+        0x40, ORIGIN_CODE, 0x01, ORIGIN_IGP,
+        0x40, AS_PATH_CODE, 0x06, AS_SEGMENT_SEQ, 0x02, 0x00, 0x64, 0x00, 0xc8,
+        0x40, NEXT_HOP_CODE, 0x04, 0x0a, 0x00, 0x00, 0x01,
+        0x80, MP_REACH_NLRI_CODE, 0x1b,
+        0x00, AFI_IPV6, SAFI_UNICAST, 0x10,
+        0x20, 0x01, 0x0d, 0xb8, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+        0x00,
+        0x20, 0x20, 0x01, 0x0d, 0xb8,  // 2001:db8::/32
+        0x00,                          // ::/0
+        0x80, MP_UNREACH_NLRI_CODE, 0x0c,
+        0x00, AFI_IPV6, SAFI_UNICAST,
+        0x30, 0x20, 0x01, 0x0d, 0xb8, 0x00, 0x01,  // 2001:db8:1::/48
+        0x01, 0x80                                 // 8000::/1
+    };
+    static const byte nlri[] = {
+        0x18, 0xc0, 0x00, 0x02,       // 192.0.2.0/24
+        0x10, 0xc6, 0x33,             // 198.51.0.0/16
+        0x1c, 0xcb, 0x00, 0x71, 0x10  // 203.0.113.16/28
+    };
+
+    byte buf[BGPBUFSIZ];
+    size_t n = mkupdate(buf, sizeof(buf), withdrawn, sizeof(withdrawn), attrs, sizeof(attrs), nlri, sizeof(nlri));
+    CU_ASSERT_FATAL(n > 0);
+
+    setbgpread(&curbgp, buf, n, BGPF_DEFAULT);
+    checkallpfxs(&curbgp, true, 5);
+    checkallpfxs(&curbgp, false, 4);
+    CU_ASSERT_EQUAL(bgpclose(&curbgp), BGP_ENOERR);
+
+    // the same prefixes, with path identifiers
+    static const byte apwithdrawn[] = {
+        0x00, 0x00, 0x00, 0x01, 0x08, 0x0a,
+        0x00, 0x00, 0x00, 0x02, 0x20, 0xc0, 0x00, 0x02, 0x01
+    };
+    static const byte apattrs[] = {
+        0x40, ORIGIN_CODE, 0x01, ORIGIN_IGP,
+        0x40, AS_PATH_CODE, 0x06, AS_SEGMENT_SEQ, 0x02, 0x00, 0x64, 0x00, 0xc8,
+        0x40, NEXT_HOP_CODE, 0x04, 0x0a, 0x00, 0x00, 0x01,
+        0x80, MP_REACH_NLRI_CODE, 0x23,
+        0x00, AFI_IPV6, SAFI_UNICAST, 0x10,
+        0x20, 0x01, 0x0d, 0xb8, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+        0x00,
+        0x00, 0x00, 0x00, 0x03, 0x20, 0x20, 0x01, 0x0d, 0xb8,
+        0xff, 0xff, 0xff, 0xff, 0x00,
+        0x80, MP_UNREACH_NLRI_CODE, 0x14,
+        0x00, AFI_IPV6, SAFI_UNICAST,
+        0x00, 0x00, 0x01, 0x00, 0x30, 0x20, 0x01, 0x0d, 0xb8, 0x00, 0x01,
+        0x00, 0x00, 0x00, 0x00, 0x01, 0x80
+    };
+    static const byte apnlri[] = {
+        0x00, 0x00, 0x00, 0x07, 0x18, 0xc0, 0x00, 0x02,
+        0x00, 0x00, 0x00, 0x07, 0x10, 0xc6, 0x33,
+        0x00, 0x01, 0x00, 0x00, 0x1c, 0xcb, 0x00, 0x71, 0x10
+    };
+
+    n = mkupdate(buf, sizeof(buf), apwithdrawn, sizeof(apwithdrawn), apattrs, sizeof(apattrs), apnlri, sizeof(apnlri));
+    CU_ASSERT_FATAL(n > 0);
+
+    setbgpread(&curbgp, buf, n, BGPF_ADDPATH);
+    checkallpfxs(&curbgp, true, 5);
+    checkallpfxs(&curbgp, false, 4);
+
+    netaddrap_t pfxs[5];
+    CU_ASSERT_EQUAL(getallnlri(&curbgp, pfxs, countof(pfxs)), 5);
+    CU_ASSERT_EQUAL(pfxs[2].pathid, 0x10000);
+    CU_ASSERT_EQUAL(pfxs[4].pathid, 0xffffffff);
+    CU_ASSERT_EQUAL(pfxs[4].pfx.family, AF_INET6);
+    CU_ASSERT_EQUAL(bgpclose(&curbgp), BGP_ENOERR);
+
+    // MP_REACH_NLRI only, and no prefixes at all
+    n = mkupdate(buf, sizeof(buf), NULL, 0, attrs, sizeof(attrs), NULL, 0);
+    CU_ASSERT_FATAL(n > 0);
+
+    setbgpread(&curbgp, buf, n, BGPF_DEFAULT);
+    checkallpfxs(&curbgp, true, 2);
+    CU_ASSERT_EQUAL(bgpclose(&curbgp), BGP_ENOERR);
+
+    n = mkupdate(buf, sizeof(buf), NULL, 0, attrs, 20, NULL, 0);
+    CU_ASSERT_FATAL(n > 0);
+
+    setbgpread(&curbgp, buf, n, BGPF_DEFAULT);
+    checkallpfxs(&curbgp, true, 0);
+    checkallpfxs(&curbgp, false, 0);
+    CU_ASSERT_EQUAL(bgpclose(&curbgp), BGP_ENOERR);
+}
+
+typedef struct {
+    int type, segno;
+    uint32_t as;
+} asent_t;
+
+// plain AS path walk, decoding one AS at a time whatever its size,
+// stops after limit ASes (AS_SETs count once), a negative limit walks everything
+static size_t walkaspath(const byte *ptr, size_t len, size_t as_size, int limit, int *segno, asent_t *out)
+{
+    const byte *end = ptr + len;
+
+    size_t n = 0;
+    while (ptr < end && limit != 0) {
+        int type  = *ptr++;
+        int count = *ptr++;
+
+        (*segno)++;
+        for (int i = 0; i < count && limit != 0; i++) {
+            uint32_t as = 0;
+            for (size_t j = 0; j < as_size; j++)
+                as = (as << 8) | *ptr++;
+
+            out[n].type  = type;
+            out[n].segno = *segno;
+            out[n].as    = as;
+            n++;
+
+            if (type != AS_SEGMENT_SET || i == 0)
+                limit--;
+        }
+    }
+    return n;
+}
+
+static int countaspath(const byte *ptr, size_t len, size_t as_size)
+{
+    const byte *end = ptr + len;
+
+    int count = 0;
+    while (ptr < end) {
+        int type = *ptr++;
+        int n    = *ptr++;
+
+        ptr   += n * as_size;
+        count += (type == AS_SEGMENT_SET) ? (n != 0) : n;
+    }
+    return count;
+}
+
+// encode segments as { type, count, AS... } into an attribute of the given code
+static size_t putaspath(byte *buf, int code, size_t as_size, const uint32_t *segs, size_t nsegs)
+{
+    byte *ptr = buf + 3;
+    for (size_t i = 0; i < nsegs; ) {
+        *ptr++ = segs[i++];
+
+        uint32_t count = segs[i++];
+        *ptr++ = count;
+        while (count-- > 0) {
+            uint32_t as = segs[i++];
+            for (size_t j = as_size; j > 0; j--)
+                *ptr++ = as >> (8 * (j - 1));
+        }
+    }
+
+    buf[0] = (code == AS_PATH_CODE) ? ATTR_TRANSITIVE : ATTR_OPTIONAL | ATTR_TRANSITIVE;
+    buf[1] = code;
+    buf[2] = ptr - buf - 3;
+    return ptr - buf;
+}
+
+static void checkaspath(ubgp_msg_s *msg, ubgp_err (*start)(ubgp_msg_s *), const asent_t *expect, size_t n)
+{
+    CU_ASSERT_EQUAL(start(msg), BGP_ENOERR);
+
+    size_t i = 0;
+    as_pathent_t *ent;
+    while ((ent = nextaspath(msg)) != NULL) {
+        CU_ASSERT_FATAL(i < n);
+        CU_ASSERT_EQUAL(ent->type,  expect[i].type);
+        CU_ASSERT_EQUAL(ent->segno, expect[i].segno);
+        CU_ASSERT_EQUAL(ent->as,    expect[i].as);
+        i++;
+    }
+    CU_ASSERT_EQUAL(i, n);
+    CU_ASSERT_EQUAL(endaspath(msg), BGP_ENOERR);
+}
+
+enum { AS_SEGMENT_CONFED_SEQ = 3, AS_SEGMENT_CONFED_SET = 4 };
+
+void testaspathiter(void)
+{
+    static const uint32_t aspath[] = {
+        AS_SEGMENT_SEQ,        2, 100, 200,
+        AS_SEGMENT_SET,        0,
+        AS_SEGMENT_SET,        2, 300, 400,
+        AS_SEGMENT_CONFED_SEQ, 1, 500,
+        AS_SEGMENT_CONFED_SET, 2, 600, 700,
+        AS_SEGMENT_SEQ,        2, AS_TRANS, AS_TRANS,
+        AS_SEGMENT_SET,        0
+    };
+    static const uint32_t as4path[] = {
+        AS_SEGMENT_SEQ,        1, 70000,
+        AS_SEGMENT_SET,        0,
+        AS_SEGMENT_SET,        2, 80000, 90000
+    };
+    static const uint32_t longas4path[] = {
+        AS_SEGMENT_SEQ,        8, 1, 2, 3, 4, 5, 6, 7, 8
+    };
+    static const byte origin[] = {
+        0x40, ORIGIN_CODE, 0x01, ORIGIN_IGP
+    };
+
+    static const struct {
+        int flags;
+        const uint32_t *as4path;
+        size_t nas4path;
+    } cases[] = {
+        { BGPF_DEFAULT,  as4path,     countof(as4path)     },
+        { BGPF_DEFAULT,  longas4path, countof(longas4path) },  // AS4_PATH must be ignored
+        { BGPF_DEFAULT,  NULL,        0                    },
+        { BGPF_ASN32BIT, as4path,     countof(as4path)     }
+    };
+
+    for (size_t k = 0; k < countof(cases); k++) {
+        size_t as_size = (cases[k].flags & BGPF_ASN32BIT) ? sizeof(uint32_t) : sizeof(uint16_t);
+
+        byte attrs[256];
+        memcpy(attrs, origin, sizeof(origin));
+
+        size_t nattrs  = sizeof(origin);
+        byte  *asp     = attrs + nattrs;
+        nattrs        += putaspath(asp, AS_PATH_CODE, as_size, aspath, countof(aspath));
+
+        byte *as4p = NULL;
+        if (cases[k].as4path) {
+            as4p    = attrs + nattrs;
+            nattrs += putaspath(as4p, AS4_PATH_CODE, sizeof(uint32_t), cases[k].as4path, cases[k].nas4path);
+        }
+
+        byte buf[BGPBUFSIZ];
+        size_t n = mkupdate(buf, sizeof(buf), NULL, 0, attrs, nattrs, NULL, 0);
+        CU_ASSERT_FATAL(n > 0);
+
+        setbgpread(&curbgp, buf, n, cases[k].flags);
+
+        asent_t expect[32];
+        int segno = -1;
+        n = walkaspath(asp + 3, asp[2], as_size, -1, &segno, expect);
+        checkaspath(&curbgp, startaspath, expect, n);
+
+        segno = -1;
+        n = 0;
+        if (as4p)
+            n = walkaspath(as4p + 3, as4p[2], sizeof(uint32_t), -1, &segno, expect);
+
+        checkaspath(&curbgp, startas4path, expect, n);
+
+        // AS_PATH prefix up to the AS4_PATH length, followed by AS4_PATH
+        int limit = -1;
+        if (as4p && as_size == sizeof(uint16_t)) {
+            int ascount  = countaspath(asp + 3, asp[2], as_size);
+            int as4count = countaspath(as4p + 3, as4p[2], sizeof(uint32_t));
+            if (ascount >= as4count)
+                limit = ascount - as4count;
+        }
+
+        segno = -1;
+        n = walkaspath(asp + 3, asp[2], as_size, limit, &segno, expect);
+        if (limit >= 0)
+            n += walkaspath(as4p + 3, as4p[2], sizeof(uint32_t), -1, &segno, expect + n);
+
+        checkaspath(&curbgp, startrealaspath, expect, n);
+
+        // the origin is the last AS of the real path
+        as_origin_t orig;
+        CU_ASSERT_EQUAL(getrealoriginas(&curbgp, &orig), BGP_ENOERR);
+        CU_ASSERT_EQUAL(orig.type, expect[n - 1].type == AS_SEGMENT_SET ? AS_SEGMENT_SET : AS_SEGMENT_SEQ);
+        if (orig.type == AS_SEGMENT_SEQ)
+            CU_ASSERT_EQUAL(orig.as, expect[n - 1].as);
+        else
+            CU_ASSERT_EQUAL(getasoriginset(&orig, orig.count - 1), expect[n - 1].as);
+
+        CU_ASSERT_EQUAL(bgpclose(&curbgp), BGP_ENOERR);
+    }
+}
@@ -0,0 +1,111 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#include "../../ubgp/aslinks.h"
+#include "test.h"
+
+#include <CUnit/CUnit.h>
+
+#include <stdlib.h>
+
+static const aslink_t *findlink(const aslink_t *links, size_t n, uint32_t a, uint32_t b)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (links[i].a == a && links[i].b == b)
+            return &links[i];
+    }
+    return NULL;
+}
+
+void testaslinks(void)
+{
+    aslinks_t x, y;
+    aslinksinit(&x);
+    aslinksinit(&y);
+
+    CU_ASSERT(aslinksadd(&x, 3, 1, 0, 100));
+    CU_ASSERT(aslinksadd(&x, 1, 3, 0, 50));   // same link, same peer
+    CU_ASSERT(aslinksadd(&x, 1, 3, 1, 200));
+    CU_ASSERT(aslinksadd(&x, 2, 2, 0, 100));  // self loop
+    CU_ASSERT(aslinksadd(&x, 1, 2, 0, 100));
+    CU_ASSERT(aslinkscount(&x) == 2);
+
+    CU_ASSERT(aslinksadd(&y, 1, 3, 1, 300));  // peer already seen by x
+    CU_ASSERT(aslinksadd(&y, 3, 1, 2, 10));
+    CU_ASSERT(aslinksadd(&y, 4294967295u, 3, 2, 10));
+
+    // force a few rehashes
+    for (uint32_t i = 1000; i < 5000; i++)
+        CU_ASSERT(aslinksadd(&y, i, i + 1, i % 7, i));
+
+    CU_ASSERT_FATAL(aslinksmerge(&x, &y));
+    CU_ASSERT(aslinkscount(&x) == 3 + 4000);
+
+    size_t n;
+    aslink_t *links = aslinkslist(&x, &n);
+    CU_ASSERT_FATAL(links != NULL);
+    CU_ASSERT_FATAL(n == aslinkscount(&x));
+
+    for (size_t i = 1; i < n; i++)
+        CU_ASSERT(links[i-1].a < links[i].a || (links[i-1].a == links[i].a && links[i-1].b < links[i].b));
+
+    const aslink_t *l = findlink(links, n, 1, 3);
+    CU_ASSERT_FATAL(l != NULL);
+    CU_ASSERT(l->first == 10 && l->last == 300 && l->npeers == 3);
+
+    l = findlink(links, n, 1, 2);
+    CU_ASSERT_FATAL(l != NULL);
+    CU_ASSERT(l->first == 100 && l->last == 100 && l->npeers == 1);
+
+    l = findlink(links, n, 3, 4294967295u);
+    CU_ASSERT_FATAL(l != NULL);
+    CU_ASSERT(l->npeers == 1);
+
+    l = findlink(links, n, 2500, 2501);
+    CU_ASSERT_FATAL(l != NULL);
+    CU_ASSERT(l->first == 2500 && l->npeers == 1);
+
+    aslinks_csr_t csr;
+    CU_ASSERT_FATAL(aslinkscsr(&csr, links, n));
+    CU_ASSERT(csr.nverts == 4 + 4001);
+    CU_ASSERT(csr.nadj == 2 * n);
+    CU_ASSERT(csr.offs[csr.nverts] == csr.nadj);
+
+    // vertex 0 is AS1, with neighbours AS2 and AS3
+    CU_ASSERT(csr.ases[0] == 1 && csr.ases[1] == 2 && csr.ases[2] == 3);
+    CU_ASSERT(csr.offs[1] - csr.offs[0] == 2);
+    CU_ASSERT(csr.adj[csr.offs[0]] == 1 && csr.adj[csr.offs[0] + 1] == 2);
+
+    // vertex 2 is AS3, with neighbours AS1 and AS4294967295
+    CU_ASSERT(csr.offs[3] - csr.offs[2] == 2);
+    CU_ASSERT(csr.adj[csr.offs[2]] == 0);
+    CU_ASSERT(csr.ases[csr.adj[csr.offs[2] + 1]] == 4294967295u);
+
+    for (size_t v = 0; v < csr.nverts; v++) {
+        for (uint32_t i = csr.offs[v] + 1; i < csr.offs[v+1]; i++)
+            CU_ASSERT(csr.adj[i-1] < csr.adj[i]);
+    }
+
+    aslinksfreecsr(&csr);
+    free(links);
+    aslinksdestroy(&x);
+    aslinksdestroy(&y);
+}
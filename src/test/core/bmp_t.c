@@ -0,0 +1,480 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#include "../../ubgp/bgp.h"
+#include "../../ubgp/bgpattribs.h"
+#include "../../ubgp/bgpparams.h"
+#include "../../ubgp/bmp.h"
+#include "../../ubgp/endian.h"
+#include "../../ubgp/frame.h"
+#include "../../ubgp/io.h"
+#include "test.h"
+
+#include <CUnit/CUnit.h>
+#include <arpa/inet.h>
+#include <string.h>
+
+#define PEER_AS 4200000001u
+#define STAMP   1546300800u
+
+static byte stream[4096];
+static size_t streamlen;
+
+static void put(const void *data, size_t n)
+{
+    CU_ASSERT_FATAL(streamlen + n <= sizeof(stream));
+    memcpy(&stream[streamlen], data, n);
+    streamlen += n;
+}
+
+static void put8(uint8_t v)
+{
+    put(&v, sizeof(v));
+}
+
+static void put16(uint16_t v)
+{
+    v = beswap16(v);
+    put(&v, sizeof(v));
+}
+
+static void put32(uint32_t v)
+{
+    v = beswap32(v);
+    put(&v, sizeof(v));
+}
+
+static void put64(uint64_t v)
+{
+    v = beswap64(v);
+    put(&v, sizeof(v));
+}
+
+// common header, with a length to be patched by endmsg()
+static size_t startmsg(bmp_msgtype type)
+{
+    size_t off = streamlen;
+
+    put8(BMP_VERSION);
+    put32(0);
+    put8(type);
+    return off;
+}
+
+static void endmsg(size_t off)
+{
+    uint32_t len = beswap32(streamlen - off);
+    memcpy(&stream[off + 1], &len, sizeof(len));
+}
+
+static void putpeerhdr(uint8_t flags)
+{
+    struct in_addr addr;
+    inet_pton(AF_INET, "192.0.2.1", &addr);
+
+    put8(BMP_PEER_GLOBAL);
+    put8(flags);
+    put64(0);
+    for (int i = 0; i < 12; i++)
+        put8(0);
+
+    put(&addr, sizeof(addr));
+    put32(PEER_AS);
+    put(&addr, sizeof(addr));
+    put32(STAMP);
+    put32(250000);
+}
+
+static void putbgp(ubgp_msg_s *msg)
+{
+    size_t n;
+    const void *pkt = bgpfinish(msg, &n);
+
+    CU_ASSERT_FATAL(pkt != NULL);
+    put(pkt, n);
+    bgpclose(msg);
+}
+
+static void putopen(uint addpath)
+{
+    ubgp_msg_s msg;
+    bgpcap_t cap;
+    bgp_open_t op = {
+        .version   = BGP_VERSION,
+        .my_as     = AS_TRANS,
+        .hold_time = BGP_HOLD_SECS
+    };
+
+    setbgpwrite(&msg, BGP_OPEN, BGPF_DEFAULT);
+    setbgpopen(&msg, &op);
+    startbgpcaps(&msg);
+        cap.code = ASN32BIT_CODE;
+        cap.len  = ASN32BIT_LENGTH;
+        putbgpcap(&msg, setasn32bit(&cap, PEER_AS));
+
+        cap.code = ADD_PATH_CODE;
+        cap.len  = 0;
+        putaddpathtuple(&cap, AFI_IPV4, SAFI_UNICAST, addpath);
+        putbgpcap(&msg, &cap);
+    endbgpcaps(&msg);
+
+    putbgp(&msg);
+}
+
+static void putupdate(void)
+{
+    ubgp_msg_s msg;
+    byte attrbuf[64];
+    bgpattr_t *attr = (bgpattr_t *) attrbuf;
+    uint32_t as = PEER_AS;
+
+    setbgpwrite(&msg, BGP_UPDATE, BGPF_ASN32BIT);
+    startbgpattribs(&msg);
+        attr->code  = ORIGIN_CODE;
+        attr->len   = ORIGIN_LENGTH;
+        attr->flags = DEFAULT_ORIGIN_FLAGS;
+        setorigin(attr, ORIGIN_IGP);
+        putbgpattrib(&msg, attr);
+
+        attr->code  = AS_PATH_CODE;
+        attr->len   = 0;
+        attr->flags = DEFAULT_AS_PATH_FLAGS;
+        putasseg32(attr, AS_SEGMENT_SEQ, &as, 1);
+        putbgpattrib(&msg, attr);
+    endbgpattribs(&msg);
+
+    netaddr_t pfx;
+    CU_ASSERT_FATAL(stonaddr(&pfx, "10.0.0.0/8") == 0);
+
+    startnlri(&msg);
+        putnlri(&msg, &pfx);
+    endnlri(&msg);
+
+    putbgp(&msg);
+}
+
+// Initiation, Peer Up, Route Monitoring, Statistics Report, Peer Down, Termination
+static void buildstream(void)
+{
+    streamlen = 0;
+
+    size_t off = startmsg(BMP_INITIATION);
+    put16(BMP_INFO_SYSNAME);
+    put16(6);
+    put("router", 6);
+    endmsg(off);
+
+    off = startmsg(BMP_PEER_UP);
+    putpeerhdr(0);
+    for (int i = 0; i < 12; i++)
+        put8(0);
+
+    put32(0xc0000202);  // 192.0.2.2
+    put16(179);
+    put16(40000);
+    putopen(ADD_PATH_RX);
+    putopen(ADD_PATH_TX);
+    put16(BMP_INFO_STRING);
+    put16(2);
+    put("up", 2);
+    endmsg(off);
+
+    off = startmsg(BMP_ROUTE_MONITORING);
+    putpeerhdr(BMP_PEERF_POST);
+    putupdate();
+    endmsg(off);
+
+    off = startmsg(BMP_STATS_REPORT);
+    putpeerhdr(0);
+    put32(2);
+    put16(BMP_STAT_REJECTED);
+    put16(4);
+    put32(7);
+    put16(BMP_STAT_ADJ_RIB_IN);
+    put16(8);
+    put64(1234);
+    endmsg(off);
+
+    off = startmsg(BMP_PEER_DOWN);
+    putpeerhdr(0);
+    put8(BMP_DOWN_REMOTE_NOTIFY);
+    for (int i = 0; i < 16; i++)
+        put8(0xff);
+
+    put16(21);
+    put8(BGP_NOTIFICATION);
+    put8(6);  // Cease
+    put8(2);  // Administrative Shutdown
+    endmsg(off);
+
+    off = startmsg(BMP_TERMINATION);
+    put16(BMP_TERM_REASON);
+    put16(2);
+    put16(0);
+    endmsg(off);
+}
+
+static void checkpeerhdr(ubmp_msg_s *msg, uint8_t flags)
+{
+    const bmp_peer_header_t *ph = getbmppeerheader(msg);
+
+    CU_ASSERT_FATAL(ph != NULL);
+    CU_ASSERT(ph->peer_type == BMP_PEER_GLOBAL);
+    CU_ASSERT(ph->peer_flags == flags);
+    CU_ASSERT(ph->peer_as == PEER_AS);
+    CU_ASSERT(ph->peer_addr.family == AF_INET);
+    CU_ASSERT(strcmp(naddrtos(&ph->peer_addr, NADDR_PLAIN), "192.0.2.1") == 0);
+    CU_ASSERT(ph->stamp.tv_sec == STAMP);
+    CU_ASSERT(ph->stamp.tv_nsec == 250000000l);
+}
+
+static void testbmpread(void)
+{
+    ubmp_msg_s msg;
+    ubgp_msg_s bgp;
+    bmp_tlv_t *tlv;
+    size_t count;
+
+    io_rw_t io = IO_MEM_RDINIT(stream, streamlen);
+
+    CU_ASSERT_FATAL(setbmpreadfrom(&msg, &io) == BMP_ENOERR);
+    CU_ASSERT(getbmptype(&msg) == BMP_INITIATION);
+    CU_ASSERT(getbmppeerheader(&msg) == NULL);
+    CU_ASSERT(bmperror(&msg) == BMP_EINVOP);
+    bmpclose(&msg);
+
+    CU_ASSERT_FATAL(setbmpreadfrom(&msg, &io) == BMP_ENOERR);
+    CU_ASSERT(getbmptype(&msg) == BMP_PEER_UP);
+    checkpeerhdr(&msg, 0);
+
+    const bmp_peer_up_t *up = getbmppeerup(&msg);
+    CU_ASSERT_FATAL(up != NULL);
+    CU_ASSERT(strcmp(naddrtos(&up->local_addr, NADDR_PLAIN), "192.0.2.2") == 0);
+    CU_ASSERT(up->local_port == 179);
+    CU_ASSERT(up->remote_port == 40000);
+    CU_ASSERT(up->bgpflags == (BGPF_ASN32BIT | BGPF_ADDPATH));
+
+    setbgpread(&bgp, up->recv_open, up->recv_len, BGPF_NOCOPY);
+    CU_ASSERT(getbgptype(&bgp) == BGP_OPEN);
+    bgpclose(&bgp);
+
+    CU_ASSERT(startbmptlvs(&msg, NULL) == BMP_ENOERR);
+    tlv = nextbmptlv(&msg);
+    CU_ASSERT_FATAL(tlv != NULL);
+    CU_ASSERT(tlv->type == BMP_INFO_STRING);
+    CU_ASSERT(tlv->len == 2 && memcmp(tlv->value, "up", 2) == 0);
+    CU_ASSERT(nextbmptlv(&msg) == NULL);
+    CU_ASSERT(bmpclose(&msg) == BMP_ENOERR);
+
+    CU_ASSERT_FATAL(setbmpreadfrom(&msg, &io) == BMP_ENOERR);
+    CU_ASSERT(getbmptype(&msg) == BMP_ROUTE_MONITORING);
+    checkpeerhdr(&msg, BMP_PEERF_POST);
+    CU_ASSERT(getbmppeerup(&msg) == NULL);
+    CU_ASSERT(bmperror(&msg) == BMP_EINVOP);
+    bmpclose(&msg);
+
+    // errors are sticky, read the Route Monitoring message again
+    io = (io_rw_t) IO_MEM_RDINIT(stream, streamlen);
+    for (int i = 0; i < 3; i++) {
+        CU_ASSERT_FATAL(setbmpreadfrom(&msg, &io) == BMP_ENOERR);
+        if (i < 2)
+            bmpclose(&msg);
+    }
+
+    CU_ASSERT_FATAL(unwrapbmp(&msg, &bgp, BGPF_DEFAULT) == BMP_ENOERR);
+    CU_ASSERT(getbgptype(&bgp) == BGP_UPDATE);
+    CU_ASSERT(isbgpasn32bit(&bgp));
+    CU_ASSERT(!isbgpaddpath(&bgp));
+
+    // zero-copy
+    size_t n;
+    const byte *pdu = getbgpdata(&bgp, &n);
+    CU_ASSERT(pdu > (const byte *) &msg && pdu < (const byte *) (&msg + 1));
+
+    startnlri(&bgp);
+    const netaddr_t *pfx = nextnlri(&bgp);
+    CU_ASSERT_FATAL(pfx != NULL);
+    CU_ASSERT(strcmp(naddrtos(pfx, NADDR_CIDR), "10.0.0.0/8") == 0);
+    endnlri(&bgp);
+    CU_ASSERT(bgpclose(&bgp) == BGP_ENOERR);
+    bmpclose(&msg);
+
+    CU_ASSERT_FATAL(setbmpreadfrom(&msg, &io) == BMP_ENOERR);
+    CU_ASSERT(getbmptype(&msg) == BMP_STATS_REPORT);
+    CU_ASSERT(startbmptlvs(&msg, &count) == BMP_ENOERR);
+    CU_ASSERT(count == 2);
+    tlv = nextbmptlv(&msg);
+    CU_ASSERT_FATAL(tlv != NULL);
+    CU_ASSERT(tlv->type == BMP_STAT_REJECTED && getbmpstat(tlv) == 7);
+    tlv = nextbmptlv(&msg);
+    CU_ASSERT_FATAL(tlv != NULL);
+    CU_ASSERT(tlv->type == BMP_STAT_ADJ_RIB_IN && getbmpstat(tlv) == 1234);
+    CU_ASSERT(nextbmptlv(&msg) == NULL);
+    CU_ASSERT(bmpclose(&msg) == BMP_ENOERR);
+
+    CU_ASSERT_FATAL(setbmpreadfrom(&msg, &io) == BMP_ENOERR);
+    CU_ASSERT(getbmptype(&msg) == BMP_PEER_DOWN);
+    checkpeerhdr(&msg, 0);
+
+    const bmp_peer_down_t *down = getbmppeerdown(&msg);
+    CU_ASSERT_FATAL(down != NULL);
+    CU_ASSERT(down->reason == BMP_DOWN_REMOTE_NOTIFY);
+    CU_ASSERT(down->len == 21);
+    bmpclose(&msg);
+
+    CU_ASSERT_FATAL(setbmpreadfrom(&msg, &io) == BMP_ENOERR);
+    CU_ASSERT(getbmptype(&msg) == BMP_TERMINATION);
+    CU_ASSERT(startbmptlvs(&msg, NULL) == BMP_ENOERR);
+    tlv = nextbmptlv(&msg);
+    CU_ASSERT(tlv && tlv->type == BMP_TERM_REASON && tlv->len == 2);
+    bmpclose(&msg);
+
+    CU_ASSERT(setbmpreadfrom(&msg, &io) == BMP_EIO);
+    bmpclose(&msg);
+}
+
+static void testbmpframe(void)
+{
+    for (size_t chunk = 1; chunk <= streamlen; chunk++) {
+        framer_t f;
+        framerinit(&f, FRAME_BMP);
+
+        size_t nmsgs = 0, off = 0;
+        for (size_t i = 0; i < streamlen; i += chunk) {
+            framerfeed(&f, &stream[i], MIN(chunk, streamlen - i));
+
+            const void *rec;
+            size_t size;
+            while ((rec = framernext(&f, &size)) != NULL) {
+                ubmp_msg_s msg;
+
+                CU_ASSERT(setbmpread(&msg, rec, size, BMPF_NOCOPY) == BMP_ENOERR);
+                CU_ASSERT(getbmptype(&msg) == stream[off + 5]);
+                bmpclose(&msg);
+
+                off += size;
+                nmsgs++;
+            }
+        }
+
+        CU_ASSERT(framererror(&f) == FRAME_ENOERR);
+        CU_ASSERT(nmsgs == 6);
+        framerdestroy(&f);
+    }
+}
+
+static void testbmpbad(void)
+{
+    ubmp_msg_s msg;
+
+    // unsupported version
+    stream[0] = 2;
+    CU_ASSERT(setbmpread(&msg, stream, streamlen, BMPF_DEFAULT) == BMP_EBADVERS);
+    bmpclose(&msg);
+
+    framer_t f;
+    framerinit(&f, FRAME_BMP);
+    framerfeed(&f, stream, streamlen);
+    CU_ASSERT(framernext(&f, NULL) == NULL);
+    CU_ASSERT(framererror(&f) == FRAME_EBADVERSION);
+    framerdestroy(&f);
+    stream[0] = BMP_VERSION;
+
+    // a Route Monitoring message too short for its per-peer header
+    byte rm[BMP_HDRSIZ + 10] = { BMP_VERSION, 0, 0, 0, sizeof(rm), BMP_ROUTE_MONITORING };
+    CU_ASSERT(setbmpread(&msg, rm, sizeof(rm), BMPF_DEFAULT) == BMP_ENOERR);
+    CU_ASSERT(getbmppeerheader(&msg) == NULL);
+    CU_ASSERT(bmpclose(&msg) == BMP_EBADPEERHDR);
+
+    // length disagreeing with data
+    CU_ASSERT(setbmpread(&msg, rm, sizeof(rm) - 1, BMPF_DEFAULT) == BMP_EBADHDR);
+    bmpclose(&msg);
+
+    // truncated stream
+    io_rw_t io = IO_MEM_RDINIT(stream, 32);  // Initiation and part of Peer Up
+    CU_ASSERT(setbmpreadfrom(&msg, &io) == BMP_ENOERR);
+    bmpclose(&msg);
+    CU_ASSERT(setbmpreadfrom(&msg, &io) == BMP_EBADMSG);
+    bmpclose(&msg);
+}
+
+// OPEN advertising each capability in its own optional parameter
+static void putsplitopen(uint addpath)
+{
+    for (int i = 0; i < 16; i++)
+        put8(0xff);
+
+    put16(19 + 10 + 2 * 8);  // header, OPEN fields and two parameters
+    put8(BGP_OPEN);
+    put8(BGP_VERSION);
+    put16(AS_TRANS);
+    put16(BGP_HOLD_SECS);
+    put32(0xc0000201);
+    put8(2 * 8);
+
+    put8(CAPABILITY_CODE);
+    put8(6);
+    put8(ASN32BIT_CODE);
+    put8(ASN32BIT_LENGTH);
+    put32(PEER_AS);
+
+    put8(CAPABILITY_CODE);
+    put8(6);
+    put8(ADD_PATH_CODE);
+    put8(4);
+    put16(AFI_IPV4);
+    put8(SAFI_UNICAST);
+    put8(addpath);
+}
+
+static void testbmpsplitcaps(void)
+{
+    ubmp_msg_s msg;
+
+    streamlen = 0;
+
+    size_t off = startmsg(BMP_PEER_UP);
+    putpeerhdr(0);
+    for (int i = 0; i < 16; i++)
+        put8(0);
+
+    put16(179);
+    put16(40000);
+    putsplitopen(ADD_PATH_RX);
+    putsplitopen(ADD_PATH_TX);
+    endmsg(off);
+
+    CU_ASSERT_FATAL(setbmpread(&msg, stream, streamlen, BMPF_DEFAULT) == BMP_ENOERR);
+
+    const bmp_peer_up_t *up = getbmppeerup(&msg);
+    CU_ASSERT_FATAL(up != NULL);
+    CU_ASSERT(up->bgpflags == (BGPF_ASN32BIT | BGPF_ADDPATH));
+    CU_ASSERT(bmpclose(&msg) == BMP_ENOERR);
+}
+
+void testbmp(void)
+{
+    buildstream();
+    testbmpread();
+    testbmpframe();
+    testbmpbad();
+    testbmpsplitcaps();
+}
@@ -0,0 +1,380 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#include "../../ubgp/cpatriciatrie.h"
+#include "../../ubgp/endian.h"
+#include "../../ubgp/patriciatrie.h"
+#include "../../ubgp/ubgpdef.h"
+#include "../test_util.h"
+#include "test.h"
+
+#include <CUnit/CUnit.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+
+enum {
+    NUM_STABLE   = 512,
+    NUM_VOLATILE = 2048,
+    NUM_READERS  = 4,
+    NUM_ROUNDS   = 64,
+
+    PAYLOAD_LIVE = 0x11fe,
+    PAYLOAD_DEAD = 0xdead
+};
+
+static const uint bitlens[] = { 8, 12, 16, 17, 20, 24, 32 };
+
+static uint32_t xorshift(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+// random prefix inside 10.0.0.0/8, with few significant bits to make them overlap
+static void randpfx(netaddr_t *p, uint32_t *state)
+{
+    uint32_t r = xorshift(state);
+    uint bitlen = bitlens[r % countof(bitlens)];
+    uint32_t addr = 0x0a000000u | (xorshift(state) & 0x00f30f01u);
+
+    addr &= ~0u << (32 - bitlen);
+    addr = beswap32(addr);
+    makenaddr(p, AF_INET, &addr, bitlen);
+}
+
+static bool refmatches(const netaddr_t *a, const netaddr_t *b, uint bitlen)
+{
+    return prefixeqwithmask(a, b, bitlen);
+}
+
+void testcpatbase(void)
+{
+    cpatricia_trie_t pt;
+    cpatinit(&pt, AF_INET);
+
+    cpatricia_reader_t *r = cpatreaderget(&pt);
+    CU_ASSERT_FATAL(r != NULL);
+
+    netaddr_t set[256];
+    bool present[256] = { false };
+    uint32_t state = 0x9e3779b9u;
+
+    for (uint i = 0; i < countof(set); i++) {
+        randpfx(&set[i], &state);
+        for (uint j = 0; j < i; j++) {
+            if (prefixeq(&set[i], &set[j])) {
+                i--;
+                break;
+            }
+        }
+    }
+
+    for (uint round = 0; round < 4096; round++) {
+        uint i = xorshift(&state) % countof(set);
+
+        int inserted;
+        if (present[i]) {
+            void *payload = cpatremove(&pt, &set[i]);
+            CU_ASSERT(payload == &set[i]);
+        } else {
+            trienode_t *n = cpatinsert(&pt, &set[i], &set[i], &inserted);
+            CU_ASSERT_FATAL(n != NULL);
+            CU_ASSERT(inserted == PREFIX_INSERTED);
+            CU_ASSERT(n->payload == &set[i]);
+        }
+        present[i] = !present[i];
+
+        uint count = 0;
+        for (uint j = 0; j < countof(set); j++)
+            count += present[j];
+
+        CU_ASSERT(cpatcount(&pt) == count);
+
+        netaddr_t q;
+        randpfx(&q, &state);
+
+        const netaddr_t *exact = NULL, *best = NULL;
+        bool subnet = false, supernet = false;
+        for (uint j = 0; j < countof(set); j++) {
+            if (!present[j])
+                continue;
+
+            const netaddr_t *p = &set[j];
+            if (p->bitlen == q.bitlen && refmatches(p, &q, q.bitlen))
+                exact = p;
+            // best match excludes the prefix itself, being a subnet doesn't
+            if (p->bitlen < q.bitlen && refmatches(p, &q, p->bitlen) && (!best || best->bitlen < p->bitlen))
+                best = p;
+            if (p->bitlen <= q.bitlen && refmatches(p, &q, p->bitlen))
+                subnet = true;
+            if (p->bitlen >= q.bitlen && refmatches(p, &q, q.bitlen))
+                supernet = true;
+        }
+
+        cpatreadbegin(&pt, r);
+
+        trienode_t *n = cpatsearchexact(&pt, &q);
+        CU_ASSERT_EX((n ? n->payload : NULL) == exact, "%s", naddrtos(&q, NADDR_CIDR));
+
+        n = cpatsearchbest(&pt, &q);
+        CU_ASSERT_EX((n ? n->payload : NULL) == best, "%s", naddrtos(&q, NADDR_CIDR));
+
+        CU_ASSERT(cpatissubnetof(&pt, &q) == subnet);
+        CU_ASSERT(cpatissupernetof(&pt, &q) == supernet);
+        CU_ASSERT(cpatisrelatedof(&pt, &q) == (subnet || supernet));
+
+        cpatreadend(r);
+    }
+
+    cpatreaderput(r);
+    cpatsynchronize(&pt);
+    cpatdestroy(&pt);
+}
+
+// both tries must answer every query alike
+void testcpatdiff(void)
+{
+    patricia_trie_t ref;
+    cpatricia_trie_t pt;
+
+    patinit(&ref, AF_INET);
+    cpatinit(&pt, AF_INET);
+
+    cpatricia_reader_t *r = cpatreaderget(&pt);
+    CU_ASSERT_FATAL(r != NULL);
+
+    netaddr_t set[512];
+    uint32_t state = 0x6a09e667u;
+
+    for (uint i = 0; i < countof(set); i++)
+        randpfx(&set[i], &state);
+
+    for (uint round = 0; round < 16384; round++) {
+        uint i = xorshift(&state) % countof(set);
+
+        // the set may hold duplicates, keep both tries in sync on the first one
+        trienode_t *n = patsearchexact(&ref, &set[i]);
+        if (n) {
+            CU_ASSERT(cpatremove(&pt, &set[i]) == n->payload);
+            CU_ASSERT(patremove(&ref, &set[i]) == n->payload);
+        } else {
+            int inserted;
+
+            n = patinsert(&ref, &set[i], &inserted);
+            CU_ASSERT_FATAL(n != NULL);
+            n->payload = &set[i];
+
+            CU_ASSERT_FATAL(cpatinsert(&pt, &set[i], &set[i], &inserted) != NULL);
+            CU_ASSERT(inserted == PREFIX_INSERTED);
+        }
+
+        CU_ASSERT(cpatcount(&pt) == ref.nprefs);
+
+        // query both random prefixes and ones likely in the tries
+        netaddr_t q;
+        if (round & 1)
+            randpfx(&q, &state);
+        else
+            q = set[xorshift(&state) % countof(set)];
+
+        cpatreadbegin(&pt, r);
+
+        n = patsearchexact(&ref, &q);
+        trienode_t *cn = cpatsearchexact(&pt, &q);
+        CU_ASSERT_EX((n ? n->payload : NULL) == (cn ? cn->payload : NULL), "%s", naddrtos(&q, NADDR_CIDR));
+
+        n  = patsearchbest(&ref, &q);
+        cn = cpatsearchbest(&pt, &q);
+        CU_ASSERT_EX((n ? n->payload : NULL) == (cn ? cn->payload : NULL), "%s", naddrtos(&q, NADDR_CIDR));
+
+        CU_ASSERT_EX(cpatissubnetof(&pt, &q) == patissubnetof(&ref, &q), "%s", naddrtos(&q, NADDR_CIDR));
+        CU_ASSERT_EX(cpatissupernetof(&pt, &q) == patissupernetof(&ref, &q), "%s", naddrtos(&q, NADDR_CIDR));
+        CU_ASSERT_EX(cpatisrelatedof(&pt, &q) == patisrelatedof(&ref, &q), "%s", naddrtos(&q, NADDR_CIDR));
+
+        cpatreadend(r);
+    }
+
+    cpatreaderput(r);
+    cpatsynchronize(&pt);
+    cpatdestroy(&pt);
+    patdestroy(&ref);
+}
+
+typedef struct {
+    int magic;
+    netaddr_t prefix;
+} stresspayload_t;
+
+typedef struct {
+    cpatricia_trie_t *pt;
+    netaddr_t *stable;
+    netaddr_t *volatiles;
+    int done;
+    int errors;
+    uint seed;
+} stressctx_t;
+
+static void *stressreader(void *arg)
+{
+    stressctx_t *ctx = arg;
+    uint32_t state = ATOMIC_INCR(ctx->seed) * 0x9e3779b9u;
+
+    cpatricia_reader_t *r = cpatreaderget(ctx->pt);
+    if (!r) {
+        (void) ATOMIC_INCR(ctx->errors);
+        return NULL;
+    }
+
+    while (!ATOMIC_LOAD_ACQ(ctx->done)) {
+        cpatreadbegin(ctx->pt, r);
+
+        // stable prefixes must never disappear
+        const netaddr_t *p = &ctx->stable[xorshift(&state) % NUM_STABLE];
+        trienode_t *n = cpatsearchexact(ctx->pt, p);
+        if (!n || n->payload != p || (p->bitlen > 8 && !cpatissubnetof(ctx->pt, p)))
+            (void) ATOMIC_INCR(ctx->errors);
+
+        // volatile prefixes come and go, but found payloads must be alive
+        p = &ctx->volatiles[xorshift(&state) % NUM_VOLATILE];
+        n = cpatsearchexact(ctx->pt, p);
+        if (n) {
+            const stresspayload_t *payload = n->payload;
+            if (payload->magic != PAYLOAD_LIVE || !prefixeq(&payload->prefix, p))
+                (void) ATOMIC_INCR(ctx->errors);
+        }
+
+        n = cpatsearchbest(ctx->pt, p);
+        if (!n || !prefixeqwithmask(&n->prefix, p, n->prefix.bitlen))
+            (void) ATOMIC_INCR(ctx->errors);
+
+        cpatreadend(r);
+    }
+
+    cpatreaderput(r);
+    return NULL;
+}
+
+void testcpatstress(void)
+{
+    cpatricia_trie_t *pt = malloc(sizeof(*pt));
+    CU_ASSERT_FATAL(pt != NULL);
+
+    cpatinit(pt, AF_INET);
+
+    netaddr_t *stable    = calloc(NUM_STABLE, sizeof(*stable));
+    netaddr_t *volatiles = calloc(NUM_VOLATILE, sizeof(*volatiles));
+    stresspayload_t **payloads = calloc(NUM_VOLATILE, sizeof(*payloads));
+    CU_ASSERT_FATAL(stable && volatiles && payloads);
+
+    uint32_t state = 0x2545f491u;
+
+    // 10.0.0.0/8 is always present, so any best match query succeeds
+    uint32_t net = beswap32(0x0a000000u);
+    makenaddr(&stable[0], AF_INET, &net, 8);
+    CU_ASSERT_FATAL(cpatinsert(pt, &stable[0], &stable[0], NULL) != NULL);
+
+    for (uint i = 1; i < NUM_STABLE; i++) {
+        int inserted;
+
+        randpfx(&stable[i], &state);
+        CU_ASSERT_FATAL(cpatinsert(pt, &stable[i], &stable[i], &inserted) != NULL);
+        if (inserted != PREFIX_INSERTED)
+            i--;
+    }
+    for (uint i = 0; i < NUM_VOLATILE; i++) {
+        randpfx(&volatiles[i], &state);
+
+        // never touch stable ones, nor insert the same prefix twice
+        bool dup = (cpatsearchexact(pt, &volatiles[i]) != NULL);
+        for (uint j = 0; j < i && !dup; j++)
+            dup = prefixeq(&volatiles[i], &volatiles[j]);
+
+        if (dup)
+            i--;
+    }
+
+    stressctx_t ctx = {
+        .pt        = pt,
+        .stable    = stable,
+        .volatiles = volatiles
+    };
+
+    pthread_t readers[NUM_READERS];
+    for (uint i = 0; i < NUM_READERS; i++)
+        CU_ASSERT_FATAL(pthread_create(&readers[i], NULL, stressreader, &ctx) == 0);
+
+    for (uint round = 0; round < NUM_ROUNDS; round++) {
+        stresspayload_t *dead[NUM_VOLATILE];
+        uint ndead = 0;
+
+        for (uint j = 0; j < NUM_VOLATILE; j++) {
+            uint i = xorshift(&state) % NUM_VOLATILE;
+
+            if (payloads[i]) {
+                void *payload = cpatremove(pt, &volatiles[i]);
+                CU_ASSERT(payload == payloads[i]);
+
+                dead[ndead++] = payloads[i];
+                payloads[i]   = NULL;
+            } else {
+                stresspayload_t *payload = malloc(sizeof(*payload));
+                CU_ASSERT_FATAL(payload != NULL);
+
+                payload->magic  = PAYLOAD_LIVE;
+                payload->prefix = volatiles[i];
+
+                int inserted;
+                CU_ASSERT_FATAL(cpatinsert(pt, &volatiles[i], payload, &inserted) != NULL);
+                CU_ASSERT(inserted == PREFIX_INSERTED);
+                payloads[i] = payload;
+            }
+        }
+
+        // no reader may see removed payloads past this point
+        cpatsynchronize(pt);
+        for (uint i = 0; i < ndead; i++) {
+            dead[i]->magic = PAYLOAD_DEAD;
+            free(dead[i]);
+        }
+    }
+
+    ATOMIC_STORE_REL(ctx.done, 1);
+    for (uint i = 0; i < NUM_READERS; i++)
+        pthread_join(readers[i], NULL);
+
+    CU_ASSERT(ctx.errors == 0);
+
+    for (uint i = 0; i < NUM_STABLE; i++)
+        CU_ASSERT(cpatsearchexact(pt, &stable[i]) != NULL);
+
+    for (uint i = 0; i < NUM_VOLATILE; i++)
+        free(payloads[i]);
+
+    cpatdestroy(pt);
+    free(pt);
+    free(stable);
+    free(volatiles);
+    free(payloads);
+}
@@ -0,0 +1,133 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#include "../../ubgp/flap.h"
+#include "../test_util.h"
+#include "test.h"
+
+#include <CUnit/CUnit.h>
+
+void testflap(void)
+{
+    flap_table_t t;
+    float penalty;
+
+    flapinit(&t, NULL);
+
+    CU_ASSERT(flapupdate(&t, 1, pfx("10.0.0.0/8"), 0, false, 0, &penalty) == FLAP_NONE);
+    CU_ASSERT(penalty == 0.0f);
+    CU_ASSERT(flapupdate(&t, 1, pfx("10.0.0.0/8"), 0, true, 1, &penalty) == FLAP_NONE);
+    CU_ASSERT(penalty == 1000.0f);
+    CU_ASSERT(flapupdate(&t, 1, pfx("10.0.0.0/8"), 0, false, 2, &penalty) == FLAP_NONE);
+    CU_ASSERT(flapupdate(&t, 1, pfx("10.0.0.0/8"), 0, true, 3, &penalty) == FLAP_NONE);
+    CU_ASSERT(penalty > 1990.0f && penalty < 2000.0f);  // decayed a little
+    CU_ASSERT(flapupdate(&t, 1, pfx("10.0.0.0/8"), 0, false, 4, &penalty) == FLAP_NONE);
+    CU_ASSERT(flapupdate(&t, 1, pfx("10.0.0.0/8"), 0, true, 5, &penalty) == FLAP_SUPPRESS);
+    CU_ASSERT(penalty > 2000.0f);
+
+    // repeated withdrawals count once, suppression is only reported once
+    float before = penalty;
+    CU_ASSERT(flapupdate(&t, 1, pfx("10.0.0.0/8"), 0, true, 5, &penalty) == FLAP_NONE);
+    CU_ASSERT(penalty == before);
+
+    // routes are told apart by peer, path identifier and family
+    CU_ASSERT(flapupdate(&t, 2, pfx("10.0.0.0/8"), 0, true, 5, &penalty) == FLAP_NONE);
+    CU_ASSERT(penalty == 1000.0f);
+    CU_ASSERT(flapupdate(&t, 1, pfx("10.0.0.0/8"), 7, true, 5, &penalty) == FLAP_NONE);
+    CU_ASSERT(penalty == 1000.0f);
+    CU_ASSERT(flapupdate(&t, 1, pfx("a00::/8"), 0, true, 5, &penalty) == FLAP_NONE);
+    CU_ASSERT(penalty == 1000.0f);
+    CU_ASSERT(flapcount(&t) == 4);
+
+    // a little more than two half-lives
+    CU_ASSERT(flapupdate(&t, 1, pfx("10.0.0.0/8"), 0, false, 2000, &penalty) == FLAP_REUSE);
+    CU_ASSERT(penalty > 600.0f && penalty < 700.0f);
+
+    // routes idle long enough are as good as new, whether they've been swept or not
+    CU_ASSERT(flapupdate(&t, 2, pfx("10.0.0.0/8"), 0, false, 5000, &penalty) == FLAP_NONE);
+    CU_ASSERT(penalty == 0.0f);
+
+    CU_ASSERT(flapsweep(&t, 5000, 0) == 3);
+    CU_ASSERT(flapcount(&t) == 1);
+    CU_ASSERT(flapsweep(&t, 86400, 0) == 1);
+    CU_ASSERT(flapcount(&t) == 0);
+
+    // grow while routes are hot
+    for (uint32_t i = 0; i < 100000; i++) {
+        netaddr_t addr;
+        makenaddr(&addr, AF_INET, &i, 32);
+
+        CU_ASSERT(flapupdate(&t, 1, &addr, 0, true, 100000, NULL) == FLAP_NONE);
+    }
+    CU_ASSERT(flapcount(&t) == 100000);
+    CU_ASSERT(flapfootprint(&t) <= 262144 * 16 + sizeof(t));
+
+    CU_ASSERT(flapsweep(&t, 100000 + 900, 0) == 0);
+    CU_ASSERT(flapsweep(&t, 200000, 0) == 100000);
+    CU_ASSERT(flapcount(&t) == 0);
+
+    // a suppressed route going quiet is never forgotten, its next update reports the reuse
+    CU_ASSERT(flapupdate(&t, 3, pfx("10.0.0.0/8"), 0, true, 300000, &penalty) == FLAP_NONE);
+    CU_ASSERT(flapupdate(&t, 3, pfx("10.0.0.0/8"), 0, false, 300000, &penalty) == FLAP_NONE);
+    CU_ASSERT(flapupdate(&t, 3, pfx("10.0.0.0/8"), 0, true, 300000, &penalty) == FLAP_SUPPRESS);
+    CU_ASSERT(penalty == 2000.0f);
+
+    // three half-lives later
+    CU_ASSERT(flapsweep(&t, 300000 + 3 * 900, 0) == 0);
+    CU_ASSERT(flapcount(&t) == 1);
+    CU_ASSERT(flapupdate(&t, 3, pfx("10.0.0.0/8"), 0, false, 300000 + 3 * 900, &penalty) == FLAP_REUSE);
+    CU_ASSERT(penalty == 250.0f);
+
+    // once reused, it may be forgotten as any other route
+    CU_ASSERT(flapsweep(&t, 400000, 0) == 1);
+    CU_ASSERT(flapcount(&t) == 0);
+
+    // the same while the table grows, rehashing drops cold routes only
+    CU_ASSERT(flapupdate(&t, 3, pfx("10.0.0.0/8"), 0, true, 400000, &penalty) == FLAP_NONE);
+    CU_ASSERT(flapupdate(&t, 3, pfx("10.0.0.0/8"), 0, false, 400000, &penalty) == FLAP_NONE);
+    CU_ASSERT(flapupdate(&t, 3, pfx("10.0.0.0/8"), 0, true, 400000, &penalty) == FLAP_SUPPRESS);
+    for (uint32_t i = 0; i < 100000; i++) {
+        netaddr_t addr;
+        makenaddr(&addr, AF_INET, &i, 32);
+
+        CU_ASSERT(flapupdate(&t, 1, &addr, 0, true, 400000 + 3 * 900, NULL) == FLAP_NONE);
+    }
+    CU_ASSERT(flapupdate(&t, 3, pfx("10.0.0.0/8"), 0, false, 400000 + 3 * 900, &penalty) == FLAP_REUSE);
+
+    // custom parameters
+    flap_params_t params = {
+        .withdrawal = 1.0f, .readvertise = 1.0f, .change = 1.0f,
+        .suppress   = 3.0f, .reuse       = 1.0f, .ceiling = 4.0f,
+        .halflife   = 60
+    };
+
+    flapdestroy(&t);
+    flapinit(&t, &params);
+
+    CU_ASSERT(flapupdate(&t, 1, pfx("10.0.0.0/8"), 0, true, 0, &penalty) == FLAP_NONE);
+    CU_ASSERT(flapupdate(&t, 1, pfx("10.0.0.0/8"), 0, false, 0, &penalty) == FLAP_NONE);
+    CU_ASSERT(flapupdate(&t, 1, pfx("10.0.0.0/8"), 0, true, 0, &penalty) == FLAP_SUPPRESS);
+    CU_ASSERT(flapupdate(&t, 1, pfx("10.0.0.0/8"), 0, false, 0, &penalty) == FLAP_NONE);
+    CU_ASSERT(flapupdate(&t, 1, pfx("10.0.0.0/8"), 0, true, 0, &penalty) == FLAP_NONE);
+    CU_ASSERT(penalty == 4.0f);
+
+    flapdestroy(&t);
+}
@@ -0,0 +1,147 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#include "../../ubgp/frame.h"
+#include "../../ubgp/mrt.h"
+#include "test.h"
+
+#include <CUnit/CUnit.h>
+
+#include <string.h>
+
+// feed data in chunks of the given size, checking records come out whole and in order
+static void feedchunks(frame_kind_t kind, const byte *data, size_t n, size_t chunk, size_t nrecs)
+{
+    framer_t f;
+    framerinit(&f, kind);
+
+    size_t off = 0, count = 0;
+    for (size_t i = 0; i < n; i += chunk) {
+        size_t len = MIN(chunk, n - i);
+        framerfeed(&f, &data[i], len);
+
+        const byte *rec;
+        size_t size;
+        while ((rec = framernext(&f, &size)) != NULL) {
+            CU_ASSERT_FATAL(off + size <= n);
+            CU_ASSERT(memcmp(rec, &data[off], size) == 0);
+
+            // records inside the chunk are never copied
+            if (off >= i && off + size <= i + len)
+                CU_ASSERT(rec == &data[off]);
+
+            off += size;
+            count++;
+        }
+
+        CU_ASSERT(framererror(&f) == FRAME_ENOERR);
+        CU_ASSERT(framerpending(&f) == i + len - off);
+    }
+
+    CU_ASSERT(off == n);
+    CU_ASSERT(count == nrecs);
+    framerdestroy(&f);
+}
+
+static void testframemrt(void)
+{
+    mrt_writer_t w;
+    mrtwriterinit(&w, NULL, 0, NULL);
+
+    peer_entry_t pe;
+    memset(&pe, 0, sizeof(pe));
+    CU_ASSERT_FATAL(stonaddr(&pe.addr, "192.0.2.1") == 0);
+    pe.as_size = sizeof(uint32_t);
+    pe.as      = 65000;
+
+    struct in_addr collector = { 0 };
+    CU_ASSERT(mrtputpeeridx(&w, 0, collector, NULL, &pe, 1) == MRT_ENOERR);
+
+    netaddr_t pfx;
+    CU_ASSERT_FATAL(stonaddr(&pfx, "10.0.0.0/8") == 0);
+
+    byte attrs[300];
+    memset(attrs, 0, sizeof(attrs));
+    for (uint i = 0; i < 8; i++) {
+        CU_ASSERT(mrtstartrib(&w, 0, MRT_TABLE_DUMPV2_RIB_IPV4_UNICAST, i, &pfx) == MRT_ENOERR);
+        for (uint j = 0; j < i; j++)
+            CU_ASSERT(mrtputribent(&w, 0, 0, 0, attrs, sizeof(attrs)) == MRT_ENOERR);
+
+        CU_ASSERT(mrtendrib(&w) == MRT_ENOERR);
+    }
+
+    size_t n;
+    const byte *data = mrtwriterdata(&w, &n);
+    for (size_t chunk = 1; chunk <= n; chunk++)
+        feedchunks(FRAME_MRT, data, n, chunk, 9);
+
+    mrtwriterclose(&w);
+}
+
+static void testframebgp(void)
+{
+    byte data[19 + 100 + 19];
+
+    // KEEPALIVE, a 100 bytes message, another KEEPALIVE
+    memset(data, 0xff, sizeof(data));
+    data[16]           = 0x00;
+    data[17]           = 19;
+    data[18]           = 4;
+    data[19 + 16]      = 0x00;
+    data[19 + 17]      = 100;
+    data[19 + 18]      = 2;
+    data[119 + 16]     = 0x00;
+    data[119 + 17]     = 19;
+    data[119 + 18]     = 4;
+
+    for (size_t chunk = 1; chunk <= sizeof(data); chunk++)
+        feedchunks(FRAME_BGP, data, sizeof(data), chunk, 3);
+
+    framer_t f;
+
+    // a broken marker means we lost sync
+    data[19 + 3] = 0;
+    framerinit(&f, FRAME_BGP);
+    framerfeed(&f, data, sizeof(data));
+    CU_ASSERT(framernext(&f, NULL) != NULL);
+    CU_ASSERT(framernext(&f, NULL) == NULL);
+    CU_ASSERT(framererror(&f) == FRAME_EBADMARKER);
+    framerdestroy(&f);
+
+    data[19 + 3]  = 0xff;
+    data[19 + 17] = 18;
+    framerinit(&f, FRAME_BGP);
+    framerfeed(&f, data, 19);
+    CU_ASSERT(framernext(&f, NULL) != NULL);
+    framerfeed(&f, &data[19], 10);
+    CU_ASSERT(framernext(&f, NULL) == NULL);
+    CU_ASSERT(framererror(&f) == FRAME_ENOERR);
+    framerfeed(&f, &data[29], 10);
+    CU_ASSERT(framernext(&f, NULL) == NULL);
+    CU_ASSERT(framererror(&f) == FRAME_EBADLEN);
+    framerdestroy(&f);
+}
+
+void testframe(void)
+{
+    testframemrt();
+    testframebgp();
+}
@@ -0,0 +1,110 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#include "../../ubgp/hijack.h"
+#include "../test_util.h"
+#include "test.h"
+
+#include <CUnit/CUnit.h>
+
+#include <string.h>
+
+static int announce(hijack_detector_t *det, const char *s, uint32_t origin, time_t stamp, hijack_event_t *events)
+{
+    int n = hijackannounce(det, pfx(s), origin, stamp, events);
+    CU_ASSERT_FATAL(n >= 0);
+    return n;
+}
+
+void testhijack(void)
+{
+    hijack_detector_t det;
+    hijack_event_t events[HIJACK_EVENTS_MAX];
+
+    hijackinit(&det, 100);
+    CU_ASSERT_FATAL(hijackmonitor(&det, pfx("10.0.0.0/8")));
+    CU_ASSERT_FATAL(hijackmonitor(&det, pfx("10.1.0.0/16")));
+    CU_ASSERT_FATAL(hijackmonitor(&det, pfx("2001:db8::/32")));
+
+    // monitored prefixes themselves are not sub-prefixes
+    CU_ASSERT(announce(&det, "10.0.0.0/8", 1, 0, events) == 0);
+    CU_ASSERT(announce(&det, "10.0.0.0/8", 1, 10, events) == 0);
+
+    CU_ASSERT_FATAL(announce(&det, "10.0.0.0/8", 2, 20, events) == 1);
+    CU_ASSERT(events[0].type == HIJACK_MOAS);
+    CU_ASSERT(events[0].origin == 2 && events[0].stamp == 20);
+    CU_ASSERT(events[0].norigins == 1 && events[0].origins[0] == 1);
+
+    // most specific monitored prefix is reported
+    CU_ASSERT_FATAL(announce(&det, "10.1.2.0/24", 3, 30, events) == 1);
+    CU_ASSERT(events[0].type == HIJACK_SUBPREFIX);
+    CU_ASSERT(strcmp(naddrtos(&events[0].covering, NADDR_CIDR), "10.1.0.0/16") == 0);
+    CU_ASSERT(events[0].norigins == 0);
+
+    CU_ASSERT_FATAL(announce(&det, "10.2.0.0/16", 3, 30, events) == 1);
+    CU_ASSERT(events[0].type == HIJACK_SUBPREFIX);
+    CU_ASSERT(strcmp(naddrtos(&events[0].covering, NADDR_CIDR), "10.0.0.0/8") == 0);
+    CU_ASSERT(events[0].norigins == 2 && events[0].origins[0] == 1 && events[0].origins[1] == 2);
+
+    // known sub-prefix, new origin
+    CU_ASSERT_FATAL(announce(&det, "10.2.0.0/16", 4, 40, events) == 1);
+    CU_ASSERT(events[0].type == HIJACK_MOAS);
+    CU_ASSERT(strcmp(naddrtos(&events[0].pfx, NADDR_CIDR), "10.2.0.0/16") == 0);
+
+    CU_ASSERT(announce(&det, "11.0.0.0/8", 5, 40, events) == 0);
+    CU_ASSERT(hijackcount(&det) == 4);
+
+    // origin 2 of 10.0.0.0/8 goes stale, while origin 1 keeps it alive
+    CU_ASSERT(announce(&det, "10.0.0.0/8", 1, 110, events) == 0);
+    CU_ASSERT(announce(&det, "10.0.0.0/8", 2, 125, events) == 1);
+    CU_ASSERT(events[0].norigins == 1 && events[0].origins[0] == 1);
+    CU_ASSERT(hijackcount(&det) == 4);
+
+    // everything else expired, a new subnet is raised again
+    CU_ASSERT_FATAL(announce(&det, "10.2.0.0/16", 4, 141, events) == 1);
+    CU_ASSERT(events[0].type == HIJACK_SUBPREFIX);
+    CU_ASSERT(hijackcount(&det) == 2);
+
+    // origins beyond HIJACK_ORIGINS_MAX evict the least recently seen
+    CU_ASSERT(announce(&det, "12.0.0.0/8", 1, 150, events) == 0);
+    for (uint32_t as = 2; as <= HIJACK_ORIGINS_MAX + 1; as++)
+        CU_ASSERT(announce(&det, "12.0.0.0/8", as, 150 + as, events) == 1);
+
+    CU_ASSERT_FATAL(announce(&det, "12.0.0.0/8", 1, 160, events) == 1);
+    CU_ASSERT(events[0].norigins == HIJACK_ORIGINS_MAX);
+    CU_ASSERT(events[0].origins[0] == 2);
+    CU_ASSERT(events[0].origins[HIJACK_ORIGINS_MAX - 1] == HIJACK_ORIGINS_MAX + 1);
+
+    CU_ASSERT_FATAL(announce(&det, "2001:db8:1::/48", 1, 160, events) == 1);
+    CU_ASSERT(events[0].type == HIJACK_SUBPREFIX && events[0].norigins == 0);
+
+    CU_ASSERT(hijackexpire(&det, 1000) == 4);
+    CU_ASSERT(hijackcount(&det) == 0);
+
+    hijackdestroy(&det);
+
+    // no time-to-live
+    hijackinit(&det, 0);
+    CU_ASSERT(announce(&det, "10.0.0.0/8", 1, 0, events) == 0);
+    CU_ASSERT(hijackexpire(&det, 1000000) == 0);
+    CU_ASSERT(announce(&det, "10.0.0.0/8", 2, 1000000, events) == 1);
+    hijackdestroy(&det);
+}
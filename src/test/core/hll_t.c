@@ -0,0 +1,85 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#include "../../ubgp/bloom.h"
+#include "../../ubgp/hll.h"
+#include "test.h"
+
+#include <CUnit/CUnit.h>
+
+static uint64_t hashaddr(uint32_t i)
+{
+    netaddr_t addr;
+
+    makenaddr(&addr, AF_INET, &i, 32);
+    return bloomhash(&addr);
+}
+
+static bool isclose(uint64_t est, uint64_t n, double tolerance)
+{
+    double diff = (est > n) ? est - n : n - est;
+    return diff <= n * tolerance;
+}
+
+void testhll(void)
+{
+    hll_t a, b;
+
+    CU_ASSERT(!hllinit(&a, HLL_MIN_PRECISION - 1));
+    hlldestroy(&a);
+    CU_ASSERT(!hllinit(&a, HLL_MAX_PRECISION + 1));
+    hlldestroy(&a);
+
+    CU_ASSERT_FATAL(hllinit(&a, HLL_DEFAULT_PRECISION));
+    CU_ASSERT_FATAL(hllinit(&b, HLL_DEFAULT_PRECISION));
+
+    CU_ASSERT(hllcount(&a) == 0);
+
+    // small cardinalities go through linear counting, duplicates don't count
+    for (uint32_t i = 0; i < 100; i++) {
+        hlladd(&a, hashaddr(i));
+        hlladd(&a, hashaddr(i));
+    }
+    CU_ASSERT(isclose(hllcount(&a), 100, 0.05));
+
+    // large ones, ~3% standard error
+    for (uint32_t i = 100; i < 100000; i++)
+        hlladd(&a, hashaddr(i));
+    for (uint32_t i = 50000; i < 200000; i++)
+        hlladd(&b, hashaddr(i));
+
+    CU_ASSERT(isclose(hllcount(&a), 100000, 0.1));
+    CU_ASSERT(isclose(hllcount(&b), 150000, 0.1));
+
+    CU_ASSERT(hllmerge(&a, &b));
+    CU_ASSERT(isclose(hllcount(&a), 200000, 0.1));
+
+    hllclear(&b);
+    CU_ASSERT(hllcount(&b) == 0);
+
+    hll_t c;
+    CU_ASSERT_FATAL(hllinit(&c, HLL_MIN_PRECISION));
+    CU_ASSERT(!hllmerge(&a, &c));
+
+    hlldestroy(&a);
+    hlldestroy(&b);
+    hlldestroy(&c);
+}
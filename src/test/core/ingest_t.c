@@ -0,0 +1,378 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#include "../../ubgp/bgp.h"
+#include "../../ubgp/bgpattribs.h"
+#include "../../ubgp/bgpparams.h"
+#include "../../ubgp/filterintrin.h"
+#include "../../ubgp/ingest.h"
+#include "test.h"
+
+#include <CUnit/CUnit.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+enum {
+    NCLIENTS  = 4,
+    NUPDATES  = 300,  // per client, more than a single batch
+    CHUNKSIZ  = 1021  // odd sized writes, splitting messages anywhere
+};
+
+typedef struct {
+    size_t nopens, nupdates, nkeepalives;
+    size_t nbatches, maxbatch;
+    size_t nknown;
+    bool   closed;
+    int    err;
+    uint32_t as;
+} replay_stats_t;
+
+static replay_stats_t stats[NCLIENTS + 1];
+static size_t nopened;
+static size_t commlen;  // size of UPDATE messages having communities
+
+static size_t appendmsg(byte *buf, size_t off, ubgp_msg_s *msg)
+{
+    size_t n;
+    const void *pkt = bgpfinish(msg, &n);
+
+    CU_ASSERT_FATAL(pkt != NULL);
+    memcpy(&buf[off], pkt, n);
+    bgpclose(msg);
+    return off + n;
+}
+
+static size_t putopen(byte *buf, size_t off, uint32_t as)
+{
+    ubgp_msg_s msg;
+    bgpcap_t cap;
+    bgp_open_t op = {
+        .version   = BGP_VERSION,
+        .my_as     = AS_TRANS,
+        .hold_time = BGP_HOLD_SECS
+    };
+
+    setbgpwrite(&msg, BGP_OPEN, BGPF_DEFAULT);
+    setbgpopen(&msg, &op);
+    startbgpcaps(&msg);
+        cap.code = ASN32BIT_CODE;
+        cap.len  = ASN32BIT_LENGTH;
+        putbgpcap(&msg, setasn32bit(&cap, as));
+    endbgpcaps(&msg);
+
+    return appendmsg(buf, off, &msg);
+}
+
+static size_t putupdate(byte *buf, size_t off, uint32_t as, bool community)
+{
+    ubgp_msg_s msg;
+    byte attrbuf[64];
+    bgpattr_t *attr = (bgpattr_t *) attrbuf;
+
+    setbgpwrite(&msg, BGP_UPDATE, BGPF_ASN32BIT);
+    startbgpattribs(&msg);
+        attr->code  = ORIGIN_CODE;
+        attr->len   = ORIGIN_LENGTH;
+        attr->flags = DEFAULT_ORIGIN_FLAGS;
+        setorigin(attr, ORIGIN_IGP);
+        putbgpattrib(&msg, attr);
+
+        attr->code  = AS_PATH_CODE;
+        attr->len   = 0;
+        attr->flags = DEFAULT_AS_PATH_FLAGS;
+        putasseg32(attr, AS_SEGMENT_SEQ, &as, 1);
+        putbgpattrib(&msg, attr);
+
+        if (community) {
+            attr->code  = COMMUNITY_CODE;
+            attr->len   = sizeof(uint32_t);
+            attr->flags = ATTR_TRANSITIVE | ATTR_OPTIONAL;
+            memset(attr->data, 0xaa, sizeof(uint32_t));
+            putbgpattrib(&msg, attr);
+        }
+    endbgpattribs(&msg);
+
+    netaddr_t pfx;
+    CU_ASSERT_FATAL(stonaddr(&pfx, "10.0.0.0/8") == 0);
+
+    startnlri(&msg);
+        putnlri(&msg, &pfx);
+    endnlri(&msg);
+
+    size_t end = appendmsg(buf, off, &msg);
+    if (community)
+        commlen = end - off;
+
+    return end;
+}
+
+static size_t putkeepalive(byte *buf, size_t off)
+{
+    ubgp_msg_s msg;
+
+    setbgpwrite(&msg, BGP_KEEPALIVE, BGPF_DEFAULT);
+    return appendmsg(buf, off, &msg);
+}
+
+static replay_stats_t *getstats(ingest_session_t *s)
+{
+    CU_ASSERT_FATAL(s->id < NCLIENTS + 1);
+    return &stats[s->id];
+}
+
+static void onopen(ingest_session_t *s, void *user)
+{
+    USED(s);
+    USED(user);
+
+    nopened++;
+}
+
+static void onknown(ingest_session_t *s, filter_ctx_t *ctx, void *user)
+{
+    USED(ctx);
+    USED(user);
+
+    getstats(s)->nknown++;
+}
+
+static void onbatch(ingest_session_t *s, ubgp_msg_s *const *msgs, size_t n, void *user)
+{
+    USED(user);
+
+    replay_stats_t *st = getstats(s);
+
+    CU_ASSERT(n > 0 && n <= INGEST_BATCHSIZ);
+    st->nbatches++;
+    if (n > st->maxbatch)
+        st->maxbatch = n;
+
+    for (size_t i = 0; i < n; i++) {
+        switch (getbgptype(msgs[i])) {
+        case BGP_OPEN:
+            st->nopens++;
+            break;
+        case BGP_UPDATE:
+            // only UPDATE messages having communities pass the filter
+            CU_ASSERT(getbgplength(msgs[i]) == commlen);
+            st->nupdates++;
+            break;
+        case BGP_KEEPALIVE:
+            st->nkeepalives++;
+            break;
+        default:
+            CU_FAIL("unexpected BGP message");
+            break;
+        }
+    }
+
+    st->as = s->as;
+}
+
+static void onclose(ingest_session_t *s, void *user)
+{
+    USED(user);
+
+    replay_stats_t *st = getstats(s);
+
+    st->closed = true;
+    st->err    = s->err;
+
+    // replay clients connect from loopback and advertise 32 bits ASes
+    if (s->id < NCLIENTS) {
+        CU_ASSERT(s->addr.family == AF_INET);
+        CU_ASSERT(s->port != 0);
+        CU_ASSERT(s->bgpflags & BGPF_ASN32BIT);
+        CU_ASSERT(s->nmsgs == 2 + NUPDATES);
+    }
+}
+
+static const ingest_ops_t ops = {
+    .batch = onbatch,
+    .known = onknown,
+    .open  = onopen,
+    .close = onclose
+};
+
+static int replaylisten(uint16_t *port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1)
+        return -1;
+
+    struct sockaddr_in sin;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family      = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sin.sin_port        = 0;
+
+    socklen_t len = sizeof(sin);
+    if (bind(fd, (struct sockaddr *) &sin, sizeof(sin)) != 0 ||
+        listen(fd, NCLIENTS) != 0 ||
+        getsockname(fd, (struct sockaddr *) &sin, &len) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    *port = ntohs(sin.sin_port);
+    return fd;
+}
+
+static int replayconnect(uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1)
+        return -1;
+
+    struct sockaddr_in sin;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family      = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sin.sin_port        = htons(port);
+    if (connect(fd, (struct sockaddr *) &sin, sizeof(sin)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+void testingest(void)
+{
+    static byte streams[NCLIENTS][64 * 1024];
+    size_t sizes[NCLIENTS];
+
+    memset(stats, 0, sizeof(stats));
+    nopened = 0;
+
+    // OPEN, updates with and without communities, a final KEEPALIVE
+    for (uint i = 0; i < NCLIENTS; i++) {
+        uint32_t as = 4200000000u + i;
+
+        sizes[i] = putopen(streams[i], 0, as);
+        for (uint j = 0; j < NUPDATES; j++)
+            sizes[i] = putupdate(streams[i], sizes[i], as, (j % 3) == 0);
+
+        sizes[i] = putkeepalive(streams[i], sizes[i]);
+        CU_ASSERT_FATAL(sizes[i] <= sizeof(streams[i]));
+    }
+
+    // pass only UPDATE messages having a COMMUNITY attribute
+    filter_vm_t vm;
+    filter_init(&vm);
+    vm_emit(&vm.prog, FOPC_BLK);
+    vm_emit(&vm.prog, vm_makeop(FOPC_HASATTR, COMMUNITY_CODE));
+    vm_emit(&vm.prog, FOPC_ENDBLK);
+    vm_emit(&vm.prog, FOPC_NOT);
+    vm_emit(&vm.prog, FOPC_CFAIL);
+    vm_emit(&vm.prog, vm_makeop(FOPC_LOAD, true));
+
+    ingest_t ing;
+    CU_ASSERT_FATAL(ingestinit(&ing, &ops, NULL) == 0);
+    ingestfilter(&ing, &vm.prog, &vm.ctx);
+
+    uint16_t port = 0;
+    int lfd = replaylisten(&port);
+    CU_ASSERT_FATAL(lfd != -1);
+    CU_ASSERT_FATAL(port != 0);
+    CU_ASSERT_FATAL(ingestlisten(&ing, lfd) == 0);
+
+    int fds[NCLIENTS];
+    for (uint i = 0; i < NCLIENTS; i++) {
+        fds[i] = replayconnect(port);
+        CU_ASSERT_FATAL(fds[i] != -1);
+
+        // accept in order, so that session ids match clients
+        while (nopened < i + 1)
+            CU_ASSERT_FATAL(ingestpoll(&ing, 1000) >= 0);
+    }
+    CU_ASSERT(ing.nsessions == NCLIENTS);
+
+    // a local socket losing sync with BGP messages
+    int pair[2];
+    CU_ASSERT_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0);
+
+    ingest_session_t *local = ingestadd(&ing, pair[0]);
+    CU_ASSERT_FATAL(local != NULL);
+    CU_ASSERT(local->id == NCLIENTS);
+    CU_ASSERT(local->addr.family == AF_UNSPEC);
+
+    byte garbage[64];
+    size_t n = putkeepalive(garbage, 0);
+    memset(&garbage[n], 0x55, sizeof(garbage) - n);
+    CU_ASSERT_FATAL(write(pair[1], garbage, sizeof(garbage)) == (ssize_t) sizeof(garbage));
+
+    // interleave clients, polling in between writes
+    size_t offs[NCLIENTS] = { 0 };
+    size_t ndelivered = 0;
+    bool done = false;
+    while (!done) {
+        done = true;
+        for (uint i = 0; i < NCLIENTS; i++) {
+            size_t len = MIN(sizes[i] - offs[i], (size_t) CHUNKSIZ);
+            if (len == 0)
+                continue;
+
+            CU_ASSERT_FATAL(write(fds[i], &streams[i][offs[i]], len) == (ssize_t) len);
+            offs[i] += len;
+            done = false;
+        }
+
+        int res = ingestpoll(&ing, 0);
+        CU_ASSERT_FATAL(res >= 0);
+        ndelivered += res;
+    }
+    for (uint i = 0; i < NCLIENTS; i++)
+        close(fds[i]);
+
+    for (int tries = 0; ing.nsessions > 0 && tries < 1000; tries++) {
+        int res = ingestpoll(&ing, 100);
+        CU_ASSERT_FATAL(res >= 0);
+        ndelivered += res;
+    }
+    CU_ASSERT(ing.nsessions == 0);
+
+    size_t npassing = (NUPDATES + 2) / 3;
+    CU_ASSERT(ndelivered == NCLIENTS * (npassing + 2) + 1);
+    for (uint i = 0; i < NCLIENTS; i++) {
+        CU_ASSERT(stats[i].closed);
+        CU_ASSERT(stats[i].err == 0);
+        CU_ASSERT(stats[i].nopens == 1);
+        CU_ASSERT(stats[i].nkeepalives == 1);
+        CU_ASSERT(stats[i].nupdates == npassing);
+        CU_ASSERT(stats[i].nknown > 0);
+        CU_ASSERT(stats[i].maxbatch > 1);
+        CU_ASSERT(stats[i].as == 4200000000u + i);
+    }
+
+    // the KEEPALIVE preceding garbage is still delivered
+    CU_ASSERT(stats[NCLIENTS].closed);
+    CU_ASSERT(stats[NCLIENTS].err == EPROTO);
+    CU_ASSERT(stats[NCLIENTS].nkeepalives == 1);
+
+    close(pair[1]);
+    ingestdestroy(&ing);
+    filter_destroy(&vm);
+}
@@ -83,6 +83,60 @@ int main(void)
     if (!CU_add_test(suite, "test patricia problem", testpatproblem))
         goto error;
 
+    if (!CU_add_test(suite, "test patricia Bloom filter", testpatbloom))
+        goto error;
+
+    if (!CU_add_test(suite, "test patricia packed nodes", testpatpack))
+        goto error;
+
+    if (!CU_add_test(suite, "test patricia set operations", testpatsetops))
+        goto error;
+
+    if (!CU_add_test(suite, "test patricia compaction", testpatcompact))
+        goto error;
+
+    if (!CU_add_test(suite, "test patricia augmented coverage", testpataugment))
+        goto error;
+
+    if (!CU_add_test(suite, "test prefix to origin AS table", testpfx2as))
+        goto error;
+
+    if (!CU_add_test(suite, "test AS links table", testaslinks))
+        goto error;
+
+    if (!CU_add_test(suite, "test HyperLogLog sketch", testhll))
+        goto error;
+
+    if (!CU_add_test(suite, "test MOAS and sub-prefix hijack detection", testhijack))
+        goto error;
+
+    if (!CU_add_test(suite, "test route flap tracking", testflap))
+        goto error;
+
+    if (!CU_add_test(suite, "test MRT writer", testmrtwriter))
+        goto error;
+
+    if (!CU_add_test(suite, "test MRT RIB batch decoding", testmrtribbatch))
+        goto error;
+
+    if (!CU_add_test(suite, "test incremental MRT and BGP framing", testframe))
+        goto error;
+
+    if (!CU_add_test(suite, "test epoll BGP ingestion from loopback replays", testingest))
+        goto error;
+
+    if (!CU_add_test(suite, "test BMP reader", testbmp))
+        goto error;
+
+    if (!CU_add_test(suite, "test concurrent patricia base", testcpatbase))
+        goto error;
+
+    if (!CU_add_test(suite, "test concurrent patricia against patricia", testcpatdiff))
+        goto error;
+
+    if (!CU_add_test(suite, "test concurrent patricia readers stress", testcpatstress))
+        goto error;
+
     if (!CU_add_test(suite, "test abstract I/O with Zlib", testzio))
         goto error;
 
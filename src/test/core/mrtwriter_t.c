@@ -0,0 +1,317 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#include "../../ubgp/mrt.h"
+#include "test.h"
+
+#include <CUnit/CUnit.h>
+
+#include <string.h>
+
+static const byte keepalive[] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0x00, 0x13, 0x04
+};
+
+static const byte attrs[] = { 0x40, 0x01, 0x01, 0x00 };  // ORIGIN IGP
+
+static void writerecords(mrt_writer_t *w)
+{
+    peer_entry_t peers[2];
+
+    memset(peers, 0, sizeof(peers));
+    inet_pton(AF_INET, "10.0.0.1", &peers[0].id);
+    CU_ASSERT_FATAL(stonaddr(&peers[0].addr, "192.0.2.1") == 0);
+    peers[0].as_size = sizeof(uint16_t);
+    peers[0].as      = 64512;
+    inet_pton(AF_INET, "10.0.0.2", &peers[1].id);
+    CU_ASSERT_FATAL(stonaddr(&peers[1].addr, "2001:db8::1") == 0);
+    peers[1].as_size = sizeof(uint16_t);  // promoted, doesn't fit
+    peers[1].as      = 4200000000u;
+
+    struct in_addr collector;
+    inet_pton(AF_INET, "10.0.0.254", &collector);
+
+    CU_ASSERT(mrtputpeeridx(w, 1000, collector, "view", peers, 2) == MRT_ENOERR);
+
+    netaddr_t pfx;
+    CU_ASSERT_FATAL(stonaddr(&pfx, "2001:db8::/33") == 0);
+
+    // no entries allowed in a mismatching family
+    CU_ASSERT(mrtstartrib(w, 1001, MRT_TABLE_DUMPV2_RIB_IPV4_UNICAST, 0, &pfx) == MRT_EAFINOTSUP);
+    CU_ASSERT(mrtputribent(w, 0, 0, 0, attrs, sizeof(attrs)) == MRT_EINVOP);
+
+    CU_ASSERT(mrtstartrib(w, 1001, MRT_TABLE_DUMPV2_RIB_IPV6_UNICAST_ADDPATH, 7, &pfx) == MRT_ENOERR);
+    for (uint i = 0; i < 1000; i++)
+        CU_ASSERT(mrtputribent(w, i & 1, 900, i, attrs, sizeof(attrs)) == MRT_ENOERR);
+
+    CU_ASSERT(mrtendrib(w) == MRT_ENOERR);
+
+    bgp4mp_header_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.peer_as  = 4200000000u;
+    hdr.local_as = 65000;
+    hdr.iface    = 3;
+    CU_ASSERT_FATAL(stonaddr(&hdr.peer_addr, "192.0.2.1") == 0);
+    CU_ASSERT_FATAL(stonaddr(&hdr.local_addr, "192.0.2.2") == 0);
+
+    struct timespec stamp = { .tv_sec = 1002, .tv_nsec = 5000 };
+    CU_ASSERT(mrtputbgp4mp(w, &stamp, MRT_BGP4MP_ET, BGP4MP_MESSAGE_AS4, &hdr, keepalive, sizeof(keepalive)) == MRT_ENOERR);
+
+    // 2 bytes AS becomes AS_TRANS
+    hdr.old_state = 1;
+    hdr.new_state = 6;
+    CU_ASSERT(mrtputbgp4mp(w, &stamp, MRT_BGP4MP, BGP4MP_STATE_CHANGE, &hdr, NULL, 0) == MRT_ENOERR);
+}
+
+static void readrecords(const void *data, size_t n)
+{
+    io_rw_t io = IO_MEM_RDINIT(data, n);
+    umrt_msg_s pi, msg;
+
+    // PEER_INDEX_TABLE
+    CU_ASSERT_FATAL(setmrtreadfrom(&pi, &io) == MRT_ENOERR);
+    CU_ASSERT(getmrtheader(&pi)->stamp.tv_sec == 1000);
+
+    char buf[16];
+    CU_ASSERT(getpiviewname(&pi, buf, sizeof(buf)) == 4);
+    CU_ASSERT_STRING_EQUAL(buf, "view");
+
+    size_t count;
+    CU_ASSERT(startpeerents(&pi, &count) == MRT_ENOERR);
+    CU_ASSERT_FATAL(count == 2);
+
+    peer_entry_t *pe = nextpeerent(&pi);
+    CU_ASSERT(pe->as == 64512 && pe->as_size == sizeof(uint16_t));
+    CU_ASSERT(pe->addr.family == AF_INET);
+    pe = nextpeerent(&pi);
+    CU_ASSERT(pe->as == 4200000000u && pe->as_size == sizeof(uint32_t));
+    CU_ASSERT(pe->addr.family == AF_INET6);
+    CU_ASSERT(nextpeerent(&pi) == NULL);
+    CU_ASSERT(endpeerents(&pi) == MRT_ENOERR);
+
+    // RIB
+    CU_ASSERT_FATAL(setmrtreadfrom(&msg, &io) == MRT_ENOERR);
+    CU_ASSERT_FATAL(setribpi(&msg, &pi) == MRT_ENOERR);
+
+    rib_batch_t batch = {0};
+    CU_ASSERT_FATAL(getribbatch(&msg, &batch) == MRT_ENOERR);
+    CU_ASSERT(batch.hdr.seqno == 7);
+    CU_ASSERT(batch.hdr.nlri.bitlen == 33);
+    CU_ASSERT_FATAL(batch.count == 1000);
+    for (uint i = 0; i < batch.count; i++) {
+        CU_ASSERT(batch.peer_idx[i] == (i & 1));
+        CU_ASSERT(batch.originated[i] == 900);
+        CU_ASSERT(batch.pathid[i] == i);
+        CU_ASSERT(batch.attr_len[i] == sizeof(attrs));
+        CU_ASSERT(memcmp(batch.base + batch.attr_off[i], attrs, sizeof(attrs)) == 0);
+    }
+
+    ribbatchclose(&batch);
+    mrtclose(&msg);
+
+    // BGP4MP_ET
+    CU_ASSERT_FATAL(setmrtreadfrom(&msg, &io) == MRT_ENOERR);
+    CU_ASSERT(getmrtheader(&msg)->stamp.tv_nsec == 5000);
+
+    bgp4mp_header_t *hdr = getbgp4mpheader(&msg);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(hdr);
+    CU_ASSERT(hdr->peer_as == 4200000000u && hdr->local_as == 65000);
+    CU_ASSERT(hdr->iface == 3);
+
+    size_t len;
+    void *pkt = unwrapbgp4mp(&msg, &len);
+    CU_ASSERT(len == sizeof(keepalive));
+    CU_ASSERT(pkt && memcmp(pkt, keepalive, sizeof(keepalive)) == 0);
+    mrtclose(&msg);
+
+    // BGP4MP state change
+    CU_ASSERT_FATAL(setmrtreadfrom(&msg, &io) == MRT_ENOERR);
+
+    hdr = getbgp4mpheader(&msg);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(hdr);
+    CU_ASSERT(hdr->peer_as == AS_TRANS && hdr->local_as == 65000);
+    CU_ASSERT(hdr->old_state == 1 && hdr->new_state == 6);
+    mrtclose(&msg);
+
+    CU_ASSERT(setmrtreadfrom(&msg, &io) == MRT_EIO);
+    mrtclose(&pi);
+}
+
+void testmrtwriter(void)
+{
+    mrt_writer_t w;
+    byte small[64];
+
+    // in memory, outgrowing the initial buffer
+    mrtwriterinit(&w, small, sizeof(small), NULL);
+    writerecords(&w);
+
+    size_t n;
+    void *data = mrtwriterdata(&w, &n);
+    readrecords(data, n);
+    CU_ASSERT(mrtwriterclose(&w) == MRT_ENOERR);
+
+    // flushing through an io_rw_t, partial RIB records are kept across flushes
+    static byte out[64 * 1024];
+
+    io_rw_t io = IO_MEM_WRINIT(out, sizeof(out));
+    mrtwriterinit(&w, small, sizeof(small), &io);
+    writerecords(&w);
+    CU_ASSERT(mrtflush(&w) == MRT_ENOERR);
+    CU_ASSERT(mrtwriterclose(&w) == MRT_ENOERR);
+
+    readrecords(out, io.mem.ptr - out);
+
+    // a RIB left open is discarded
+    io = (io_rw_t) IO_MEM_WRINIT(out, sizeof(out));
+    mrtwriterinit(&w, NULL, 0, &io);
+
+    netaddr_t pfx;
+    CU_ASSERT_FATAL(stonaddr(&pfx, "10.0.0.0/8") == 0);
+    CU_ASSERT(mrtstartrib(&w, 0, MRT_TABLE_DUMPV2_RIB_IPV4_UNICAST, 0, &pfx) == MRT_ENOERR);
+    CU_ASSERT(mrtwriterclose(&w) == MRT_ENOERR);
+    CU_ASSERT(io.mem.ptr == out);
+}
+
+// compare getribbatch() with the nextribent() iterator on the current RIB
+static void checkribbatch(umrt_msg_s *msg, rib_batch_t *batch, size_t expected)
+{
+    CU_ASSERT_FATAL(getribbatch(msg, batch) == MRT_ENOERR);
+    CU_ASSERT_FATAL(batch->count == expected);
+
+    size_t count;
+    rib_header_t *hdr = startribents(msg, &count);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(hdr);
+    CU_ASSERT(batch->hdr.seqno == hdr->seqno);
+    CU_ASSERT(batch->hdr.nlri.bitlen == hdr->nlri.bitlen);
+    CU_ASSERT(count == expected);
+
+    size_t i = 0;
+    rib_entry_t *rib;
+    while ((rib = nextribent(msg)) != NULL) {
+        CU_ASSERT_FATAL(i < batch->count);
+        CU_ASSERT(batch->peer_idx[i] == rib->peer_idx);
+        CU_ASSERT(batch->originated[i] == rib->originated);
+        CU_ASSERT(batch->pathid[i] == rib->pathid);
+        CU_ASSERT(batch->attr_len[i] == rib->attr_length);
+        CU_ASSERT(batch->base + batch->attr_off[i] == (byte *) rib->attrs);
+        i++;
+    }
+    CU_ASSERT(mrterror(msg) == MRT_ENOERR);
+    CU_ASSERT(i == batch->count);
+    CU_ASSERT(endribents(msg) == MRT_ENOERR);
+}
+
+void testmrtribbatch(void)
+{
+    mrt_writer_t w;
+    mrtwriterinit(&w, NULL, 0, NULL);
+
+    peer_entry_t peers[3];
+    memset(peers, 0, sizeof(peers));
+    for (uint i = 0; i < countof(peers); i++) {
+        peers[i].as_size = sizeof(uint32_t);
+        peers[i].as      = 65000 + i;
+        CU_ASSERT_FATAL(stonaddr(&peers[i].addr, "192.0.2.1") == 0);
+        peers[i].addr.bytes[3] += i;
+    }
+
+    struct in_addr collector;
+    inet_pton(AF_INET, "10.0.0.254", &collector);
+    CU_ASSERT(mrtputpeeridx(&w, 1000, collector, "", peers, countof(peers)) == MRT_ENOERR);
+
+    // entries with attributes of different lengths
+    byte ribattrs[sizeof(attrs) + 3 + 64];
+    memcpy(ribattrs, attrs, sizeof(attrs));
+    memset(ribattrs + sizeof(attrs), 0xaa, sizeof(ribattrs) - sizeof(attrs));
+    ribattrs[sizeof(attrs)]     = 0xc0;  // optional transitive, unknown
+    ribattrs[sizeof(attrs) + 1] = 0xfe;
+
+    netaddr_t pfx;
+    CU_ASSERT_FATAL(stonaddr(&pfx, "198.51.100.0/22") == 0);
+    CU_ASSERT(mrtstartrib(&w, 1001, MRT_TABLE_DUMPV2_RIB_IPV4_UNICAST, 1, &pfx) == MRT_ENOERR);
+    for (uint i = 0; i < 37; i++) {
+        size_t len = i % 65;
+        ribattrs[sizeof(attrs) + 2] = len;
+        CU_ASSERT(mrtputribent(&w, i % 3, 900 + i, i, ribattrs, sizeof(attrs) + 3 + len) == MRT_ENOERR);
+    }
+    CU_ASSERT(mrtendrib(&w) == MRT_ENOERR);
+
+    CU_ASSERT_FATAL(stonaddr(&pfx, "2001:db8::/32") == 0);
+    CU_ASSERT(mrtstartrib(&w, 1001, MRT_TABLE_DUMPV2_RIB_IPV6_UNICAST_ADDPATH, 2, &pfx) == MRT_ENOERR);
+    for (uint i = 0; i < 300; i++) {
+        size_t len = (i * 7) % 65;
+        ribattrs[sizeof(attrs) + 2] = len;
+        CU_ASSERT(mrtputribent(&w, 2 - i % 3, 900, 0xffff0000 + i, ribattrs, sizeof(attrs) + 3 + len) == MRT_ENOERR);
+    }
+    CU_ASSERT(mrtendrib(&w) == MRT_ENOERR);
+
+    // no entries at all
+    CU_ASSERT(mrtstartrib(&w, 1001, MRT_TABLE_DUMPV2_RIB_IPV6_UNICAST, 3, &pfx) == MRT_ENOERR);
+    CU_ASSERT(mrtendrib(&w) == MRT_ENOERR);
+
+    // an entry referencing a peer past the PEER_INDEX_TABLE
+    CU_ASSERT(mrtstartrib(&w, 1001, MRT_TABLE_DUMPV2_RIB_IPV6_UNICAST, 4, &pfx) == MRT_ENOERR);
+    CU_ASSERT(mrtputribent(&w, 0, 900, 0, attrs, sizeof(attrs)) == MRT_ENOERR);
+    CU_ASSERT(mrtputribent(&w, countof(peers), 900, 0, attrs, sizeof(attrs)) == MRT_ENOERR);
+    CU_ASSERT(mrtendrib(&w) == MRT_ENOERR);
+
+    size_t n;
+    void *data = mrtwriterdata(&w, &n);
+
+    io_rw_t io = IO_MEM_RDINIT(data, n);
+    umrt_msg_s pi, msg;
+    rib_batch_t batch = {0};
+
+    CU_ASSERT_FATAL(setmrtreadfrom(&pi, &io) == MRT_ENOERR);
+
+    // a RIB without its PEER_INDEX_TABLE
+    CU_ASSERT_FATAL(setmrtreadfrom(&msg, &io) == MRT_ENOERR);
+    CU_ASSERT(getribbatch(&msg, &batch) == MRT_ENEEDSPEERIDX);
+    CU_ASSERT(mrterror(&msg) == MRT_ENEEDSPEERIDX);
+    mrtclose(&msg);
+
+    io = (io_rw_t) IO_MEM_RDINIT(data, n);
+    CU_ASSERT_FATAL(setmrtreadfrom(&msg, &io) == MRT_ENOERR);  // skip PEER_INDEX_TABLE
+    mrtclose(&msg);
+
+    static const size_t counts[] = { 37, 300, 0 };
+    for (uint i = 0; i < countof(counts); i++) {
+        CU_ASSERT_FATAL(setmrtreadfrom(&msg, &io) == MRT_ENOERR);
+        CU_ASSERT_FATAL(setribpi(&msg, &pi) == MRT_ENOERR);
+        checkribbatch(&msg, &batch, counts[i]);
+        mrtclose(&msg);
+    }
+
+    CU_ASSERT_FATAL(setmrtreadfrom(&msg, &io) == MRT_ENOERR);
+    CU_ASSERT_FATAL(setribpi(&msg, &pi) == MRT_ENOERR);
+    CU_ASSERT(getribbatch(&msg, &batch) == MRT_EBADPEERIDX);
+    CU_ASSERT(mrterror(&msg) == MRT_EBADPEERIDX);
+    mrtclose(&msg);
+
+    CU_ASSERT(setmrtreadfrom(&msg, &io) == MRT_EIO);
+
+    ribbatchclose(&batch);
+    mrtclose(&pi);
+    CU_ASSERT(mrtwriterclose(&w) == MRT_ENOERR);
+}
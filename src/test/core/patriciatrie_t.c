@@ -28,14 +28,6 @@
 
 #include <stdlib.h>
 
-static netaddr_t *pfx(const char *s)
-{
-    static netaddr_t p;
-
-    CU_ASSERT_FATAL(stonaddr(&p, s) == 0);
-    return &p;
-}
-
 void testpatbase(void)
 {
     patricia_trie_t pt;
@@ -677,3 +669,486 @@ void testpatproblem(void)
     patdestroy(&pt);
 }
 
+
+void testpatbloom(void)
+{
+    patricia_trie_t pt;
+    patinit(&pt, AF_INET);
+
+    netaddr_t addr;
+    for (uint i = 0; i < 4096; i++) {
+        makenaddr(&addr, AF_INET, &(struct in_addr) { htonl(0x0a000000u | (i << 8)) }, 24);
+        CU_ASSERT_FATAL(patinsert(&pt, &addr, NULL) != NULL);
+    }
+
+    CU_ASSERT(patmaybeexact(&pt, pfx("11.0.0.0/24")));  // no filter, always maybe
+    CU_ASSERT_FATAL(patbloom(&pt));
+
+    // no false negatives, including prefixes inserted afterwards
+    CU_ASSERT(patinsert(&pt, pfx("192.168.0.0/16"), NULL) != NULL);
+    CU_ASSERT(patmaybeexact(&pt, pfx("192.168.0.0/16")));
+    for (uint i = 0; i < 4096; i++) {
+        makenaddr(&addr, AF_INET, &(struct in_addr) { htonl(0x0a000000u | (i << 8)) }, 24);
+        CU_ASSERT(patmaybeexact(&pt, &addr));
+    }
+
+    // bits past the prefix length are not significant
+    CU_ASSERT(patmaybeexact(&pt, pfx("192.168.1.1/16")));
+
+    // most misses are rejected
+    uint rejected = 0;
+    for (uint i = 0; i < 4096; i++) {
+        makenaddr(&addr, AF_INET, &(struct in_addr) { htonl(0x0b000000u | (i << 8)) }, 24);
+        rejected += !patmaybeexact(&pt, &addr);
+    }
+    CU_ASSERT(rejected > 4000);
+
+    patclear(&pt);
+    CU_ASSERT(!patmaybeexact(&pt, pfx("192.168.0.0/16")));
+
+    patdestroy(&pt);
+}
+
+static void checkpacked(patricia_trie_t *pt, const netaddr_t *queries, uint nqueries)
+{
+    trienode_t *exact[nqueries], *best[nqueries];
+    bool subnet[nqueries], supernet[nqueries], related[nqueries];
+
+    for (uint i = 0; i < nqueries; i++) {
+        exact[i]    = patsearchexact(pt, &queries[i]);
+        best[i]     = patsearchbest(pt, &queries[i]);
+        subnet[i]   = patissubnetof(pt, &queries[i]);
+        supernet[i] = patissupernetof(pt, &queries[i]);
+        related[i]  = patisrelatedof(pt, &queries[i]);
+    }
+
+    // packed nodes take less room than the regular ones
+    size_t before, after;
+    patmemusage(pt, &before, NULL);
+    CU_ASSERT_FATAL(patpack(pt));
+    patmemusage(pt, &after, NULL);
+    CU_ASSERT(after > before && after - before < before);
+
+    for (uint i = 0; i < nqueries; i++) {
+        const char *q = naddrtos(&queries[i], NADDR_CIDR);
+
+        CU_ASSERT_EX(patsearchexact(pt, &queries[i]) == exact[i], "%s", q);
+        CU_ASSERT_EX(patsearchbest(pt, &queries[i]) == best[i], "%s", q);
+        CU_ASSERT_EX(patissubnetof(pt, &queries[i]) == subnet[i], "%s", q);
+        CU_ASSERT_EX(patissupernetof(pt, &queries[i]) == supernet[i], "%s", q);
+        CU_ASSERT_EX(patisrelatedof(pt, &queries[i]) == related[i], "%s", q);
+    }
+}
+
+void testpatpack(void)
+{
+    static const uint bitlens[] = { 0, 8, 12, 16, 19, 24, 32, 48, 64, 65, 96, 127, 128 };
+
+    netaddr_t queries[512];
+    uint32_t seed = 1;
+
+    patricia_trie_t pt;
+    patinit(&pt, AF_INET);
+
+    // packing an empty trie is fine
+    CU_ASSERT_FATAL(patpack(&pt));
+    CU_ASSERT(patsearchbest(&pt, pfx("8.2.0.0/16")) == NULL);
+    CU_ASSERT(!patisrelatedof(&pt, pfx("8.2.0.0/16")));
+
+    for (uint i = 0; i < 2048; i++) {
+        seed = seed * 1103515245u + 12345u;
+
+        uint bitlen = bitlens[1 + (seed >> 16) % 6];
+        uint32_t addr = htonl(0x0a000000u | (seed & 0x00ff0f00u));
+        netaddr_t pfx;
+        makenaddr(&pfx, AF_INET, &addr, bitlen);
+        patinsert(&pt, &pfx, NULL);
+
+        if (i < countof(queries)) {
+            addr = htonl(0x0a000000u | ((seed * 7u) & 0x00ff0f0fu));
+            makenaddr(&queries[i], AF_INET, &addr, bitlens[(seed >> 8) % 7]);
+        }
+    }
+
+    checkpacked(&pt, queries, countof(queries));
+
+    // any update drops the packed nodes, lookups keep working
+    CU_ASSERT(patinsert(&pt, pfx("8.2.0.0/16"), NULL) != NULL);
+    CU_ASSERT(patsearchexact(&pt, pfx("8.2.0.0/16")) != NULL);
+    patdestroy(&pt);
+
+    patinit(&pt, AF_INET6);
+    for (uint i = 0; i < 2048; i++) {
+        seed = seed * 1103515245u + 12345u;
+
+        uint32_t addr[4] = { htonl(0x20010db8u), htonl(seed & 0xff000f00u), htonl(seed & 0x00f0000fu), htonl(seed & 0x0f0000f0u) };
+        netaddr_t pfx;
+        makenaddr(&pfx, AF_INET6, addr, bitlens[1 + (seed >> 16) % 12]);
+        patinsert(&pt, &pfx, NULL);
+
+        if (i < countof(queries)) {
+            addr[1] = htonl((seed * 7u) & 0xff000f0fu);
+            makenaddr(&queries[i], AF_INET6, addr, bitlens[(seed >> 8) % 13]);
+        }
+    }
+
+    checkpacked(&pt, queries, countof(queries));
+    patdestroy(&pt);
+}
+
+// random prefixes inside 10.0.0.0/16, so their address space fits a bitmap
+static void randomtrie(patricia_trie_t *pt, uint n, uint32_t *seed)
+{
+    patinit(pt, AF_INET);
+    for (uint i = 0; i < n; i++) {
+        *seed = *seed * 1103515245u + 12345u;
+
+        uint bitlen = 16 + (*seed >> 24) % 17;
+        uint32_t addr = 0x0a000000u | ((*seed >> 4) & 0xffffu);
+        addr = htonl(addr & (~0ull << (32 - bitlen)));
+
+        netaddr_t pfx;
+        makenaddr(&pfx, AF_INET, &addr, bitlen);
+        trienode_t *node = patinsert(pt, &pfx, NULL);
+        CU_ASSERT_FATAL(node != NULL);
+        node->payload = pt;
+    }
+}
+
+static void markspace(byte *bitmap, const patricia_trie_t *pt)
+{
+    memset(bitmap, 0, 0x10000 / 8);
+
+    patiterator_t it;
+    for (patiteratorinit(&it, pt); !patiteratorend(&it); patiteratornext(&it)) {
+        const netaddr_t *pfx = &patiteratorget(&it)->prefix;
+
+        uint32_t first = ntohl(pfx->u32[0]) & 0xffffu;
+        uint32_t count = 1u << (32 - pfx->bitlen);
+        for (uint32_t i = first; i < first + count; i++)
+            bitmap[i >> 3] |= 1 << (i & 7);
+    }
+}
+
+static uint countprefixes(const patricia_trie_t *pt)
+{
+    uint n = 0;
+
+    patiterator_t it;
+    for (patiteratorinit(&it, pt); !patiteratorend(&it); patiteratornext(&it))
+        n++;
+
+    return n;
+}
+
+void testpatsetops(void)
+{
+    uint32_t seed = 42;
+
+    for (uint round = 0; round < 16; round++) {
+        patricia_trie_t a, b, u, x, d, uc;
+        randomtrie(&a, 64 + round * 16, &seed);
+        randomtrie(&b, 64 + round * 8, &seed);
+        patinit(&u, AF_INET);
+        patinit(&x, AF_INET);
+        patinit(&d, AF_INET);
+        patinit(&uc, AF_INET);
+
+        CU_ASSERT_FATAL(patunion(&u, &a, &b));
+        CU_ASSERT_FATAL(patintersect(&x, &a, &b));
+        CU_ASSERT_FATAL(patdifference(&d, &a, &b));
+
+        uint na = 0, nx = 0;
+        patiterator_t it;
+        for (patiteratorinit(&it, &a); !patiteratorend(&it); patiteratornext(&it)) {
+            const trienode_t *n = patiteratorget(&it);
+            bool inb = patsearchexact(&b, &n->prefix) != NULL;
+
+            trienode_t *m = patsearchexact(&u, &n->prefix);
+            CU_ASSERT(m && m->payload == &a);
+            CU_ASSERT((patsearchexact(&x, &n->prefix) != NULL) == inb);
+            CU_ASSERT((patsearchexact(&d, &n->prefix) != NULL) == !inb);
+
+            na++;
+            nx += inb;
+        }
+        for (patiteratorinit(&it, &b); !patiteratorend(&it); patiteratornext(&it))
+            CU_ASSERT(patsearchexact(&u, &patiteratorget(&it)->prefix) != NULL);
+
+        CU_ASSERT(countprefixes(&u) == na + countprefixes(&b) - nx);
+        CU_ASSERT(countprefixes(&x) == nx);
+        CU_ASSERT(countprefixes(&d) == na - nx);
+        CU_ASSERT(u.nprefs == countprefixes(&u));
+
+        // uncovered space must match a brute-force bitmap
+        u128 amount;
+        CU_ASSERT_FATAL(patuncovered(&uc, &a, &b, &amount));
+
+        byte bma[0x10000 / 8], bmb[0x10000 / 8], bmuc[0x10000 / 8];
+        markspace(bma, &a);
+        markspace(bmb, &b);
+        markspace(bmuc, &uc);
+
+        uint64_t expected = 0;
+        for (uint i = 0; i < sizeof(bma); i++) {
+            CU_ASSERT((bma[i] & ~bmb[i]) == bmuc[i]);
+            expected += __builtin_popcount(bma[i] & ~bmb[i]);
+        }
+        CU_ASSERT(u128equ(amount, expected));
+        CU_ASSERT(u128equ(patcoverage(&uc), expected));
+
+        // minimal: no prefix overlaps nor has its sibling in the result
+        for (patiteratorinit(&it, &uc); !patiteratorend(&it); patiteratornext(&it)) {
+            netaddr_t pfx = patiteratorget(&it)->prefix;
+
+            CU_ASSERT(patsearchbest(&uc, &pfx) == NULL);  // only looks for strict supernets
+            if (pfx.bitlen == 0)
+                continue;
+
+            uint bit = pfx.bitlen - 1;
+            pfx.bytes[bit >> 3] ^= 0x80 >> (bit & 7);
+            CU_ASSERT(patsearchexact(&uc, &pfx) == NULL);
+        }
+
+        patdestroy(&a);
+        patdestroy(&b);
+        patdestroy(&u);
+        patdestroy(&x);
+        patdestroy(&d);
+        patdestroy(&uc);
+    }
+
+    patricia_trie_t a, b, uc;
+    patinit(&a, AF_INET);
+    patinit(&b, AF_INET);
+    patinit(&uc, AF_INET);
+
+    patinsert(&a, pfx("10.0.0.0/8"), NULL);
+    patinsert(&b, pfx("10.0.0.0/9"), NULL);
+    patinsert(&b, pfx("10.192.0.0/10"), NULL);
+
+    u128 amount;
+    CU_ASSERT_FATAL(patuncovered(&uc, &a, &b, &amount));
+    CU_ASSERT(uc.nprefs == 1);
+    CU_ASSERT(patsearchexact(&uc, pfx("10.128.0.0/10")) != NULL);
+    CU_ASSERT(u128equ(amount, 1u << 22));
+
+    patdestroy(&a);
+    patdestroy(&b);
+    patdestroy(&uc);
+}
+
+// random prefix inside 10.0.0.0/16, *key identifies it within [0, 17 << 16)
+static void randomprefix(netaddr_t *pfx, uint *key, uint32_t *seed)
+{
+    *seed = *seed * 1103515245u + 12345u;
+
+    uint bitlen = 16 + (*seed >> 24) % 17;
+    uint32_t host = ((*seed >> 4) & 0xffffu) & (0xffffu << (32 - bitlen));
+    uint32_t addr = htonl(0x0a000000u | host);
+
+    makenaddr(pfx, AF_INET, &addr, bitlen);
+    *key = ((bitlen - 16) << 16) | host;
+}
+
+static void checkcompacted(const patricia_trie_t *pt, const byte *present)
+{
+    uint count = 0;
+    for (uint key = 0; key < (17u << 16); key++) {
+        uint bitlen = 16 + (key >> 16);
+        uint32_t host = key & 0xffffu;
+        if (host & ~(0xffffu << (32 - bitlen)))
+            continue;  // not a valid prefix
+
+        uint32_t addr = htonl(0x0a000000u | host);
+        netaddr_t pfx;
+        makenaddr(&pfx, AF_INET, &addr, bitlen);
+
+        trienode_t *n = patsearchexact(pt, &pfx);
+        if (present[key >> 3] & (1 << (key & 7))) {
+            CU_ASSERT(n != NULL && n->payload == &present[key >> 3]);
+            count++;
+        } else {
+            CU_ASSERT(n == NULL);
+        }
+    }
+
+    CU_ASSERT(pt->nprefs == count);
+}
+
+void testpatcompact(void)
+{
+    static byte present[(17u << 16) / 8];
+
+    uint32_t seed = 7;
+    size_t inuse, reserved;
+
+    patricia_trie_t pt;
+    patinit(&pt, AF_INET);
+
+    // compacting an empty trie is fine
+    CU_ASSERT(patcompact(&pt, 0));
+    patmemusage(&pt, &inuse, &reserved);
+    CU_ASSERT(inuse == 0 && reserved == 0);
+
+    memset(present, 0, sizeof(present));
+    for (uint i = 0; i < 20000; i++) {
+        netaddr_t pfx;
+        uint key;
+        randomprefix(&pfx, &key, &seed);
+
+        trienode_t *n = patinsert(&pt, &pfx, NULL);
+        CU_ASSERT_FATAL(n != NULL);
+        n->payload = &present[key >> 3];
+        present[key >> 3] |= 1 << (key & 7);
+    }
+
+    // churn, leaving most pages sparsely populated
+    for (uint i = 0; i < 200000; i++) {
+        netaddr_t pfx;
+        uint key;
+        randomprefix(&pfx, &key, &seed);
+
+        if (patremove(&pt, &pfx))
+            present[key >> 3] &= ~(1 << (key & 7));
+    }
+
+    size_t before;
+    patmemusage(&pt, &inuse, &before);
+    CU_ASSERT(inuse > 0 && inuse < before);
+
+    CU_ASSERT(patcompact(&pt, 0));
+    checkcompacted(&pt, present);
+
+    patmemusage(&pt, &inuse, &reserved);
+    CU_ASSERT(reserved < before);
+    CU_ASSERT(reserved - inuse < 2 * 8192);
+
+    // incremental compaction interleaved with updates
+    for (uint i = 0; i < 20000; i++) {
+        netaddr_t pfx;
+        uint key;
+        randomprefix(&pfx, &key, &seed);
+
+        trienode_t *n = patinsert(&pt, &pfx, NULL);
+        CU_ASSERT_FATAL(n != NULL);
+        n->payload = &present[key >> 3];
+        present[key >> 3] |= 1 << (key & 7);
+    }
+
+    uint passes = 0;
+    for (uint i = 0; i < 100000; i++) {
+        netaddr_t pfx;
+        uint key;
+        randomprefix(&pfx, &key, &seed);
+
+        if (i & 1) {
+            trienode_t *n = patinsert(&pt, &pfx, NULL);
+            CU_ASSERT_FATAL(n != NULL);
+            n->payload = &present[key >> 3];
+            present[key >> 3] |= 1 << (key & 7);
+        } else if (patremove(&pt, &pfx)) {
+            present[key >> 3] &= ~(1 << (key & 7));
+        }
+
+        passes += patcompact(&pt, 4);
+    }
+
+    CU_ASSERT(passes > 0);
+    while (!patcompact(&pt, 64));
+
+    checkcompacted(&pt, present);
+    patmemusage(&pt, &inuse, &reserved);
+    CU_ASSERT(inuse <= reserved);
+
+    patdestroy(&pt);
+}
+
+static u128 countspace(const byte *bitmap, const netaddr_t *pfx)
+{
+    uint32_t first = ntohl(pfx->u32[0]) & 0xffffu;
+    uint32_t count = 1u << (32 - pfx->bitlen);
+
+    u128 n = U128_ZERO;
+    for (uint32_t i = first; i < first + count; i++) {
+        if (bitmap[i >> 3] & (1 << (i & 7)))
+            n = u128addu(n, 1);
+    }
+
+    return n;
+}
+
+static void checkcoverage(const patricia_trie_t *aug, const patricia_trie_t *pt, uint32_t *seed)
+{
+    static byte bitmap[0x10000 / 8];
+    markspace(bitmap, pt);
+
+    CU_ASSERT(u128cmp(patcoverage(aug), patcoverage(pt)) == 0);
+    CU_ASSERT(u128cmp(patcoverage(aug), countspace(bitmap, pfx("10.0.0.0/16"))) == 0);
+
+    for (uint i = 0; i < 64; i++) {
+        netaddr_t q;
+        uint key;
+        randomprefix(&q, &key, seed);
+
+        u128 expect = countspace(bitmap, &q);
+        CU_ASSERT(u128cmp(patcoverageof(aug, &q), expect) == 0);
+        CU_ASSERT(u128cmp(patcoverageof(pt, &q), expect) == 0);
+    }
+}
+
+void testpataugment(void)
+{
+    uint32_t seed = 11;
+
+    patricia_trie_t aug, pt;
+    patinit(&aug, AF_INET);
+    patinit(&pt, AF_INET);
+    CU_ASSERT_FATAL(pataugment(&aug));
+
+    CU_ASSERT(u128equ(patcoverage(&aug), 0));
+    CU_ASSERT(u128equ(patcoverageof(&aug, pfx("10.0.0.0/8")), 0));
+
+    for (uint round = 0; round < 32; round++) {
+        for (uint i = 0; i < 256; i++) {
+            netaddr_t p;
+            uint key;
+            randomprefix(&p, &key, &seed);
+
+            if (round & 1 && i & 1) {
+                CU_ASSERT(patremove(&aug, &p) == patremove(&pt, &p));
+            } else {
+                CU_ASSERT_FATAL(patinsert(&aug, &p, NULL) != NULL);
+                CU_ASSERT_FATAL(patinsert(&pt, &p, NULL) != NULL);
+            }
+        }
+
+        checkcoverage(&aug, &pt, &seed);
+    }
+
+    // queries outside any prefix, or above all of them
+    CU_ASSERT(u128equ(patcoverageof(&aug, pfx("192.168.0.0/16")), 0));
+    CU_ASSERT(u128cmp(patcoverageof(&aug, pfx("10.0.0.0/8")), patcoverage(&aug)) == 0);
+    CU_ASSERT(u128cmp(patcoverageof(&aug, pfx("0.0.0.0/0")), patcoverage(&aug)) == 0);
+
+    // the default route is ignored, a covering supernet is not
+    patinsert(&aug, pfx("0.0.0.0/0"), NULL);
+    CU_ASSERT(u128cmp(patcoverageof(&aug, pfx("10.0.0.0/8")), patcoverage(&pt)) == 0);
+    patinsert(&aug, pfx("10.0.0.0/8"), NULL);
+    CU_ASSERT(u128equ(patcoverage(&aug), 1u << 24));
+    CU_ASSERT(u128equ(patcoverageof(&aug, pfx("10.1.2.0/24")), 256));
+    patremove(&aug, pfx("10.0.0.0/8"));
+    patremove(&aug, pfx("0.0.0.0/0"));
+    CU_ASSERT(u128cmp(patcoverage(&aug), patcoverage(&pt)) == 0);
+
+    // cached coverage survives compaction
+    CU_ASSERT(patcompact(&aug, 0));
+    checkcoverage(&aug, &pt, &seed);
+
+    // augmenting a populated trie
+    CU_ASSERT_FATAL(pataugment(&pt));
+    checkcoverage(&pt, &aug, &seed);
+
+    patdestroy(&aug);
+    patdestroy(&pt);
+}
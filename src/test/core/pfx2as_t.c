@@ -0,0 +1,139 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#include "../../ubgp/pfx2as.h"
+#include "../../ubgp/ubgpdef.h"
+#include "../test_util.h"
+#include "test.h"
+
+#include <CUnit/CUnit.h>
+
+#include <string.h>
+
+static const as_origin_t *aseqorigin(uint32_t as)
+{
+    static as_origin_t o;
+
+    o.type    = AS_SEGMENT_SEQ;
+    o.as      = as;
+    o.as_size = sizeof(uint32_t);
+    o.count   = 0;
+    o.set     = NULL;
+    return &o;
+}
+
+// set members as big endian 16 bits ASes, as found in a segment
+static const as_origin_t *asetorigin(const byte *set, uint count)
+{
+    static as_origin_t o;
+
+    o.type    = AS_SEGMENT_SET;
+    o.as      = 0;
+    o.as_size = sizeof(uint16_t);
+    o.count   = count;
+    o.set     = set;
+    return &o;
+}
+
+static const pfx2as_origin_t *nextrow(pfx2as_iterator_t *it, const char *expect, size_t *pn)
+{
+    const pfx2as_origin_t *origins;
+
+    const netaddr_t *p = pfx2asiternext(it, &origins, pn);
+    CU_ASSERT_FATAL(p != NULL);
+    CU_ASSERT(strcmp(naddrtos(p, NADDR_CIDR), expect) == 0);
+    return origins;
+}
+
+void testpfx2as(void)
+{
+    static const byte set1[] = { 0, 30, 0, 10, 0, 20, 0, 10 };  // {30,10,20,10}
+    static const byte set2[] = { 0, 10, 0, 20, 0, 30 };         // same as set1
+    static const byte set3[] = { 0, 10 };
+
+    pfx2as_t a, b;
+    pfx2asinit(&a);
+    pfx2asinit(&b);
+
+    // MOAS prefix, spilling out of the inline origins
+    for (uint i = 0; i < 3; i++)
+        CU_ASSERT(pfx2asadd(&a, pfx("10.0.0.0/8"), aseqorigin(100), 1 + i));
+
+    CU_ASSERT(pfx2asadd(&a, pfx("10.0.0.0/8"), aseqorigin(200), 4));
+    CU_ASSERT(pfx2asadd(&a, pfx("10.0.0.0/8"), asetorigin(set1, 4), 5));
+    CU_ASSERT(pfx2asadd(&a, pfx("10.0.0.0/8"), asetorigin(set2, 3), 6));
+    CU_ASSERT(pfx2asadd(&a, pfx("10.0.0.0/8"), asetorigin(set3, 1), 7));
+    CU_ASSERT(pfx2asadd(&a, pfx("2001:db8::/32"), aseqorigin(300), 1));
+    CU_ASSERT(pfx2asadd(&a, pfx("9.0.0.0/8"), aseqorigin(400), 1));
+
+    // a peer counts once per origin, whatever the number of paths
+    CU_ASSERT(pfx2asadd(&a, pfx("10.0.0.0/8"), aseqorigin(100), 1));
+    CU_ASSERT(pfx2asadd(&a, pfx("10.0.0.0/8"), asetorigin(set2, 3), 5));
+    CU_ASSERT(pfx2asadd(&a, pfx("9.0.0.0/8"), aseqorigin(400), 1));
+
+    // no origin
+    as_origin_t none = { .type = AS_SEGMENT_BAD };
+    CU_ASSERT(pfx2asadd(&a, pfx("8.0.0.0/8"), &none, 1));
+
+    CU_ASSERT(pfx2ascount(&a) == 3);
+
+    // peers 4 and 7 announce the same routes in both tables
+    CU_ASSERT(pfx2asadd(&b, pfx("10.0.0.0/8"), aseqorigin(200), 8));
+    CU_ASSERT(pfx2asadd(&b, pfx("10.0.0.0/8"), aseqorigin(200), 4));
+    CU_ASSERT(pfx2asadd(&b, pfx("10.0.0.0/8"), asetorigin(set3, 1), 9));
+    CU_ASSERT(pfx2asadd(&b, pfx("10.0.0.0/8"), asetorigin(set3, 1), 7));
+    CU_ASSERT(pfx2asadd(&b, pfx("10.0.0.0/8"), asetorigin(set2, 3), 10));
+    CU_ASSERT(pfx2asadd(&b, pfx("10.0.0.0/16"), aseqorigin(200), 4));
+
+    CU_ASSERT_FATAL(pfx2asmerge(&a, &b));
+    CU_ASSERT(pfx2ascount(&a) == 4);
+
+    size_t n, count;
+    const uint32_t *set;
+
+    pfx2as_iterator_t it;
+    pfx2asiterinit(&it, &a);
+
+    const pfx2as_origin_t *origins = nextrow(&it, "9.0.0.0/8", &n);
+    CU_ASSERT(n == 1 && origins[0].npeers == 1);
+
+    origins = nextrow(&it, "10.0.0.0/8", &n);
+    CU_ASSERT_FATAL(n == 4);
+    CU_ASSERT(origins[0].npeers == 3 && !origins[0].isset && origins[0].as == 100);
+    CU_ASSERT(origins[1].npeers == 3 && origins[1].isset);  // {10,20,30}
+    set = pfx2asset(&a, origins[1].as, &count);
+    CU_ASSERT(count == 3 && set[0] == 10 && set[1] == 20 && set[2] == 30);
+    CU_ASSERT(origins[2].npeers == 2 && !origins[2].isset && origins[2].as == 200);
+    CU_ASSERT(origins[3].npeers == 2 && origins[3].isset);  // {10}
+    set = pfx2asset(&a, origins[3].as, &count);
+    CU_ASSERT(count == 1 && set[0] == 10);
+
+    origins = nextrow(&it, "10.0.0.0/16", &n);
+    CU_ASSERT(n == 1 && origins[0].as == 200 && origins[0].npeers == 1);
+
+    origins = nextrow(&it, "2001:db8::/32", &n);
+    CU_ASSERT(n == 1 && origins[0].as == 300);
+
+    CU_ASSERT(pfx2asiternext(&it, &origins, &n) == NULL);
+
+    pfx2asdestroy(&a);
+    pfx2asdestroy(&b);
+}
@@ -52,6 +52,42 @@ void testpatcoverage(void);
 
 void testpatgetfirstsubnets(void);
 
+void testpatbloom(void);
+
+void testpatpack(void);
+
+void testpatsetops(void);
+
+void testpatcompact(void);
+
+void testpataugment(void);
+
+void testpfx2as(void);
+
+void testaslinks(void);
+
+void testhll(void);
+
+void testhijack(void);
+
+void testflap(void);
+
+void testmrtwriter(void);
+
+void testmrtribbatch(void);
+
+void testframe(void);
+
+void testingest(void);
+
+void testbmp(void);
+
+void testcpatbase(void);
+
+void testcpatdiff(void);
+
+void testcpatstress(void);
+
 void testzio(void);
 
 void testbz2(void);
@@ -22,6 +22,8 @@
 #ifndef UBGP_TEST_UTIL_H_
 #define UBGP_TEST_UTIL_H_
 
+#include "../ubgp/netaddr.h"
+
 #include <CUnit/CUnit.h>
 #include <stdio.h>
 #include <string.h>
@@ -42,4 +44,13 @@
 #define CU_ASSERT_STRING_EQUAL_EX(r, s, fmt, ...) \
     CU_ASSERT_VERBOSE(strcmp(r, s) == 0, __LINE__, __FILE__, __func__, 0, fmt, ## __VA_ARGS__)
 
+// parse a prefix, the result is only valid up to the next call
+static inline netaddr_t *pfx(const char *s)
+{
+    static netaddr_t p;
+
+    CU_ASSERT_FATAL(stonaddr(&p, s) == 0);
+    return &p;
+}
+
 #endif
@@ -0,0 +1,392 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#include "aslinks.h"
+#include "branch.h"
+#include "ubgpdef.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct aslinks_val_s {
+    time_t   first, last;
+    uint32_t id;      // link identifier in seen pairs, starting from 1
+    uint32_t npeers;
+};
+
+static uint64_t mix64(uint64_t x)
+{
+    // splitmix64 finalizer, AS numbers are far from uniformly distributed
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+static uint64_t packlink(uint32_t a, uint32_t b)
+{
+    return (a < b) ? ((uint64_t) a << 32) | b : ((uint64_t) b << 32) | a;
+}
+
+UBGP_API void aslinksinit(aslinks_t *t)
+{
+    memset(t, 0, sizeof(*t));
+}
+
+UBGP_API void aslinksdestroy(aslinks_t *t)
+{
+    free(t->keys);
+    free(t->vals);
+    free(t->seen);
+}
+
+static bool rehashlinks(aslinks_t *t)
+{
+    size_t cap = (t->cap > 0) ? 2 * t->cap : 1024;
+
+    uint64_t      *keys = calloc(cap, sizeof(*keys));
+    aslinks_val_t *vals = malloc(cap * sizeof(*vals));
+    if (unlikely(!keys || !vals)) {
+        free(keys);
+        free(vals);
+        return false;
+    }
+
+    for (size_t i = 0; i < t->cap; i++) {
+        if (t->keys[i] == 0)
+            continue;
+
+        size_t h = mix64(t->keys[i]) & (cap - 1);
+        while (keys[h] != 0)
+            h = (h + 1) & (cap - 1);
+
+        keys[h] = t->keys[i];
+        vals[h] = t->vals[i];
+    }
+
+    free(t->keys);
+    free(t->vals);
+    t->keys = keys;
+    t->vals = vals;
+    t->cap  = cap;
+    return true;
+}
+
+// returns the value for key, inserting an empty one if needed, NULL on out of memory
+static aslinks_val_t *getlink(aslinks_t *t, uint64_t key, time_t stamp)
+{
+    // keep load factor under 1/2, so probe sequences stay within a cache line or two
+    if (2 * (t->nlinks + 1) > t->cap && !rehashlinks(t))
+        return NULL;
+
+    size_t mask = t->cap - 1;
+    size_t h = mix64(key) & mask;
+    while (t->keys[h] != 0) {
+        if (t->keys[h] == key)
+            return &t->vals[h];
+
+        h = (h + 1) & mask;
+    }
+    if (unlikely(t->nlinks == UINT32_MAX))
+        return NULL;  // out of link identifiers
+
+    aslinks_val_t *val = &t->vals[h];
+    val->first  = stamp;
+    val->last   = stamp;
+    val->id     = ++t->nlinks;
+    val->npeers = 0;
+
+    t->keys[h] = key;
+    return val;
+}
+
+static bool rehashseen(aslinks_t *t)
+{
+    size_t cap = (t->seencap > 0) ? 2 * t->seencap : 1024;
+
+    uint64_t *seen = calloc(cap, sizeof(*seen));
+    if (unlikely(!seen))
+        return false;
+
+    for (size_t i = 0; i < t->seencap; i++) {
+        if (t->seen[i] == 0)
+            continue;
+
+        size_t h = mix64(t->seen[i]) & (cap - 1);
+        while (seen[h] != 0)
+            h = (h + 1) & (cap - 1);
+
+        seen[h] = t->seen[i];
+    }
+
+    free(t->seen);
+    t->seen    = seen;
+    t->seencap = cap;
+    return true;
+}
+
+// count peer on the link, unless it was already counted, returns false on out of memory
+static bool addpeer(aslinks_t *t, aslinks_val_t *val, uint32_t peer)
+{
+    if (2 * (t->nseen + 1) > t->seencap && !rehashseen(t))
+        return false;
+
+    uint64_t key  = ((uint64_t) val->id << 32) | peer;
+    size_t   mask = t->seencap - 1;
+    size_t   h    = mix64(key) & mask;
+    while (t->seen[h] != 0) {
+        if (t->seen[h] == key)
+            return true;
+
+        h = (h + 1) & mask;
+    }
+
+    t->seen[h] = key;
+    t->nseen++;
+    val->npeers++;
+    return true;
+}
+
+UBGP_API bool aslinksadd(aslinks_t *t, uint32_t a, uint32_t b, uint32_t peer, time_t stamp)
+{
+    if (a == b)
+        return true;
+
+    aslinks_val_t *val = getlink(t, packlink(a, b), stamp);
+    if (unlikely(!val))
+        return false;
+
+    val->first = MIN(val->first, stamp);
+    val->last  = MAX(val->last, stamp);
+    return addpeer(t, val, peer);
+}
+
+UBGP_API ubgp_err aslinksaddpath(aslinks_t *t, ubgp_msg_s *msg, uint32_t peer, time_t stamp)
+{
+    ubgp_err err = startrealaspath(msg);
+    if (unlikely(err != BGP_ENOERR))
+        return err;
+
+    uint32_t prev    = 0;
+    bool     hasprev = false;
+
+    as_pathent_t *ent;
+    while ((ent = nextaspath(msg)) != NULL) {
+        if (ent->type != AS_SEGMENT_SEQ || ent->as == AS_TRANS) {
+            // position of the hidden ASes is unknown, so is adjacency
+            hasprev = false;
+            continue;
+        }
+        if (hasprev && ent->as == prev)
+            continue;  // prepending
+
+        if (hasprev && unlikely(!aslinksadd(t, prev, ent->as, peer, stamp))) {
+            endaspath(msg);
+            return BGP_ENOMEM;
+        }
+
+        prev    = ent->as;
+        hasprev = true;
+    }
+
+    return endaspath(msg);
+}
+
+static aslinks_val_t *findlink(const aslinks_t *t, uint64_t key)
+{
+    size_t mask = t->cap - 1;
+    size_t h    = mix64(key) & mask;
+    while (t->keys[h] != key)
+        h = (h + 1) & mask;
+
+    return &t->vals[h];
+}
+
+UBGP_API bool aslinksmerge(aslinks_t *dst, const aslinks_t *src)
+{
+    if (src->nlinks == 0)
+        return true;
+
+    // map src link identifiers to dst values, so seen pairs can be translated
+    aslinks_val_t **valmap = malloc((src->nlinks + 1) * sizeof(*valmap));
+    if (unlikely(!valmap))
+        return false;
+
+    bool ok = false;
+    for (size_t i = 0; i < src->cap; i++) {
+        if (src->keys[i] == 0)
+            continue;
+
+        const aslinks_val_t *sval = &src->vals[i];
+
+        aslinks_val_t *val = getlink(dst, src->keys[i], sval->first);
+        if (unlikely(!val))
+            goto out;
+
+        val->first = MIN(val->first, sval->first);
+        val->last  = MAX(val->last, sval->last);
+    }
+    // no more links are inserted from now on, so values stay put
+    for (size_t i = 0; i < src->cap; i++) {
+        if (src->keys[i] != 0)
+            valmap[src->vals[i].id] = findlink(dst, src->keys[i]);
+    }
+    for (size_t i = 0; i < src->seencap; i++) {
+        if (src->seen[i] == 0)
+            continue;
+
+        uint32_t id   = src->seen[i] >> 32;
+        uint32_t peer = src->seen[i] & 0xffffffffu;
+        if (unlikely(!addpeer(dst, valmap[id], peer)))
+            goto out;
+    }
+
+    ok = true;
+
+out:
+    free(valmap);
+    return ok;
+}
+
+static int cmplink(const void *a, const void *b)
+{
+    const aslink_t *x = a, *y = b;
+
+    if (x->a != y->a)
+        return (x->a > y->a) - (x->a < y->a);
+
+    return (x->b > y->b) - (x->b < y->b);
+}
+
+UBGP_API aslink_t *aslinkslist(const aslinks_t *t, size_t *pn)
+{
+    *pn = 0;
+    if (t->nlinks == 0)
+        return NULL;
+
+    aslink_t *links = malloc(t->nlinks * sizeof(*links));
+    if (unlikely(!links))
+        return NULL;
+
+    size_t n = 0;
+    for (size_t i = 0; i < t->cap; i++) {
+        if (t->keys[i] == 0)
+            continue;
+
+        aslink_t *l = &links[n++];
+        l->a      = t->keys[i] >> 32;
+        l->b      = t->keys[i] & 0xffffffffu;
+        l->first  = t->vals[i].first;
+        l->last   = t->vals[i].last;
+        l->npeers = t->vals[i].npeers;
+    }
+
+    qsort(links, n, sizeof(*links), cmplink);
+    *pn = n;
+    return links;
+}
+
+static int cmpas(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a;
+    uint32_t y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t vertexof(const aslinks_csr_t *csr, uint32_t as)
+{
+    const uint32_t *v = bsearch(&as, csr->ases, csr->nverts, sizeof(as), cmpas);
+    return v - csr->ases;
+}
+
+UBGP_API bool aslinkscsr(aslinks_csr_t *csr, const aslink_t *links, size_t n)
+{
+    memset(csr, 0, sizeof(*csr));
+
+    uint32_t *ases = malloc((2 * n + 1) * sizeof(*ases));
+    uint32_t *offs = NULL;
+    uint32_t *adj  = malloc((2 * n + 1) * sizeof(*adj));
+    if (unlikely(!ases || !adj))
+        goto oom;
+
+    for (size_t i = 0; i < n; i++) {
+        ases[2*i]     = links[i].a;
+        ases[2*i + 1] = links[i].b;
+    }
+    qsort(ases, 2 * n, sizeof(*ases), cmpas);
+
+    size_t nverts = 0;
+    for (size_t i = 0; i < 2 * n; i++) {
+        if (nverts == 0 || ases[nverts - 1] != ases[i])
+            ases[nverts++] = ases[i];
+    }
+
+    offs = calloc(nverts + 1, sizeof(*offs));
+    if (unlikely(!offs))
+        goto oom;
+
+    csr->ases   = ases;
+    csr->offs   = offs;
+    csr->adj    = adj;
+    csr->nverts = nverts;
+    csr->nadj   = 2 * n;
+
+    // count degrees, then turn them into offsets
+    for (size_t i = 0; i < n; i++) {
+        offs[vertexof(csr, links[i].a) + 1]++;
+        offs[vertexof(csr, links[i].b) + 1]++;
+    }
+    for (size_t i = 0; i < nverts; i++)
+        offs[i + 1] += offs[i];
+
+    // links are sorted by a, so each vertex receives its lower neighbours
+    // first, in increasing order, and then its higher ones: lists come out sorted
+    uint32_t *cur = malloc((nverts + 1) * sizeof(*cur));
+    if (unlikely(!cur))
+        goto oom;
+
+    memcpy(cur, offs, nverts * sizeof(*cur));
+    for (size_t i = 0; i < n; i++) {
+        uint32_t u = vertexof(csr, links[i].a);
+        uint32_t v = vertexof(csr, links[i].b);
+
+        adj[cur[u]++] = v;
+        adj[cur[v]++] = u;
+    }
+    free(cur);
+    return true;
+
+oom:
+    free(ases);
+    free(offs);
+    free(adj);
+    memset(csr, 0, sizeof(*csr));
+    return false;
+}
+
+UBGP_API void aslinksfreecsr(aslinks_csr_t *csr)
+{
+    free(csr->ases);
+    free(csr->offs);
+    free(csr->adj);
+}
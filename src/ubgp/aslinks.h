@@ -0,0 +1,195 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#ifndef UBGP_ASLINKS_H_
+#define UBGP_ASLINKS_H_
+
+#include "bgp.h"
+#include "funcattribs.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * SECTION: aslinks
+ * @title: AS Adjacency Graph
+ * @include: aslinks.h
+ *
+ * Extract the AS level topology from BGP routes: any two ASes adjacent in
+ * an AS_SEQUENCE of a real AS path (see startrealaspath()) form an
+ * undirected link.
+ * Prepending is collapsed, while AS_SETs, confederation segments and
+ * %AS_TRANS break adjacency, since the position of the ASes
+ * they hide is unknown.
+ *
+ * Links are packed into 64 bits integers and deduplicated in an open
+ * addressing hash table, each carrying its first and last seen timestamps
+ * and the number of distinct peers observing it.
+ * Peers are identified by caller assigned integers, which must be
+ * consistent across tables that are going to be merged.
+ *
+ * Tables are meant to be filled independently by each worker,
+ * and combined once done by aslinksmerge().
+ */
+
+/**
+ * aslink_t:
+ * @a:      the lower AS of the link
+ * @b:      the higher AS of the link
+ * @first:  timestamp of the first route containing the link
+ * @last:   timestamp of the last route containing the link
+ * @npeers: number of distinct peers observing the link
+ *
+ * An AS link.
+ */
+typedef struct {
+    uint32_t a, b;
+    time_t   first, last;
+    uint32_t npeers;
+} aslink_t;
+
+typedef struct aslinks_val_s aslinks_val_t;
+
+/**
+ * aslinks_t:
+ *
+ * An AS links table.
+ */
+typedef struct {
+    /*< private >*/
+    uint64_t      *keys;    // packed links, (a << 32) | b, 0 marks a free slot
+    aslinks_val_t *vals;    // parallel to keys, only touched on hits
+    size_t         nlinks, cap;
+    uint64_t      *seen;    // distinct (link id << 32) | peer pairs, 0 marks a free slot
+    size_t         nseen, seencap;
+} aslinks_t;
+
+UBGP_API CHECK_NONNULL(1) void aslinksinit(aslinks_t *t);
+
+UBGP_API CHECK_NONNULL(1) void aslinksdestroy(aslinks_t *t);
+
+/**
+ * aslinksadd:
+ * @t:     a #aslinks_t
+ * @a:     an AS
+ * @b:     an AS adjacent to @a, in any order
+ * @peer:  identifier of the peer observing the link
+ * @stamp: timestamp of the observation
+ *
+ * Record a single link, self loops are ignored.
+ *
+ * Returns: %true on success, %false on out of memory.
+ */
+UBGP_API CHECK_NONNULL(1) bool aslinksadd(aslinks_t *t,
+                                          uint32_t   a,
+                                          uint32_t   b,
+                                          uint32_t   peer,
+                                          time_t     stamp);
+
+/**
+ * aslinksaddpath:
+ * @t:     a #aslinks_t
+ * @msg:   a BGP UPDATE message
+ * @peer:  identifier of the peer that advertised @msg
+ * @stamp: timestamp of the advertisement
+ *
+ * Record every link along the real AS path of @msg.
+ * This uses the AS path iterator of @msg, so it must not be called
+ * while another AS path iteration is in progress.
+ *
+ * Returns: %BGP_ENOERR on success, %BGP_ENOMEM on out of memory,
+ *          or any error raised while decoding the AS path.
+ */
+UBGP_API CHECK_NONNULL(1, 2) ubgp_err aslinksaddpath(aslinks_t  *t,
+                                                     ubgp_msg_s *msg,
+                                                     uint32_t    peer,
+                                                     time_t      stamp);
+
+/**
+ * aslinksmerge:
+ * @dst: table receiving the merged data
+ * @src: a table to be merged into @dst, left untouched
+ *
+ * Add every link in @src to @dst, widening the observation interval
+ * and joining the peer sets of links found in both.
+ *
+ * Returns: %true on success, %false on out of memory, in which case @dst
+ *          may contain part of @src.
+ */
+UBGP_API CHECK_NONNULL(1, 2) bool aslinksmerge(aslinks_t *dst, const aslinks_t *src);
+
+/**
+ * aslinkscount:
+ * @t: a #aslinks_t
+ *
+ * Returns: number of distinct links in @t.
+ */
+static inline PUREFUNC CHECK_NONNULL(1) size_t aslinkscount(const aslinks_t *t)
+{
+    return t->nlinks;
+}
+
+/**
+ * aslinkslist:
+ * @t:  a #aslinks_t
+ * @pn: storage for the number of links
+ *
+ * Collect every link in @t, sorted by @a and then by @b.
+ *
+ * Returns: a list to be free()d by the caller, %NULL on out of memory
+ *          or if @t is empty.
+ */
+UBGP_API CHECK_NONNULL(1, 2) aslink_t *aslinkslist(const aslinks_t *t, size_t *pn);
+
+/**
+ * aslinks_csr_t:
+ * @ases:   the sorted ASes in the graph, vertex i is AS @ases[i]
+ * @offs:   neighbours of vertex i are @adj[@offs[i]] up to @adj[@offs[i+1]]
+ * @adj:    sorted neighbour vertexes, each link appears once per direction
+ * @nverts: number of vertexes
+ * @nadj:   size of @adj, twice the number of links
+ *
+ * The AS graph in compressed sparse row form, see aslinkscsr().
+ */
+typedef struct {
+    uint32_t *ases;
+    uint32_t *offs;
+    uint32_t *adj;
+    size_t    nverts, nadj;
+} aslinks_csr_t;
+
+/**
+ * aslinkscsr:
+ * @csr:   storage for the graph
+ * @links: a list of links sorted as returned by aslinkslist()
+ * @n:     number of links
+ *
+ * Build the compressed sparse row form of the graph described by @links,
+ * to be released with aslinksfreecsr().
+ *
+ * Returns: %true on success, %false on out of memory.
+ */
+UBGP_API CHECK_NONNULL(1) bool aslinkscsr(aslinks_csr_t *csr, const aslink_t *links, size_t n);
+
+UBGP_API CHECK_NONNULL(1) void aslinksfreecsr(aslinks_csr_t *csr);
+
+#endif
@@ -30,6 +30,14 @@ typedef unsigned atomic_uword __attribute__((__mode__(__word__)));
 #define ATOMIC_INCR(x) (__atomic_fetch_add(&(x), 1, __ATOMIC_ACQ_REL) + 1)
 #define ATOMIC_DECR(x) (__atomic_fetch_sub(&(x), 1, __ATOMIC_ACQ_REL) - 1)
 
+#define ATOMIC_LOAD(x)         __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define ATOMIC_LOAD_ACQ(x)     __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(x, v)     __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+#define ATOMIC_STORE_REL(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+#define ATOMIC_CAS(x, e, v) \
+    __atomic_compare_exchange_n(&(x), &(e), (v), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define ATOMIC_FENCE()         __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
 #else
 /* rely on stdatomic, not as portable as we'd like to, unfortunately */
 
@@ -46,6 +54,14 @@ typedef atomic_uint atomic_uword;
 #define ATOMIC_INCR(x) (atomic_fetch_add_explicit(&(x), 1, memory_order_acq_rel) + 1)
 #define ATOMIC_DECR(x) (atomic_fetch_sub_explicit(&(x), 1, memory_order_acq_rel) - 1)
 
+#define ATOMIC_LOAD(x)         atomic_load_explicit(&(x), memory_order_relaxed)
+#define ATOMIC_LOAD_ACQ(x)     atomic_load_explicit(&(x), memory_order_acquire)
+#define ATOMIC_STORE(x, v)     atomic_store_explicit(&(x), (v), memory_order_relaxed)
+#define ATOMIC_STORE_REL(x, v) atomic_store_explicit(&(x), (v), memory_order_release)
+#define ATOMIC_CAS(x, e, v) \
+    atomic_compare_exchange_strong_explicit(&(x), &(e), (v), memory_order_acq_rel, memory_order_acquire)
+#define ATOMIC_FENCE()         atomic_thread_fence(memory_order_seq_cst)
+
 #endif
 
 #endif
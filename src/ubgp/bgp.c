@@ -59,7 +59,8 @@ enum {
     F_COMMUNITY  = 1 << 12,
     F_ADDPATH    = 1 << 13,
     F_ASN32BIT   = 1 << 14,
-    F_PRESOFFTAB = 1 << 15  // See rebuildbgpfrommrt()
+    F_PRESIDX    = 1 << 15,  // See rebuildbgpfrommrt()
+    F_ATTRIDX    = 1 << 16  // Attribute index is up to date, see buildattridx()
 };
 
 /// @brief Offsets for various BGP packet fields
@@ -91,35 +92,21 @@ enum {
 
     // BGP route refresh packet
     ROUTE_REFRESH_LENGTH = BASE_PACKET_LENGTH + sizeof(afi_safi_t),
-
-    // special offset value, indicating that value was not found
-    // (used while reading special attributes in update message, to indicate
-    // that the attribute was already searched, but was not found)
-    OFFSET_NOT_FOUND_BYTE = 0xff, // used for memset()
-    OFFSET_NOT_FOUND      = 0xffff
 };
 
-// Notable attributes lookup table
-
-#define INDEX_BIAS 1
-#define MAKE_CODE_INDEX(x) ((x) + INDEX_BIAS)
-#define EXTRACT_CODE_INDEX(x) ((x) - INDEX_BIAS)
-
-// NOTE: index count must be less than countof(ubgp_msg_s.offtab)!
-static const int8_t attr_code_index[255] = {
-    [AS_PATH_CODE]            = MAKE_CODE_INDEX(0),
-    [ORIGIN_CODE]             = MAKE_CODE_INDEX(1),
-    [ATOMIC_AGGREGATE_CODE]   = MAKE_CODE_INDEX(2),
-    [AGGREGATOR_CODE]         = MAKE_CODE_INDEX(3),
-    [NEXT_HOP_CODE]           = MAKE_CODE_INDEX(4),
-    [COMMUNITY_CODE]          = MAKE_CODE_INDEX(5),
-    [MP_REACH_NLRI_CODE]      = MAKE_CODE_INDEX(6),
-    [MP_UNREACH_NLRI_CODE]    = MAKE_CODE_INDEX(7),
-    [EXTENDED_COMMUNITY_CODE] = MAKE_CODE_INDEX(8),
-    [AS4_PATH_CODE]           = MAKE_CODE_INDEX(9),
-    [AS4_AGGREGATOR_CODE]     = MAKE_CODE_INDEX(10),
-    [LARGE_COMMUNITY_CODE]    = MAKE_CODE_INDEX(11)
-};
+// Attribute index, see buildattridx()
+
+static void setattridx(ubgp_msg_s *msg, int code, const void *attr)
+{
+    uint64_t bit = 1ull << (code & 0x3f);
+    uint64_t *w  = &msg->attrmask[code >> 6];
+
+    // only the first occurrence of each attribute is indexed
+    if ((*w & bit) == 0) {
+        *w |= bit;
+        msg->attroff[code] = (const byte *) attr - msg->buf;
+    }
+}
 
 UBGP_API int getbgptype(ubgp_msg_s *msg)
 {
@@ -258,7 +245,6 @@ UBGP_API ubgp_err setbgpread(ubgp_msg_s *msg,
         memcpy(msg->buf, data, n);
     }
 
-    memset(msg->offtab, 0, sizeof(msg->offtab));
     return BGP_ENOERR;
 }
 
@@ -303,7 +289,6 @@ UBGP_API ubgp_err setbgpreadfrom(ubgp_msg_s *msg, io_rw_t *io, uint flags)
     msg->err = BGP_ENOERR;
     msg->pktlen = len;
     msg->bufsiz = len;
-    memset(msg->offtab, 0, sizeof(msg->offtab));
     return BGP_ENOERR;
 }
 
@@ -338,8 +323,8 @@ UBGP_API ubgp_err rebuildbgpfrommrt(ubgp_msg_s *msg,
     bool seen_mp_reach        = false;
 
     // innocent little HACK, see while-loop below...
-    msg->flags |= F_PRESOFFTAB;  // don't let bgpfinish() zero-out the offset table
-    memset(msg->offtab, OFFSET_NOT_FOUND_BYTE, sizeof(msg->offtab));
+    msg->flags |= F_PRESIDX;  // don't let bgpfinish() discard the attribute index
+    memset(msg->attrmask, 0, sizeof(msg->attrmask));
 
     // no withdrawn, zero-out 2 bytes
     *dst++ = 0;
@@ -374,14 +359,11 @@ UBGP_API ubgp_err rebuildbgpfrommrt(ubgp_msg_s *msg,
         if (unlikely(n < size))
             goto error;
 
-        // HACK: pre-populate the notable attribute offset table:
-        // scanning the packet for MP_REACH and MP_UNREACH, note that we really
-        // shouldn't do that while writing to the packet, but we are filling it
-        // directly inside this loop (and bgpfinish() doesn't touch it),
-        // so we know we are safe.
-        int idx = EXTRACT_CODE_INDEX(attr_code_index[attr->code]);
-        if (idx >= 0)
-            msg->offtab[idx] = ((byte *) dst - msg->buf);
+        // HACK: populate the attribute index while copying,
+        // note that we really shouldn't do that while writing to the packet,
+        // but we are filling it directly inside this loop
+        // (and bgpfinish() doesn't discard it), so we know we are safe.
+        byte *attrstart = dst;
 
         bool truncated = true;  // assume BGPF_STDMRT
         switch (attr->code) {
@@ -451,8 +433,6 @@ UBGP_API ubgp_err rebuildbgpfrommrt(ubgp_msg_s *msg,
             if ((flags & BGPF_STRIPUNREACH) == 0) {
                 memcpy(dst, attr, size);
                 dst += size;
-            } else {
-                msg->offtab[idx] = OFFSET_NOT_FOUND;  // discard entry from the notable attribute offset table
             }
             break;
         case AS_PATH_CODE:
@@ -522,6 +502,10 @@ UBGP_API ubgp_err rebuildbgpfrommrt(ubgp_msg_s *msg,
             break;
         }
 
+        // index attribute, unless it was discarded
+        if (dst != attrstart)
+            setattridx(msg, attr->code, attrstart);
+
         src += len;  // NOTE: this must be the *ONLY* place where src gets modified
         attr = (const bgpattr_t *) src;
 
@@ -657,10 +641,10 @@ UBGP_API void *bgpfinish(ubgp_msg_s *msg, size_t *pn)
     if (likely(pn))
         *pn = n;
 
-    if ((msg->flags & F_PRESOFFTAB)== 0)
-        memset(msg->offtab, 0, sizeof(msg->offtab));
+    if (msg->flags & F_PRESIDX)
+        msg->flags |= F_ATTRIDX;
 
-    msg->flags &= ~(F_WR | F_PRESOFFTAB);
+    msg->flags &= ~(F_WR | F_PRESIDX);
     msg->flags |= F_RD; //allow reading from this message in the future
     return msg->buf;
 }
@@ -769,6 +753,8 @@ UBGP_API bgpcap_t *nextbgpcap(ubgp_msg_s *msg)
 
             return NULL;
         }
+
+        end = ptr + PARAM_HEADER_SIZE + ptr[1];
         if (ptr[0] == CAPABILITY_CODE) {
             // found
             ptr += PARAM_HEADER_SIZE;
@@ -778,7 +764,6 @@ UBGP_API bgpcap_t *nextbgpcap(ubgp_msg_s *msg)
         // next parameter
         ptr = end;
         msg->params = end;
-        end = ptr + PARAM_HEADER_SIZE + ptr[1];
     }
 
     if (unlikely(ptr + ptr[1] + CAPABILITY_HEADER_SIZE > end)) {
@@ -1180,12 +1165,6 @@ UBGP_API bgpattr_t *nextbgpattrib(ubgp_msg_s *msg)
         return NULL;
     }
     msg->uptr += len;
-
-    // if this is a notable attribute, then insert its offset into offtab
-    int idx = EXTRACT_CODE_INDEX(attr_code_index[attr->code]);
-    if (idx >= 0)
-        msg->offtab[idx] = ((byte *) attr - msg->buf);
-
     return attr;
 }
 
@@ -1375,6 +1354,299 @@ UBGP_API ubgp_err endnlri(ubgp_msg_s *msg)
     return msg->err;
 }
 
+// Bulk prefix decoding ========================================================
+
+// big endian masks keeping the first n bytes of a wide load
+static const uint32_t pfxmask32[] = {
+    0x00000000, 0xff000000, 0xffff0000, 0xffffff00, 0xffffffff
+};
+static const uint64_t pfxmask64[] = {
+    0x0000000000000000ull, 0xff00000000000000ull, 0xffff000000000000ull,
+    0xffffff0000000000ull, 0xffffffff00000000ull, 0xffffffffff000000ull,
+    0xffffffffffff0000ull, 0xffffffffffffff00ull, 0xffffffffffffffffull
+};
+
+// Decode prefixes in [ptr, end) into out[count...] up to cap, returns the
+// updated prefix count, or SIZE_MAX on malformed field.
+// Only ever called with constant family and addpath, so each combination
+// gets its own loop. Prefix bytes are fetched with a single wide load masked
+// to the prefix length, lim marks the end of the buffer for such loads.
+static inline size_t decodepfxs(netaddrap_t *restrict out,
+                                size_t                cap,
+                                size_t                count,
+                                const byte           *ptr,
+                                const byte           *end,
+                                const byte           *lim,
+                                short                 family,
+                                bool                  addpath)
+{
+    const uint maxbitlen = (family == AF_INET6) ? IPV6_BIT : IPV4_BIT;
+    const size_t widesiz = (family == AF_INET6) ? IPV6_SIZE : IPV4_SIZE;
+
+    while (ptr < end) {
+        uint32_t pathid = 0;
+        if (addpath) {
+            // >=, also catch the case in which there is no room for bit length
+            if (unlikely(ptr + sizeof(pathid) >= end))
+                return SIZE_MAX;
+
+            memcpy(&pathid, ptr, sizeof(pathid));
+            pathid = beswap32(pathid);
+            ptr += sizeof(pathid);
+        }
+
+        uint bitlen = *ptr++;
+        uint n      = naddrsize(bitlen);
+        if (unlikely(bitlen > maxbitlen || ptr + n > end))
+            return SIZE_MAX;
+
+        if (likely(count < cap)) {
+            netaddrap_t *dst = &out[count];
+
+            dst->pfx.family = family;
+            dst->pfx.bitlen = bitlen;
+            dst->pathid     = pathid;
+            if (likely(ptr + widesiz <= lim)) {
+                if (family == AF_INET6) {
+                    uint64_t hi, lo;
+
+                    memcpy(&hi, ptr, sizeof(hi));
+                    memcpy(&lo, ptr + sizeof(hi), sizeof(lo));
+                    hi &= beswap64(pfxmask64[MIN(n, 8)]);
+                    lo &= beswap64(pfxmask64[MAX(n, 8) - 8]);
+                    memcpy(&dst->pfx.bytes[0], &hi, sizeof(hi));
+                    memcpy(&dst->pfx.bytes[sizeof(hi)], &lo, sizeof(lo));
+                } else {
+                    uint32_t w;
+
+                    memcpy(&w, ptr, sizeof(w));
+                    dst->pfx.u32[0] = w & beswap32(pfxmask32[n]);
+                    dst->pfx.u32[1] = 0;
+                    dst->pfx.u32[2] = 0;
+                    dst->pfx.u32[3] = 0;
+                }
+            } else {
+                // too close to the buffer end for a wide load
+                memset(dst->pfx.bytes, 0, sizeof(dst->pfx.bytes));
+                memcpy(dst->pfx.bytes, ptr, n);
+            }
+        }
+
+        count++;
+        ptr += n;
+    }
+
+    return count;
+}
+
+static size_t decodepfxs4(netaddrap_t *out, size_t cap, size_t count, const byte *ptr, const byte *end, const byte *lim)
+{
+    return decodepfxs(out, cap, count, ptr, end, lim, AF_INET, false);
+}
+
+static size_t decodepfxs4ap(netaddrap_t *out, size_t cap, size_t count, const byte *ptr, const byte *end, const byte *lim)
+{
+    return decodepfxs(out, cap, count, ptr, end, lim, AF_INET, true);
+}
+
+static size_t decodepfxs6(netaddrap_t *out, size_t cap, size_t count, const byte *ptr, const byte *end, const byte *lim)
+{
+    return decodepfxs(out, cap, count, ptr, end, lim, AF_INET6, false);
+}
+
+static size_t decodepfxs6ap(netaddrap_t *out, size_t cap, size_t count, const byte *ptr, const byte *end, const byte *lim)
+{
+    return decodepfxs(out, cap, count, ptr, end, lim, AF_INET6, true);
+}
+
+typedef size_t (*decodepfxs_func_t)(netaddrap_t *, size_t, size_t, const byte *, const byte *, const byte *);
+
+static decodepfxs_func_t pickdecodepfxs(short family, bool addpath)
+{
+    if (family == AF_INET6)
+        return addpath ? decodepfxs6ap : decodepfxs6;
+    else
+        return addpath ? decodepfxs4ap : decodepfxs4;
+}
+
+// decode a plain field followed by the MP_(UN)REACH_NLRI attribute prefixes
+static size_t getallpfxs(ubgp_msg_s  *msg,
+                         netaddrap_t *out,
+                         size_t       cap,
+                         byte        *ptr,
+                         size_t       n,
+                         bgpattr_t   *attr,
+                         ubgp_err     errcode)
+{
+    const byte *lim = msg->buf + msg->pktlen;
+    bool addpath    = (msg->flags & F_ADDPATH) != 0;
+
+    if (unlikely(n > (size_t) (lim - ptr)))
+        goto bad;
+
+    size_t count = pickdecodepfxs(AF_INET, addpath)(out, cap, 0, ptr, ptr + n, lim);
+    if (unlikely(count == SIZE_MAX))
+        goto bad;
+    if (!attr)
+        return count;
+
+    afi_t  afi  = getmpafi(attr);
+    safi_t safi = getmpsafi(attr);
+    if (unlikely(safi != SAFI_UNICAST && safi != SAFI_MULTICAST))
+        goto bad;
+
+    short family;
+    switch (afi) {
+    case AFI_IPV4:
+        family = AF_INET;
+        break;
+    case AFI_IPV6:
+        family = AF_INET6;
+        break;
+    default:
+        goto bad;
+    }
+
+    ptr = getmpnlri(attr, &n);
+    if (unlikely(ptr > lim || n > (size_t) (lim - ptr)))
+        goto bad;
+
+    count = pickdecodepfxs(family, addpath)(out, cap, count, ptr, ptr + n, lim);
+    if (unlikely(count == SIZE_MAX))
+        goto bad;
+
+    return count;
+
+bad:
+    msg->err = errcode;
+    return 0;
+}
+
+UBGP_API size_t getallnlri(ubgp_msg_s *msg, netaddrap_t *out, size_t cap)
+{
+    CHECKTYPEANDFLAGSR(BGP_UPDATE, F_RD, 0);
+
+    size_t n;
+    byte *ptr = getnlri(msg, &n);
+    return getallpfxs(msg, out, cap, ptr, n, getbgpmpreach(msg), BGP_EBADNLRI);
+}
+
+UBGP_API size_t getallwithdrawn(ubgp_msg_s *msg, netaddrap_t *out, size_t cap)
+{
+    CHECKTYPEANDFLAGSR(BGP_UPDATE, F_RD, 0);
+
+    size_t n;
+    byte *ptr = getwithdrawn(msg, &n);
+    return getallpfxs(msg, out, cap, ptr, n, getbgpmpunreach(msg), BGP_EBADWDRWN);
+}
+
+// AS path iteration:
+//
+// AS size is known when the iteration starts, so each start function picks
+// a specialized iterator once, and nextaspath() merely dispatches to it.
+// Segment headers are validated against the whole segment length, hence
+// iterators need no bound checks (nor any AS size branch) on each AS.
+
+enum {
+    ASITER_AS16,     // 16 bits AS_PATH
+    ASITER_AS32,     // 32 bits AS_PATH or AS4_PATH
+    ASITER_REALAS16  // 16 bits AS_PATH prefix, followed by AS4_PATH
+};
+
+// Move to the next non-empty segment, returns false on iteration end or error.
+static bool nextasseg(ubgp_msg_s *msg, size_t as_size)
+{
+    do {
+        if (msg->asptr == msg->asend)
+            return false;  // end of iteration
+
+        if (unlikely(msg->asend - msg->asptr < AS_SEGMENT_HEADER_SIZE))
+            goto error;
+
+        msg->asp.type = *msg->asptr++;
+        msg->seglen   = *msg->asptr++;
+        msg->segi     = 0;
+        msg->asp.segno++;
+
+        if (unlikely((size_t) (msg->asend - msg->asptr) < msg->seglen * as_size))
+            goto error;
+    } while (msg->seglen == 0);
+
+    return true;
+
+error:
+    msg->err = BGP_EBADATTR; // FIXME
+    return false;
+}
+
+#define DEFINE_NEXTAS(name, as_t, swap)                         \
+    static as_pathent_t *name(ubgp_msg_s *msg)                  \
+    {                                                           \
+        if (unlikely(msg->segi == msg->seglen)) {               \
+            if (!nextasseg(msg, sizeof(as_t)))                  \
+                return NULL;                                    \
+        }                                                       \
+                                                                \
+        as_t as;                                                \
+                                                                \
+        memcpy(&as, msg->asptr, sizeof(as));                    \
+        msg->asp.as = swap(as);                                 \
+        msg->asptr += sizeof(as);                               \
+        msg->segi++;                                            \
+        return &msg->asp;                                       \
+    }
+
+#define DEFINE_COUNTAS(name, as_t)                              \
+    static int name(const byte *ptr, const byte *end)           \
+    {                                                           \
+        int count = 0;                                          \
+        while (ptr < end) {                                     \
+            if (unlikely(end - ptr < AS_SEGMENT_HEADER_SIZE))   \
+                return -1;                                      \
+                                                                \
+            int type = *ptr++;                                  \
+            int n    = *ptr++;                                  \
+                                                                \
+            ptr   += n * sizeof(as_t);                          \
+            count += (type == AS_SEGMENT_SET) ? (n != 0) : n;   \
+        }                                                       \
+        return (ptr == end) ? count : -1;                       \
+    }
+
+DEFINE_NEXTAS(nextas16, uint16_t, beswap16)
+DEFINE_NEXTAS(nextas32, uint32_t, beswap32)
+
+DEFINE_COUNTAS(countas16, uint16_t)
+DEFINE_COUNTAS(countas32, uint32_t)
+
+#undef DEFINE_NEXTAS
+#undef DEFINE_COUNTAS
+
+static as_pathent_t *nextrealas16(ubgp_msg_s *msg)
+{
+    // ascount starts as > 0 and decrements towards 0,
+    // then the iterator switches to AS4_PATH
+    if (unlikely(msg->ascount == 0)) {
+        // we've prepended enough AS_PATH entries, we must commute to AS4_PATH
+        msg->asptr       = msg->as4ptr;
+        msg->asend       = msg->as4end;
+        msg->asp.as_size = sizeof(uint32_t);
+        msg->seglen      = 0;
+        msg->segi        = 0;
+        msg->ascount     = -1;
+        msg->asiter      = ASITER_AS32;
+        msg->flags      &= ~F_REALASPATH;
+        return nextas32(msg);
+    }
+
+    as_pathent_t *ent = nextas16(msg);
+    if (likely(ent)) {
+        // only decrement AS count if element is first in a SET or if inside a SEQ
+        msg->ascount -= (ent->type != AS_SEGMENT_SET || msg->segi == 1);
+    }
+    return ent;
+}
+
 // XXX this should probably be void
 static ubgp_err dostartaspath(ubgp_msg_s *msg, bgpattr_t *attr, size_t as_size)
 {
@@ -1383,6 +1655,7 @@ static ubgp_err dostartaspath(ubgp_msg_s *msg, bgpattr_t *attr, size_t as_size)
     msg->segi        = 0;
     msg->seglen      = 0;
     msg->asp.as_size = as_size;
+    msg->asiter      = (as_size == sizeof(uint32_t)) ? ASITER_AS32 : ASITER_AS16;
     // don't do any AS count verification on regular AS_PATH iteration
     msg->ascount     = -1;
     msg->asp.segno   = -1;
@@ -1417,25 +1690,10 @@ UBGP_API ubgp_err startas4path(ubgp_msg_s *msg)
 UBGP_API ubgp_err startrealaspath(ubgp_msg_s *msg)
 {
     CHECKTYPEANDFLAGS(BGP_UPDATE, F_RD);
-    endpending(msg);
 
-    msg->flags       |= F_ASPATH;
-    msg->seglen       = 0;
-    msg->segi         = 0;
-    msg->ascount      = -1;
-    msg->asp.as_size  = (msg->flags & F_ASN32BIT) ? sizeof(uint32_t) : sizeof(uint16_t);;
-    msg->asp.segno    = -1;
-
-    bgpattr_t *asp = getbgpaspath(msg);
-    if (!asp) {
-        msg->asptr = msg->asend = NULL;
-        return BGP_ENOERR;
-    }
-
-    size_t len;
-    msg->asptr = getaspath(asp, &len);
-    msg->asend = msg->asptr + len;
-    if (msg->asp.as_size == sizeof(uint32_t))
+    size_t as_size = (msg->flags & F_ASN32BIT) ? sizeof(uint32_t) : sizeof(uint16_t);
+    dostartaspath(msg, getbgpaspath(msg), as_size);
+    if (!msg->asptr || as_size == sizeof(uint32_t))
         return BGP_ENOERR;
 
     bgpattr_t *aggr  = getbgpaggregator(msg);
@@ -1449,40 +1707,12 @@ UBGP_API ubgp_err startrealaspath(ubgp_msg_s *msg)
     if (!as4p)
         return BGP_ENOERR;
 
-    byte *ptr = msg->asptr;
-    byte *end = msg->asend;
-
-    int ascount = 0, as4count = 0;
-    while (ptr < end) {
-        int type  = *ptr++;
-        int count = *ptr++;
-
-        ptr += count * sizeof(uint16_t);
-        if (type == AS_SEGMENT_SET)
-            count = 1;
-
-        ascount += count;
-    }
-
-    if (unlikely(ptr > end)) {
-        msg->err = BGP_EBADATTR;
-        return msg->err;
-    }
-
-    ptr = getaspath(as4p, &len);
-    end = ptr + len;
-    while (ptr < end) {
-        int type  = *ptr++;
-        int count = *ptr++;
-
-        ptr += count * sizeof(uint32_t);
-        if (type == AS_SEGMENT_SET)
-            count = 1;
-
-        as4count += count;
-    }
+    size_t len;
+    byte *ptr = getaspath(as4p, &len);
 
-    if (unlikely(ptr > end)) {
+    int ascount  = countas16(msg->asptr, msg->asend);
+    int as4count = countas32(ptr, ptr + len);
+    if (unlikely(ascount < 0 || as4count < 0)) {
         msg->err = BGP_EBADATTR;
         return msg->err;
     }
@@ -1490,67 +1720,121 @@ UBGP_API ubgp_err startrealaspath(ubgp_msg_s *msg)
     if (ascount < as4count)
         return BGP_ENOERR;   // must ignore AS4_PATH
 
-    msg->as4ptr  = end - len;
-    msg->as4end  = end;
+    msg->as4ptr  = ptr;
+    msg->as4end  = ptr + len;
     // prepend a number of AS path from AS_PATH such that it is
     msg->ascount = ascount - as4count;
+    msg->asiter  = ASITER_REALAS16;
     msg->flags  |= F_REALASPATH;
     return BGP_ENOERR;
 }
 
-UBGP_API as_pathent_t *nextaspath(ubgp_msg_s *msg)
+// Locate the last non-empty segment of a path, only walking segment headers,
+// *pseg is left NULL for empty paths.
+static bool lastasseg(const byte *ptr, const byte *end, size_t as_size, const byte **pseg)
 {
-    CHECKFLAGSR(F_ASPATH, NULL);
+    *pseg = NULL;
+    while (ptr < end) {
+        if (unlikely(end - ptr < AS_SEGMENT_HEADER_SIZE))
+            return false;
 
-    while (msg->segi == msg->seglen) {
-        if (msg->asptr == msg->asend)
-            return NULL;  // end of iteration
+        size_t n = ptr[1];
+        if (unlikely((size_t) (end - ptr - AS_SEGMENT_HEADER_SIZE) < n * as_size))
+            return false;
 
-        if (unlikely(msg->asptr + 2 > msg->asend)) {
-            msg->err = BGP_EBADATTR; // FIXME
-            return NULL;
-        }
+        if (n > 0)
+            *pseg = ptr;
 
-        msg->asp.type = *msg->asptr++;
-        msg->seglen   = *msg->asptr++;
-        msg->segi     = 0;
-        msg->asp.segno++;
+        ptr += AS_SEGMENT_HEADER_SIZE + n * as_size;
     }
+    return true;
+}
 
-    // AS_PATH or AS4_PATH
-    if (msg->asp.as_size == sizeof(uint16_t)) {
-        uint16_t as16;
+UBGP_API ubgp_err getrealoriginas(ubgp_msg_s *msg, as_origin_t *dst)
+{
+    CHECKTYPEANDFLAGS(BGP_UPDATE, F_RD);
 
-        memcpy(&as16, msg->asptr, sizeof(as16));
-        msg->asp.as = beswap16(as16);
-    } else {
-        assert(msg->asp.as_size == sizeof(uint32_t));
+    dst->type    = AS_SEGMENT_BAD;
+    dst->as      = 0;
+    dst->as_size = (msg->flags & F_ASN32BIT) ? sizeof(uint32_t) : sizeof(uint16_t);
+    dst->count   = 0;
+    dst->set     = NULL;
 
-        memcpy(&msg->asp.as, msg->asptr, sizeof(msg->asp.as));
-        msg->asp.as = beswap32(msg->asp.as);
+    bgpattr_t *asp = getbgpaspath(msg);
+    if (!asp)
+        return msg->err;  // BGP_ENOERR unless attributes are corrupted
+
+    size_t len;
+    const byte *ptr = getaspath(asp, &len);
+    const byte *end = ptr + len;
+
+    if (dst->as_size == sizeof(uint16_t)) {
+        // same rules as startrealaspath(): AS4_PATH holds the tail of the real path,
+        // unless it is longer than AS_PATH or AGGREGATOR tells it is stale
+        bgpattr_t *aggr  = getbgpaggregator(msg);
+        bgpattr_t *aggr4 = getbgpas4aggregator(msg);
+        bgpattr_t *as4p  = getbgpas4path(msg);
+        if (as4p && !(aggr && aggr4 && getaggregatoras(aggr) != AS_TRANS)) {
+            size_t len4;
+            const byte *ptr4 = getaspath(as4p, &len4);
+
+            int ascount  = countas16(ptr, end);
+            int as4count = countas32(ptr4, ptr4 + len4);
+            if (unlikely(ascount < 0 || as4count < 0)) {
+                msg->err = BGP_EBADATTR;
+                return msg->err;
+            }
+            if (ascount >= as4count && as4count > 0) {
+                ptr = ptr4;
+                end = ptr4 + len4;
+                dst->as_size = sizeof(uint32_t);
+            }
+        }
+    }
+
+    const byte *seg;
+    if (unlikely(!lastasseg(ptr, end, dst->as_size, &seg))) {
+        msg->err = BGP_EBADATTR;
+        return msg->err;
     }
+    if (!seg)
+        return BGP_ENOERR;
 
-    msg->asptr += msg->asp.as_size;
-    msg->segi++;
+    const byte *ases = seg + AS_SEGMENT_HEADER_SIZE;
+    if (seg[0] == AS_SEGMENT_SET) {
+        dst->type  = AS_SEGMENT_SET;
+        dst->count = seg[1];
+        dst->set   = ases;
+        return BGP_ENOERR;
+    }
 
-    // if we are rebuilding a real AS path,
-    // then ascount starts as > 0 and decrements towards 0, until it switches to AS4_PATH;
-    // else ascount starts as -1 and decrements at will (!= 0 is always true, which is what we want);
-    if (msg->ascount != 0) {
-        // only decrement AS count if element is first in a SET or if inside a SEQ
-        msg->ascount -= (msg->asp.type != AS_SEGMENT_SET || msg->segi == 1);
-        return &msg->asp;
+    const byte *last = ases + (seg[1] - 1) * dst->as_size;
+    if (dst->as_size == sizeof(uint32_t)) {
+        uint32_t as32;
+        memcpy(&as32, last, sizeof(as32));
+        dst->as = beswap32(as32);
+    } else {
+        uint16_t as16;
+        memcpy(&as16, last, sizeof(as16));
+        dst->as = beswap16(as16);
     }
 
-    // we've prepended enough AS_PATH entries, we must commute to AS4_PATH
-    msg->asptr       = msg->as4ptr;
-    msg->asend       = msg->as4end;
-    msg->asp.as_size = sizeof(uint32_t);
-    msg->seglen      = 0;
-    msg->segi        = 0;
-    msg->ascount     = -1;
-    msg->flags      &= ~F_REALASPATH;
-    return nextaspath(msg);
+    dst->type = AS_SEGMENT_SEQ;
+    return BGP_ENOERR;
+}
+
+UBGP_API as_pathent_t *nextaspath(ubgp_msg_s *msg)
+{
+    static as_pathent_t *(*const nextas[])(ubgp_msg_s *) = {
+        [ASITER_AS16]     = nextas16,
+        [ASITER_AS32]     = nextas32,
+        [ASITER_REALAS16] = nextrealas16
+    };
+
+    CHECKFLAGSR(F_ASPATH, NULL);
+
+    assert(msg->asiter < countof(nextas));
+    return nextas[msg->asiter](msg);
 }
 
 UBGP_API ubgp_err endaspath(ubgp_msg_s *msg)
@@ -1739,67 +2023,101 @@ UBGP_API ubgp_err endcommunities(ubgp_msg_s* msg)
     return msg->err;
 }
 
-static bgpattr_t *seekbgpattr(ubgp_msg_s *msg, int code)
+// Index every attribute inside the packet in one scan,
+// without disturbing any ongoing iteration.
+static bool buildattridx(ubgp_msg_s *msg)
 {
-    CHECKTYPEANDFLAGSR(BGP_UPDATE, F_RD, NULL);
-
-    uint idx = EXTRACT_CODE_INDEX(attr_code_index[code]);
-
-    assert(idx < countof(msg->offtab));
+    size_t n;
+    byte *ptr = getbgpattribs(msg, &n);
+    byte *end = ptr + n;
 
-    uint16_t off = msg->offtab[idx];
-    if (unlikely(off == 0)) {
-        bgpattr_t *attr;
+    memset(msg->attrmask, 0, sizeof(msg->attrmask));
+    if (unlikely(end > &msg->buf[msg->pktlen]))
+        goto error;
 
-        SAVE_UPDATE_ITER(msg);
+    while (ptr < end) {
+        if (unlikely(end - ptr < ATTR_HEADER_SIZE))
+            goto error;
 
-        startbgpattribs(msg);
-        while ((attr = nextbgpattrib(msg)) != NULL && attr->code != code);
+        const bgpattr_t *attr = (const bgpattr_t *) ptr;
 
-        if (unlikely(endbgpattribs(msg) != BGP_ENOERR))
-            return NULL;
+        size_t hdrsize = ATTR_HEADER_SIZE;
+        size_t len     = attr->len;
+        if (attr->flags & ATTR_EXTENDED_LENGTH) {
+            if (unlikely(end - ptr < ATTR_EXTENDED_HEADER_SIZE))
+                goto error;
 
-        RESTORE_UPDATE_ITER(msg);
-        if (msg->offtab[idx] == 0) {
-            // we found no such attribute, but we know we iterated all attributes,
-            // so remap any 0 to an OFFSET_NOT_FOUND
-            for (uint i = 0; i < countof(msg->offtab); i++) {
-                if (msg->offtab[i] == 0)
-                    msg->offtab[i] = OFFSET_NOT_FOUND;
-            }
+            hdrsize = ATTR_EXTENDED_HEADER_SIZE;
+            len <<= 8;
+            len |= attr->exlen[1];  // len was exlen[0]
         }
+        if (unlikely((size_t) (end - ptr) < hdrsize + len))
+            goto error;
 
-        off = msg->offtab[idx];
+        setattridx(msg, attr->code, attr);
+        ptr += hdrsize + len;
     }
-    if (off == OFFSET_NOT_FOUND)
+
+    msg->flags |= F_ATTRIDX;
+    return true;
+
+error:
+    msg->err = BGP_EBADATTR;
+    return false;
+}
+
+UBGP_API bgpattr_t *getbgpattrib(ubgp_msg_s *msg, int code)
+{
+    CHECKTYPEANDFLAGSR(BGP_UPDATE, F_RD, NULL);
+
+    if (unlikely((msg->flags & F_ATTRIDX) == 0 && !buildattridx(msg)))
         return NULL;
 
-    return (bgpattr_t *) &msg->buf[off];
+    code &= 0xff;
+    if ((msg->attrmask[code >> 6] & (1ull << (code & 0x3f))) == 0)
+        return NULL;
+
+    return (bgpattr_t *) &msg->buf[msg->attroff[code]];
+}
+
+UBGP_API bool hasanybgpattrib(ubgp_msg_s *msg, const uint64_t *mask)
+{
+    CHECKTYPEANDFLAGSR(BGP_UPDATE, F_RD, false);
+
+    if (unlikely((msg->flags & F_ATTRIDX) == 0 && !buildattridx(msg)))
+        return false;
+
+    uint64_t any = 0;
+    for (int i = 0; i < BGP_ATTRMASK_WORDS; i++)
+        any |= msg->attrmask[i] & mask[i];
+
+    return any != 0;
 }
 
+
 bgpattr_t *getbgporigin(ubgp_msg_s *msg)
 {
-    return seekbgpattr(msg, ORIGIN_CODE);
+    return getbgpattrib(msg, ORIGIN_CODE);
 }
 
 bgpattr_t *getbgpnexthop(ubgp_msg_s *msg)
 {
-    return seekbgpattr(msg, NEXT_HOP_CODE);
+    return getbgpattrib(msg, NEXT_HOP_CODE);
 }
 
 bgpattr_t *getbgpaggregator(ubgp_msg_s *msg)
 {
-    return seekbgpattr(msg, AGGREGATOR_CODE);
+    return getbgpattrib(msg, AGGREGATOR_CODE);
 }
 
 bgpattr_t *getbgpas4aggregator(ubgp_msg_s *msg)
 {
-    return seekbgpattr(msg, AS4_AGGREGATOR_CODE);
+    return getbgpattrib(msg, AS4_AGGREGATOR_CODE);
 }
 
 bgpattr_t *getbgpatomicaggregate(ubgp_msg_s *msg)
 {
-    return seekbgpattr(msg, ATOMIC_AGGREGATE_CODE);
+    return getbgpattrib(msg, ATOMIC_AGGREGATE_CODE);
 }
 
 bgpattr_t *getrealbgpaggregator(ubgp_msg_s *msg)
@@ -1839,37 +2157,37 @@ bgpattr_t *getrealbgpaggregator(ubgp_msg_s *msg)
 
 bgpattr_t *getbgpaspath(ubgp_msg_s *msg)
 {
-    return seekbgpattr(msg, AS_PATH_CODE);
+    return getbgpattrib(msg, AS_PATH_CODE);
 }
 
 bgpattr_t *getbgpas4path(ubgp_msg_s *msg)
 {
-    return seekbgpattr(msg, AS4_PATH_CODE);
+    return getbgpattrib(msg, AS4_PATH_CODE);
 }
 
 bgpattr_t *getbgpmpreach(ubgp_msg_s *msg)
 {
-    return seekbgpattr(msg, MP_REACH_NLRI_CODE);
+    return getbgpattrib(msg, MP_REACH_NLRI_CODE);
 }
 
 bgpattr_t *getbgpmpunreach(ubgp_msg_s *msg)
 {
-    return seekbgpattr(msg, MP_UNREACH_NLRI_CODE);
+    return getbgpattrib(msg, MP_UNREACH_NLRI_CODE);
 }
 
 bgpattr_t *getbgpcommunities(ubgp_msg_s *msg)
 {
-    return seekbgpattr(msg, COMMUNITY_CODE);
+    return getbgpattrib(msg, COMMUNITY_CODE);
 }
 
 bgpattr_t *getbgplargecommunities(ubgp_msg_s *msg)
 {
-    return seekbgpattr(msg, LARGE_COMMUNITY_CODE);
+    return getbgpattrib(msg, LARGE_COMMUNITY_CODE);
 }
 
 bgpattr_t *getbgpexcommunities(ubgp_msg_s *msg)
 {
-    return seekbgpattr(msg, EXTENDED_COMMUNITY_CODE);
+    return getbgpattrib(msg, EXTENDED_COMMUNITY_CODE);
 }
 
 // TODO Route refresh message read/write functions =============================
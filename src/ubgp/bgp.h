@@ -192,6 +192,15 @@ typedef struct {
  */
 #define BGPBUFSIZ 4096
 
+/**
+ * BGP_ATTRMASK_WORDS:
+ *
+ * Number of 64 bits words in a set of attribute codes, as accepted by
+ * hasanybgpattrib(): code `c` belongs to the set if bit `c % 64`
+ * of word `c / 64` is set.
+ */
+#define BGP_ATTRMASK_WORDS (256 / 64)
+
 /**
  * ubgp_msg_s:
  * BGP message structure.
@@ -205,7 +214,7 @@ typedef struct {
 typedef struct {
     /*< private >*/
 
-    uint16_t  flags;   // General status flags.
+    uint32_t  flags;   // General status flags.
     uint16_t  pktlen;  // Actual packet length.
     uint16_t  bufsiz;  // Packet buffer capacity
     int16_t   err;     // Last error code.
@@ -238,6 +247,7 @@ typedef struct {
                             uint8_t seglen;
                             uint8_t segi;
                             int16_t ascount;
+                            uint8_t asiter;  // AS iterator, see nextaspath()
                             as_pathent_t asp;
                         };
                         struct {
@@ -257,7 +267,8 @@ typedef struct {
                         };
                     };
 
-                    uint16_t offtab[16];  // Notable attributes offset table.
+                    uint64_t attrmask[BGP_ATTRMASK_WORDS];  // Attributes presence bitmap.
+                    uint16_t attroff[256];  // Attributes offset table, indexed by code.
                 };
 
                 // write-specific fields.
@@ -396,6 +407,38 @@ UBGP_API CHECK_NONNULL(1) void *nextnlri(ubgp_msg_s *msg);
 
 UBGP_API CHECK_NONNULL(1) ubgp_err endnlri(ubgp_msg_s *msg);
 
+/**
+ * getallnlri:
+ * @msg: a BGP UPDATE message opened for read
+ * @out: storage for the decoded prefixes
+ * @cap: capacity of @out
+ *
+ * Decode every prefix inside the NLRI field and the MP_REACH_NLRI
+ * attribute at once, the same prefixes visited by startallnlri() and
+ * nextnlri(). A specialized loop is picked for each address family and
+ * ADDPATH combination, any ongoing prefix iteration is not affected.
+ *
+ * Prefix path identifiers are always stored, 0 unless the message
+ * is ADDPATH enabled.
+ *
+ * Returns: the number of prefixes inside @msg, only the first @cap are
+ *          stored into @out, a caller may retry with a larger buffer.
+ *          On error 0 is returned and bgperror() is set.
+ */
+UBGP_API CHECK_NONNULL(1) size_t getallnlri(ubgp_msg_s  *msg,
+                                            netaddrap_t *out,
+                                            size_t       cap);
+
+/**
+ * getallwithdrawn:
+ *
+ * Same as getallnlri(), but decodes the Withdrawn field and the
+ * MP_UNREACH_NLRI attribute.
+ */
+UBGP_API CHECK_NONNULL(1) size_t getallwithdrawn(ubgp_msg_s  *msg,
+                                                 netaddrap_t *out,
+                                                 size_t       cap);
+
 UBGP_API CHECK_NONNULL(1) ubgp_err startaspath(ubgp_msg_s *msg);
 
 UBGP_API CHECK_NONNULL(1) ubgp_err startas4path(ubgp_msg_s *msg);
@@ -406,6 +449,56 @@ UBGP_API CHECK_NONNULL(1) as_pathent_t *nextaspath(ubgp_msg_s *msg);
 
 UBGP_API CHECK_NONNULL(1) ubgp_err endaspath(ubgp_msg_s *msg);
 
+/**
+ * as_origin_t:
+ * @type:    %AS_SEGMENT_SEQ if the path ends with an AS_SEQUENCE,
+ *           %AS_SEGMENT_SET if it ends with an AS_SET,
+ *           %AS_SEGMENT_BAD if the path is empty
+ * @as:      the origin AS, only meaningful for %AS_SEGMENT_SEQ
+ * @as_size: size of each AS in @set
+ * @count:   number of ASes in @set
+ * @set:     members of the trailing AS_SET, in network byte order,
+ *           see getasoriginset()
+ *
+ * Origin of a route, as returned by getrealoriginas().
+ */
+typedef struct {
+    int type;
+    uint32_t as;
+    size_t as_size;
+    uint count;
+    const void *set;
+} as_origin_t;
+
+/**
+ * getrealoriginas:
+ * @msg: an update message opened for read
+ * @dst: storage for the route origin
+ *
+ * Retrieve the last AS of the real AS path, that is what iterating the whole
+ * path by startrealaspath() would yield last, without decoding any AS but
+ * the last segment. Any ongoing iteration is not affected.
+ *
+ * Returns: %BGP_ENOERR on success, an error code otherwise (bgperror() is set).
+ */
+UBGP_API CHECK_NONNULL(1, 2) ubgp_err getrealoriginas(ubgp_msg_s *msg, as_origin_t *dst);
+
+/**
+ * getasoriginset:
+ * @origin: an origin returned by getrealoriginas(), of type %AS_SEGMENT_SET
+ * @i:      member index, less than @origin count
+ *
+ * Returns: the @i-th AS in the trailing AS_SET of @origin.
+ */
+static inline uint32_t getasoriginset(const as_origin_t *origin, uint i)
+{
+    const byte *ptr = (const byte *) origin->set + i * origin->as_size;
+    if (origin->as_size == sizeof(uint32_t))
+        return ((uint32_t) ptr[0] << 24) | ((uint32_t) ptr[1] << 16) | ((uint32_t) ptr[2] << 8) | ptr[3];
+
+    return ((uint32_t) ptr[0] << 8) | ptr[1];
+}
+
 UBGP_API CHECK_NONNULL(1) ubgp_err startnhop(ubgp_msg_s *msg);
 
 UBGP_API CHECK_NONNULL(1) netaddr_t *nextnhop(ubgp_msg_s *msg);
@@ -418,6 +511,36 @@ UBGP_API CHECK_NONNULL(1) void *nextcommunity(ubgp_msg_s *msg);
 
 UBGP_API CHECK_NONNULL(1) ubgp_err endcommunities(ubgp_msg_s *msg);
 
+/**
+ * getbgpattrib:
+ * @msg:  an update message opened for read
+ * @code: attribute code
+ *
+ * Direct access to any attribute by code.
+ *
+ * On first access every attribute in @msg is indexed in one scan,
+ * any following lookup is a table access, regardless of the attribute
+ * being notable or not. Any ongoing iteration is not affected.
+ *
+ * Returns: the first attribute with code @code, %NULL if @msg has no
+ *          such attribute, or on error (bgperror() is set).
+ */
+UBGP_API CHECK_NONNULL(1) bgpattr_t *getbgpattrib(ubgp_msg_s *msg, int code);
+
+/**
+ * hasanybgpattrib:
+ * @msg:  an update message opened for read
+ * @mask: a set of attribute codes, see %BGP_ATTRMASK_WORDS
+ *
+ * Test whether @msg has at least one attribute in @mask, using the same
+ * index as getbgpattrib().
+ *
+ * Returns: %true if any attribute in @mask is present in @msg,
+ *          %false otherwise, or on error (bgperror() is set).
+ */
+UBGP_API CHECK_NONNULL(1, 2) bool hasanybgpattrib(ubgp_msg_s     *msg,
+                                                  const uint64_t *mask);
+
 // utility functions for update packages, direct access to notable attributes
 
 UBGP_API CHECK_NONNULL(1) bgpattr_t *getbgporigin(ubgp_msg_s *msg);
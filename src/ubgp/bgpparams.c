@@ -21,6 +21,8 @@
 
 #include "bgpparams.h"
 
+#include <string.h>
+
 UBGP_API size_t getgracefulrestarttuples(afi_safi_t     *dst,
                                          size_t          n,
                                          const bgpcap_t *cap)
@@ -35,11 +37,10 @@ UBGP_API size_t getgracefulrestarttuples(afi_safi_t     *dst,
     if (n > size)
         n = size;
 
-    // copy and swap bytes
+    // copy and swap bytes, capabilities aren't aligned inside packets
     for (size_t i = 0; i < n; i++) {
-        dst[i].afi   = beswap16(src[i].afi);
-        dst[i].safi  = src[i].safi;
-        dst[i].flags = src[i].flags;
+        memcpy(&dst[i], &src[i], sizeof(dst[i]));
+        dst[i].afi = beswap16(dst[i].afi);
     }
     return size;
 }
@@ -54,11 +55,10 @@ UBGP_API size_t getaddpathtuples(afi_safi_t* dst, size_t n, const bgpcap_t *cap)
     if (n > size)
         n = size;
 
-    // copy and swap bytes
+    // copy and swap bytes, capabilities aren't aligned inside packets
     for (size_t i = 0; i < n; i++) {
-        dst[i].afi   = beswap16(src[i].afi);
-        dst[i].safi  = src[i].safi;
-        dst[i].flags = src[i].flags;
+        memcpy(&dst[i], &src[i], sizeof(dst[i]));
+        dst[i].afi = beswap16(dst[i].afi);
     }
     return size;
 }
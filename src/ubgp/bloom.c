@@ -0,0 +1,62 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#include "bloom.h"
+#include "branch.h"
+
+#include <limits.h>
+#include <stdlib.h>
+
+enum {
+    BLOOM_BLOCK_SIZE = BLOOM_BLOCK_WORDS * sizeof(uint64_t)
+};
+
+UBGP_API bool bloominit(bloom_filter_t *bf, size_t n)
+{
+    // round block count to the next power of 2
+    size_t want    = (n * BLOOM_BITS_PER_KEY + BLOOM_BLOCK_SIZE * CHAR_BIT - 1) / (BLOOM_BLOCK_SIZE * CHAR_BIT);
+    size_t nblocks = 1;
+    while (nblocks < want)
+        nblocks <<= 1;
+
+    if (unlikely(nblocks > UINT_MAX / 2 + 1))
+        return false;
+
+    bf->blocks = aligned_alloc(BLOOM_BLOCK_SIZE, nblocks * BLOOM_BLOCK_SIZE);
+    if (unlikely(!bf->blocks))
+        return false;
+
+    bf->nblocks = nblocks;
+    bloomclear(bf);
+    return true;
+}
+
+UBGP_API void bloomclear(bloom_filter_t *bf)
+{
+    memset(bf->blocks, 0, (size_t) bf->nblocks * BLOOM_BLOCK_SIZE);
+    bf->nkeys = 0;
+}
+
+UBGP_API void bloomdestroy(bloom_filter_t *bf)
+{
+    free(bf->blocks);
+}
+
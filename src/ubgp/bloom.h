@@ -0,0 +1,186 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#ifndef UBGP_BLOOM_H_
+#define UBGP_BLOOM_H_
+
+#include "funcattribs.h"
+#include "netaddr.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * SECTION: bloom
+ * @title: Blocked Bloom Filter
+ * @include: bloom.h
+ *
+ * A Bloom filter of network addresses (or prefixes), to quickly discard
+ * lookups that would miss a larger set, such as a #patricia_trie_t.
+ *
+ * The filter is split into cache line sized blocks, each address only
+ * touches one block, setting one bit in each of its words.
+ * A membership test is thus a single cache miss at most, and both hashing
+ * and testing are straight-line loops over the block words, which the
+ * compiler is free to vectorize.
+ */
+
+enum {
+    BLOOM_BLOCK_WORDS  = 8,   // 64 bits words in a block (one cache line)
+    BLOOM_BITS_PER_KEY = 16   // Bits reserved to each expected key, ~0.5% false positives
+};
+
+/**
+ * bloom_filter_t:
+ * @blocks:  filter blocks, cache line aligned
+ * @nblocks: number of blocks, always a power of 2
+ * @nkeys:   number of keys added to the filter
+ *
+ * A blocked Bloom filter.
+ */
+typedef struct {
+    uint64_t (*blocks)[BLOOM_BLOCK_WORDS];
+    uint nblocks;
+    uint nkeys;
+} bloom_filter_t;
+
+/**
+ * bloominit:
+ * @bf: filter to be initialized
+ * @n:  expected number of keys
+ *
+ * Initialize an empty filter, sized to hold @n keys with a false positive
+ * rate around 0.5%. More keys may be added afterwards, at the price
+ * of a higher false positive rate.
+ *
+ * Returns: %true on success, %false on out of memory.
+ */
+UBGP_API CHECK_NONNULL(1) bool bloominit(bloom_filter_t *bf, size_t n);
+
+/**
+ * bloomclear:
+ * @bf: an initialized #bloom_filter_t
+ *
+ * Remove every key from @bf, preserving its memory.
+ */
+UBGP_API CHECK_NONNULL(1) void bloomclear(bloom_filter_t *bf);
+
+UBGP_API CHECK_NONNULL(1) void bloomdestroy(bloom_filter_t *bf);
+
+// Block bit selection salts, one per block word
+static const uint32_t bloom_salts[BLOOM_BLOCK_WORDS] = {
+    0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du,
+    0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u
+};
+
+/**
+ * bloomhash:
+ * @addr: a network address or prefix
+ *
+ * Hash the significant bits of @addr, bits past the prefix length
+ * are ignored.
+ */
+static inline PUREFUNC CHECK_NONNULL(1) uint64_t bloomhash(const netaddr_t *addr)
+{
+    union {
+        byte     bytes[sizeof(addr->bytes)];
+        uint64_t words[sizeof(addr->bytes) / sizeof(uint64_t)];
+    } key;
+
+    uint n = naddrsize(addr->bitlen);
+
+    memset(&key, 0, sizeof(key));
+    memcpy(key.bytes, addr->bytes, n);
+    if (addr->bitlen & 7)
+        key.bytes[n - 1] &= 0xff << (8 - (addr->bitlen & 7));
+
+    uint64_t h = key.words[0] * 0x9e3779b97f4a7c15ull;
+    h ^= (key.words[1] + addr->bitlen) * 0xc2b2ae3d27d4eb4full;
+    h ^= h >> 29;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 32;
+    return h;
+}
+
+// Compute the bits selected by hash in its block
+static inline void bloommask(uint64_t h, uint64_t mask[BLOOM_BLOCK_WORDS])
+{
+    uint32_t key = h;
+
+    for (int i = 0; i < BLOOM_BLOCK_WORDS; i++)
+        mask[i] = 1ull << ((uint32_t) (key * bloom_salts[i]) >> 26);
+}
+
+static inline uint64_t *bloomblock(const bloom_filter_t *bf, uint64_t h)
+{
+    return bf->blocks[(h >> 32) & (bf->nblocks - 1)];
+}
+
+/**
+ * bloomadd:
+ * @bf:   an initialized #bloom_filter_t
+ * @addr: address to be added
+ *
+ * Add @addr to @bf.
+ */
+static inline CHECK_NONNULL(1, 2) void bloomadd(bloom_filter_t  *bf,
+                                                const netaddr_t *addr)
+{
+    uint64_t h = bloomhash(addr);
+    uint64_t mask[BLOOM_BLOCK_WORDS];
+    uint64_t *block = bloomblock(bf, h);
+
+    bloommask(h, mask);
+    for (int i = 0; i < BLOOM_BLOCK_WORDS; i++)
+        block[i] |= mask[i];
+
+    bf->nkeys++;
+}
+
+/**
+ * bloommaycontain:
+ * @bf:   an initialized #bloom_filter_t
+ * @addr: address to be tested
+ *
+ * Test @addr membership.
+ *
+ * Returns: %false if @addr was definitely never added to @bf,
+ *          %true if it might have been.
+ */
+static inline PUREFUNC CHECK_NONNULL(1, 2) bool bloommaycontain(const bloom_filter_t *bf,
+                                                                const netaddr_t      *addr)
+{
+    uint64_t h = bloomhash(addr);
+    uint64_t mask[BLOOM_BLOCK_WORDS];
+    const uint64_t *block = bloomblock(bf, h);
+
+    bloommask(h, mask);
+
+    uint64_t miss = 0;
+    for (int i = 0; i < BLOOM_BLOCK_WORDS; i++)
+        miss |= mask[i] & ~block[i];
+
+    return miss == 0;
+}
+
+#endif
+
@@ -0,0 +1,531 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#include "bgpparams.h"
+#include "bmp.h"
+#include "branch.h"
+#include "endian.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    // common header
+    VERSION_OFFSET = 0,
+    LENGTH_OFFSET  = VERSION_OFFSET + sizeof(uint8_t),
+    TYPE_OFFSET    = LENGTH_OFFSET + sizeof(uint32_t),
+
+    // per-peer header, relative to the end of the common header
+    PEER_TYPE_OFFSET  = 0,
+    PEER_FLAGS_OFFSET = PEER_TYPE_OFFSET + sizeof(uint8_t),
+    PEER_DIST_OFFSET  = PEER_FLAGS_OFFSET + sizeof(uint8_t),
+    PEER_ADDR_OFFSET  = PEER_DIST_OFFSET + sizeof(uint64_t),
+    PEER_AS_OFFSET    = PEER_ADDR_OFFSET + 16,
+    PEER_ID_OFFSET    = PEER_AS_OFFSET + sizeof(uint32_t),
+    PEER_SEC_OFFSET   = PEER_ID_OFFSET + sizeof(uint32_t),
+    PEER_USEC_OFFSET  = PEER_SEC_OFFSET + sizeof(uint32_t),
+
+    // Peer Up, relative to the end of the per-peer header
+    UP_LOCAL_ADDR_OFFSET  = 0,
+    UP_LOCAL_PORT_OFFSET  = UP_LOCAL_ADDR_OFFSET + 16,
+    UP_REMOTE_PORT_OFFSET = UP_LOCAL_PORT_OFFSET + sizeof(uint16_t),
+    UP_OPENS_OFFSET       = UP_REMOTE_PORT_OFFSET + sizeof(uint16_t),
+
+    BODY_OFFSET = BMP_HDRSIZ + BMP_PEERHDRSIZ,  // body of messages having a per-peer header
+
+    TLV_HDRSIZ     = 2 * sizeof(uint16_t),
+    STATS_CNTSIZ   = sizeof(uint32_t),
+
+    BGP_HDRSIZ = 19,
+    BGP_LENOFF = 16,
+
+    ADDPATH_TUPLES_MAX = CAPABILITY_LENGTH_MAX / sizeof(afi_safi_t)
+};
+
+enum {
+    F_RD = 1 << 0,  // reading a message
+    F_SH = 1 << 1,  // buffer is shared, see BMPF_NOCOPY
+    F_PH = 1 << 2   // per-peer header is decoded
+};
+
+static uint16_t getbe16(const byte *p)
+{
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return beswap16(v);
+}
+
+static uint32_t getbe32(const byte *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return beswap32(v);
+}
+
+static uint64_t getbe64(const byte *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return beswap64(v);
+}
+
+static bool hasperpeer(int type)
+{
+    switch (type) {
+    case BMP_ROUTE_MONITORING:
+    case BMP_STATS_REPORT:
+    case BMP_PEER_DOWN:
+    case BMP_PEER_UP:
+    case BMP_ROUTE_MIRRORING:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static ubmp_err seterr(ubmp_msg_s *msg, ubmp_err err)
+{
+    if (msg->err == BMP_ENOERR)
+        msg->err = err;
+
+    return msg->err;
+}
+
+static bool checkread(ubmp_msg_s *msg, int type)
+{
+    if (unlikely((msg->flags & F_RD) == 0 || msg->buf[TYPE_OFFSET] != type))
+        seterr(msg, BMP_EINVOP);
+
+    return msg->err == BMP_ENOERR;
+}
+
+static ubmp_err checkhdr(const byte *hdr, size_t *plen)
+{
+    if (unlikely(hdr[VERSION_OFFSET] != BMP_VERSION))
+        return BMP_EBADVERS;
+
+    uint32_t len = getbe32(&hdr[LENGTH_OFFSET]);
+    if (unlikely(len < BMP_HDRSIZ || len > BMP_MAXLEN))
+        return BMP_EBADHDR;
+
+    *plen = len;
+    return BMP_ENOERR;
+}
+
+// point msg buffer to a suitable area for a n bytes message
+static bool bmpalloc(ubmp_msg_s *msg, size_t n)
+{
+    msg->buf = msg->fastbuf;
+    if (unlikely(n > sizeof(msg->fastbuf))) {
+        msg->buf = malloc(n);
+        if (unlikely(!msg->buf)) {
+            msg->buf = msg->fastbuf;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+UBGP_API ubmp_err setbmpread(ubmp_msg_s *msg, const void *data, size_t n, uint flags)
+{
+    msg->flags = 0;
+    msg->err   = BMP_ENOERR;
+    msg->buf   = msg->fastbuf;
+    msg->tptr  = msg->tend = NULL;
+
+    size_t len;
+    if (unlikely(n < BMP_HDRSIZ))
+        return seterr(msg, BMP_EBADHDR);
+    if (unlikely(seterr(msg, checkhdr(data, &len)) != BMP_ENOERR))
+        return msg->err;
+    if (unlikely(len != n))
+        return seterr(msg, BMP_EBADHDR);
+
+    if (flags & BMPF_NOCOPY) {
+        msg->buf    = (byte *) data;  // read-only
+        msg->flags |= F_SH;
+    } else {
+        if (unlikely(!bmpalloc(msg, n)))
+            return seterr(msg, BMP_ENOMEM);
+
+        memcpy(msg->buf, data, n);
+    }
+
+    msg->len    = n;
+    msg->flags |= F_RD;
+    return BMP_ENOERR;
+}
+
+UBGP_API ubmp_err setbmpreadfrom(ubmp_msg_s *msg, io_rw_t *io)
+{
+    msg->flags = 0;
+    msg->err   = BMP_ENOERR;
+    msg->buf   = msg->fastbuf;
+    msg->tptr  = msg->tend = NULL;
+
+    byte hdr[BMP_HDRSIZ];
+    size_t n = io->read(io, hdr, sizeof(hdr));
+    if (unlikely(n != sizeof(hdr)))
+        return seterr(msg, (n > 0) ? BMP_EBADHDR : BMP_EIO);  // either a truncated header or no bytes left
+
+    size_t len;
+    if (unlikely(seterr(msg, checkhdr(hdr, &len)) != BMP_ENOERR))
+        return msg->err;
+    if (unlikely(!bmpalloc(msg, len)))
+        return seterr(msg, BMP_ENOMEM);
+
+    memcpy(msg->buf, hdr, sizeof(hdr));
+    n = len - sizeof(hdr);
+    if (unlikely(io->read(io, &msg->buf[sizeof(hdr)], n) != n)) {
+        bmpclose(msg);
+        return seterr(msg, BMP_EBADMSG);
+    }
+
+    msg->len    = len;
+    msg->flags |= F_RD;
+    return BMP_ENOERR;
+}
+
+UBGP_API int getbmptype(const ubmp_msg_s *msg)
+{
+    if (unlikely((msg->flags & F_RD) == 0))
+        return -1;
+
+    return msg->buf[TYPE_OFFSET];
+}
+
+UBGP_API bmp_peer_header_t *getbmppeerheader(ubmp_msg_s *msg)
+{
+    if (unlikely(msg->err != BMP_ENOERR))
+        return NULL;
+    if (unlikely((msg->flags & F_RD) == 0 || !hasperpeer(msg->buf[TYPE_OFFSET]))) {
+        seterr(msg, BMP_EINVOP);
+        return NULL;
+    }
+
+    bmp_peer_header_t *ph = &msg->peerhdr;
+    if (msg->flags & F_PH)
+        return ph;
+
+    if (unlikely(msg->len < BODY_OFFSET)) {
+        seterr(msg, BMP_EBADPEERHDR);
+        return NULL;
+    }
+
+    const byte *p = &msg->buf[BMP_HDRSIZ];
+
+    ph->peer_type  = p[PEER_TYPE_OFFSET];
+    ph->peer_flags = p[PEER_FLAGS_OFFSET];
+    ph->peer_dist  = getbe64(&p[PEER_DIST_OFFSET]);
+    if (ph->peer_flags & BMP_PEERF_IPV6)
+        makenaddr(&ph->peer_addr, AF_INET6, &p[PEER_ADDR_OFFSET], 128);
+    else
+        makenaddr(&ph->peer_addr, AF_INET, &p[PEER_AS_OFFSET - sizeof(struct in_addr)], 32);
+
+    ph->peer_as = getbe32(&p[PEER_AS_OFFSET]);
+    memcpy(&ph->peer_id, &p[PEER_ID_OFFSET], sizeof(ph->peer_id));
+
+    uint32_t usec = getbe32(&p[PEER_USEC_OFFSET]);
+    if (unlikely(usec >= 1000000))
+        usec = 0;
+
+    ph->stamp.tv_sec  = getbe32(&p[PEER_SEC_OFFSET]);
+    ph->stamp.tv_nsec = usec * 1000l;
+
+    msg->flags |= F_PH;
+    return ph;
+}
+
+UBGP_API ubmp_err unwrapbmp(ubmp_msg_s *msg, ubgp_msg_s *bgp, uint flags)
+{
+    if (unlikely(!checkread(msg, BMP_ROUTE_MONITORING)))
+        return msg->err;
+
+    const bmp_peer_header_t *ph = getbmppeerheader(msg);
+    if (unlikely(!ph))
+        return msg->err;
+
+    // exactly one BGP message follows
+    const byte *pdu = &msg->buf[BODY_OFFSET];
+    size_t n = msg->len - BODY_OFFSET;
+    if (unlikely(n < BGP_HDRSIZ || getbe16(&pdu[BGP_LENOFF]) != n))
+        return seterr(msg, BMP_EBADMSG);
+
+    flags |= BGPF_NOCOPY;
+    if ((ph->peer_flags & BMP_PEERF_AS2) == 0)
+        flags |= BGPF_ASN32BIT;
+
+    if (unlikely(setbgpread(bgp, pdu, n, flags) != BGP_ENOERR))
+        return seterr(msg, BMP_ENOMEM);
+
+    return BMP_ENOERR;
+}
+
+// size of the OPEN message at p, 0 if it doesn't fit in n bytes
+static size_t opensize(const byte *p, size_t n)
+{
+    if (unlikely(n < BGP_HDRSIZ))
+        return 0;
+
+    size_t len = getbe16(&p[BGP_LENOFF]);
+    if (unlikely(len < BGP_HDRSIZ || len > n))
+        return 0;
+
+    return len;
+}
+
+// capabilities of interest advertised by an OPEN message
+static size_t opencaps(const void *data, size_t n, bool *as4, afi_safi_t *tuples)
+{
+    ubgp_msg_s open;
+    size_t ntuples = 0;
+
+    *as4 = false;
+    setbgpread(&open, data, n, BGPF_NOCOPY);
+    if (getbgpopen(&open) && startbgpcaps(&open) == BGP_ENOERR) {
+        bgpcap_t *cap;
+        while ((cap = nextbgpcap(&open)) != NULL) {
+            if (cap->code == ASN32BIT_CODE) {
+                *as4 = true;
+            } else if (cap->code == ADD_PATH_CODE) {
+                size_t count = getaddpathtuples(&tuples[ntuples], ADDPATH_TUPLES_MAX - ntuples, cap);
+
+                ntuples += MIN(count, ADDPATH_TUPLES_MAX - ntuples);
+            }
+        }
+        endbgpcaps(&open);
+    }
+
+    bgpclose(&open);
+    return ntuples;
+}
+
+// decoding flags for messages sent by the peer, as negotiated by OPEN messages
+static uint negotiate(const bmp_peer_up_t *up)
+{
+    afi_safi_t sent[ADDPATH_TUPLES_MAX], recv[ADDPATH_TUPLES_MAX];
+    bool sentas4, recvas4;
+
+    size_t nsent = opencaps(up->sent_open, up->sent_len, &sentas4, sent);
+    size_t nrecv = opencaps(up->recv_open, up->recv_len, &recvas4, recv);
+
+    uint flags = 0;
+    if (sentas4 && recvas4)
+        flags |= BGPF_ASN32BIT;
+
+    for (size_t i = 0; i < nrecv; i++) {
+        if ((recv[i].flags & ADD_PATH_TX) == 0)
+            continue;
+
+        for (size_t j = 0; j < nsent; j++) {
+            if (sent[j].afi == recv[i].afi && sent[j].safi == recv[i].safi && (sent[j].flags & ADD_PATH_RX))
+                flags |= BGPF_ADDPATH;
+        }
+    }
+
+    return flags;
+}
+
+// start of the information TLVs of a Peer Up message
+static const byte *peeruptlvs(const ubmp_msg_s *msg)
+{
+    return (const byte *) msg->up.recv_open + msg->up.recv_len;
+}
+
+UBGP_API bmp_peer_up_t *getbmppeerup(ubmp_msg_s *msg)
+{
+    if (unlikely(!checkread(msg, BMP_PEER_UP)))
+        return NULL;
+
+    const bmp_peer_header_t *ph = getbmppeerheader(msg);
+    if (unlikely(!ph))
+        return NULL;
+
+    const byte *p = &msg->buf[BODY_OFFSET];
+    size_t n = msg->len - BODY_OFFSET;
+    if (unlikely(n < UP_OPENS_OFFSET)) {
+        seterr(msg, BMP_EBADMSG);
+        return NULL;
+    }
+
+    bmp_peer_up_t *up = &msg->up;
+    if (ph->peer_flags & BMP_PEERF_IPV6)
+        makenaddr(&up->local_addr, AF_INET6, &p[UP_LOCAL_ADDR_OFFSET], 128);
+    else
+        makenaddr(&up->local_addr, AF_INET, &p[UP_LOCAL_PORT_OFFSET - sizeof(struct in_addr)], 32);
+
+    up->local_port  = getbe16(&p[UP_LOCAL_PORT_OFFSET]);
+    up->remote_port = getbe16(&p[UP_REMOTE_PORT_OFFSET]);
+
+    p += UP_OPENS_OFFSET;
+    n -= UP_OPENS_OFFSET;
+
+    up->sent_open = p;
+    up->sent_len  = opensize(p, n);
+    p += up->sent_len;
+    n -= up->sent_len;
+
+    up->recv_open = p;
+    up->recv_len  = opensize(p, n);
+    if (unlikely(up->sent_len == 0 || up->recv_len == 0)) {
+        seterr(msg, BMP_EBADMSG);
+        return NULL;
+    }
+
+    up->bgpflags = negotiate(up);
+    return up;
+}
+
+UBGP_API bmp_peer_down_t *getbmppeerdown(ubmp_msg_s *msg)
+{
+    if (unlikely(!checkread(msg, BMP_PEER_DOWN)))
+        return NULL;
+    if (unlikely(!getbmppeerheader(msg)))
+        return NULL;
+
+    const byte *p = &msg->buf[BODY_OFFSET];
+    size_t n = msg->len - BODY_OFFSET;
+    if (unlikely(n < sizeof(uint8_t))) {
+        seterr(msg, BMP_EBADMSG);
+        return NULL;
+    }
+
+    bmp_peer_down_t *down = &msg->down;
+
+    down->reason = p[0];
+    down->data   = &p[1];
+    down->len    = n - 1;
+    return down;
+}
+
+UBGP_API ubmp_err startbmptlvs(ubmp_msg_s *msg, size_t *pcount)
+{
+    if (unlikely(msg->err != BMP_ENOERR))
+        return msg->err;
+    if (unlikely((msg->flags & F_RD) == 0))
+        return seterr(msg, BMP_EINVOP);
+
+    const byte *p;
+    const byte *end = &msg->buf[msg->len];
+
+    size_t count = 0;
+    switch (msg->buf[TYPE_OFFSET]) {
+    case BMP_INITIATION:
+    case BMP_TERMINATION:
+        p = &msg->buf[BMP_HDRSIZ];
+        break;
+
+    case BMP_ROUTE_MIRRORING:
+        if (unlikely(!getbmppeerheader(msg)))
+            return msg->err;
+
+        p = &msg->buf[BODY_OFFSET];
+        break;
+
+    case BMP_STATS_REPORT:
+        if (unlikely(!getbmppeerheader(msg)))
+            return msg->err;
+        if (unlikely(msg->len - BODY_OFFSET < STATS_CNTSIZ))
+            return seterr(msg, BMP_EBADMSG);
+
+        count = getbe32(&msg->buf[BODY_OFFSET]);
+        p     = &msg->buf[BODY_OFFSET + STATS_CNTSIZ];
+        break;
+
+    case BMP_PEER_UP:
+        if (unlikely(!getbmppeerup(msg)))
+            return msg->err;
+
+        p = peeruptlvs(msg);
+        break;
+
+    default:
+        return seterr(msg, BMP_EINVOP);
+    }
+
+    if (pcount)
+        *pcount = count;
+
+    msg->tptr = p;
+    msg->tend = end;
+    return BMP_ENOERR;
+}
+
+UBGP_API bmp_tlv_t *nextbmptlv(ubmp_msg_s *msg)
+{
+    if (unlikely(msg->err != BMP_ENOERR || !msg->tptr))
+        return NULL;
+    if (msg->tptr == msg->tend)
+        return NULL;
+
+    size_t n = msg->tend - msg->tptr;
+    if (unlikely(n < TLV_HDRSIZ)) {
+        seterr(msg, BMP_EBADMSG);
+        return NULL;
+    }
+
+    bmp_tlv_t *tlv = &msg->tlv;
+
+    tlv->type  = getbe16(msg->tptr);
+    tlv->len   = getbe16(msg->tptr + sizeof(uint16_t));
+    tlv->value = msg->tptr + TLV_HDRSIZ;
+    if (unlikely(tlv->len > n - TLV_HDRSIZ)) {
+        seterr(msg, BMP_EBADMSG);
+        return NULL;
+    }
+
+    msg->tptr = tlv->value + tlv->len;
+    return tlv;
+}
+
+UBGP_API uint64_t getbmpstat(const bmp_tlv_t *tlv)
+{
+    switch (tlv->len) {
+    case sizeof(uint32_t):
+        return getbe32(tlv->value);  // counter
+    case sizeof(uint64_t):
+        return getbe64(tlv->value);  // gauge
+    case sizeof(uint16_t) + sizeof(uint8_t) + sizeof(uint64_t):
+        return getbe64(&tlv->value[sizeof(uint16_t) + sizeof(uint8_t)]);  // per AFI/SAFI gauge
+    default:
+        return 0;
+    }
+}
+
+UBGP_API ubmp_err bmperror(const ubmp_msg_s *msg)
+{
+    return msg->err;
+}
+
+UBGP_API ubmp_err bmpclose(ubmp_msg_s *msg)
+{
+    ubmp_err err = msg->err;
+    if (msg->buf != msg->fastbuf && (msg->flags & F_SH) == 0)
+        free(msg->buf);
+
+    msg->buf   = msg->fastbuf;
+    msg->flags = 0;
+    msg->err   = BMP_ENOERR;
+    msg->tptr  = msg->tend = NULL;
+    return err;
+}
@@ -0,0 +1,396 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#ifndef UBGP_BMP_H_
+#define UBGP_BMP_H_
+
+#include "bgp.h"
+#include "funcattribs.h"
+#include "io.h"
+#include "netaddr.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * SECTION: bmp
+ * @title: BGP Monitoring Protocol
+ * @include: bmp.h
+ *
+ * Read BGP Monitoring Protocol messages, as defined by RFC 7854.
+ *
+ * Messages concerning a monitored peer carry a per-peer header, decoded
+ * into a #bmp_peer_header_t, Route Monitoring messages are unwrapped into
+ * a #ubgp_msg_s without copying the BGP UPDATE they carry.
+ * A stream of BMP messages can be split with a #framer_t
+ * of kind %FRAME_BMP, or read one message at a time with setbmpreadfrom().
+ */
+
+enum {
+    BMP_VERSION = 3,
+
+    BMP_HDRSIZ     = 6,   // common header size
+    BMP_PEERHDRSIZ = 42,  // per-peer header size
+
+    BMP_MAXLEN = 16 * 1024 * 1024  // sanity bound for message length
+};
+
+/**
+ * bmp_msgtype:
+ *
+ * BMP message types.
+ */
+typedef enum {
+    BMP_ROUTE_MONITORING = 0,
+    BMP_STATS_REPORT     = 1,
+    BMP_PEER_DOWN        = 2,
+    BMP_PEER_UP          = 3,
+    BMP_INITIATION       = 4,
+    BMP_TERMINATION      = 5,
+    BMP_ROUTE_MIRRORING  = 6
+} bmp_msgtype;
+
+/// @brief Peer types
+enum {
+    BMP_PEER_GLOBAL = 0,
+    BMP_PEER_RD     = 1,
+    BMP_PEER_LOCAL  = 2,
+    BMP_PEER_LOCRIB = 3   ///< RFC 9069
+};
+
+/// @brief Per-peer header flags
+enum {
+    BMP_PEERF_IPV6     = 1 << 7,  ///< V flag, peer address is IPv6
+    BMP_PEERF_POST     = 1 << 6,  ///< L flag, post-policy Adj-RIB-In
+    BMP_PEERF_AS2      = 1 << 5,  ///< A flag, legacy 2 octets AS_PATH
+    BMP_PEERF_ADJRIBOUT = 1 << 4  ///< O flag, Adj-RIB-Out, RFC 8671
+};
+
+/// @brief Peer Down reasons
+enum {
+    BMP_DOWN_LOCAL_NOTIFY   = 1,
+    BMP_DOWN_LOCAL_NODATA   = 2,
+    BMP_DOWN_REMOTE_NOTIFY  = 3,
+    BMP_DOWN_REMOTE_NODATA  = 4,
+    BMP_DOWN_DECONFIGURED   = 5
+};
+
+/// @brief Statistics Report types
+enum {
+    BMP_STAT_REJECTED          = 0,
+    BMP_STAT_DUP_PREFIX        = 1,
+    BMP_STAT_DUP_WITHDRAW      = 2,
+    BMP_STAT_CLUSTER_LIST_LOOP = 3,
+    BMP_STAT_AS_PATH_LOOP      = 4,
+    BMP_STAT_ORIGINATOR_LOOP   = 5,
+    BMP_STAT_AS_CONFED_LOOP    = 6,
+    BMP_STAT_ADJ_RIB_IN        = 7,
+    BMP_STAT_LOC_RIB           = 8
+};
+
+/// @brief Initiation and Termination information types
+enum {
+    BMP_INFO_STRING   = 0,
+    BMP_INFO_SYSDESCR = 1,
+    BMP_INFO_SYSNAME  = 2,
+    BMP_TERM_REASON   = 1
+};
+
+/**
+ * ubmp_err:
+ * @BMP_ENOERR:       no error (success) guaranteed to be zero
+ * @BMP_EIO:          input/output error, or end of input
+ * @BMP_EINVOP:       invalid operation for this message
+ * @BMP_ENOMEM:       out of memory
+ * @BMP_EBADHDR:      bad or truncated common header
+ * @BMP_EBADVERS:     unsupported BMP version
+ * @BMP_EBADPEERHDR:  bad or truncated per-peer header
+ * @BMP_EBADMSG:      message body inconsistent with its type
+ *
+ * BMP API error codes.
+ */
+typedef enum {
+    BMP_ENOERR = 0,
+    BMP_EIO,
+    BMP_EINVOP,
+    BMP_ENOMEM,
+    BMP_EBADHDR,
+    BMP_EBADVERS,
+    BMP_EBADPEERHDR,
+    BMP_EBADMSG
+} ubmp_err;
+
+static inline const char *bmpstrerror(ubmp_err err)
+{
+    switch (err) {
+    case BMP_ENOERR:
+        return "Success";
+    case BMP_EIO:
+        return "I/O error";
+    case BMP_EINVOP:
+        return "Invalid operation";
+    case BMP_ENOMEM:
+        return "Out of memory";
+    case BMP_EBADHDR:
+        return "Bad BMP header";
+    case BMP_EBADVERS:
+        return "Unsupported BMP version";
+    case BMP_EBADPEERHDR:
+        return "Bad BMP per-peer header";
+    case BMP_EBADMSG:
+        return "Corrupted or truncated BMP message";
+    default:
+        return "Unknown error";
+    }
+}
+
+/**
+ * bmp_peer_header_t:
+ * @peer_type:  peer type, such as %BMP_PEER_GLOBAL
+ * @peer_flags: per-peer header flags, such as %BMP_PEERF_IPV6
+ * @peer_dist:  peer distinguisher, 0 for global instance peers
+ * @peer_as:    peer AS
+ * @peer_addr:  peer address, all zeroes for Loc-RIB
+ * @peer_id:    peer BGP identifier
+ * @stamp:      time the message was generated, 0 if unavailable
+ *
+ * Per-peer header of a BMP message, matching the peer fields
+ * of a #bgp4mp_header_t.
+ */
+typedef struct {
+    uint8_t         peer_type;
+    uint8_t         peer_flags;
+    uint64_t        peer_dist;
+    uint32_t        peer_as;
+    netaddr_t       peer_addr;
+    struct in_addr  peer_id;
+    struct timespec stamp;
+} bmp_peer_header_t;
+
+/**
+ * bmp_peer_up_t:
+ * @local_addr:  local address of the session
+ * @local_port:  local TCP port
+ * @remote_port: remote TCP port
+ * @sent_open:   OPEN message sent by the monitored router
+ * @sent_len:    @sent_open size in bytes
+ * @recv_open:   OPEN message received from the peer
+ * @recv_len:    @recv_open size in bytes
+ * @bgpflags:    flags for setbgpread(), to decode the peer messages,
+ *               %BGPF_ASN32BIT and %BGPF_ADDPATH are set if both OPEN
+ *               messages advertise them, the latter in the peer sending
+ *               direction for at least one address family
+ *
+ * Peer Up notification.
+ */
+typedef struct {
+    netaddr_t   local_addr;
+    uint16_t    local_port, remote_port;
+    const void *sent_open;
+    size_t      sent_len;
+    const void *recv_open;
+    size_t      recv_len;
+    uint        bgpflags;
+} bmp_peer_up_t;
+
+/**
+ * bmp_peer_down_t:
+ * @reason: reason the session was closed, such as %BMP_DOWN_REMOTE_NOTIFY
+ * @data:   reason specific data: a NOTIFICATION message
+ *          for %BMP_DOWN_LOCAL_NOTIFY and %BMP_DOWN_REMOTE_NOTIFY,
+ *          a 2 octets FSM event code for %BMP_DOWN_LOCAL_NODATA
+ * @len:    @data size in bytes
+ *
+ * Peer Down notification.
+ */
+typedef struct {
+    uint8_t     reason;
+    const void *data;
+    size_t      len;
+} bmp_peer_down_t;
+
+/**
+ * bmp_tlv_t:
+ * @type:  information or statistic type
+ * @len:   @value size in bytes
+ * @value: TLV value
+ *
+ * Information TLV of Initiation, Termination, Peer Up and Route Mirroring
+ * messages, or statistic of a Statistics Report.
+ */
+typedef struct {
+    uint16_t    type;
+    uint16_t    len;
+    const byte *value;
+} bmp_tlv_t;
+
+/**
+ * getbmpstat:
+ * @tlv: a statistic of a Statistics Report
+ *
+ * Returns: the counter or gauge value of @tlv, 0 if its size is unknown.
+ */
+UBGP_API CHECK_NONNULL(1) PUREFUNC uint64_t getbmpstat(const bmp_tlv_t *tlv);
+
+/**
+ * BMPF_DEFAULT:
+ *
+ * Default flags for setbmpread(), copy the message.
+ */
+#define BMPF_DEFAULT 0
+
+/**
+ * BMPF_NOCOPY:
+ *
+ * A flag for setbmpread(), do not copy the message, its buffer must
+ * remain valid until bmpclose().
+ */
+#define BMPF_NOCOPY (1 << 0)
+
+#define BMPBUFSIZ 4096
+
+/**
+ * ubmp_msg_s:
+ *
+ * BMP message reader.
+ */
+typedef struct {
+    /*< private >*/
+    uint16_t flags;
+    int16_t  err;
+    uint32_t len;     // message length, including common header
+    byte    *buf;     // message buffer
+
+    bmp_peer_header_t peerhdr;
+    union {
+        bmp_peer_up_t   up;
+        bmp_peer_down_t down;
+    };
+    bmp_tlv_t   tlv;
+    const byte *tptr, *tend;  // TLV iteration
+
+    byte fastbuf[BMPBUFSIZ];  // Fast buffer to avoid malloc()s.
+} ubmp_msg_s;
+
+/**
+ * setbmpread:
+ * @msg:   a #ubmp_msg_s
+ * @data:  a complete BMP message, including its common header
+ * @n:     @data size in bytes
+ * @flags: %BMPF_DEFAULT or %BMPF_NOCOPY
+ *
+ * Start reading a BMP message from memory.
+ *
+ * Returns: %BMP_ENOERR on success, an error code otherwise.
+ */
+UBGP_API CHECK_NONNULL(1) ubmp_err setbmpread(ubmp_msg_s *msg,
+                                              const void *data,
+                                              size_t      n,
+                                              uint        flags);
+
+/**
+ * setbmpreadfrom:
+ * @msg: a #ubmp_msg_s
+ * @io:  input stream
+ *
+ * Read the next BMP message from @io.
+ *
+ * Returns: %BMP_ENOERR on success, %BMP_EIO at the end of @io,
+ *          another error code otherwise.
+ */
+UBGP_API CHECK_NONNULL(1, 2) ubmp_err setbmpreadfrom(ubmp_msg_s *msg, io_rw_t *io);
+
+/**
+ * getbmptype:
+ * @msg: a #ubmp_msg_s
+ *
+ * Returns: @msg type, which may be unknown to this library,
+ *          unknown types should be skipped.
+ */
+UBGP_API CHECK_NONNULL(1) PUREFUNC int getbmptype(const ubmp_msg_s *msg);
+
+/**
+ * getbmppeerheader:
+ * @msg: a #ubmp_msg_s
+ *
+ * Returns: the decoded per-peer header of @msg, %NULL on error
+ *          or if @msg has none, see bmperror().
+ */
+UBGP_API CHECK_NONNULL(1) bmp_peer_header_t *getbmppeerheader(ubmp_msg_s *msg);
+
+/**
+ * unwrapbmp:
+ * @msg:   a Route Monitoring #ubmp_msg_s
+ * @bgp:   BGP message to be initialized
+ * @flags: additional flags for setbgpread(), such as %BGPF_ADDPATH
+ *
+ * Start reading the BGP UPDATE carried by @msg into @bgp,
+ * without copying it, @bgp must be closed before @msg.
+ * %BGPF_ASN32BIT is set unless the per-peer header A flag is.
+ *
+ * Returns: %BMP_ENOERR on success, an error code otherwise.
+ */
+UBGP_API CHECK_NONNULL(1, 2) ubmp_err unwrapbmp(ubmp_msg_s *msg, ubgp_msg_s *bgp, uint flags);
+
+/**
+ * getbmppeerup:
+ * @msg: a Peer Up #ubmp_msg_s
+ *
+ * Returns: the decoded notification, %NULL on error, see bmperror().
+ */
+UBGP_API CHECK_NONNULL(1) bmp_peer_up_t *getbmppeerup(ubmp_msg_s *msg);
+
+/**
+ * getbmppeerdown:
+ * @msg: a Peer Down #ubmp_msg_s
+ *
+ * Returns: the decoded notification, %NULL on error, see bmperror().
+ */
+UBGP_API CHECK_NONNULL(1) bmp_peer_down_t *getbmppeerdown(ubmp_msg_s *msg);
+
+/**
+ * startbmptlvs:
+ * @msg: an Initiation, Termination, Peer Up, Statistics Report
+ *       or Route Mirroring #ubmp_msg_s
+ * @pcount: (nullable): if not %NULL, storage for the number of
+ *          statistics declared by a Statistics Report
+ *
+ * Start iterating over the TLVs of @msg.
+ *
+ * Returns: %BMP_ENOERR on success, an error code otherwise.
+ */
+UBGP_API CHECK_NONNULL(1) ubmp_err startbmptlvs(ubmp_msg_s *msg, size_t *pcount);
+
+/**
+ * nextbmptlv:
+ * @msg: a #ubmp_msg_s
+ *
+ * Returns: the next TLV, valid until the next call, %NULL when
+ *          there are no more TLVs or on error, see bmperror().
+ */
+UBGP_API CHECK_NONNULL(1) bmp_tlv_t *nextbmptlv(ubmp_msg_s *msg);
+
+UBGP_API CHECK_NONNULL(1) PUREFUNC ubmp_err bmperror(const ubmp_msg_s *msg);
+
+UBGP_API CHECK_NONNULL(1) ubmp_err bmpclose(ubmp_msg_s *msg);
+
+#endif
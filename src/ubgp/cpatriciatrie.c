@@ -0,0 +1,459 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#include "branch.h"
+#include "cpatriciatrie.h"
+
+#include <assert.h>
+#include <sched.h>
+#include <stdlib.h>
+
+enum {
+    CPAT_RECLAIM_THRESHOLD = 1024,  // removed nodes triggering a reclamation attempt
+};
+
+/*
+ * Nodes are never modified once reachable by readers, except for their
+ * children pointers, which are always accessed atomically.
+ * Turning a glue node into a real one (or vice-versa) replaces the node
+ * with an updated copy, so a reader never observes a torn payload.
+ *
+ * Glue nodes always have two children, every leaf is a real node.
+ */
+struct cpnode_s {
+    trienode_t pub;                  // keep first, nodes are returned as trienode_t
+    cpnode_t *children[2];           // 0 = left, 1 = right
+    cpnode_t *next;                  // limbo list link, once removed
+    uint64_t epoch;                  // epoch in which the node was removed
+    bool glue;
+};
+
+static int cpatbit(const netaddr_t *prefix, uint bit)
+{
+    return (prefix->bytes[bit >> 3] >> (7 - (bit & 0x07))) & 1;
+}
+
+static cpnode_t *cpnodenew(const netaddr_t *prefix,
+                           uint             bitlen,
+                           void            *payload,
+                           bool             glue)
+{
+    cpnode_t *n = malloc(sizeof(*n));
+    if (unlikely(!n))
+        return NULL;
+
+    n->pub.prefix        = *prefix;
+    n->pub.prefix.bitlen = bitlen;
+    n->pub.payload       = payload;
+    n->children[0]       = NULL;
+    n->children[1]       = NULL;
+    n->next              = NULL;
+    n->epoch             = 0;
+    n->glue              = glue;
+    return n;
+}
+
+UBGP_API void cpatinit(cpatricia_trie_t *pt, sa_family_t family)
+{
+    assert(family == AF_INET || family == AF_INET6);
+
+    pt->head      = NULL;
+    pt->maxbitlen = (family == AF_INET6) ? 128 : 32;
+    pt->nprefs    = 0;
+    pt->epoch     = 1;
+    pt->limbo     = NULL;
+    pt->nlimbo    = 0;
+    for (uint i = 0; i < CPAT_MAX_READERS; i++) {
+        pt->readers[i].epoch = 0;
+        pt->readers[i].inuse = 0;
+    }
+}
+
+static void cpatfreelist(cpnode_t *n)
+{
+    while (n) {
+        cpnode_t *next = n->next;
+        free(n);
+        n = next;
+    }
+}
+
+UBGP_API void cpatdestroy(cpatricia_trie_t *pt)
+{
+    cpnode_t *stack[2 * (128 + 1)];
+    cpnode_t **sp = stack;
+
+    if (pt->head)
+        *sp++ = pt->head;
+
+    while (sp != stack) {
+        cpnode_t *n = *--sp;
+        if (n->children[0])
+            *sp++ = n->children[0];
+        if (n->children[1])
+            *sp++ = n->children[1];
+
+        free(n);
+    }
+
+    cpatfreelist(pt->limbo);
+
+    pt->head   = NULL;
+    pt->nprefs = 0;
+    pt->limbo  = NULL;
+    pt->nlimbo = 0;
+}
+
+UBGP_API cpatricia_reader_t *cpatreaderget(cpatricia_trie_t *pt)
+{
+    for (uint i = 0; i < CPAT_MAX_READERS; i++) {
+        cpatricia_reader_t *r = &pt->readers[i];
+
+        int unused = 0;
+        if (ATOMIC_LOAD(r->inuse) == 0 && ATOMIC_CAS(r->inuse, unused, 1))
+            return r;
+    }
+
+    return NULL;
+}
+
+UBGP_API void cpatreaderput(cpatricia_reader_t *r)
+{
+    ATOMIC_STORE(r->epoch, 0);
+    ATOMIC_STORE_REL(r->inuse, 0);
+}
+
+// free() removed nodes no reader may reference anymore, returns true if limbo is empty
+static bool cpatreclaim(cpatricia_trie_t *pt)
+{
+    if (!pt->limbo)
+        return true;
+
+    // readers entering after the bump can't reach anything removed so far,
+    // pairs with the fence in cpatreadbegin()
+    ATOMIC_STORE(pt->epoch, pt->epoch + 1);
+    ATOMIC_FENCE();
+
+    uint64_t safe = pt->epoch;
+    for (uint i = 0; i < CPAT_MAX_READERS; i++) {
+        uint64_t e = ATOMIC_LOAD_ACQ(pt->readers[i].epoch);
+        if (e != 0 && e < safe)
+            safe = e;
+    }
+
+    // limbo is sorted by decreasing epoch, free its tail
+    cpnode_t **link = &pt->limbo;
+    while (*link && (*link)->epoch >= safe)
+        link = &(*link)->next;
+
+    cpnode_t *n = *link;
+    *link = NULL;
+    while (n) {
+        cpnode_t *next = n->next;
+        free(n);
+        pt->nlimbo--;
+        n = next;
+    }
+
+    return pt->limbo == NULL;
+}
+
+static void cpatretire(cpatricia_trie_t *pt, cpnode_t *n)
+{
+    n->epoch = pt->epoch;
+    n->next  = pt->limbo;
+    pt->limbo = n;
+    if (++pt->nlimbo >= CPAT_RECLAIM_THRESHOLD)
+        cpatreclaim(pt);
+}
+
+UBGP_API void cpatsynchronize(cpatricia_trie_t *pt)
+{
+    while (!cpatreclaim(pt))
+        sched_yield();
+}
+
+// link pointing to n, given its parent
+static cpnode_t **cpatlinkof(cpatricia_trie_t *pt, cpnode_t *parent, cpnode_t *n)
+{
+    if (!parent)
+        return &pt->head;
+
+    return &parent->children[parent->children[1] == n];
+}
+
+// replace n with a copy having a different payload/glue status, n is retired
+static cpnode_t *cpatreplace(cpatricia_trie_t *pt,
+                             cpnode_t         *parent,
+                             cpnode_t         *n,
+                             void             *payload,
+                             bool              glue)
+{
+    cpnode_t *copy = cpnodenew(&n->pub.prefix, n->pub.prefix.bitlen, payload, glue);
+    if (unlikely(!copy))
+        return NULL;
+
+    copy->children[0] = n->children[0];
+    copy->children[1] = n->children[1];
+    ATOMIC_STORE_REL(*cpatlinkof(pt, parent, n), copy);
+    cpatretire(pt, n);
+    return copy;
+}
+
+UBGP_API trienode_t *cpatinsert(cpatricia_trie_t *pt,
+                                const netaddr_t  *prefix,
+                                void             *payload,
+                                int              *inserted)
+{
+    assert(prefix->bitlen <= pt->maxbitlen);
+
+    int dummy;
+    if (!inserted)
+        inserted = &dummy;
+
+    *inserted = PREFIX_ALREADY_PRESENT;
+
+    // only the writer modifies the trie, so plain loads are fine down here
+    cpnode_t *n = pt->head;
+    if (!n) {
+        n = cpnodenew(prefix, prefix->bitlen, payload, false);
+        if (unlikely(!n))
+            return NULL;
+
+        ATOMIC_STORE_REL(pt->head, n);
+        pt->nprefs++;
+        *inserted = PREFIX_INSERTED;
+        return &n->pub;
+    }
+
+    uint bitlen = prefix->bitlen;
+
+    cpnode_t *path[128 + 1];
+    uint depth = 0;
+    while (n->pub.prefix.bitlen < bitlen || n->glue) {
+        cpnode_t *next = n->children[cpatbit(prefix, n->pub.prefix.bitlen)];
+        if (!next)
+            break;
+
+        path[depth++] = n;
+        n = next;
+    }
+
+    uint checkbit = (n->pub.prefix.bitlen < bitlen) ? n->pub.prefix.bitlen : bitlen;
+    uint differbit = 0;
+    for (uint i = 0; i * 8 < checkbit; i++) {
+        int r = prefix->bytes[i] ^ n->pub.prefix.bytes[i];
+        if (r == 0) {
+            differbit = (i + 1) * 8;
+            continue;
+        }
+
+        int j = 0;
+        while (!(r & (0x80 >> j)))
+            j++;
+
+        differbit = i * 8 + j;
+        break;
+    }
+    if (differbit > checkbit)
+        differbit = checkbit;
+
+    while (depth > 0 && path[depth - 1]->pub.prefix.bitlen >= differbit)
+        n = path[--depth];
+
+    cpnode_t *parent = (depth > 0) ? path[depth - 1] : NULL;
+
+    if (differbit == bitlen && n->pub.prefix.bitlen == bitlen) {
+        if (!n->glue)
+            return &n->pub;
+
+        n = cpatreplace(pt, parent, n, payload, false);
+        if (unlikely(!n))
+            return NULL;
+
+        pt->nprefs++;
+        *inserted = PREFIX_INSERTED;
+        return &n->pub;
+    }
+
+    cpnode_t *newnode = cpnodenew(prefix, bitlen, payload, false);
+    if (unlikely(!newnode))
+        return NULL;
+
+    if (n->pub.prefix.bitlen == differbit) {
+        int bit = cpatbit(prefix, n->pub.prefix.bitlen);
+
+        assert(!n->children[bit]);
+        ATOMIC_STORE_REL(n->children[bit], newnode);
+    } else if (bitlen == differbit) {
+        newnode->children[cpatbit(&n->pub.prefix, bitlen)] = n;
+        ATOMIC_STORE_REL(*cpatlinkof(pt, parent, n), newnode);
+    } else {
+        cpnode_t *glue = cpnodenew(prefix, differbit, NULL, true);
+        if (unlikely(!glue)) {
+            free(newnode);
+            return NULL;
+        }
+
+        int bit = cpatbit(prefix, differbit);
+        glue->children[bit]  = newnode;
+        glue->children[!bit] = n;
+        ATOMIC_STORE_REL(*cpatlinkof(pt, parent, n), glue);
+    }
+
+    pt->nprefs++;
+    *inserted = PREFIX_INSERTED;
+    return &newnode->pub;
+}
+
+UBGP_API void *cpatremove(cpatricia_trie_t *pt, const netaddr_t *prefix)
+{
+    uint bitlen = prefix->bitlen;
+
+    cpnode_t *parent = NULL, *grandparent = NULL;
+    cpnode_t *n = pt->head;
+    while (n && n->pub.prefix.bitlen < bitlen) {
+        grandparent = parent;
+        parent = n;
+        n = n->children[cpatbit(prefix, n->pub.prefix.bitlen)];
+    }
+
+    if (!n || n->pub.prefix.bitlen != bitlen || n->glue)
+        return NULL;
+    if (!prefixeqwithmask(&n->pub.prefix, prefix, bitlen))
+        return NULL;
+
+    void *payload = n->pub.payload;
+
+    if (n->children[0] && n->children[1]) {
+        // node is still needed to hold its children, turn it to glue
+        if (unlikely(!cpatreplace(pt, parent, n, NULL, true)))
+            return NULL;
+
+    } else if (n->children[0] || n->children[1]) {
+        cpnode_t *child = n->children[0] ? n->children[0] : n->children[1];
+
+        ATOMIC_STORE_REL(*cpatlinkof(pt, parent, n), child);
+        cpatretire(pt, n);
+
+    } else if (parent && parent->glue) {
+        // glue parent would be left with a single child, replace it with the sibling
+        cpnode_t *sibling = parent->children[parent->children[0] == n];
+
+        ATOMIC_STORE_REL(*cpatlinkof(pt, grandparent, parent), sibling);
+        cpatretire(pt, parent);
+        cpatretire(pt, n);
+
+    } else {
+        ATOMIC_STORE_REL(*cpatlinkof(pt, parent, n), NULL);
+        cpatretire(pt, n);
+    }
+
+    pt->nprefs--;
+    return payload;
+}
+
+UBGP_API trienode_t *cpatsearchexact(const cpatricia_trie_t *pt,
+                                     const netaddr_t        *prefix)
+{
+    uint bitlen = prefix->bitlen;
+
+    cpnode_t *n = ATOMIC_LOAD_ACQ(pt->head);
+    while (n && n->pub.prefix.bitlen < bitlen)
+        n = ATOMIC_LOAD_ACQ(n->children[cpatbit(prefix, n->pub.prefix.bitlen)]);
+
+    if (!n || n->pub.prefix.bitlen != bitlen || n->glue)
+        return NULL;
+    if (!prefixeqwithmask(&n->pub.prefix, prefix, bitlen))
+        return NULL;
+
+    return &n->pub;
+}
+
+UBGP_API trienode_t *cpatsearchbest(const cpatricia_trie_t *pt,
+                                    const netaddr_t        *prefix)
+{
+    uint bitlen = prefix->bitlen;
+
+    // as patsearchbest(), @prefix itself is not a match
+    cpnode_t *last = NULL;
+    cpnode_t *n = ATOMIC_LOAD_ACQ(pt->head);
+    while (n && n->pub.prefix.bitlen < bitlen) {
+        if (!prefixeqwithmask(&n->pub.prefix, prefix, n->pub.prefix.bitlen))
+            break;
+        if (!n->glue)
+            last = n;
+
+        n = ATOMIC_LOAD_ACQ(n->children[cpatbit(prefix, n->pub.prefix.bitlen)]);
+    }
+
+    return (last) ? &last->pub : NULL;
+}
+
+UBGP_API bool cpatissupernetof(const cpatricia_trie_t *pt,
+                               const netaddr_t        *prefix)
+{
+    uint bitlen = prefix->bitlen;
+
+    cpnode_t *n = ATOMIC_LOAD_ACQ(pt->head);
+    while (n && n->pub.prefix.bitlen < bitlen)
+        n = ATOMIC_LOAD_ACQ(n->children[cpatbit(prefix, n->pub.prefix.bitlen)]);
+
+    // any subtree holds at least a real node, since glue nodes have two children
+    return n && prefixeqwithmask(&n->pub.prefix, prefix, bitlen);
+}
+
+UBGP_API bool cpatissubnetof(const cpatricia_trie_t *pt,
+                             const netaddr_t        *prefix)
+{
+    uint bitlen = prefix->bitlen;
+
+    cpnode_t *n = ATOMIC_LOAD_ACQ(pt->head);
+    while (n && n->pub.prefix.bitlen < bitlen) {
+        if (!prefixeqwithmask(&n->pub.prefix, prefix, n->pub.prefix.bitlen))
+            return false;
+        if (!n->glue)
+            return true;
+
+        n = ATOMIC_LOAD_ACQ(n->children[cpatbit(prefix, n->pub.prefix.bitlen)]);
+    }
+
+    // as patissubnetof(), @prefix itself counts as a subnet
+    return n && !n->glue && n->pub.prefix.bitlen == bitlen && prefixeqwithmask(&n->pub.prefix, prefix, bitlen);
+}
+
+UBGP_API bool cpatisrelatedof(const cpatricia_trie_t *pt,
+                              const netaddr_t        *prefix)
+{
+    uint bitlen = prefix->bitlen;
+
+    cpnode_t *n = ATOMIC_LOAD_ACQ(pt->head);
+    while (n && n->pub.prefix.bitlen < bitlen) {
+        if (!prefixeqwithmask(&n->pub.prefix, prefix, n->pub.prefix.bitlen))
+            return false;
+        if (!n->glue)
+            return true;
+
+        n = ATOMIC_LOAD_ACQ(n->children[cpatbit(prefix, n->pub.prefix.bitlen)]);
+    }
+
+    return n && prefixeqwithmask(&n->pub.prefix, prefix, bitlen);
+}
@@ -0,0 +1,232 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#ifndef UBGP_CPATRICIA_TRIE_H_
+#define UBGP_CPATRICIA_TRIE_H_
+
+#include "atomics.h"
+#include "funcattribs.h"
+#include "netaddr.h"
+#include "patriciatrie.h"
+
+#include <stdint.h>
+
+/**
+ * SECTION: cpatriciatrie
+ * @title: Concurrent Patricia Trie
+ * @include: cpatriciatrie.h
+ *
+ * A (binary) Patricia Trie allowing any number of concurrent readers
+ * alongside a single writer.
+ *
+ * Readers never take locks, they enclose each lookup between
+ * cpatreadbegin() and cpatreadend(), using a reader slot obtained
+ * by cpatreaderget(). Every node returned by a lookup remains valid
+ * until the matching cpatreadend().
+ *
+ * Updates (cpatinsert() and cpatremove()) must be serialized by the
+ * caller, only a single writer may run at any time.
+ * Each update becomes visible to readers with a single pointer store,
+ * so any reader observes the trie either before or after it.
+ * Nodes unlinked by an update are reclaimed only after every reader
+ * that might still reference them has left its read section
+ * (epoch based reclamation).
+ */
+
+/**
+ * CPAT_MAX_READERS:
+ *
+ * Maximum number of reader slots available in a #cpatricia_trie_t.
+ */
+#define CPAT_MAX_READERS 64
+
+typedef struct cpnode_s cpnode_t;
+
+/**
+ * cpatricia_reader_t:
+ *
+ * A reader slot, each reader thread owns one, see cpatreaderget().
+ */
+typedef struct {
+    /*< private >*/
+    _Alignas(64) uint64_t epoch;  // 0 when outside of a read section
+    int inuse;
+} cpatricia_reader_t;
+
+/**
+ * cpatricia_trie_t:
+ *
+ * Nodes are allocated individually, since they must outlive their removal
+ * as long as readers may reference them.
+ * Removed nodes are kept in a limbo list, tagged with the epoch they were
+ * unlinked in, and free()d once every active reader announced a later epoch.
+ */
+typedef struct cpatricia_trie {
+    /*< private >*/
+    cpnode_t *head;
+    uint maxbitlen;
+    uint nprefs;
+    uint64_t epoch;
+    cpnode_t *limbo;
+    uint nlimbo;
+    cpatricia_reader_t readers[CPAT_MAX_READERS];
+} cpatricia_trie_t;
+
+UBGP_API CHECK_NONNULL(1) void cpatinit(cpatricia_trie_t *pt, sa_family_t family);
+
+/**
+ * cpatdestroy:
+ * @pt: a #cpatricia_trie_t
+ *
+ * Destroy a concurrent Patricia Trie, free()ing any allocated memory.
+ *
+ * No reader may be inside a read section while this function is called,
+ * and as for patdestroy(), any memory referenced by node `payload`s
+ * is left to the caller.
+ */
+UBGP_API CHECK_NONNULL(1) void cpatdestroy(cpatricia_trie_t *pt);
+
+/**
+ * cpatreaderget:
+ * @pt: a #cpatricia_trie_t
+ *
+ * Reserve a reader slot, may be called by any thread.
+ *
+ * Returns: a reader slot to be used with cpatreadbegin() and cpatreadend(),
+ *          %NULL if all of the #CPAT_MAX_READERS slots are taken.
+ *          The slot should be released with cpatreaderput().
+ */
+UBGP_API CHECK_NONNULL(1) cpatricia_reader_t *cpatreaderget(cpatricia_trie_t *pt);
+
+UBGP_API CHECK_NONNULL(1) void cpatreaderput(cpatricia_reader_t *r);
+
+/**
+ * cpatreadbegin:
+ * @pt: a #cpatricia_trie_t
+ * @r:  reader slot owned by the calling thread
+ *
+ * Enter a read section, the trie may be looked up until cpatreadend().
+ * Read sections should be short, since they hold back memory reclamation.
+ */
+static inline CHECK_NONNULL(1, 2) void cpatreadbegin(cpatricia_trie_t   *pt,
+                                                     cpatricia_reader_t *r)
+{
+    ATOMIC_STORE(r->epoch, ATOMIC_LOAD(pt->epoch));
+    // announcement must be visible before any node is read,
+    // pairs with the fence in cpatsynchronize()
+    ATOMIC_FENCE();
+}
+
+/**
+ * cpatreadend:
+ * @r: reader slot passed to cpatreadbegin()
+ *
+ * Leave a read section, any node obtained inside it must not be accessed
+ * anymore.
+ */
+static inline CHECK_NONNULL(1) void cpatreadend(cpatricia_reader_t *r)
+{
+    ATOMIC_STORE_REL(r->epoch, 0);
+}
+
+/**
+ * cpatinsert:
+ * @pt:       a #cpatricia_trie_t
+ * @prefix:   prefix to be inserted
+ * @payload:  payload of the newly inserted node
+ * @inserted: if not %NULL, set to %PREFIX_INSERTED or %PREFIX_ALREADY_PRESENT
+ *
+ * Insert a prefix, readers observe the new node with @payload already set.
+ * If @prefix is already present its node is returned untouched.
+ *
+ * Returns: the node holding @prefix, %NULL on out of memory.
+ */
+UBGP_API CHECK_NONNULL(1, 2) trienode_t *cpatinsert(cpatricia_trie_t *pt,
+                                                    const netaddr_t  *prefix,
+                                                    void             *payload,
+                                                    int              *inserted);
+
+/**
+ * cpatremove:
+ * @pt:     a #cpatricia_trie_t
+ * @prefix: prefix to be removed
+ *
+ * Remove a prefix, readers may still observe it until they leave their
+ * current read section, hence the returned payload must not be disposed of
+ * before cpatsynchronize().
+ *
+ * Returns: payload of the removed node, %NULL if @prefix was not found.
+ */
+UBGP_API CHECK_NONNULL(1, 2) void *cpatremove(cpatricia_trie_t *pt,
+                                              const netaddr_t  *prefix);
+
+/**
+ * cpatsynchronize:
+ * @pt: a #cpatricia_trie_t
+ *
+ * Wait until every reader has left the read sections it was into
+ * at the time of the call, then reclaim every removed node.
+ * Must only be called by the writer, outside of any read section.
+ */
+UBGP_API CHECK_NONNULL(1) void cpatsynchronize(cpatricia_trie_t *pt);
+
+/**
+ * cpatcount:
+ * @pt: a #cpatricia_trie_t
+ *
+ * Returns: number of prefixes inside @pt, only reliable for the writer.
+ */
+static inline PUREFUNC CHECK_NONNULL(1) uint cpatcount(const cpatricia_trie_t *pt)
+{
+    return pt->nprefs;
+}
+
+UBGP_API CHECK_NONNULL(1, 2)
+trienode_t *cpatsearchexact(const cpatricia_trie_t *pt, const netaddr_t *prefix);
+
+UBGP_API CHECK_NONNULL(1, 2)
+trienode_t *cpatsearchbest(const cpatricia_trie_t *pt, const netaddr_t *prefix);
+
+/**
+ * cpatissupernetof:
+ *
+ * Concurrent counterpart of patissupernetof().
+ */
+UBGP_API CHECK_NONNULL(1, 2)
+bool cpatissupernetof(const cpatricia_trie_t *pt, const netaddr_t *prefix);
+
+/**
+ * cpatissubnetof:
+ *
+ * Concurrent counterpart of patissubnetof().
+ */
+UBGP_API CHECK_NONNULL(1, 2)
+bool cpatissubnetof(const cpatricia_trie_t *pt, const netaddr_t *prefix);
+
+/**
+ * cpatisrelatedof:
+ *
+ * Concurrent counterpart of patisrelatedof().
+ */
+UBGP_API CHECK_NONNULL(1, 2)
+bool cpatisrelatedof(const cpatricia_trie_t *pt, const netaddr_t *prefix);
+
+#endif
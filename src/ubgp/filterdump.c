@@ -73,7 +73,8 @@ static const char *const vm_opstr_table[256] = {
     [FOPC_CLRTRIE6]     = "CLRTRIE6",
     [FOPC_ASCMP]        = "ASCMP",
     [FOPC_ADDRCMP]      = "ADDRCMP",
-    [FOPC_PFXCMP]       = "PFXCMP"
+    [FOPC_PFXCMP]       = "PFXCMP",
+    [FOPC_HASANYATTR]   = "HASANYATTR"
 };
 
 static const int8_t vm_oparg_table[OPCODES_COUNT] = {
@@ -110,7 +111,8 @@ static const int8_t vm_oparg_table[OPCODES_COUNT] = {
     [FOPC_CLRTRIE6]     = ARG_NONE,
     [FOPC_ASCMP]        = ARG_K,
     [FOPC_ADDRCMP]      = ARG_K,
-    [FOPC_PFXCMP]       = ARG_K
+    [FOPC_PFXCMP]       = ARG_K,
+    [FOPC_HASANYATTR]   = ARG_K
 };
 
 #define BADOPCOL  VTREDB VTWHT
@@ -239,9 +241,98 @@ static void explain_block(FILE *f, int colors, int pc, int codesiz, int blksize)
         comment(f, COMM_INFO, colors, "to line: %d", pc + blksize + 1);
 }
 
-static void prolog(FILE *f, int pc, bytecode_t code, int colors)
+static ullong totalcycles(const filter_profile_t *prof)
+{
+    ullong total = 0;
+    for (int i = 0; i < VM_OPCODES_MAX; i++)
+        total += prof->opcycles[i];
+
+    return total;
+}
+
+static double percent(ullong part, ullong total)
+{
+    return (total > 0) ? 100.0 * part / total : 0.0;
+}
+
+static void profile_columns(FILE *f, const filter_profile_t *prof, int pc, ullong total)
+{
+    ullong count  = 0;
+    ullong cycles = 0;
+    if (pc < prof->codesiz) {
+        count  = prof->count[pc];
+        cycles = prof->cycles[pc];
+    }
+
+    fprintf(f, "%12llu %14llu %8.1f %6.2f%%  ",
+               count,
+               cycles,
+               (count > 0) ? (double) cycles / count : 0.0,
+               percent(cycles, total));
+}
+
+static void profile_header(FILE *f, const filter_profile_t *prof, int colors)
+{
+    comment(f, COMM_INFO, colors, "profile: %llu runs, %llu passed, %llu failed, %llu errors",
+                                  prof->runs,
+                                  prof->passes,
+                                  prof->runs - prof->passes - prof->errors,
+                                  prof->errors);
+    fputc('\n', f);
+
+    fprintf(f, "%5s  %12s %14s %8s %7s  %s\n", "line", "count", "cycles", "avg", "cycles%", "instruction");
+}
+
+static void profile_shortcircuits(FILE *f, const filter_profile_t *prof, int pc, int colors)
+{
+    if (pc >= prof->codesiz || prof->count[pc] == 0)
+        return;
+
+    fputs("\t\t", f);
+    comment(f, COMM_INFO, colors, "short-circuits: %llu (%.2f%%)",
+                                  prof->shortcircuits[pc],
+                                  percent(prof->shortcircuits[pc], prof->count[pc]));
+}
+
+static void profile_summary(FILE *f, const filter_profile_t *prof, int colors)
+{
+    ullong total = totalcycles(prof);
+
+    fputc('\n', f);
+    comment(f, COMM_INFO, colors, "per opcode summary:");
+    fputc('\n', f);
+    for (int i = 0; i < VM_OPCODES_MAX; i++) {
+        if (prof->opcount[i] == 0)
+            continue;
+
+        const char *name = vm_opstr_table[i];
+        if (!name)
+            name = "<ILLEGAL>";
+
+        comment(f, COMM_INFO, colors, "%-12s %12llu %14llu %8.1f %6.2f%%",
+                                      name,
+                                      prof->opcount[i],
+                                      prof->opcycles[i],
+                                      (double) prof->opcycles[i] / prof->opcount[i],
+                                      percent(prof->opcycles[i], total));
+        fputc('\n', f);
+    }
+    if (prof->bloomprobes > 0) {
+        // false positive rate is relative to the prefixes missing from the trie
+        ullong misses = prof->bloomrejects + prof->bloomfalsepos;
+
+        fputc('\n', f);
+        comment(f, COMM_INFO, colors, "Bloom prefilter: %llu probes, %llu rejected, %llu false positives (%.2f%% rate)",
+                                      prof->bloomprobes,
+                                      prof->bloomrejects,
+                                      prof->bloomfalsepos,
+                                      percent(prof->bloomfalsepos, misses));
+        fputc('\n', f);
+    }
+}
+
+static void prolog(FILE *f, bytecode_t code, int colors)
 {
-    fprintf(f, "%5d: ", pc + 1);
     if (colors)
         fputs(HEXCOL, f);
 
@@ -334,20 +425,39 @@ void filter_dump(FILE *f, filter_vm_t *vm)
     bool colors = isvt100tty(fileno(f));
     int exarg = 0;
 
-    for (int pc = 0; pc < vm->codesiz; pc++) {
-        bytecode_t ip = vm->code[pc];
+    // annotate instructions if we have some profile data
+    const filter_profile_t *prof = vm->ctx.prof;
+    if (prof && prof->runs == 0)
+        prof = NULL;
+
+    ullong total = 0;
+    if (prof) {
+        total = totalcycles(prof);
+        profile_header(f, prof, colors);
+    }
+
+    for (int pc = 0; pc < vm->prog.codesiz; pc++) {
+        bytecode_t ip = vm->prog.code[pc];
 
         const char *name = vm_opstr_table[vm_getopcode(ip)];
 
-        prolog(f, pc, ip, colors);
+        fprintf(f, "%5d: ", pc + 1);
+        if (prof)
+            profile_columns(f, prof, pc, total);
+
+        prolog(f, ip, colors);
         fputc(' ', f);
 
         bool consumed = false;
         if (name)
-            consumed = printop(f, pc, vm->codesiz, ip, name, exarg, colors);
+            consumed = printop(f, pc, vm->prog.codesiz, ip, name, exarg, colors);
         else
             printbad(f, ip, colors);
 
+        int opcode = vm_getopcode(ip);
+        if (prof && (opcode == FOPC_CPASS || opcode == FOPC_CFAIL))
+            profile_shortcircuits(f, prof, pc, colors);
+
         fputc('\n', f);
 
         if (ip == FOPC_EXARG) {
@@ -357,5 +467,7 @@ void filter_dump(FILE *f, filter_vm_t *vm)
         if (consumed)
             exarg = 0;
     }
-}
 
+    if (prof)
+        profile_summary(f, prof, colors);
+}
@@ -32,7 +32,7 @@ enum {
     PATRICIA_GROW_STEP = 2
 };
 
-UBGP_API void vm_growstack(filter_vm_t *vm)
+UBGP_API void vm_growstack(filter_ctx_t *vm)
 {
     stack_cell_t *stk = NULL;
     if (vm->sp != vm->stackbuf)
@@ -50,57 +50,57 @@ UBGP_API void vm_growstack(filter_vm_t *vm)
     vm->stacksiz = stacksiz;
 }
 
-UBGP_API bool vm_growcode(filter_vm_t *vm)
+UBGP_API bool vm_growcode(filter_prog_t *prog)
 {
-    ushort codesiz   = vm->maxcode + CODE_GROW_STEP;
-    bytecode_t *code = realloc(vm->code, codesiz * sizeof(*code));
+    ushort codesiz   = prog->maxcode + CODE_GROW_STEP;
+    bytecode_t *code = realloc(prog->code, codesiz * sizeof(*code));
     if (unlikely(!code))
         return false;
 
-    vm->code    = code;
-    vm->maxcode = codesiz;
+    prog->code    = code;
+    prog->maxcode = codesiz;
     return true;
 }
 
-UBGP_API bool vm_growk(filter_vm_t *vm)
+UBGP_API bool vm_growk(filter_prog_t *prog)
 {
-    ushort ksiz = vm->maxk + K_GROW_STEP;
+    ushort ksiz = prog->maxk + K_GROW_STEP;
     stack_cell_t *k = NULL;
-    if (k != vm->kbuf)
-        k = vm->kp;
+    if (prog->kp != prog->kbuf)
+        k = prog->kp;
 
     k = realloc(k, ksiz * sizeof(*k));
     if (unlikely(!k))
         return false;
 
-    if (vm->kp == vm->kbuf)
-        memcpy(k, vm->kp, sizeof(vm->kbuf));
+    if (prog->kp == prog->kbuf)
+        memcpy(k, prog->kp, sizeof(prog->kbuf));
 
-    vm->kp   = k;
-    vm->maxk = ksiz;
+    prog->kp   = k;
+    prog->maxk = ksiz;
     return true;
 }
 
-UBGP_API bool vm_growtrie(filter_vm_t *vm)
+UBGP_API bool vm_growtrie(filter_prog_t *prog)
 {
     patricia_trie_t *tries = NULL;
-    if (vm->tries != vm->triebuf)
-        tries = vm->tries;
+    if (prog->tries != prog->triebuf)
+        tries = prog->tries;
 
-    ushort ntries = vm->maxtries + PATRICIA_GROW_STEP;
+    ushort ntries = prog->maxtries + PATRICIA_GROW_STEP;
     tries = realloc(tries, ntries * sizeof(*tries));
     if (unlikely(!tries))
         return false;
 
-    if (vm->tries == vm->triebuf)
-        memcpy(tries, vm->tries, sizeof(vm->triebuf));
+    if (prog->tries == prog->triebuf)
+        memcpy(tries, prog->tries, sizeof(prog->triebuf));
 
-    vm->tries    = tries;
-    vm->maxtries = ntries;
+    prog->tries    = tries;
+    prog->maxtries = ntries;
     return true;
 }
 
-UBGP_API void vm_exec_unpack(filter_vm_t *vm)
+UBGP_API void vm_exec_unpack(filter_ctx_t *vm)
 {
     stack_cell_t *cell = vm_pop(vm);
     vm_check_array(vm, cell);
@@ -118,68 +118,39 @@ UBGP_API void vm_exec_unpack(filter_vm_t *vm)
     }
 }
 
-UBGP_API void vm_exec_hasattr(filter_vm_t *vm, int code)
+UBGP_API void vm_exec_hasattr(filter_ctx_t *vm, int code)
 {
     if (getbgptype(vm->bgp) != BGP_UPDATE)
         vm_abort(vm, VM_PACKET_MISMATCH);
 
     vm_exec_settle(vm);
 
-    // optimize notable attributes
-    bgpattr_t *ptr = NULL;
-    switch (code) {
-    case ORIGIN_CODE:
-        ptr = getbgporigin(vm->bgp);
-        break;
-    case NEXT_HOP_CODE:
-        ptr = getbgpnexthop(vm->bgp);
-        break;
-    case AGGREGATOR_CODE:
-        ptr = getbgpaggregator(vm->bgp);
-        break;
-    case AS4_AGGREGATOR_CODE:
-        ptr = getbgpas4aggregator(vm->bgp);
-        break;
-    case ATOMIC_AGGREGATE_CODE:
-        ptr = getbgpatomicaggregate(vm->bgp);
-        break;
-    case AS_PATH_CODE:
-        ptr = getbgpaspath(vm->bgp);
-        break;
-    case AS4_PATH_CODE:
-        ptr = getbgpas4path(vm->bgp);
-        break;
-    case MP_REACH_NLRI_CODE:
-        ptr = getbgpmpreach(vm->bgp);
-        break;
-    case MP_UNREACH_NLRI_CODE:
-        ptr = getbgpmpunreach(vm->bgp);
-        break;
-    case COMMUNITY_CODE:
-        ptr = getbgpcommunities(vm->bgp);
-        break;
-    case EXTENDED_COMMUNITY_CODE:
-        ptr = getbgpexcommunities(vm->bgp);
-        break;
-    case LARGE_COMMUNITY_CODE:
-        ptr = getbgplargecommunities(vm->bgp);
-        break;
-    default:
-        // no luck, plain iteration
-        startbgpattribs(vm->bgp);
-        while ((ptr = nextbgpattrib(vm->bgp)) != NULL) {
-            if (ptr->code == code)
-                break;
-        }
-        endbgpattribs(vm->bgp);
-    }
+    // every attribute is indexed on first access, no iteration required
+    bgpattr_t *ptr = getbgpattrib(vm->bgp, code);
 
     assert(ptr == NULL || ptr->code == code);
 
     vm_pushvalue(vm, ptr != NULL);
 }
 
-UBGP_API void vm_prepare_addr_access(filter_vm_t *vm, ushort mode)
+UBGP_API void vm_exec_hasanyattr(filter_ctx_t *vm, int kidx)
+{
+    if (getbgptype(vm->bgp) != BGP_UPDATE)
+        vm_abort(vm, VM_PACKET_MISMATCH);
+    if (unlikely((uint) kidx >= vm->prog->ksiz))
+        vm_abort(vm, VM_K_UNDEFINED);
+
+    const stack_cell_t *cell = vm_getk(vm, kidx);
+    if (unlikely(cell->elsiz != sizeof(uint64_t) || cell->nels != BGP_ATTRMASK_WORDS))
+        vm_abort(vm, VM_BAD_ARRAY);
+
+    vm_check_array(vm, cell);
+    vm_exec_settle(vm);
+
+    vm_pushvalue(vm, hasanybgpattrib(vm->bgp, vm_heap_ptr(vm, cell->base)));
+}
+
+UBGP_API void vm_prepare_addr_access(filter_ctx_t *vm, ushort mode)
 {
     if (mode & FOPC_ACCESS_SETTLE)
         vm_exec_settle(vm);
@@ -212,7 +183,7 @@ UBGP_API void vm_prepare_addr_access(filter_vm_t *vm, ushort mode)
     vm->access_mask = mode;
 }
 
-UBGP_API void vm_prepare_as_access(filter_vm_t *vm, ushort mode)
+UBGP_API void vm_prepare_as_access(filter_ctx_t *vm, ushort mode)
 {
     if (mode & FOPC_ACCESS_SETTLE)
         vm_exec_settle(vm);
@@ -239,156 +210,138 @@ UBGP_API void vm_prepare_as_access(filter_vm_t *vm, ushort mode)
     vm->access_mask = mode;
 }
 
-UBGP_API void vm_exec_exact(filter_vm_t *vm, uint access)
+UBGP_API size_t vm_decode_pfxs(filter_ctx_t *vm, uint access)
 {
-    if (getbgptype(vm->bgp) != BGP_UPDATE)
-        vm_abort(vm, VM_PACKET_MISMATCH);
+    size_t (*getall)(ubgp_msg_s *, netaddrap_t *, size_t) = (access & FOPC_ACCESS_NLRI) ?
+                                                            getallnlri :
+                                                            getallwithdrawn;
 
-    vm_prepare_addr_access(vm, access);
+    size_t n = getall(vm->bgp, vm->pfxs, vm->pfxsiz);
+    if (unlikely(n > vm->pfxsiz)) {
+        netaddrap_t *pfxs = NULL;
+        if (vm->pfxs != vm->pfxbuf)
+            pfxs = vm->pfxs;
 
-    bool result = false;
-    while (true) {
-        netaddr_t *addr = (access & FOPC_ACCESS_NLRI) ?
-                          nextnlri(vm->bgp) :
-                          nextwithdrawn(vm->bgp);
-        if (!addr)
-            break;
+        pfxs = realloc(pfxs, n * sizeof(*pfxs));
+        if (unlikely(!pfxs))
+            vm_abort(vm, VM_OUT_OF_MEMORY);
 
-        patricia_trie_t *trie = vm->curtrie;
-        switch (addr->family) {
-        case AF_INET6:
-            trie = vm->curtrie6;
-            // fallthrough
-        case AF_INET:
-            if (patsearchexact(trie, addr)) {
-                result = true;
-                goto done;
-            }
+        vm->pfxs   = pfxs;
+        vm->pfxsiz = n;
 
-            break;
-        default:
-            vm_abort(vm, VM_SURPRISING_BYTES);  // should never happen
-            break;
-        }
+        n = getall(vm->bgp, vm->pfxs, vm->pfxsiz);
     }
 
-done:
-    vm_pushvalue(vm, result);
+    return n;
 }
 
-UBGP_API void vm_exec_subnet(filter_vm_t *vm, uint access)
+static bool patisexactof(const patricia_trie_t *pt, const netaddr_t *prefix)
 {
-    if (getbgptype(vm->bgp) != BGP_UPDATE)
-        vm_abort(vm, VM_PACKET_MISMATCH);
-
-    vm_prepare_addr_access(vm, access);
-
-    bool result = false;
-    while (true) {
-        netaddr_t *addr = (access & FOPC_ACCESS_NLRI) ?
-                          nextnlri(vm->bgp) :
-                          nextwithdrawn(vm->bgp);
-        if (!addr)
-            break;
-
-        patricia_trie_t *trie = vm->curtrie;
-        switch (addr->family) {
-        case AF_INET6:
-            trie = vm->curtrie6;
-            // fallthrough
-        case AF_INET:
-            if (patissubnetof(trie, addr)) {
-                result = true;
-                goto done;
-            }
+    return patsearchexact(pt, prefix) != NULL;
+}
 
-            break;
-        default:
-            vm_abort(vm, VM_SURPRISING_BYTES);  // should never happen
-            break;
-        }
+// exact matches are prefiltered by the trie Bloom filter, if any
+static inline bool vm_match_exact(filter_ctx_t          *vm,
+                                  const patricia_trie_t *trie,
+                                  const netaddr_t       *addr)
+{
+    bool maybe = patmaybeexact(trie, addr);
+    bool found = maybe && patsearchexact(trie, addr) != NULL;
+
+    filter_profile_t *prof = vm->prof;
+    if (unlikely(prof) && trie->bloom) {
+        prof->bloomprobes++;
+        prof->bloomrejects  += !maybe;
+        prof->bloomfalsepos += maybe && !found;
     }
+    return found;
+}
 
-done:
-    vm_pushvalue(vm, result);
+static inline bool vm_match_addr(filter_ctx_t     *vm,
+                                 const netaddr_t  *addr,
+                                 bool            (*match)(const patricia_trie_t *, const netaddr_t *))
+{
+    patricia_trie_t *trie = vm->curtrie;
+    switch (addr->family) {
+    case AF_INET6:
+        trie = vm->curtrie6;
+        // fallthrough
+    case AF_INET:
+        if (match == patisexactof)
+            return vm_match_exact(vm, trie, addr);
+
+        return match(trie, addr);
+    default:
+        vm_abort(vm, VM_SURPRISING_BYTES);  // should never happen
+        return false;
+    }
 }
 
-UBGP_API void vm_exec_supernet(filter_vm_t *vm, uint access)
+static inline void vm_exec_pfxmatch(filter_ctx_t  *vm,
+                                    uint           access,
+                                    bool         (*match)(const patricia_trie_t *, const netaddr_t *))
 {
     if (getbgptype(vm->bgp) != BGP_UPDATE)
         vm_abort(vm, VM_PACKET_MISMATCH);
 
-    vm_prepare_addr_access(vm, access);
-
     bool result = false;
-    while (true) {
-        netaddr_t *addr = (access & FOPC_ACCESS_NLRI) ?
-                    nextnlri(vm->bgp) :
-                    nextwithdrawn(vm->bgp);
-        if (!addr)
-            break;
 
-        patricia_trie_t *trie = vm->curtrie;
-        switch (addr->family) {
-        case AF_INET6:
-            trie = vm->curtrie6;
-            // fallthrough
-        case AF_INET:
-            if (patissupernetof(trie, addr)) {
+    // a settling access always starts a new iteration that no later
+    // accessor may resume, so decode every prefix at once
+    if ((access & (FOPC_ACCESS_SETTLE | FOPC_ACCESS_ALL)) == (FOPC_ACCESS_SETTLE | FOPC_ACCESS_ALL)) {
+        vm_exec_settle(vm);
+        vm->access_mask = 0;
+
+        size_t n = vm_decode_pfxs(vm, access);
+        for (size_t i = 0; i < n; i++) {
+            if (vm_match_addr(vm, &vm->pfxs[i].pfx, match)) {
                 result = true;
-                goto done;
+                break;
             }
-
-            break;
-        default:
-            vm_abort(vm, VM_SURPRISING_BYTES);  // should never happen
-            break;
         }
-    }
-
-done:
-    vm_pushvalue(vm, result);
-}
 
-
-UBGP_API void vm_exec_related(filter_vm_t *vm, uint access)
-{
-    if (getbgptype(vm->bgp) != BGP_UPDATE)
-        vm_abort(vm, VM_PACKET_MISMATCH);
+        vm_pushvalue(vm, result);
+        return;
+    }
 
     vm_prepare_addr_access(vm, access);
-
-    bool result = false;
     while (true) {
         netaddr_t *addr = (access & FOPC_ACCESS_NLRI) ?
-                    nextnlri(vm->bgp) :
-                    nextwithdrawn(vm->bgp);
+                          nextnlri(vm->bgp) :
+                          nextwithdrawn(vm->bgp);
         if (!addr)
             break;
 
-        patricia_trie_t *trie = vm->curtrie;
-        switch (addr->family) {
-        case AF_INET6:
-            trie = vm->curtrie6;
-            // fallthrough
-        case AF_INET:
-            if (patisrelatedof(trie, addr)) {
-                result = true;
-                goto done;
-            }
-
-            break;
-        default:
-            vm_abort(vm, VM_SURPRISING_BYTES);  // should never happen
+        if (vm_match_addr(vm, addr, match)) {
+            result = true;
             break;
         }
     }
 
-done:
     vm_pushvalue(vm, result);
 }
 
-UBGP_API void vm_exec_aspmatch(filter_vm_t *vm, uint access)
+UBGP_API void vm_exec_exact(filter_ctx_t *vm, uint access)
+{
+    vm_exec_pfxmatch(vm, access, patisexactof);
+}
+
+UBGP_API void vm_exec_subnet(filter_ctx_t *vm, uint access)
+{
+    vm_exec_pfxmatch(vm, access, patissubnetof);
+}
+
+UBGP_API void vm_exec_supernet(filter_ctx_t *vm, uint access)
+{
+    vm_exec_pfxmatch(vm, access, patissupernetof);
+}
+
+UBGP_API void vm_exec_related(filter_ctx_t *vm, uint access)
+{
+    vm_exec_pfxmatch(vm, access, patisrelatedof);
+}
+
+UBGP_API void vm_exec_aspmatch(filter_ctx_t *vm, uint access)
 {
     if (getbgptype(vm->bgp) != BGP_UPDATE)
         vm_abort(vm, VM_PACKET_MISMATCH);
@@ -433,7 +386,7 @@ UBGP_API void vm_exec_aspmatch(filter_vm_t *vm, uint access)
     }
 }
 
-UBGP_API void vm_exec_aspstarts(filter_vm_t *vm, uint access)
+UBGP_API void vm_exec_aspstarts(filter_ctx_t *vm, uint access)
 {
     if (getbgptype(vm->bgp) != BGP_UPDATE)
         vm_abort(vm, VM_PACKET_MISMATCH);
@@ -455,7 +408,7 @@ UBGP_API void vm_exec_aspstarts(filter_vm_t *vm, uint access)
     vm->sp[vm->si++].value = value;
 }
 
-UBGP_API void vm_exec_aspends(filter_vm_t *vm, uint access)
+UBGP_API void vm_exec_aspends(filter_ctx_t *vm, uint access)
 {
     if (getbgptype(vm->bgp) != BGP_UPDATE)
         vm_abort(vm, VM_PACKET_MISMATCH);
@@ -495,7 +448,7 @@ UBGP_API void vm_exec_aspends(filter_vm_t *vm, uint access)
     vm->sp[vm->si++].value = (i == n);
 }
 
-UBGP_API void vm_exec_aspexact(filter_vm_t *vm, uint access)
+UBGP_API void vm_exec_aspexact(filter_ctx_t *vm, uint access)
 {
     if (getbgptype(vm->bgp) != BGP_UPDATE)
         vm_abort(vm, VM_PACKET_MISMATCH);
@@ -520,7 +473,7 @@ UBGP_API void vm_exec_aspexact(filter_vm_t *vm, uint access)
     vm->sp[vm->si++].value = value;
 }
 
-UBGP_API void vm_exec_commexact(filter_vm_t *vm)
+UBGP_API void vm_exec_commexact(filter_ctx_t *vm)
 {
     if (getbgptype(vm->bgp) != BGP_UPDATE)
         vm_abort(vm, VM_PACKET_MISMATCH);
@@ -554,7 +507,7 @@ UBGP_API void vm_exec_commexact(filter_vm_t *vm)
     vm->sp[vm->si++].value = value;
 }
 
-UBGP_API void vm_emit_ex(filter_vm_t *vm, int opcode, int idx)
+UBGP_API void vm_emit_ex(filter_prog_t *prog, int opcode, int idx)
 {
     // NOTE: paranoid, assumes 8 bit bytes... as the whole ubgp does
 
@@ -569,85 +522,68 @@ UBGP_API void vm_emit_ex(filter_vm_t *vm, int opcode, int idx)
 
     // emit value most-significant byte first
     while (msb > 0) {
-        vm_emit(vm, vm_makeop(FOPC_EXARG, (idx >> msb) & 0xff));
+        vm_emit(prog, vm_makeop(FOPC_EXARG, (idx >> msb) & 0xff));
         msb -= 8;
     }
     // emit the instruction with the least-signficiant byte
-    vm_emit(vm, vm_makeop(opcode, idx & 0xff));
+    vm_emit(prog, vm_makeop(opcode, idx & 0xff));
 }
 
-static void *vm_heap_ensure(filter_vm_t *vm, size_t aligned_size)
+static void *vm_heap_ensure(void   **pheap,
+                            uint    *pheapsiz,
+                            size_t   used,
+                            size_t   aligned_size)
 {
-    size_t used = vm->highwater;
-    used += vm->dynmarker;
-    if (likely(vm->heapsiz - used >= aligned_size))
-        return vm->heap;
+    if (likely(*pheapsiz - used >= aligned_size))
+        return *pheap;
 
     aligned_size += used;
     aligned_size += HEAP_GROW_STEP;
-    void *heap = realloc(vm->heap, aligned_size);
+    void *heap = realloc(*pheap, aligned_size);
     if (unlikely(!heap))
         return NULL;
 
-    vm->heap    = heap;
-    vm->heapsiz = aligned_size;
+    *pheap    = heap;
+    *pheapsiz = aligned_size;
     return heap;
 }
 
-UBGP_API intptr_t vm_heap_alloc(filter_vm_t    *vm,
-                                size_t          size,
-                                vm_heap_zone_t  zone)
+UBGP_API intptr_t vm_heap_alloc(filter_prog_t *prog, size_t size)
 {
     // align allocation
     size += sizeof(max_align_t) - 1;
     size -= (size & (sizeof(max_align_t) - 1));
 
-    intptr_t ptr;
-    if (unlikely(!vm_heap_ensure(vm, size)))
+    void *heap = vm_heap_ensure(&prog->heap, &prog->heapsiz,
+                                prog->highwater, size);
+    if (unlikely(!heap))
         return VM_BAD_HEAP_PTR;
 
-    switch (zone) {
-    case VM_HEAP_PERM:
-        if (unlikely(vm->dynmarker > 0)) {
-            assert(false);
-            return VM_BAD_HEAP_PTR; // illegal!
-        }
-
-        ptr = vm->highwater;
-        vm->highwater += size;
-        return ptr;
-
-    case VM_HEAP_TEMP:
-        ptr = vm->highwater;
-        ptr += vm->dynmarker;
-
-        vm->dynmarker += size;
-        return ptr;
-
-    default:
-        // should never happen
-        assert(false);
-        return VM_BAD_HEAP_PTR;
-    }
+    intptr_t ptr = prog->highwater;
+    prog->highwater += size;
+    return ptr;
 }
 
-UBGP_API intptr_t vm_heap_grow(filter_vm_t *vm, intptr_t addr, size_t newsize)
+UBGP_API intptr_t vm_heap_grow(filter_ctx_t *vm, intptr_t addr, size_t newsize)
 {
     newsize += sizeof(max_align_t) - 1;
     newsize -= (newsize & (sizeof(max_align_t) - 1));
 
+    // temporary chunks live past the program permanent zone
+    size_t highwater = vm->prog->highwater;
     if (addr == 0)
-        addr = vm->highwater; // never did a VM_HEAP_TEMP alloc before
+        addr = highwater; // never did a temporary alloc before
 
-    size_t oldsize = vm->highwater + vm->dynmarker - addr;
+    size_t oldsize = highwater + vm->dynmarker - addr;
     if (unlikely(newsize < oldsize))
         return addr;
 
     size_t amount = newsize - oldsize;
-    if (unlikely(!vm_heap_ensure(vm, amount)))
+    void *heap = vm_heap_ensure(&vm->heap, &vm->heapsiz,
+                                vm->dynmarker, amount);
+    if (unlikely(!heap))
         return VM_BAD_HEAP_PTR;
 
     vm->dynmarker += amount;
     return addr;
 }
-
@@ -56,6 +56,9 @@
  * @FOPC_CFAIL:    POP - pops topmost stack element and terminates with FAIL if value is %false.
  * @FOPC_SETTLE:   NONE - forcefully close an iteration sequence
  * @FOPC_HASATTR:  push %true if attribute is present, %false otherwise.
+ * @FOPC_HASANYATTR: push %true if any attribute in a set is present, %false otherwise,
+ *                 the set is a constant array of %BGP_ATTRMASK_WORDS 64 bits words,
+ *                 see hasanybgpattrib().
  * @FOPC_EXACT:    pops the entire stack and verifies that at least one *address* has an *exact* relationship with
  *                 the addresses stored inside the current tries, pushes a boolean result.
  *                 This opcode expects that the entire stack is composed of cells containing #netaddr_t.
@@ -118,6 +121,7 @@ enum {
     FOPC_PFXCMP,
     FOPC_ADDRCMP,
     FOPC_ASCMP,
+    FOPC_HASANYATTR,
 
     OPCODES_COUNT
 };
@@ -142,7 +146,7 @@ enum {
 
 /**
  * vm_growstack:
- * @vm: an initialized #filter_vm_t.
+ * @vm: an initialized #filter_ctx_t.
  *
  * Grow @vm stack segment.
  *
@@ -150,43 +154,43 @@ enum {
  * hence it doesn't return a value on failure, but rather
  * triggers vm_abort().
  */
-UBGP_API CHECK_NONNULL(1) void vm_growstack(filter_vm_t *vm);
+UBGP_API CHECK_NONNULL(1) void vm_growstack(filter_ctx_t *vm);
 
 /**
  * vm_growcode:
- * @vm: an initialized #filter_vm_t.
+ * @prog: an initialized #filter_prog_t.
  *
- * Grow @vm bytecode instructions segment.
+ * Grow @prog bytecode instructions segment.
  *
  * Returns: %true on success, %false on out of memory.
- * On failure @vm is left unchanged.
+ * On failure @prog is left unchanged.
  */
-UBGP_API CHECK_NONNULL(1) bool vm_growcode(filter_vm_t *vm);
+UBGP_API CHECK_NONNULL(1) bool vm_growcode(filter_prog_t *prog);
 
 /**
  * vm_growk:
- * @vm: an initialized #filter_vm_t.
+ * @prog: an initialized #filter_prog_t.
  *
- * Grow @vm constant segment.
+ * Grow @prog constant segment.
  *
  * Returns: %true on success, %false on out of memory.
- * On failure @vm is left unchanged.
+ * On failure @prog is left unchanged.
  */
-UBGP_API CHECK_NONNULL(1) bool vm_growk(filter_vm_t *vm);
+UBGP_API CHECK_NONNULL(1) bool vm_growk(filter_prog_t *prog);
 
 /**
  * vm_growtrie:
- * @vm: an initialized #filter_vm_t.
+ * @prog: an initialized #filter_prog_t.
  *
- * Grow @vm allocated PATRICIA trie segment.
+ * Grow @prog allocated PATRICIA trie segment.
  *
  * Returns: %true on success, %false on out of memory.
- * On failure @vm is left unchanged.
+ * On failure @prog is left unchanged.
  */
-UBGP_API CHECK_NONNULL(1) bool vm_growtrie(filter_vm_t *vm);
+UBGP_API CHECK_NONNULL(1) bool vm_growtrie(filter_prog_t *prog);
 
-static inline noreturn CHECK_NONNULL(1) void vm_abort(filter_vm_t *vm,
-                                                      int          error)
+static inline noreturn CHECK_NONNULL(1) void vm_abort(filter_ctx_t *vm,
+                                                      int           error)
 {
     vm->error = error;
     longjmp(vm->except, -1);
@@ -213,66 +217,160 @@ static inline int vm_extendarg(int arg, int exarg)
 }
 
 /// @brief Reserve one constant (avoids the user custom section).
-static inline CHECK_NONNULL(1) int vm_newk(filter_vm_t *vm)
+static inline CHECK_NONNULL(1) int vm_newk(filter_prog_t *prog)
 {
-    if (unlikely(vm->ksiz == vm->maxk)) {
-        if (unlikely(!vm_growk(vm)))
+    if (unlikely(prog->ksiz == prog->maxk)) {
+        if (unlikely(!vm_growk(prog)))
             return -1;
     }
-    return vm->ksiz++;
+    return prog->ksiz++;
 }
 
-static inline int vm_newtrie(filter_vm_t *vm, sa_family_t family)
+static inline int vm_newtrie(filter_prog_t *prog, sa_family_t family)
 {
-    if (unlikely(vm->ntries == vm->maxtries)) {
-        if (unlikely(!vm_growtrie(vm)))
+    if (unlikely(prog->ntries == prog->maxtries)) {
+        if (unlikely(!vm_growtrie(prog)))
             return -1;
     }
 
-    int idx = vm->ntries++;
-    patinit(&vm->tries[idx], family);
+    int idx = prog->ntries++;
+    patinit(&prog->tries[idx], family);
     return idx;
 }
 
+// Whether an instruction writes the temporary tries, valid CALL arguments
+// are below VM_FUNCS_COUNT, so they never need an EXARG.
+static inline bool vm_writestries(bytecode_t opcode)
+{
+    switch (vm_getopcode(opcode)) {
+    case FOPC_STORE:
+    case FOPC_DISCARD:
+    case FOPC_CLRTRIE:
+    case FOPC_CLRTRIE6:
+        return true;
+
+    case FOPC_CALL:
+        switch (vm_getarg(opcode)) {
+        case VM_WITHDRAWN_INSERT_FN:
+        case VM_ALL_WITHDRAWN_INSERT_FN:
+        case VM_NLRI_INSERT_FN:
+        case VM_ALL_NLRI_INSERT_FN:
+            return true;
+
+        default:
+            return false;
+        }
+
+    default:
+        return false;
+    }
+}
+
 /**
  * vm_emit:
- * @vm:     an inactive #filter_vm_t
+ * @prog:   a #filter_prog_t being compiled
  * @opcode: an instruction
  *
- * Emit one bytecode operation.
+ * Emit one bytecode operation, and record whether @prog writes
+ * the temporary tries, which keeps it out of bgp_filter_batch()
+ * column-wise execution.
  *
  * Returns: %true on success, %false on out of memory.
  */
-static inline bool vm_emit(filter_vm_t *vm, bytecode_t opcode)
+static inline bool vm_emit(filter_prog_t *prog, bytecode_t opcode)
 {
-    if (unlikely(vm->codesiz == vm->maxcode)) {
-        if (unlikely(!vm_growcode(vm)))
+    if (unlikely(prog->codesiz == prog->maxcode)) {
+        if (unlikely(!vm_growcode(prog)))
             return false;
     }
 
-    vm->code[vm->codesiz++] = opcode;
+    prog->code[prog->codesiz++] = opcode;
+    prog->writestries |= vm_writestries(opcode);
     return true;
 }
 
-UBGP_API CHECK_NONNULL(1) void vm_emit_ex(filter_vm_t *vm,
-                                          int          opcode,
-                                          int          idx);
+UBGP_API CHECK_NONNULL(1) void vm_emit_ex(filter_prog_t *prog,
+                                          int            opcode,
+                                          int            idx);
 
-// Virtual Machine dynamic memory:
+/**
+ * vm_getk:
+ * @vm:   a #filter_ctx_t in execution mode
+ * @kidx: constant index, must be in bounds
+ *
+ * Resolve a constant, indexes lower than %KBASESIZ refer to the
+ * known variables stored inside @vm, the others to the program constants.
+ */
+static inline CHECK_NONNULL(1) stack_cell_t *vm_getk(filter_ctx_t *vm,
+                                                     int           kidx)
+{
+    if (kidx < KBASESIZ)
+        return &vm->known[kidx];
 
-typedef enum { VM_HEAP_PERM, VM_HEAP_TEMP } vm_heap_zone_t;
+    return &vm->prog->kp[kidx];
+}
+
+/**
+ * vm_gettrie:
+ * @vm:  a #filter_ctx_t in execution mode
+ * @idx: trie index, must be in bounds
+ *
+ * Resolve a trie, %VM_TMPTRIE and %VM_TMPTRIE6 refer to the temporary
+ * tries owned by @vm, the others to the program tries.
+ */
+static inline CHECK_NONNULL(1) patricia_trie_t *vm_gettrie(filter_ctx_t *vm,
+                                                           int           idx)
+{
+    if (idx <= VM_TMPTRIE6)
+        return &vm->tmptries[idx];
+
+    return &vm->prog->tries[idx];
+}
+
+/**
+ * vm_writabletrie:
+ * @vm:   a #filter_ctx_t in execution mode
+ * @trie: trie about to be modified
+ *
+ * Program tries are shared by every context running the program,
+ * abort with %VM_TRIE_READONLY unless @trie is a temporary trie of @vm.
+ */
+static inline CHECK_NONNULL(1, 2) patricia_trie_t *vm_writabletrie(filter_ctx_t    *vm,
+                                                                  patricia_trie_t *trie)
+{
+    if (unlikely(trie != &vm->tmptries[VM_TMPTRIE] &&
+                 trie != &vm->tmptries[VM_TMPTRIE6]))
+        vm_abort(vm, VM_TRIE_READONLY);
+
+    return trie;
+}
+
+// Virtual Machine dynamic memory:
+//
+// The heap address space is shared between the program and the context,
+// offsets below the program high water mark refer to the permanent
+// program heap, allocated at compile time by vm_heap_alloc(), the rest
+// refer to the temporary context heap, allocated by vm_heap_grow()
+// during execution.
 
 #define VM_BAD_HEAP_PTR -1
 
-UBGP_API CHECK_NONNULL(1) intptr_t vm_heap_alloc(filter_vm_t    *vm,
-                                                 size_t          size,
-                                                 vm_heap_zone_t  zone);
+UBGP_API CHECK_NONNULL(1) intptr_t vm_heap_alloc(filter_prog_t *prog,
+                                                 size_t         size);
+
+static inline CHECK_NONNULL(1) void *vm_prog_heap_ptr(const filter_prog_t *prog,
+                                                      intptr_t             offset)
+{
+    assert(offset >= 0 && (size_t) offset < prog->highwater);
+
+    return (byte *) prog->heap + offset;
+}
 
 /**
- * Only valid for the last allocated %VM_HEAP_TEMP chunk!!!
+ * Only valid for the last temporary chunk allocated by vm_heap_grow()!!!
  */
-static inline CHECK_NONNULL(1) void vm_heap_return(filter_vm_t* vm,
-                                                   size_t       size)
+static inline CHECK_NONNULL(1) void vm_heap_return(filter_ctx_t *vm,
+                                                   size_t        size)
 {
     // align allocation
     size += sizeof(max_align_t) - 1;
@@ -284,21 +382,21 @@ static inline CHECK_NONNULL(1) void vm_heap_return(filter_vm_t* vm,
 }
 
 /**
- * Only valid for the last allocated %VM_HEAP_TEMP chunk!!!
+ * Only valid for the last temporary chunk allocated by vm_heap_grow()!!!
  */
-UBGP_API CHECK_NONNULL(1) intptr_t vm_heap_grow(filter_vm_t *vm,
-                                                intptr_t     addr,
-                                                size_t       newsize);
+UBGP_API CHECK_NONNULL(1) intptr_t vm_heap_grow(filter_ctx_t *vm,
+                                                intptr_t      addr,
+                                                size_t        newsize);
 
 
 // General Virtual Machine operations:
 
-static inline CHECK_NONNULL(1) void vm_clearstack(filter_vm_t *vm)
+static inline CHECK_NONNULL(1) void vm_clearstack(filter_ctx_t *vm)
 {
     vm->si = 0;
 }
 
-static inline CHECK_NONNULL(1) stack_cell_t *vm_peek(filter_vm_t *vm)
+static inline CHECK_NONNULL(1) stack_cell_t *vm_peek(filter_ctx_t *vm)
 {
     if (unlikely(vm->si == 0))
         vm_abort(vm, VM_STACK_UNDERFLOW);
@@ -306,7 +404,7 @@ static inline CHECK_NONNULL(1) stack_cell_t *vm_peek(filter_vm_t *vm)
     return &vm->sp[vm->si - 1];
 }
 
-static inline CHECK_NONNULL(1) stack_cell_t *vm_pop(filter_vm_t *vm)
+static inline CHECK_NONNULL(1) stack_cell_t *vm_pop(filter_ctx_t *vm)
 {
     if (unlikely(vm->si == 0))
         vm_abort(vm, VM_STACK_UNDERFLOW);
@@ -314,7 +412,7 @@ static inline CHECK_NONNULL(1) stack_cell_t *vm_pop(filter_vm_t *vm)
     return &vm->sp[--vm->si];
 }
 
-static inline CHECK_NONNULL(1, 2) void vm_push(filter_vm_t        *vm,
+static inline CHECK_NONNULL(1, 2) void vm_push(filter_ctx_t       *vm,
                                                const stack_cell_t *cell)
 {
     if (unlikely(vm->si == vm->stacksiz))
@@ -323,7 +421,7 @@ static inline CHECK_NONNULL(1, 2) void vm_push(filter_vm_t        *vm,
     memcpy(&vm->sp[vm->si++], cell, sizeof(*cell));
 }
 
-static inline CHECK_NONNULL(1, 2) void vm_pushaddr(filter_vm_t     *vm,
+static inline CHECK_NONNULL(1, 2) void vm_pushaddr(filter_ctx_t    *vm,
                                                    const netaddr_t *addr)
 {
     // especially optimized, since it's very common
@@ -333,7 +431,7 @@ static inline CHECK_NONNULL(1, 2) void vm_pushaddr(filter_vm_t     *vm,
     memcpy(&vm->sp[vm->si++].addr, addr, sizeof(*addr));
 }
 
-static inline CHECK_NONNULL(1) void vm_pushvalue(filter_vm_t *vm, int value)
+static inline CHECK_NONNULL(1) void vm_pushvalue(filter_ctx_t *vm, int value)
 {
     // optimized, since it's common
     if (unlikely(vm->si == vm->stacksiz))
@@ -342,7 +440,7 @@ static inline CHECK_NONNULL(1) void vm_pushvalue(filter_vm_t *vm, int value)
     vm->sp[vm->si++].value = value;
 }
 
-static inline CHECK_NONNULL(1) void vm_pushas(filter_vm_t *vm, wide_as_t as)
+static inline CHECK_NONNULL(1) void vm_pushas(filter_ctx_t *vm, wide_as_t as)
 {
     if (unlikely(vm->si == vm->stacksiz))
         vm_growstack(vm);
@@ -350,29 +448,30 @@ static inline CHECK_NONNULL(1) void vm_pushas(filter_vm_t *vm, wide_as_t as)
     vm->sp[vm->si++].as  = as;
 }
 
-static inline CHECK_NONNULL(1) void vm_exec_loadk(filter_vm_t *vm, int kidx)
+static inline CHECK_NONNULL(1) void vm_exec_loadk(filter_ctx_t *vm, int kidx)
 {
-    if (unlikely(kidx >= vm->ksiz))
+    if (unlikely((uint) kidx >= vm->prog->ksiz))
         vm_abort(vm, VM_K_UNDEFINED);
 
-    vm_push(vm, &vm->kp[kidx]);
+    vm_push(vm, vm_getk(vm, kidx));
 }
 
 /**
  * vm_exec_break:
- * @vm: a #filter_vm_t in execution mode
+ * @vm: a #filter_ctx_t in execution mode
  *
  * Breaks from the current `BLK`, leaves `vm->pc` at the corresponding `ENDBLK`,
  * `vm->pc` is assumed to be inside the `BLK`.
  */
-static inline CHECK_NONNULL(1) void vm_exec_break(filter_vm_t *vm)
+static inline CHECK_NONNULL(1) void vm_exec_break(filter_ctx_t *vm)
 {
+    const bytecode_t *code = vm->prog->code;
     uint nblk = 1; // encountered blocks
 
-    while (vm->pc < vm->codesiz) {
-        if (vm->code[vm->pc] == FOPC_ENDBLK)
+    while (vm->pc < vm->prog->codesiz) {
+        if (code[vm->pc] == FOPC_ENDBLK)
             nblk--;
-        if (vm->code[vm->pc] == FOPC_BLK)
+        if (code[vm->pc] == FOPC_BLK)
             nblk++;
 
         if (nblk == 0)
@@ -382,33 +481,46 @@ static inline CHECK_NONNULL(1) void vm_exec_break(filter_vm_t *vm)
     }
 }
 
-static inline CHECK_NONNULL(1) void vm_exec_not(filter_vm_t *vm)
+static inline CHECK_NONNULL(1) void vm_exec_not(filter_ctx_t *vm)
 {
     stack_cell_t *cell = vm_peek(vm);
     cell->value = !cell->value;
 }
 
-static inline CHECK_NONNULL(1) void *vm_heap_ptr(filter_vm_t *vm,
-                                                 intptr_t     offset)
+static inline CHECK_NONNULL(1) void *vm_heap_ptr(filter_ctx_t *vm,
+                                                 intptr_t      offset)
 {
     assert(offset >= 0);
 
-    return (byte *) vm->heap + offset;  // duh...
+    const filter_prog_t *prog = vm->prog;
+    if ((size_t) offset < prog->highwater)
+        return (byte *) prog->heap + offset;
+
+    return (byte *) vm->heap + (offset - prog->highwater);
 }
 
-static inline CHECK_NONNULL(1, 2) void vm_check_array(filter_vm_t        *vm,
+static inline CHECK_NONNULL(1, 2) void vm_check_array(filter_ctx_t       *vm,
                                                       const stack_cell_t *arr)
 {
-    size_t bound = arr->base;
-    bound += arr->nels * arr->elsiz;
+    size_t highwater = vm->prog->highwater;
+    size_t base      = arr->base;
+    size_t bound     = base + arr->nels * arr->elsiz;
+
+    if (unlikely(arr->elsiz > sizeof(stack_cell_t)))
+        vm_abort(vm, VM_BAD_ARRAY);
 
-    if (unlikely(arr->elsiz > sizeof(stack_cell_t) || bound > vm->heapsiz))
+    // arrays may not straddle the program and context heaps
+    if (base < highwater) {
+        if (unlikely(bound > highwater))
+            vm_abort(vm, VM_BAD_ARRAY);
+    } else if (unlikely(bound - highwater > vm->heapsiz)) {
         vm_abort(vm, VM_BAD_ARRAY);
+    }
 }
 
-UBGP_API CHECK_NONNULL(1) void vm_exec_unpack(filter_vm_t *vm);
+UBGP_API CHECK_NONNULL(1) void vm_exec_unpack(filter_ctx_t *vm);
 
-static inline CHECK_NONNULL(1) void vm_exec_store(filter_vm_t *vm)
+static inline CHECK_NONNULL(1) void vm_exec_store(filter_ctx_t *vm)
 {
     stack_cell_t *cell    = vm_pop(vm);
     netaddr_t *addr       = &cell->addr;
@@ -418,7 +530,7 @@ static inline CHECK_NONNULL(1) void vm_exec_store(filter_vm_t *vm)
         trie = vm->curtrie6;
         FALLTHROUGH;
     case AF_INET:
-        if (!patinsert(trie, addr, NULL))
+        if (!patinsert(vm_writabletrie(vm, trie), addr, NULL))
             vm_abort(vm, VM_OUT_OF_MEMORY);
 
         break;
@@ -428,7 +540,7 @@ static inline CHECK_NONNULL(1) void vm_exec_store(filter_vm_t *vm)
     }
 }
 
-static inline CHECK_NONNULL(1) void vm_exec_discard(filter_vm_t *vm)
+static inline CHECK_NONNULL(1) void vm_exec_discard(filter_ctx_t *vm)
 {
     stack_cell_t *cell    = vm_pop(vm);
     netaddr_t *addr       = &cell->addr;
@@ -438,7 +550,7 @@ static inline CHECK_NONNULL(1) void vm_exec_discard(filter_vm_t *vm)
         trie = vm->curtrie6;
         FALLTHROUGH;
     case AF_INET:
-        patremove(trie, addr);
+        patremove(vm_writabletrie(vm, trie), addr);
         break;
     default:
         vm_abort(vm, VM_SURPRISING_BYTES);  // should never happen
@@ -446,68 +558,68 @@ static inline CHECK_NONNULL(1) void vm_exec_discard(filter_vm_t *vm)
     }
 }
 
-static inline CHECK_NONNULL(1) void vm_exec_clrtrie(filter_vm_t *vm)
+static inline CHECK_NONNULL(1) void vm_exec_clrtrie(filter_ctx_t *vm)
 {
-    patclear(vm->curtrie);
+    patclear(vm_writabletrie(vm, vm->curtrie));
 }
 
-static inline CHECK_NONNULL(1) void vm_exec_clrtrie6(filter_vm_t *vm)
+static inline CHECK_NONNULL(1) void vm_exec_clrtrie6(filter_ctx_t *vm)
 {
-    patclear(vm->curtrie6);
+    patclear(vm_writabletrie(vm, vm->curtrie6));
 }
 
-static inline CHECK_NONNULL(1) void vm_exec_settrie(filter_vm_t *vm, int trie)
+static inline CHECK_NONNULL(1) void vm_exec_settrie(filter_ctx_t *vm, int trie)
 {
-    if (unlikely((uint) trie >= vm->ntries))
+    if (unlikely((uint) trie >= vm->prog->ntries))
         vm_abort(vm, VM_TRIE_UNDEFINED);
 
-    vm->curtrie = &vm->tries[trie];
+    vm->curtrie = vm_gettrie(vm, trie);
     if (unlikely(vm->curtrie->maxbitlen != 32))
         vm_abort(vm, VM_TRIE_MISMATCH);
 }
 
-static inline CHECK_NONNULL(1) void vm_exec_settrie6(filter_vm_t *vm, int trie6)
+static inline CHECK_NONNULL(1) void vm_exec_settrie6(filter_ctx_t *vm, int trie6)
 {
-    if (unlikely((uint) trie6 >= vm->ntries))
+    if (unlikely((uint) trie6 >= vm->prog->ntries))
         vm_abort(vm, VM_TRIE_UNDEFINED);
 
-    vm->curtrie6 = &vm->tries[trie6];
+    vm->curtrie6 = vm_gettrie(vm, trie6);
     if (unlikely(vm->curtrie6->maxbitlen != 128))
         vm_abort(vm, VM_TRIE_MISMATCH);
 }
 
-static inline CHECK_NONNULL(1) void vm_exec_ascmp(filter_vm_t *vm, int kidx)
+static inline CHECK_NONNULL(1) void vm_exec_ascmp(filter_ctx_t *vm, int kidx)
 {
-    if (unlikely((uint) kidx >= vm->ksiz))
+    if (unlikely((uint) kidx >= vm->prog->ksiz))
         vm_abort(vm, VM_K_UNDEFINED);
 
     stack_cell_t *a = vm_peek(vm);
-    stack_cell_t *b = &vm->kp[kidx];
+    stack_cell_t *b = vm_getk(vm, kidx);
 
     a->value = (a->as == b->as);
 }
 
-static inline CHECK_NONNULL(1) void vm_exec_addrcmp(filter_vm_t *vm, int kidx)
+static inline CHECK_NONNULL(1) void vm_exec_addrcmp(filter_ctx_t *vm, int kidx)
 {
-    if (unlikely((uint) kidx >= vm->ksiz))
+    if (unlikely((uint) kidx >= vm->prog->ksiz))
         vm_abort(vm, VM_K_UNDEFINED);
 
     stack_cell_t *a = vm_peek(vm);
-    stack_cell_t *b = &vm->kp[kidx];
+    stack_cell_t *b = vm_getk(vm, kidx);
     a->value = naddreq(&a->addr, &b->addr);
 }
 
-static inline CHECK_NONNULL(1) void vm_exec_pfxcmp(filter_vm_t *vm, int kidx)
+static inline CHECK_NONNULL(1) void vm_exec_pfxcmp(filter_ctx_t *vm, int kidx)
 {
-    if (unlikely((uint) kidx >= vm->ksiz))
+    if (unlikely((uint) kidx >= vm->prog->ksiz))
         vm_abort(vm, VM_K_UNDEFINED);
 
     stack_cell_t *a = vm_peek(vm);
-    stack_cell_t *b = &vm->kp[kidx];
+    stack_cell_t *b = vm_getk(vm, kidx);
     a->value = prefixeq(&a->addr, &b->addr);
 }
 
-static inline CHECK_NONNULL(1) void vm_exec_settle(filter_vm_t *vm)
+static inline CHECK_NONNULL(1) void vm_exec_settle(filter_ctx_t *vm)
 {
     if (vm->settle_func) {
         vm->settle_func(vm->bgp);
@@ -517,25 +629,43 @@ static inline CHECK_NONNULL(1) void vm_exec_settle(filter_vm_t *vm)
     }
 }
 
-UBGP_API CHECK_NONNULL(1) void vm_exec_hasattr(filter_vm_t *vm, int code);
+UBGP_API CHECK_NONNULL(1) void vm_exec_hasattr(filter_ctx_t *vm, int code);
+
+UBGP_API CHECK_NONNULL(1) void vm_exec_hasanyattr(filter_ctx_t *vm, int kidx);
+
+/**
+ * vm_decode_pfxs:
+ * @vm:     a #filter_ctx_t in execution mode
+ * @access: %FOPC_ACCESS_NLRI or %FOPC_ACCESS_WITHDRAWN
+ *
+ * Decode every NLRI (or withdrawn) prefix of the current packet at once,
+ * including the MP_REACH_NLRI (or MP_UNREACH_NLRI) attribute ones,
+ * see getallnlri().
+ *
+ * Returns: the number of prefixes stored into `vm->pfxs`, valid up to the
+ *          next call, on error 0 is returned and bgperror() is set.
+ */
+UBGP_API CHECK_NONNULL(1) size_t vm_decode_pfxs(filter_ctx_t *vm, uint access);
 
 static inline CHECK_NONNULL(1)
-void vm_exec_all_withdrawn_insert(filter_vm_t *vm)
+void vm_exec_all_withdrawn_insert(filter_ctx_t *vm)
 {
     if (unlikely(getbgptype(vm->bgp) != BGP_UPDATE))
         vm_abort(vm, VM_PACKET_MISMATCH);
 
-    startallwithdrawn(vm->bgp);
+    size_t n = vm_decode_pfxs(vm, FOPC_ACCESS_WITHDRAWN);
+    if (unlikely(bgperror(vm->bgp) != BGP_ENOERR))
+        vm_abort(vm, VM_BAD_PACKET);
 
-    const netaddr_t *addr;
-    while ((addr = nextwithdrawn(vm->bgp)) != NULL) {
+    for (size_t i = 0; i < n; i++) {
+        const netaddr_t *addr = &vm->pfxs[i].pfx;
         patricia_trie_t *trie = vm->curtrie;
         switch (addr->family) {
         case AF_INET6:
             trie = vm->curtrie6;
             FALLTHROUGH;
         case AF_INET:
-            if (!patinsert(trie, addr, NULL))
+            if (!patinsert(vm_writabletrie(vm, trie), addr, NULL))
                 vm_abort(vm, VM_OUT_OF_MEMORY);
 
             break;
@@ -544,29 +674,24 @@ void vm_exec_all_withdrawn_insert(filter_vm_t *vm)
             break;
         }
     }
-
-    if (unlikely(endwithdrawn(vm->bgp) != BGP_ENOERR))
-        vm_abort(vm, VM_BAD_PACKET);
 }
 
 static inline CHECK_NONNULL(1)
-void vm_exec_all_withdrawn_accumulate(filter_vm_t *vm)
+void vm_exec_all_withdrawn_accumulate(filter_ctx_t *vm)
 {
     if (unlikely(getbgptype(vm->bgp) != BGP_UPDATE))
         vm_abort(vm, VM_PACKET_MISMATCH);
 
-    startallwithdrawn(vm->bgp);
-
-    const netaddr_t *addr;
-    while ((addr = nextwithdrawn(vm->bgp)) != NULL)
-        vm_pushaddr(vm, addr);
-
-    if (unlikely(endwithdrawn(vm->bgp) != BGP_ENOERR))
+    size_t n = vm_decode_pfxs(vm, FOPC_ACCESS_WITHDRAWN);
+    if (unlikely(bgperror(vm->bgp) != BGP_ENOERR))
         vm_abort(vm, VM_BAD_PACKET);
+
+    for (size_t i = 0; i < n; i++)
+        vm_pushaddr(vm, &vm->pfxs[i].pfx);
 }
 
 static inline CHECK_NONNULL(1)
-void vm_exec_withdrawn_accumulate(filter_vm_t *vm)
+void vm_exec_withdrawn_accumulate(filter_ctx_t *vm)
 {
     if (unlikely(getbgptype(vm->bgp) != BGP_UPDATE))
         vm_abort(vm, VM_PACKET_MISMATCH);
@@ -581,7 +706,7 @@ void vm_exec_withdrawn_accumulate(filter_vm_t *vm)
         vm_abort(vm, VM_BAD_PACKET);
 }
 
-static inline void CHECK_NONNULL(1) vm_exec_withdrawn_insert(filter_vm_t *vm)
+static inline void CHECK_NONNULL(1) vm_exec_withdrawn_insert(filter_ctx_t *vm)
 {
     if (unlikely(getbgptype(vm->bgp) != BGP_UPDATE))
         vm_abort(vm, VM_PACKET_MISMATCH);
@@ -596,7 +721,7 @@ static inline void CHECK_NONNULL(1) vm_exec_withdrawn_insert(filter_vm_t *vm)
             trie = vm->curtrie6;
             FALLTHROUGH;
         case AF_INET:
-            if (!patinsert(trie, addr, NULL))
+            if (!patinsert(vm_writabletrie(vm, trie), addr, NULL))
                 vm_abort(vm, VM_OUT_OF_MEMORY);
 
             break;
@@ -610,22 +735,24 @@ static inline void CHECK_NONNULL(1) vm_exec_withdrawn_insert(filter_vm_t *vm)
         vm_abort(vm, VM_BAD_PACKET);
 }
 
-static inline CHECK_NONNULL(1) void vm_exec_all_nlri_insert(filter_vm_t *vm)
+static inline CHECK_NONNULL(1) void vm_exec_all_nlri_insert(filter_ctx_t *vm)
 {
     if (unlikely(getbgptype(vm->bgp) != BGP_UPDATE))
         vm_abort(vm, VM_PACKET_MISMATCH);
 
-    startallnlri(vm->bgp);
+    size_t n = vm_decode_pfxs(vm, FOPC_ACCESS_NLRI);
+    if (unlikely(bgperror(vm->bgp) != BGP_ENOERR))
+        vm_abort(vm, VM_BAD_PACKET);
 
-    const netaddr_t *addr;
-    while ((addr = nextnlri(vm->bgp)) != NULL) {
+    for (size_t i = 0; i < n; i++) {
+        const netaddr_t *addr = &vm->pfxs[i].pfx;
         patricia_trie_t *trie = vm->curtrie;
         switch (addr->family) {
         case AF_INET6:
             trie = vm->curtrie6;
             // fallthrough
         case AF_INET:
-            if (!patinsert(trie, addr, NULL))
+            if (!patinsert(vm_writabletrie(vm, trie), addr, NULL))
                 vm_abort(vm, VM_OUT_OF_MEMORY);
 
             break;
@@ -634,29 +761,24 @@ static inline CHECK_NONNULL(1) void vm_exec_all_nlri_insert(filter_vm_t *vm)
             break;
         }
     }
-
-    if (unlikely(endnlri(vm->bgp) != BGP_ENOERR))
-        vm_abort(vm, VM_BAD_PACKET);
 }
 
 static inline CHECK_NONNULL(1)
-void vm_exec_all_nlri_accumulate(filter_vm_t *vm)
+void vm_exec_all_nlri_accumulate(filter_ctx_t *vm)
 {
     if (unlikely(getbgptype(vm->bgp) != BGP_UPDATE))
         vm_abort(vm, VM_PACKET_MISMATCH);
 
-    startallnlri(vm->bgp);
-
-    const netaddr_t *addr;
-    while ((addr = nextnlri(vm->bgp)) != NULL)
-        vm_pushaddr(vm, addr);
-
-    if (unlikely(endnlri(vm->bgp) != BGP_ENOERR))
+    size_t n = vm_decode_pfxs(vm, FOPC_ACCESS_NLRI);
+    if (unlikely(bgperror(vm->bgp) != BGP_ENOERR))
         vm_abort(vm, VM_BAD_PACKET);
+
+    for (size_t i = 0; i < n; i++)
+        vm_pushaddr(vm, &vm->pfxs[i].pfx);
 }
 
 static inline CHECK_NONNULL(1)
-void vm_exec_nlri_insert(filter_vm_t *vm)
+void vm_exec_nlri_insert(filter_ctx_t *vm)
 {
     if (unlikely(getbgptype(vm->bgp) != BGP_UPDATE))
         vm_abort(vm, VM_PACKET_MISMATCH);
@@ -671,7 +793,7 @@ void vm_exec_nlri_insert(filter_vm_t *vm)
             trie = vm->curtrie6;
             // fallthrough
         case AF_INET:
-            if (!patinsert(trie, addr, NULL))
+            if (!patinsert(vm_writabletrie(vm, trie), addr, NULL))
                 vm_abort(vm, VM_OUT_OF_MEMORY);
 
             break;
@@ -686,7 +808,7 @@ void vm_exec_nlri_insert(filter_vm_t *vm)
 }
 
 static inline CHECK_NONNULL(1)
-void vm_exec_nlri_accumulate(filter_vm_t *vm)
+void vm_exec_nlri_accumulate(filter_ctx_t *vm)
 {
     if (unlikely(getbgptype(vm->bgp) != BGP_UPDATE))
         vm_abort(vm, VM_PACKET_MISMATCH);
@@ -701,18 +823,18 @@ void vm_exec_nlri_accumulate(filter_vm_t *vm)
         vm_abort(vm, VM_BAD_PACKET);
 }
 
-UBGP_API CHECK_NONNULL(1) void vm_exec_exact(filter_vm_t *vm, uint access);
-UBGP_API CHECK_NONNULL(1) void vm_exec_subnet(filter_vm_t *vm, uint access);
-UBGP_API CHECK_NONNULL(1) void vm_exec_supernet(filter_vm_t *vm, uint access);
-UBGP_API CHECK_NONNULL(1) void vm_exec_related(filter_vm_t *vm, uint access);
+UBGP_API CHECK_NONNULL(1) void vm_exec_exact(filter_ctx_t *vm, uint access);
+UBGP_API CHECK_NONNULL(1) void vm_exec_subnet(filter_ctx_t *vm, uint access);
+UBGP_API CHECK_NONNULL(1) void vm_exec_supernet(filter_ctx_t *vm, uint access);
+UBGP_API CHECK_NONNULL(1) void vm_exec_related(filter_ctx_t *vm, uint access);
 
-static inline CHECK_NONNULL(1) void vm_exec_pfxcontains(filter_vm_t *vm,
-                                                        int          kidx)
+static inline CHECK_NONNULL(1) void vm_exec_pfxcontains(filter_ctx_t *vm,
+                                                        int           kidx)
 {
-    if (unlikely((uint) kidx >= vm->ksiz))
+    if (unlikely((uint) kidx >= vm->prog->ksiz))
         vm_abort(vm, VM_K_UNDEFINED);
 
-    stack_cell_t *a = &vm->kp[kidx];
+    stack_cell_t *a = vm_getk(vm, kidx);
     while (vm->si > 0) {
         stack_cell_t *b = vm_pop(vm);
 
@@ -726,13 +848,13 @@ static inline CHECK_NONNULL(1) void vm_exec_pfxcontains(filter_vm_t *vm,
     vm_pushvalue(vm, false);
 }
 
-static inline CHECK_NONNULL(1) void vm_exec_addrcontains(filter_vm_t *vm,
-                                                         int          kidx)
+static inline CHECK_NONNULL(1) void vm_exec_addrcontains(filter_ctx_t *vm,
+                                                         int           kidx)
 {
-    if (unlikely((uint) kidx >= vm->ksiz))
+    if (unlikely((uint) kidx >= vm->prog->ksiz))
         vm_abort(vm, VM_K_UNDEFINED);
 
-    stack_cell_t *a = &vm->kp[kidx];
+    stack_cell_t *a = vm_getk(vm, kidx);
     while (vm->si > 0) {
         stack_cell_t *b = vm_pop(vm);
 
@@ -746,13 +868,13 @@ static inline CHECK_NONNULL(1) void vm_exec_addrcontains(filter_vm_t *vm,
     vm_pushvalue(vm, false);
 }
 
-static inline CHECK_NONNULL(1) void vm_exec_ascontains(filter_vm_t *vm,
-                                                       int          kidx)
+static inline CHECK_NONNULL(1) void vm_exec_ascontains(filter_ctx_t *vm,
+                                                       int           kidx)
 {
-    if (unlikely((uint) kidx >= vm->ksiz))
+    if (unlikely((uint) kidx >= vm->prog->ksiz))
         vm_abort(vm, VM_K_UNDEFINED);
 
-    stack_cell_t *a = &vm->kp[kidx];
+    stack_cell_t *a = vm_getk(vm, kidx);
     while (vm->si > 0) {
         stack_cell_t *b = vm_pop(vm);
         if (a->as == b->as) {
@@ -765,12 +887,12 @@ static inline CHECK_NONNULL(1) void vm_exec_ascontains(filter_vm_t *vm,
     vm_pushvalue(vm, false);
 }
 
-UBGP_API CHECK_NONNULL(1) void vm_exec_aspmatch(filter_vm_t *vm, uint access);
-UBGP_API CHECK_NONNULL(1) void vm_exec_aspstarts(filter_vm_t *vm, uint access);
-UBGP_API CHECK_NONNULL(1) void vm_exec_aspends(filter_vm_t *vm, uint access);
-UBGP_API CHECK_NONNULL(1) void vm_exec_aspexact(filter_vm_t *vm, uint access);
+UBGP_API CHECK_NONNULL(1) void vm_exec_aspmatch(filter_ctx_t *vm, uint access);
+UBGP_API CHECK_NONNULL(1) void vm_exec_aspstarts(filter_ctx_t *vm, uint access);
+UBGP_API CHECK_NONNULL(1) void vm_exec_aspends(filter_ctx_t *vm, uint access);
+UBGP_API CHECK_NONNULL(1) void vm_exec_aspexact(filter_ctx_t *vm, uint access);
 
-UBGP_API CHECK_NONNULL(1) void vm_exec_commexact(filter_vm_t *vm);
+UBGP_API CHECK_NONNULL(1) void vm_exec_commexact(filter_ctx_t *vm);
 
 #endif
 
@@ -19,340 +19,730 @@
  * details.
  */
 
+#include "bitops.h"
 #include "filterintrin.h"
 #include "filterpacket.h"
 
 #include <limits.h>
 #include <stdlib.h>
+#include <time.h>
 
-UBGP_API void filter_destroy(filter_vm_t *vm)
+UBGP_API void filter_prog_init(filter_prog_t *prog)
+{
+    memset(prog, 0, sizeof(*prog));
+    prog->kp    = prog->kbuf;
+    prog->tries = prog->triebuf;
+    prog->ksiz     = KBASESIZ;  // reserved for known variables
+    prog->maxk     = countof(prog->kbuf);
+    prog->ntries   = 2;  // reserved for temporary tries
+    prog->maxtries = countof(prog->triebuf);
+    prog->funcs[VM_WITHDRAWN_INSERT_FN]         = vm_exec_withdrawn_insert;
+    prog->funcs[VM_WITHDRAWN_ACCUMULATE_FN]     = vm_exec_withdrawn_accumulate;
+    prog->funcs[VM_ALL_WITHDRAWN_INSERT_FN]     = vm_exec_all_withdrawn_insert;
+    prog->funcs[VM_ALL_WITHDRAWN_ACCUMULATE_FN] = vm_exec_all_withdrawn_accumulate;
+    prog->funcs[VM_NLRI_INSERT_FN]              = vm_exec_nlri_insert;
+    prog->funcs[VM_NLRI_ACCUMULATE_FN]          = vm_exec_nlri_accumulate;
+    prog->funcs[VM_ALL_NLRI_INSERT_FN]          = vm_exec_all_nlri_insert;
+    prog->funcs[VM_ALL_NLRI_ACCUMULATE_FN]      = vm_exec_all_nlri_accumulate;
+}
+
+UBGP_API void filter_ctx_init(filter_ctx_t *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->sp       = ctx->stackbuf;
+    ctx->stacksiz = countof(ctx->stackbuf);
+    ctx->pfxs     = ctx->pfxbuf;
+    ctx->pfxsiz   = countof(ctx->pfxbuf);
+
+    patinit(&ctx->tmptries[VM_TMPTRIE],  AF_INET);
+    patinit(&ctx->tmptries[VM_TMPTRIE6], AF_INET6);
+}
+
+static void profile_free(filter_profile_t *prof)
+{
+    free(prof->count);
+    free(prof->cycles);
+    free(prof->shortcircuits);
+    free(prof);
+}
+
+/**
+ * filter_lane_t:
+ *
+ * Per message execution state of a column-wise batch,
+ * swapped in and out of the context around each instruction.
+ */
+typedef struct {
+    ubgp_msg_s *bgp;
+    patricia_trie_t *curtrie, *curtrie6;
+    stack_cell_t *sp;  // always heap allocated, so vm_growstack() may realloc() it
+    ubgp_err (*settle_func)(ubgp_msg_s *);
+    ushort si;
+    ushort stacksiz;
+    ushort curblk;
+    ushort access_mask;
+    ushort resume;     // ENDBLK where a parked lane resumes execution
+} filter_lane_t;
+
+static_assert(FILTER_BATCH_LANES == 64, "Batch lanes must fit a results bitmap word");
+
+struct filter_batch {
+    uint64_t live;     // lanes still running
+    uint64_t parked;   // lanes skipping a block up to their ENDBLK
+    uint64_t pending;  // lanes yet to execute the current instruction
+    uint64_t passed;   // lanes terminated with a PASS
+    bytecode_t ip;     // current instruction
+    int arg;           // current instruction argument, extended
+    int exarg;
+    int brk;           // current instruction break target, -1 if not computed
+    uint cur;          // lane being executed
+    uint errlane;      // lowest failed lane
+    int error;         // error of the lowest failed lane
+    bool finishing;
+    filter_lane_t lanes[FILTER_BATCH_LANES];
+};
+
+static void batch_free(struct filter_batch *b)
+{
+    for (uint i = 0; i < countof(b->lanes); i++)
+        free(b->lanes[i].sp);
+
+    free(b);
+}
+
+UBGP_API void filter_prog_destroy(filter_prog_t *prog)
+{
+    // temporary tries slots are never initialized
+    for (uint i = VM_TMPTRIE6 + 1; i < prog->ntries; i++)
+        patdestroy(&prog->tries[i]);
+
+    if (prog->tries != prog->triebuf)
+        free(prog->tries);
+    if (prog->kp != prog->kbuf)
+        free(prog->kp);
+
+    free(prog->code);
+    free(prog->heap);
+}
+
+UBGP_API void filter_ctx_destroy(filter_ctx_t *ctx)
 {
-    for (uint i = 0; i < vm->ntries; i++)
-        patdestroy(&vm->tries[i]);
-
-    if (vm->tries != vm->triebuf)
-        free(vm->tries);
-    if (vm->kp != vm->kbuf)
-        free(vm->kp);
-    if (vm->sp != vm->stackbuf)
-        free(vm->sp);
-
-    free(vm->code);
-    free(vm->heap);
+    if (ctx->prof)
+        profile_free(ctx->prof);
+    if (ctx->batch)
+        batch_free(ctx->batch);
+
+    patdestroy(&ctx->tmptries[VM_TMPTRIE]);
+    patdestroy(&ctx->tmptries[VM_TMPTRIE6]);
+
+    if (ctx->sp != ctx->stackbuf)
+        free(ctx->sp);
+    if (ctx->pfxs != ctx->pfxbuf)
+        free(ctx->pfxs);
+
+    free(ctx->heap);
 }
 
 UBGP_API void filter_init(filter_vm_t *vm)
 {
-    memset(vm, 0, sizeof(*vm));
-    vm->sp    = vm->stackbuf;
-    vm->kp    = vm->kbuf;
-    vm->tries = vm->triebuf;
-    vm->stacksiz = countof(vm->stackbuf);
-    vm->ksiz     = KBASESIZ;  // reserved for known variables
-    vm->maxk     = countof(vm->kbuf);
-    vm->ntries   = 2;  // 2 temporary tries
-    vm->maxtries = countof(vm->triebuf);
-    vm->funcs[VM_WITHDRAWN_INSERT_FN]         = vm_exec_withdrawn_insert;
-    vm->funcs[VM_WITHDRAWN_ACCUMULATE_FN]     = vm_exec_withdrawn_accumulate;
-    vm->funcs[VM_ALL_WITHDRAWN_INSERT_FN]     = vm_exec_all_withdrawn_insert;
-    vm->funcs[VM_ALL_WITHDRAWN_ACCUMULATE_FN] = vm_exec_all_withdrawn_accumulate;
-    vm->funcs[VM_NLRI_INSERT_FN]              = vm_exec_nlri_insert;
-    vm->funcs[VM_NLRI_ACCUMULATE_FN]          = vm_exec_nlri_accumulate;
-    vm->funcs[VM_ALL_NLRI_INSERT_FN]          = vm_exec_all_nlri_insert;
-    vm->funcs[VM_ALL_NLRI_ACCUMULATE_FN]      = vm_exec_all_nlri_accumulate;
-
-    patinit(&vm->tries[VM_TMPTRIE],  AF_INET);
-    patinit(&vm->tries[VM_TMPTRIE6], AF_INET6);
+    filter_prog_init(&vm->prog);
+    filter_ctx_init(&vm->ctx);
+}
+
+UBGP_API void filter_destroy(filter_vm_t *vm)
+{
+    filter_ctx_destroy(&vm->ctx);
+    filter_prog_destroy(&vm->prog);
+}
+
+static ullong vm_cycles(void)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+static bool vm_profile_fit(filter_profile_t *prof, ushort codesiz)
+{
+    if (likely(codesiz <= prof->codesiz))
+        return true;
+
+    ullong *count  = calloc(codesiz, sizeof(*count));
+    ullong *cycles = calloc(codesiz, sizeof(*cycles));
+    ullong *sc     = calloc(codesiz, sizeof(*sc));
+    if (unlikely(!count || !cycles || !sc)) {
+        free(count);
+        free(cycles);
+        free(sc);
+        return false;
+    }
+
+    // preserve counters collected so far
+    size_t n = prof->codesiz * sizeof(*count);
+    if (n > 0) {
+        memcpy(count,  prof->count,  n);
+        memcpy(cycles, prof->cycles, n);
+        memcpy(sc,     prof->shortcircuits, n);
+    }
+
+    free(prof->count);
+    free(prof->cycles);
+    free(prof->shortcircuits);
+
+    prof->count         = count;
+    prof->cycles        = cycles;
+    prof->shortcircuits = sc;
+    prof->codesiz       = codesiz;
+    return true;
+}
+
+static void vm_profile_start(filter_profile_t *prof)
+{
+    prof->lastpc = -1;
+    prof->stamp  = vm_cycles();
+}
+
+static void vm_profile_close(filter_profile_t *prof, ullong now)
+{
+    if (prof->lastpc >= 0) {
+        ullong delta = now - prof->stamp;
+
+        prof->cycles[prof->lastpc]   += delta;
+        prof->opcycles[prof->lastop] += delta;
+    }
+}
+
+static void vm_profile_tick(filter_profile_t *prof, int pc, int opcode)
+{
+    // charge the elapsed cycles to the previous instruction
+    ullong now = vm_cycles();
+    vm_profile_close(prof, now);
+
+    prof->count[pc]++;
+    prof->opcount[opcode]++;
+    prof->lastpc = pc;
+    prof->lastop = opcode;
+    prof->stamp  = now;
+}
+
+static void vm_profile_end(filter_profile_t *prof, int res)
+{
+    vm_profile_close(prof, vm_cycles());
+    prof->lastpc = -1;
+
+    prof->runs++;
+    if (res > 0)
+        prof->passes++;
+    if (res < 0)
+        prof->errors++;
+}
+
+UBGP_API int filter_profile_enable(filter_ctx_t *ctx)
+{
+    if (ctx->prof)
+        return 0;
+
+    // per instruction counters are allocated on first execution
+    filter_profile_t *prof = calloc(1, sizeof(*prof));
+    if (unlikely(!prof))
+        return VM_OUT_OF_MEMORY;
+
+    prof->lastpc = -1;
+    ctx->prof = prof;
+    return 0;
+}
+
+#define VM_INTERP_NAME    vm_run
+#define VM_INTERP_PROFILE 0
+#include "vm_interp.h"
+
+#define VM_INTERP_NAME    vm_run_profile
+#define VM_INTERP_PROFILE 1
+#include "vm_interp.h"
+
+UBGP_API int bgp_filter_ctx(ubgp_msg_s *msg, const filter_prog_t *prog, filter_ctx_t *ctx)
+{
+    if (unlikely(ctx->prof))
+        return vm_run_profile(msg, prog, ctx);
+
+    return vm_run(msg, prog, ctx);
 }
 
 UBGP_API int bgp_filter(ubgp_msg_s *msg, filter_vm_t *vm)
 {
-// disable pedantic diagnostic about taking address label
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wpedantic"
-
-#if defined(__GNUC__) && !defined(ISOLARIO_VM_PLAIN_SWITCH)
-// use computed goto to speed-up bytecode interpreter
-#include "vm_opcodes.h"
-
-#define FETCH() ip = vm->code[vm->pc++];                                           \
-                np = likely(vm->pc < vm->codesiz) ? vm->code[vm->pc] : BAD_OPCODE; \
-                (void) np;                                                         \
-                goto *vm_opcode_table[vm_getopcode(ip)]
-
-#define PREDICT(opcode) do {                                                     \
-        if (likely(vm_getopcode(np) == FOPC_##opcode)) {                         \
-            ip = np;                                                             \
-            np = likely(vm->pc < vm->codesiz) ? vm->code[++vm->pc] : BAD_OPCODE; \
-            goto *vm_opcode_table[FOPC_##opcode];                                \
-        }                                                                        \
-    } while (false)
+    return bgp_filter_ctx(msg, &vm->prog, &vm->ctx);
+}
 
-#define DISPATCH() break
+// Column-wise batch execution:
 
-#define EXECUTE(opcode) case FOPC_##opcode: \
-                        EX_##opcode
+static struct filter_batch *vm_batch_get(filter_ctx_t *vm)
+{
+    if (likely(vm->batch))
+        return vm->batch;
 
-#define EXECUTE_SIGILL default: \
-                       EX_SIGILL
+    struct filter_batch *b = calloc(1, sizeof(*b));
+    if (unlikely(!b))
+        return NULL;
 
-#else
-// portable C
+    for (uint i = 0; i < countof(b->lanes); i++) {
+        filter_lane_t *lane = &b->lanes[i];
 
-#define FETCH() ip = vm->code[vm->pc++];                                           \
-                np = likely(vm->pc < vm->codesiz) ? vm->code[vm->pc] : BAD_OPCODE; \
-                (void) np
+        lane->sp = malloc(STACKBUFSIZ * sizeof(*lane->sp));
+        if (unlikely(!lane->sp)) {
+            batch_free(b);
+            return NULL;
+        }
 
-#define PREDICT(opcode) do (void) 0; while (false)
+        lane->stacksiz = STACKBUFSIZ;
+    }
 
-#define DISPATCH() break
+    vm->batch = b;
+    return b;
+}
 
-#define EXECUTE(opcode) case FOPC_##opcode
+static void vm_lane_enter(filter_ctx_t *vm, const filter_lane_t *lane)
+{
+    vm->bgp         = lane->bgp;
+    vm->curtrie     = lane->curtrie;
+    vm->curtrie6    = lane->curtrie6;
+    vm->sp          = lane->sp;
+    vm->settle_func = lane->settle_func;
+    vm->si          = lane->si;
+    vm->stacksiz    = lane->stacksiz;
+    vm->curblk      = lane->curblk;
+    vm->access_mask = lane->access_mask;
+}
 
-#define EXECUTE_SIGILL  default
-#endif
+static void vm_lane_leave(filter_ctx_t *vm, filter_lane_t *lane)
+{
+    lane->bgp         = vm->bgp;
+    lane->curtrie     = vm->curtrie;
+    lane->curtrie6    = vm->curtrie6;
+    lane->sp          = vm->sp;
+    lane->settle_func = vm->settle_func;
+    lane->si          = vm->si;
+    lane->stacksiz    = vm->stacksiz;
+    lane->curblk      = vm->curblk;
+    lane->access_mask = vm->access_mask;
+}
 
-    if (setjmp(vm->except) != 0) {
-        // TODO cleanup temporary patricias!
-        vm_exec_settle(vm);
-        return vm->error;
+// pick next pending lane, without entering it
+static filter_lane_t *vm_lane_pick(struct filter_batch *b)
+{
+    uint i = bsf64(b->pending) - 1;
+
+    b->pending &= b->pending - 1;
+    b->cur      = i;
+    return &b->lanes[i];
+}
+
+// abort a picked lane
+static noreturn void vm_lane_abort(filter_ctx_t        *vm,
+                                   struct filter_batch *b,
+                                   int                  error)
+{
+    vm_lane_enter(vm, &b->lanes[b->cur]);
+    vm_abort(vm, error);
+}
+
+// pick next pending lane and enter it
+static filter_lane_t *vm_lane_next(filter_ctx_t *vm, struct filter_batch *b)
+{
+    filter_lane_t *lane = vm_lane_pick(b);
+
+    vm_lane_enter(vm, lane);
+    return lane;
+}
+
+// terminate current lane, must be entered
+static void vm_lane_retire(filter_ctx_t *vm, struct filter_batch *b, bool pass)
+{
+    uint64_t bit = 1ull << b->cur;
+
+    vm_exec_settle(vm);
+    vm_lane_leave(vm, &b->lanes[b->cur]);
+
+    b->live   &= ~bit;
+    b->parked &= ~bit;
+    if (pass)
+        b->passed |= bit;
+}
+
+static int vm_batch_break(filter_ctx_t *vm, struct filter_batch *b)
+{
+    if (b->brk < 0) {
+        // every lane breaking here lands on the same ENDBLK
+        ushort pc = vm->pc;
+
+        vm_exec_break(vm);
+        b->brk = vm->pc;
+        vm->pc = pc;
+    }
+
+    return b->brk;
+}
+
+// fetch next instruction and the lanes executing it
+static void vm_batch_fetch(filter_ctx_t *vm, struct filter_batch *b)
+{
+    const filter_prog_t *prog = vm->prog;
+
+    bytecode_t ip = prog->code[vm->pc++];
+    if (vm_getopcode(ip) == FOPC_EXARG) {
+        b->exarg = vm_extendarg(vm_getarg(ip), b->exarg);
+        return;
     }
 
-    bytecode_t ip, np;
-    int arg, exarg;
-    stack_cell_t *cell;
+    b->ip    = ip;
+    b->arg   = vm_extendarg(vm_getarg(ip), b->exarg);
+    b->exarg = 0;
+    b->brk   = -1;
+
+    if (vm_getopcode(ip) == FOPC_ENDBLK) {
+        // wake lanes that skipped their block up to here
+        uint64_t w = b->parked;
+        while (w) {
+            uint i = bsf64(w) - 1;
+            w &= w - 1;
 
-    vm->bgp    = msg;
-    vm->pc     = 0;
-    vm->curblk = 0;
-    vm_clearstack(vm);
+            if (b->lanes[i].resume == vm->pc - 1)
+                b->parked &= ~(1ull << i);
+        }
+    }
+
+    b->pending = b->live & ~b->parked;
+}
+
+#define FOREACH_LANE(stmt) do {                                \
+        while (b->pending) {                                   \
+            filter_lane_t *lane_ = vm_lane_next(vm, b);        \
+            stmt;                                              \
+            vm_lane_leave(vm, lane_);                          \
+        }                                                      \
+    } while (false)
+
+static int vm_run_batch(ubgp_msg_s *const   *msgs,
+                        uint                 n,
+                        const filter_prog_t *prog,
+                        filter_ctx_t        *vm,
+                        struct filter_batch *b,
+                        uint64_t            *result)
+{
+    // lanes borrow the context stack pointer
+    stack_cell_t *const sp = vm->sp;
+    const ushort stacksiz  = vm->stacksiz;
+
+    vm->prog      = prog;
     vm->dynmarker = 0;
     vm->error     = 0;
-    exarg         = 0;
-
-    vm_exec_settrie(vm, VM_TMPTRIE);
-    vm_exec_settrie6(vm, VM_TMPTRIE6);
-    vm_exec_clrtrie(vm);
-    vm_exec_clrtrie6(vm);
-
-    while (vm->pc < vm->codesiz) {
-        FETCH();
-
-        switch (vm_getopcode(ip)) {
-        EXECUTE(NOP):
-            DISPATCH();
-
-        EXECUTE(BLK):
-            vm->curblk++;
-            DISPATCH();
-
-        EXECUTE(ENDBLK):
-            if (unlikely(vm->curblk == 0))
-                vm_abort(vm, VM_SPURIOUS_ENDBLK);
-
-            vm->curblk--;
-            PREDICT(CPASS); // OR chain case
-            PREDICT(NOT);   // usually at end of chain
-            DISPATCH();
-
-        EXECUTE(LOAD):
-            vm_pushvalue(vm, vm_extendarg(vm_getarg(ip), exarg));
-            exarg = 0;
-            DISPATCH();
-
-        EXECUTE(LOADK):
-            arg = vm_extendarg(vm_getarg(ip), exarg);
-            vm_exec_loadk(vm, arg);
-            exarg = 0;
-            DISPATCH();
-
-        EXECUTE(UNPACK):
-            vm_exec_unpack(vm);
-            DISPATCH();
-
-        EXECUTE(EXARG):
-            arg = vm_getarg(ip);
-            exarg <<= 8;
-            exarg  |= arg;
-
-            PREDICT(LOADK);
-            PREDICT(LOAD);
-            PREDICT(CALL);
-
-            DISPATCH();
-
-        EXECUTE(STORE):
-            vm_exec_store(vm);
-            DISPATCH();
-
-        EXECUTE(DISCARD):
-            vm_exec_discard(vm);
-            DISPATCH();
-
-        EXECUTE(NOT):
-            vm_exec_not(vm);
-            PREDICT(CFAIL);
-            PREDICT(CPASS);
-            DISPATCH();
-
-        EXECUTE(CPASS):
-            cell = vm_peek(vm);
-            if (cell->value) {
-                if (vm->curblk == 0)
-                    goto done; // no more blocks, we're done
-
-                // advance up to the next ENDBLK
-                vm_exec_break(vm);
-            } else {
-                vm->si--;  // discard and proceed
+
+    // batchable programs never write temporary tries, clear them once
+    patclear(&vm->tmptries[VM_TMPTRIE]);
+    patclear(&vm->tmptries[VM_TMPTRIE6]);
+
+    for (uint i = 0; i < n; i++) {
+        filter_lane_t *lane = &b->lanes[i];
+
+        lane->bgp         = msgs[i];
+        lane->curtrie     = &vm->tmptries[VM_TMPTRIE];
+        lane->curtrie6    = &vm->tmptries[VM_TMPTRIE6];
+        lane->settle_func = NULL;
+        lane->si          = 0;
+        lane->curblk      = 0;
+        lane->access_mask = 0;
+    }
+
+    b->live      = (n == FILTER_BATCH_LANES) ? ~0ull : (1ull << n) - 1;
+    b->parked    = 0;
+    b->pending   = 0;
+    b->passed    = 0;
+    b->exarg     = 0;
+    b->error     = 0;
+    b->finishing = false;
+
+    vm->pc = 0;
+    if (setjmp(vm->except) != 0) {
+        // current lane aborted, retire it and carry on with the others
+        vm_lane_retire(vm, b, false);
+        if (b->error == 0 || b->cur < b->errlane) {
+            b->error   = vm->error;
+            b->errlane = b->cur;
+        }
+        if (b->finishing)
+            goto finish;
+    }
+
+    while (b->pending || vm->pc < prog->codesiz) {
+        if (b->pending == 0) {
+            vm_batch_fetch(vm, b);
+            continue;
+        }
+
+        stack_cell_t *cell;
+        switch (vm_getopcode(b->ip)) {
+        case FOPC_NOP:
+            b->pending = 0;
+            break;
+
+        // trivial instructions work on the lanes directly
+        case FOPC_BLK:
+            while (b->pending)
+                vm_lane_pick(b)->curblk++;
+
+            break;
+
+        case FOPC_ENDBLK:
+            while (b->pending) {
+                filter_lane_t *lane = vm_lane_pick(b);
+                if (unlikely(lane->curblk == 0))
+                    vm_lane_abort(vm, b, VM_SPURIOUS_ENDBLK);
+
+                lane->curblk--;
             }
-            DISPATCH();
-
-        EXECUTE(CFAIL):
-            cell = vm_peek(vm);
-            if (cell->value) {
-                cell->value = 0;  // negate existing value
-                if (vm->curblk == 0)
-                    goto done;    // no more blocks, we're done
-
-                // advance up to the next ENDBLK
-                vm_exec_break(vm);
-            } else {
-                vm->si--;  // discard and proceed
+            break;
+
+        case FOPC_LOAD:
+            while (b->pending) {
+                filter_lane_t *lane = vm_lane_pick(b);
+                if (unlikely(lane->si == lane->stacksiz)) {
+                    vm_lane_enter(vm, lane);
+                    vm_growstack(vm);
+                    vm_lane_leave(vm, lane);
+                }
+
+                lane->sp[lane->si++].value = b->arg;
             }
-            DISPATCH();
-
-        EXECUTE(ASPMATCH):
-            vm_exec_aspmatch(vm, vm_getarg(ip));
-            DISPATCH();
-
-        EXECUTE(ASPSTARTS):
-            vm_exec_aspstarts(vm, vm_getarg(ip));
-            DISPATCH();
-
-        EXECUTE(ASPENDS):
-            vm_exec_aspends(vm, vm_getarg(ip));
-            DISPATCH();
-
-        EXECUTE(ASPEXACT):
-            vm_exec_aspexact(vm, vm_getarg(ip));
-            DISPATCH();
-
-        EXECUTE(COMMEXACT):
-            vm_exec_commexact(vm);
-            DISPATCH();
-            
-        EXECUTE(CALL):
-            arg = vm_extendarg(vm_getarg(ip), exarg);
-            if (unlikely(arg >= VM_FUNCS_COUNT))
-                vm_abort(vm, VM_FUNC_UNDEFINED);
-            if (unlikely(!vm->funcs[arg]))
-                vm_abort(vm, VM_FUNC_UNDEFINED);
-
-            vm->funcs[arg](vm);
-            exarg = 0;
-            DISPATCH();
-
-        EXECUTE(SETTLE):
-            vm_exec_settle(vm);
-            DISPATCH();
-
-        EXECUTE(HASATTR):
-            vm_exec_hasattr(vm, vm_getarg(ip));
-            PREDICT(NOT);
-            DISPATCH();
-
-        EXECUTE(EXACT):
-            vm_exec_exact(vm, vm_getarg(ip));
-            DISPATCH();
-
-        EXECUTE(SUBNET):
-            vm_exec_subnet(vm, vm_getarg(ip));
-            DISPATCH();
-
-        EXECUTE(SUPERNET):
-            vm_exec_supernet(vm, vm_getarg(ip));
-            DISPATCH();
-
-        EXECUTE(RELATED):
-            vm_exec_related(vm, vm_getarg(ip));
-            DISPATCH();
-
-        EXECUTE(PFXCONTAINS):
-            arg = vm_extendarg(vm_getarg(ip), exarg);
-            vm_exec_pfxcontains(vm, arg);
-            exarg = 0;
-            DISPATCH();
-
-        EXECUTE(ADDRCONTAINS):
-            arg = vm_extendarg(vm_getarg(ip), exarg);
-            vm_exec_addrcontains(vm, arg);
-            exarg = 0;
-            DISPATCH();
-
-        EXECUTE(ASCONTAINS):
-            arg = vm_extendarg(vm_getarg(ip), exarg);
-            vm_exec_ascontains(vm, arg);
-            exarg = 0;
-            DISPATCH();
-
-        EXECUTE(SETTRIE):
-            arg = vm_extendarg(vm_getarg(ip), exarg);
-            vm_exec_settrie(vm, arg);
-            exarg = 0;
-            DISPATCH();
-
-        EXECUTE(SETTRIE6):
-            arg = vm_extendarg(vm_getarg(ip), exarg);
-            vm_exec_settrie6(vm, arg);
-            exarg = 0;
-            DISPATCH();
-
-        EXECUTE(CLRTRIE):
-            vm_exec_clrtrie(vm);
-            DISPATCH();
-
-        EXECUTE(CLRTRIE6):
-            vm_exec_clrtrie6(vm);
-            DISPATCH();
-
-        EXECUTE(ADDRCMP):
-            arg = vm_extendarg(vm_getarg(ip), exarg);
-            vm_exec_addrcmp(vm, arg);
-            exarg = 0;
-            DISPATCH();
-
-        EXECUTE(PFXCMP):
-            arg = vm_extendarg(vm_getarg(ip), exarg);
-            vm_exec_pfxcmp(vm, arg);
-            exarg = 0;
-            DISPATCH();
-
-        EXECUTE(ASCMP):
-            arg = vm_extendarg(vm_getarg(ip), exarg);
-            vm_exec_ascmp(vm, arg);
-            exarg = 0;
-            DISPATCH();
-
-        EXECUTE_SIGILL:
-            vm_abort(vm, VM_ILLEGAL_OPCODE);
-            DISPATCH();  // unreachable
+            break;
+
+        case FOPC_LOADK:
+            FOREACH_LANE(vm_exec_loadk(vm, b->arg));
+            break;
+
+        case FOPC_UNPACK:
+            FOREACH_LANE(vm_exec_unpack(vm));
+            break;
+
+        case FOPC_STORE:
+            FOREACH_LANE(vm_exec_store(vm));
+            break;
+
+        case FOPC_DISCARD:
+            FOREACH_LANE(vm_exec_discard(vm));
+            break;
+
+        case FOPC_NOT:
+            while (b->pending) {
+                filter_lane_t *lane = vm_lane_pick(b);
+                if (unlikely(lane->si == 0))
+                    vm_lane_abort(vm, b, VM_STACK_UNDERFLOW);
+
+                cell = &lane->sp[lane->si - 1];
+                cell->value = !cell->value;
+            }
+            break;
+
+        case FOPC_CPASS:
+        case FOPC_CFAIL:
+            while (b->pending) {
+                filter_lane_t *lane = vm_lane_pick(b);
+                if (unlikely(lane->si == 0))
+                    vm_lane_abort(vm, b, VM_STACK_UNDERFLOW);
+
+                cell = &lane->sp[lane->si - 1];
+                if (cell->value) {
+                    bool pass = (vm_getopcode(b->ip) == FOPC_CPASS);
+                    if (!pass)
+                        cell->value = 0;  // negate existing value
+
+                    if (lane->curblk == 0) {
+                        // no more blocks, we're done
+                        vm_lane_enter(vm, lane);
+                        vm_lane_retire(vm, b, pass);
+                        continue;
+                    }
+
+                    // park lane up to the next ENDBLK
+                    lane->resume = vm_batch_break(vm, b);
+                    b->parked   |= 1ull << b->cur;
+                } else {
+                    lane->si--;  // discard and proceed
+                }
+            }
+            break;
+
+        case FOPC_ASPMATCH:
+            FOREACH_LANE(vm_exec_aspmatch(vm, vm_getarg(b->ip)));
+            break;
+
+        case FOPC_ASPSTARTS:
+            FOREACH_LANE(vm_exec_aspstarts(vm, vm_getarg(b->ip)));
+            break;
+
+        case FOPC_ASPENDS:
+            FOREACH_LANE(vm_exec_aspends(vm, vm_getarg(b->ip)));
+            break;
+
+        case FOPC_ASPEXACT:
+            FOREACH_LANE(vm_exec_aspexact(vm, vm_getarg(b->ip)));
+            break;
+
+        case FOPC_COMMEXACT:
+            FOREACH_LANE(vm_exec_commexact(vm));
+            break;
+
+        case FOPC_CALL:
+            FOREACH_LANE({
+                if (unlikely(b->arg >= VM_FUNCS_COUNT))
+                    vm_abort(vm, VM_FUNC_UNDEFINED);
+                if (unlikely(!prog->funcs[b->arg]))
+                    vm_abort(vm, VM_FUNC_UNDEFINED);
+
+                prog->funcs[b->arg](vm);
+            });
+            break;
+
+        case FOPC_SETTLE:
+            FOREACH_LANE(vm_exec_settle(vm));
+            break;
+
+        case FOPC_HASATTR:
+            FOREACH_LANE(vm_exec_hasattr(vm, vm_getarg(b->ip)));
+            break;
+
+        case FOPC_HASANYATTR:
+            FOREACH_LANE(vm_exec_hasanyattr(vm, b->arg));
+            break;
+
+        case FOPC_EXACT:
+            FOREACH_LANE(vm_exec_exact(vm, vm_getarg(b->ip)));
+            break;
+
+        case FOPC_SUBNET:
+            FOREACH_LANE(vm_exec_subnet(vm, vm_getarg(b->ip)));
+            break;
+
+        case FOPC_SUPERNET:
+            FOREACH_LANE(vm_exec_supernet(vm, vm_getarg(b->ip)));
+            break;
+
+        case FOPC_RELATED:
+            FOREACH_LANE(vm_exec_related(vm, vm_getarg(b->ip)));
+            break;
+
+        case FOPC_PFXCONTAINS:
+            FOREACH_LANE(vm_exec_pfxcontains(vm, b->arg));
+            break;
+
+        case FOPC_ADDRCONTAINS:
+            FOREACH_LANE(vm_exec_addrcontains(vm, b->arg));
+            break;
+
+        case FOPC_ASCONTAINS:
+            FOREACH_LANE(vm_exec_ascontains(vm, b->arg));
+            break;
+
+        case FOPC_SETTRIE:
+            FOREACH_LANE(vm_exec_settrie(vm, b->arg));
+            break;
+
+        case FOPC_SETTRIE6:
+            FOREACH_LANE(vm_exec_settrie6(vm, b->arg));
+            break;
+
+        case FOPC_CLRTRIE:
+            FOREACH_LANE(vm_exec_clrtrie(vm));
+            break;
+
+        case FOPC_CLRTRIE6:
+            FOREACH_LANE(vm_exec_clrtrie6(vm));
+            break;
+
+        case FOPC_ADDRCMP:
+            FOREACH_LANE(vm_exec_addrcmp(vm, b->arg));
+            break;
+
+        case FOPC_PFXCMP:
+            FOREACH_LANE(vm_exec_pfxcmp(vm, b->arg));
+            break;
+
+        case FOPC_ASCMP:
+            FOREACH_LANE(vm_exec_ascmp(vm, b->arg));
+            break;
+
+        default:
+            FOREACH_LANE(vm_abort(vm, VM_ILLEGAL_OPCODE));
+            break;
         }
     }
 
-done:
-    vm_exec_settle(vm);
-    if (unlikely(vm->curblk > 0))
-        vm_abort(vm, VM_DANGLING_BLK);
-
-    cell = vm_pop(vm);
-    return cell->value != 0;
-
-#undef FETCH
-#undef DISPATCH
-#undef PREDICT
-#undef EXECUTE
-#undef EXECUTE_SIGILL
-#pragma GCC diagnostic pop
+    b->pending   = b->live;
+    b->finishing = true;
+
+finish:
+    while (b->pending) {
+        vm_lane_next(vm, b);
+
+        vm_exec_settle(vm);
+        if (unlikely(vm->curblk > 0))
+            vm_abort(vm, VM_DANGLING_BLK);
+
+        stack_cell_t *cell = vm_pop(vm);
+        vm_lane_retire(vm, b, cell->value != 0);
+    }
+
+    // give the context its own stack back
+    vm->sp       = sp;
+    vm->stacksiz = stacksiz;
+    vm->si       = 0;
+    vm->curblk   = 0;
+
+    *result = b->passed;
+    return b->error;
 }
 
+#undef FOREACH_LANE
+
+UBGP_API int bgp_filter_batch(ubgp_msg_s *const   *msgs,
+                              size_t               n,
+                              const filter_prog_t *prog,
+                              filter_ctx_t        *ctx,
+                              uint64_t            *results)
+{
+    struct filter_batch *b = NULL;
+    // batched lanes share the temporary tries, programs writing
+    // to them must run one message at a time
+    if (likely(!ctx->prof && !prog->writestries))
+        b = vm_batch_get(ctx);  // on out of memory just go the slow way
+
+    int error  = 0;
+    int passed = 0;
+    for (size_t i = 0; i < n; i += FILTER_BATCH_LANES) {
+        uint m = MIN(n - i, (size_t) FILTER_BATCH_LANES);
+
+        uint64_t word = 0;
+        int res       = 0;
+        if (b) {
+            res = vm_run_batch(&msgs[i], m, prog, ctx, b, &word);
+        } else {
+            for (uint j = 0; j < m; j++) {
+                int r = bgp_filter_ctx(msgs[i + j], prog, ctx);
+                if (r > 0)
+                    word |= 1ull << j;
+                if (r < 0 && res == 0)
+                    res = r;
+            }
+        }
+
+        results[i / FILTER_BATCH_LANES] = word;
+        passed += popcnt64(word);
+        if (res < 0 && error == 0)
+            error = res;
+    }
+
+    return (error < 0) ? error : passed;
+}
@@ -30,6 +30,7 @@
 #include <setjmp.h>
 #include <stdarg.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 
 enum {
@@ -38,9 +39,12 @@ enum {
     KBASESIZ,  // base size for known variables
 
     KBUFSIZ = 64,
-    STACKBUFSIZ = 256,
+    STACKBUFSIZ = 32,
+    PFXBUFSIZ = 64,
 
-    BLKSTACKSIZ = 32
+    BLKSTACKSIZ = 32,
+
+    FILTER_BATCH_LANES = 64  // messages executed together by bgp_filter_batch()
 };
 
 enum { VM_TMPTRIE, VM_TMPTRIE6 };
@@ -86,45 +90,149 @@ typedef union {
 
 typedef uint16_t bytecode_t;
 
-typedef struct filter_vm filter_vm_t;
+typedef struct filter_prog filter_prog_t;
+typedef struct filter_ctx  filter_ctx_t;
+typedef struct filter_vm   filter_vm_t;
+
+enum {
+    VM_OPCODES_MAX = 256  // opcodes are 8 bits wide
+};
+
+/**
+ * filter_profile_t:
+ * @runs:          profiled bgp_filter() executions
+ * @passes:        executions resulting in PASS
+ * @errors:        executions aborted with an error
+ * @count:         per instruction execution count, indexed by program counter
+ * @cycles:        per instruction cycles, indexed by program counter
+ * @shortcircuits: per instruction count of CPASS/CFAIL terminating a block
+ *                 (or the whole filter), indexed by program counter
+ * @codesiz:       size of the per instruction arrays
+ * @opcount:       per opcode execution count
+ * @opcycles:      per opcode cycles
+ * @bloomprobes:   prefixes tested by `EXACT` against a trie Bloom filter,
+ *                 see patbloom()
+ * @bloomrejects:  probes rejected by the Bloom filter, skipping the trie
+ * @bloomfalsepos: probes passing the Bloom filter, but missing from the trie
+ *
+ * Execution profile collected by bgp_filter() once filter_profile_enable()
+ * is called on a VM. Cycles are read from the CPU timestamp counter where
+ * available, nanoseconds are used otherwise.
+ */
+typedef struct {
+    ullong runs;
+    ullong passes;
+    ullong errors;
+    ullong *count;
+    ullong *cycles;
+    ullong *shortcircuits;
+    ushort codesiz;
+    ullong opcount[VM_OPCODES_MAX];
+    ullong opcycles[VM_OPCODES_MAX];
+    ullong bloomprobes;
+    ullong bloomrejects;
+    ullong bloomfalsepos;
+
+    /*< private >*/
+    int lastpc, lastop;
+    ullong stamp;
+} filter_profile_t;
 
-typedef void (*filter_func_t)(filter_vm_t *vm);
+typedef void (*filter_func_t)(filter_ctx_t *vm);
 
 enum {
     VM_SHORTCIRCUIT_FORCE_FLAG = 1 << 2
 };
 
-struct filter_vm {
-    ubgp_msg_s *bgp;
-    patricia_trie_t *curtrie, *curtrie6;
-    stack_cell_t *sp, *kp;  // stack and constant segment pointers
+/**
+ * filter_prog_t:
+ * @code:  bytecode segment
+ * @kp:    constant segment, indexes below %KBASESIZ are reserved for the
+ *         known variables of each #filter_ctx_t
+ * @tries: PATRICIA tries segment, indexes %VM_TMPTRIE and %VM_TMPTRIE6 are
+ *         reserved for the temporary tries of each #filter_ctx_t
+ * @funcs: functions available to the `CALL` instruction
+ *
+ * A compiled filter program, it is only modified during compilation,
+ * and may be shared by any number of #filter_ctx_t afterwards, possibly
+ * running concurrently on different threads.
+ * Program tries are read-only during execution, instructions writing
+ * to them abort with %VM_TRIE_READONLY, only the temporary tries of
+ * the running #filter_ctx_t may be written.
+ */
+struct filter_prog {
+    bytecode_t *code;
+    stack_cell_t *kp;
     patricia_trie_t *tries;
     filter_func_t funcs[VM_FUNCS_COUNT];
-    ushort flags;        // general VM flags
 
     /*< private >*/
-    ushort pc;
-    ushort si;           // stack index
-    ushort access_mask;  // current packet access mask
-    ushort ntries;
-    ushort maxtries;
-    ushort stacksiz;
     ushort codesiz;
     ushort maxcode;
     ushort ksiz;
     ushort maxk;
-    ushort curblk;
-    stack_cell_t stackbuf[STACKBUFSIZ];
+    ushort ntries;
+    ushort maxtries;
+    bool writestries;  // emits trie writes, see vm_emit()
+    uint highwater;  // permanent heap zone size
+    uint heapsiz;
+    void *heap;
     stack_cell_t kbuf[KBUFSIZ];
     patricia_trie_t triebuf[2];
-    bytecode_t *code;
-    void *heap;
-    uint highwater;
-    uint dynmarker;
+};
+
+/**
+ * filter_ctx_t:
+ * @prog:  program being executed, only meaningful during execution
+ * @bgp:   packet being filtered, only meaningful during execution
+ * @known: known variables, set by the caller before execution
+ *         and accessed by the program as constants
+ * @prof:  execution profile, %NULL unless enabled with
+ *         filter_profile_enable()
+ *
+ * Per thread filter execution state, a context can run any
+ * #filter_prog_t, but only one at a time.
+ */
+struct filter_ctx {
+    const filter_prog_t *prog;
+    ubgp_msg_s *bgp;
+    patricia_trie_t *curtrie, *curtrie6;
+    stack_cell_t *sp;    // stack segment pointer
+    filter_profile_t *prof;
+    ushort flags;        // general VM flags
+
+    /*< private >*/
+    ushort pc;
+    ushort si;           // stack index
+    ushort access_mask;  // current packet access mask
+    ushort stacksiz;
+    ushort curblk;
+    uint dynmarker;      // temporary heap zone usage
     uint heapsiz;
+    void *heap;          // temporary heap zone, see vm_heap_ptr()
     ubgp_err (*settle_func)(ubgp_msg_s *); // SETTLE function (if not NULL has to be called to terminate the iteration)
     int error;
     jmp_buf except;
+    struct filter_batch *batch;  // column-wise execution state, see bgp_filter_batch()
+    netaddrap_t *pfxs;   // prefixes decoded in bulk, see vm_decode_pfxs()
+    uint pfxsiz;
+    stack_cell_t known[KBASESIZ];
+    patricia_trie_t tmptries[2];
+    stack_cell_t stackbuf[STACKBUFSIZ];
+    netaddrap_t pfxbuf[PFXBUFSIZ];
+};
+
+/**
+ * filter_vm_t:
+ * @prog: the filter program
+ * @ctx:  a context to execute @prog
+ *
+ * Convenience bundle of a program and a context,
+ * for single threaded users.
+ */
+struct filter_vm {
+    filter_prog_t prog;
+    filter_ctx_t  ctx;
 };
 
 typedef struct {
@@ -148,7 +256,8 @@ enum {
     VM_DANGLING_BLK     = -12,
     VM_SPURIOUS_ENDBLK  = -13,
     VM_SURPRISING_BYTES = -14,
-    VM_BAD_ARRAY        = -15
+    VM_BAD_ARRAY        = -15,
+    VM_TRIE_READONLY    = -16
 };
 
 static inline char *filter_strerror(int err)
@@ -189,17 +298,104 @@ static inline char *filter_strerror(int err)
         return "Sorry, I cannot make sense of these bytes";
     case VM_BAD_ARRAY:
         return "Array access out of bounds";
+    case VM_TRIE_READONLY:
+        return "Write to a read-only program trie";
     default:
         return "<Unknown error>";
     }
 }
 
+/**
+ * filter_prog_init:
+ * @prog: program to be initialized
+ *
+ * Initialize an empty program, ready for compilation.
+ */
+UBGP_API CHECK_NONNULL(1) void filter_prog_init(filter_prog_t *prog);
+
+/**
+ * filter_ctx_init:
+ * @ctx: context to be initialized
+ *
+ * Initialize an execution context.
+ */
+UBGP_API CHECK_NONNULL(1) void filter_ctx_init(filter_ctx_t *ctx);
+
+UBGP_API CHECK_NONNULL(1) void filter_prog_destroy(filter_prog_t *prog);
+
+UBGP_API CHECK_NONNULL(1) void filter_ctx_destroy(filter_ctx_t *ctx);
+
+/**
+ * bgp_filter_ctx:
+ * @msg:  BGP message to be filtered
+ * @prog: compiled filter program, not modified
+ * @ctx:  execution context
+ *
+ * Run @prog on @msg, using @ctx for every execution state.
+ * Distinct contexts may run the same program concurrently.
+ *
+ * Returns: a positive value if @msg passes the filter, 0 if it doesn't,
+ *          a negative VM error code otherwise, see filter_strerror().
+ */
+UBGP_API CHECK_NONNULL(1, 2, 3) int bgp_filter_ctx(ubgp_msg_s          *msg,
+                                                   const filter_prog_t *prog,
+                                                   filter_ctx_t        *ctx);
+
+/**
+ * bgp_filter_batch:
+ * @msgs:    BGP messages to be filtered
+ * @n:       number of messages in @msgs
+ * @prog:    compiled filter program, not modified
+ * @ctx:     execution context
+ * @results: results bitmap, must hold at least `(n + 63) / 64` words
+ *
+ * Run @prog on every message in @msgs, column-wise: each instruction is
+ * executed on up to %FILTER_BATCH_LANES messages before moving on to the
+ * next one, amortizing dispatch and setup costs and keeping the data
+ * accessed by each instruction hot in cache.
+ *
+ * On return, bit `i % 64` of `results[i / 64]` is set if `msgs[i]` passed
+ * the filter, and cleared if it didn't or if its execution failed.
+ * The known variables of @ctx are shared by every message.
+ *
+ * Programs manipulating the temporary tries, and profiled contexts,
+ * are transparently executed one message at a time, with identical results.
+ * Functions invoked by `CALL` must only depend on the context stack
+ * and packet.
+ *
+ * Returns: the number of messages passing the filter, or the negative
+ *          VM error code of the first failing message, see filter_strerror().
+ */
+UBGP_API CHECK_NONNULL(1, 3, 4, 5) int bgp_filter_batch(ubgp_msg_s *const   *msgs,
+                                                        size_t               n,
+                                                        const filter_prog_t *prog,
+                                                        filter_ctx_t        *ctx,
+                                                        uint64_t            *results);
+
 UBGP_API CHECK_NONNULL(1) void filter_init(filter_vm_t *vm);
 
 UBGP_API CHECK_NONNULL(1, 2) void filter_dump(FILE *f, filter_vm_t *vm);
 
+/**
+ * bgp_filter:
+ *
+ * Equivalent to bgp_filter_ctx() with @vm program and context.
+ */
 UBGP_API CHECK_NONNULL(1, 2) int bgp_filter(ubgp_msg_s *msg, filter_vm_t *vm);
 
+/**
+ * filter_profile_enable:
+ * @ctx: an initialized #filter_ctx_t.
+ *
+ * Switch @ctx to the profiling interpreter, every following execution
+ * accumulates its counters and cycles into @ctx profile,
+ * which filter_dump() prints along with the bytecode.
+ * Profiling has a significant overhead, it is a debugging aid.
+ *
+ * Returns: 0 on success, %VM_OUT_OF_MEMORY on allocation failure.
+ */
+UBGP_API CHECK_NONNULL(1) int filter_profile_enable(filter_ctx_t *ctx);
+
 UBGP_API CHECK_NONNULL(1) void filter_destroy(filter_vm_t *vm);
 
 #endif
@@ -0,0 +1,279 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#include "bloom.h"
+#include "branch.h"
+#include "flap.h"
+#include "ubgpdef.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    FLAP_WITHDRAWN  = 1 << 0,  // last update of the route was a withdrawal
+    FLAP_SUPPRESSED = 1 << 1,  // route is flapping
+    FLAP_FLAGS      = FLAP_WITHDRAWN | FLAP_SUPPRESSED,
+
+    FLAP_MIN_SLOTS  = 1024,
+    FLAP_SWEEP_STEP = 4        // slots inspected by each update
+};
+
+struct flap_slot_s {
+    uint64_t key;      // route fingerprint, flags in the low bits, 0 marks a free slot
+    float    penalty;  // as of stamp
+    uint32_t stamp;    // last update
+};
+
+_Static_assert(sizeof(flap_slot_t) == 16, "flap_slot_t must be 16 bytes");
+
+static const flap_params_t rfc2439params = {
+    .withdrawal  = 1000.0f,
+    .readvertise = 0.0f,
+    .change      = 500.0f,
+    .suppress    = 2000.0f,
+    .reuse       = 750.0f,
+    .ceiling     = 12000.0f,
+    .halflife    = 15 * 60
+};
+
+static uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+static uint64_t fingerprint(uint32_t peer, const netaddr_t *pfx, uint32_t pathid)
+{
+    uint64_t h = mix64(bloomhash(pfx) + pfx->family);
+    h = mix64(h ^ (((uint64_t) peer << 32) | pathid));
+
+    h &= ~(uint64_t) FLAP_FLAGS;
+    return (h != 0) ? h : FLAP_FLAGS + 1;
+}
+
+static size_t homeslot(const flap_table_t *t, uint64_t key)
+{
+    return (key >> 2) & (t->nslots - 1);
+}
+
+static float decayed(const flap_table_t *t, const flap_slot_t *s, time_t now)
+{
+    int64_t dt = (int64_t) (uint32_t) now - s->stamp;
+    if (dt <= 0)
+        return s->penalty;
+
+    return s->penalty * exp2(-(double) dt / t->params.halflife);
+}
+
+// cold routes are equivalent to routes never seen, so they may be forgotten any time,
+// suppressed routes never are, their next update must report FLAP_REUSE
+static bool iscold(const flap_table_t *t, const flap_slot_t *s, time_t now)
+{
+    if (s->key & FLAP_SUPPRESSED)
+        return false;
+
+    int64_t dt = (int64_t) (uint32_t) now - s->stamp;
+    return dt >= t->params.halflife && decayed(t, s, now) < t->params.reuse / 2;
+}
+
+UBGP_API void flapdefaults(flap_params_t *params)
+{
+    *params = rfc2439params;
+}
+
+UBGP_API void flapinit(flap_table_t *t, const flap_params_t *params)
+{
+    memset(t, 0, sizeof(*t));
+    t->params = params ? *params : rfc2439params;
+}
+
+UBGP_API void flapdestroy(flap_table_t *t)
+{
+    free(t->slots);
+}
+
+UBGP_API size_t flapfootprint(const flap_table_t *t)
+{
+    return sizeof(*t) + t->nslots * sizeof(*t->slots);
+}
+
+// resize to fit the routes that aren't cold, dropping the rest
+static bool rehash(flap_table_t *t, time_t now)
+{
+    size_t live = 0;
+    for (size_t i = 0; i < t->nslots; i++) {
+        if (t->slots[i].key != 0 && !iscold(t, &t->slots[i], now))
+            live++;
+    }
+
+    size_t cap = MAX(t->nslots, (size_t) FLAP_MIN_SLOTS);
+    while (3 * (live + 1) > 2 * cap)
+        cap *= 2;
+
+    flap_slot_t *slots = calloc(cap, sizeof(*slots));
+    if (unlikely(!slots))
+        return false;
+
+    flap_slot_t *old  = t->slots;
+    size_t       nold = t->nslots;
+
+    t->slots    = slots;
+    t->nslots   = cap;
+    t->nused    = live;
+    t->sweepcur = 0;
+    for (size_t i = 0; i < nold; i++) {
+        if (old[i].key == 0 || iscold(t, &old[i], now))
+            continue;
+
+        size_t h = homeslot(t, old[i].key);
+        while (slots[h].key != 0)
+            h = (h + 1) & (cap - 1);
+
+        slots[h] = old[i];
+    }
+
+    free(old);
+    return true;
+}
+
+// backward shift deletion, keeps probe sequences intact without tombstones
+static void removeslot(flap_table_t *t, size_t i)
+{
+    size_t mask = t->nslots - 1;
+
+    size_t j = i;
+    while (true) {
+        j = (j + 1) & mask;
+        if (t->slots[j].key == 0)
+            break;
+
+        // slot j may fill the hole, unless its home lies cyclically in (i, j]
+        size_t home = homeslot(t, t->slots[j].key);
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            t->slots[i] = t->slots[j];
+            i = j;
+        }
+    }
+
+    t->slots[i].key = 0;
+    t->nused--;
+}
+
+UBGP_API size_t flapsweep(flap_table_t *t, time_t now, size_t budget)
+{
+    if (t->nslots == 0)
+        return 0;
+    if (budget == 0)
+        budget = t->nslots;
+
+    size_t n = 0;
+    for (size_t step = 0; step < budget; ) {
+        flap_slot_t *s = &t->slots[t->sweepcur];
+        if (s->key != 0 && iscold(t, s, now)) {
+            // inspect whatever is shifted into this slot as well
+            removeslot(t, t->sweepcur);
+            n++;
+            continue;
+        }
+
+        t->sweepcur = (t->sweepcur + 1) & (t->nslots - 1);
+        step++;
+    }
+
+    return n;
+}
+
+UBGP_API int flapupdate(flap_table_t    *t,
+                        uint32_t         peer,
+                        const netaddr_t *pfx,
+                        uint32_t         pathid,
+                        bool             withdrawn,
+                        time_t           now,
+                        float           *ppenalty)
+{
+    if (4 * (t->nused + 1) > 3 * t->nslots && !rehash(t, now))
+        return -1;
+
+    flapsweep(t, now, FLAP_SWEEP_STEP);
+
+    uint64_t key  = fingerprint(peer, pfx, pathid);
+    size_t   mask = t->nslots - 1;
+    size_t   h    = homeslot(t, key);
+    while (t->slots[h].key != 0 && (t->slots[h].key & ~(uint64_t) FLAP_FLAGS) != key)
+        h = (h + 1) & mask;
+
+    flap_slot_t *s = &t->slots[h];
+
+    const flap_params_t *p = &t->params;
+
+    bool fresh = (s->key == 0 || iscold(t, s, now));
+    if (fresh) {
+        if (s->key == 0)
+            t->nused++;
+
+        s->key     = key;
+        s->penalty = 0.0f;
+    } else {
+        s->penalty = decayed(t, s, now);
+    }
+
+    uint flags = s->key & FLAP_FLAGS;
+
+    int ev = FLAP_NONE;
+    if ((flags & FLAP_SUPPRESSED) && s->penalty < p->reuse) {
+        flags &= ~FLAP_SUPPRESSED;
+        ev = FLAP_REUSE;
+    }
+
+    if (withdrawn) {
+        // repeated withdrawals don't make a route any less stable
+        if ((flags & FLAP_WITHDRAWN) == 0)
+            s->penalty += p->withdrawal;
+
+        flags |= FLAP_WITHDRAWN;
+    } else {
+        // attributes aren't compared, any implicit withdrawal counts as a change
+        if (flags & FLAP_WITHDRAWN)
+            s->penalty += p->readvertise;
+        else if (!fresh)
+            s->penalty += p->change;
+
+        flags &= ~FLAP_WITHDRAWN;
+    }
+
+    s->penalty = MIN(s->penalty, p->ceiling);
+    if ((flags & FLAP_SUPPRESSED) == 0 && s->penalty >= p->suppress) {
+        flags |= FLAP_SUPPRESSED;
+        ev = FLAP_SUPPRESS;
+    }
+
+    s->key   = key | flags;
+    s->stamp = (uint32_t) now;
+    if (ppenalty)
+        *ppenalty = s->penalty;
+
+    return ev;
+}
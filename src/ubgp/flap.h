@@ -0,0 +1,185 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#ifndef UBGP_FLAP_H_
+#define UBGP_FLAP_H_
+
+#include "funcattribs.h"
+#include "netaddr.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * SECTION: flap
+ * @title: Route Flap Detection
+ * @include: flap.h
+ *
+ * Track route flapping with RFC 2439 style dampening penalties,
+ * per (peer, prefix, path identifier) route.
+ *
+ * Each withdrawal or announcement adds to the route penalty, which
+ * decays exponentially over time, a route whose penalty crosses the
+ * suppress threshold is flapping, until it decays below the reuse one.
+ * Decay is applied lazily, as routes are accessed.
+ *
+ * Routes are kept in an open addressing hash table of 16 bytes slots,
+ * storing a 62 bits fingerprint of the route rather than the route
+ * itself, as a wrong merge is unlikely enough (about n^2/2^63
+ * for n routes) not to matter to analysis.
+ * Routes that weren't updated for a half-life, and whose penalty decayed
+ * below half the reuse threshold, are as good as never seen, unless they're
+ * still suppressed, waiting for an update to report their reuse: they're swept
+ * incrementally while the table is updated, so memory follows the set
+ * of routes recently active, rather than every route ever seen:
+ * 10M tracked routes take 256MiB.
+ */
+
+/**
+ * flap_params_t:
+ * @withdrawal:  penalty of a withdrawal
+ * @readvertise: penalty of an announcement following a withdrawal
+ * @change:      penalty of an announcement replacing a previous one
+ * @suppress:    threshold above which a route is flapping
+ * @reuse:       threshold below which a flapping route is stable again
+ * @ceiling:     maximum penalty
+ * @halflife:    seconds for a penalty to halve
+ *
+ * Dampening parameters, see flapinit().
+ */
+typedef struct {
+    float  withdrawal;
+    float  readvertise;
+    float  change;
+    float  suppress;
+    float  reuse;
+    float  ceiling;
+    time_t halflife;
+} flap_params_t;
+
+/**
+ * flap_event_t:
+ * @FLAP_NONE:     nothing noteworthy happened to the route
+ * @FLAP_SUPPRESS: route penalty crossed the suppress threshold
+ * @FLAP_REUSE:    penalty of a flapping route decayed below the reuse threshold
+ *
+ * Route state transitions, see flapupdate().
+ */
+typedef enum {
+    FLAP_NONE,
+    FLAP_SUPPRESS,
+    FLAP_REUSE
+} flap_event_t;
+
+typedef struct flap_slot_s flap_slot_t;
+
+/**
+ * flap_table_t:
+ *
+ * A route flap tracking table.
+ */
+typedef struct {
+    /*< private >*/
+    flap_slot_t  *slots;
+    size_t        nslots, nused;
+    size_t        sweepcur;  // next slot to be inspected by the incremental sweep
+    flap_params_t params;
+} flap_table_t;
+
+/**
+ * flapdefaults:
+ * @params: parameters to be filled
+ *
+ * Fill @params with RFC 2439 suggested values: 1000 per withdrawal,
+ * 500 per attribute change, suppress at 2000, reuse at 750,
+ * 15 minutes half-life and a ceiling of 12000.
+ */
+UBGP_API CHECK_NONNULL(1) void flapdefaults(flap_params_t *params);
+
+/**
+ * flapinit:
+ * @t:      table to be initialized
+ * @params: dampening parameters, %NULL for flapdefaults() ones
+ */
+UBGP_API CHECK_NONNULL(1) void flapinit(flap_table_t *t, const flap_params_t *params);
+
+UBGP_API CHECK_NONNULL(1) void flapdestroy(flap_table_t *t);
+
+/**
+ * flapupdate:
+ * @t:         a #flap_table_t
+ * @peer:      identifier of the peer
+ * @pfx:       the announced or withdrawn prefix
+ * @pathid:    ADD-PATH path identifier, 0 if not applicable
+ * @withdrawn: whether this is a withdrawal
+ * @now:       timestamp of the update, expected to be roughly non-decreasing
+ * @ppenalty:  if not %NULL, storage for the route penalty, after the update
+ *
+ * Account an update to a route, sweeping a few slots of the table
+ * in the process.
+ *
+ * Returns: the route state transition, if any, -1 on out of memory.
+ */
+UBGP_API CHECK_NONNULL(1, 3) int flapupdate(flap_table_t    *t,
+                                            uint32_t         peer,
+                                            const netaddr_t *pfx,
+                                            uint32_t         pathid,
+                                            bool             withdrawn,
+                                            time_t           now,
+                                            float           *ppenalty);
+
+/**
+ * flapsweep:
+ * @t:      a #flap_table_t
+ * @now:    current time
+ * @budget: maximum number of slots to inspect, 0 for the whole table
+ *
+ * Forget routes that weren't updated for a half-life and whose penalty
+ * decayed below half the reuse threshold, suppressed routes are kept until
+ * their next update reports %FLAP_REUSE. Sweeping resumes from where the previous
+ * sweep stopped. Sweeping never affects the outcome of flapupdate().
+ *
+ * Returns: number of forgotten routes.
+ */
+UBGP_API CHECK_NONNULL(1) size_t flapsweep(flap_table_t *t, time_t now, size_t budget);
+
+/**
+ * flapcount:
+ * @t: a #flap_table_t
+ *
+ * Returns: number of routes currently tracked.
+ */
+static inline PUREFUNC CHECK_NONNULL(1) size_t flapcount(const flap_table_t *t)
+{
+    return t->nused;
+}
+
+/**
+ * flapfootprint:
+ * @t: a #flap_table_t
+ *
+ * Returns: memory taken by @t, in bytes.
+ */
+UBGP_API PUREFUNC CHECK_NONNULL(1) size_t flapfootprint(const flap_table_t *t);
+
+#endif
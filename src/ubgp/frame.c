@@ -0,0 +1,226 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#include "branch.h"
+#include "endian.h"
+#include "frame.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    MRT_HDRSIZ     = 12,
+    MRT_LENOFF     = 8,
+    MRT_MAXLEN     = 64 * 1024 * 1024,  // sanity bound, well above any sane record
+
+    BGP_MARKERSIZ  = 16,
+    BGP_HDRSIZ     = 19,
+    BGP_LENOFF     = BGP_MARKERSIZ,
+
+    BMP_FRAMEHDRSIZ = 6,
+    BMP_VERSOFF     = 0,
+    BMP_LENOFF      = 1,
+    BMP_VERS        = 3,
+    BMP_FRAMEMAXLEN = 16 * 1024 * 1024
+};
+
+static size_t hdrsize(const framer_t *f)
+{
+    switch (f->kind) {
+    case FRAME_MRT:
+        return MRT_HDRSIZ;
+    case FRAME_BMP:
+        return BMP_FRAMEHDRSIZ;
+    default:
+        return BGP_HDRSIZ;
+    }
+}
+
+// size of the record starting at hdr, 0 on error
+static size_t recsize(framer_t *f, const byte *hdr)
+{
+    if (f->kind == FRAME_MRT) {
+        uint32_t len;
+        memcpy(&len, &hdr[MRT_LENOFF], sizeof(len));
+        len = beswap32(len);
+        if (unlikely(len > MRT_MAXLEN)) {
+            f->err = FRAME_EBADLEN;
+            return 0;
+        }
+
+        return MRT_HDRSIZ + (size_t) len;
+    }
+    if (f->kind == FRAME_BMP) {
+        if (unlikely(hdr[BMP_VERSOFF] != BMP_VERS)) {
+            f->err = FRAME_EBADVERSION;
+            return 0;
+        }
+
+        // length includes the header itself
+        uint32_t len;
+        memcpy(&len, &hdr[BMP_LENOFF], sizeof(len));
+        len = beswap32(len);
+        if (unlikely(len < BMP_FRAMEHDRSIZ || len > BMP_FRAMEMAXLEN)) {
+            f->err = FRAME_EBADLEN;
+            return 0;
+        }
+
+        return len;
+    }
+
+    for (int i = 0; i < BGP_MARKERSIZ; i++) {
+        if (unlikely(hdr[i] != 0xff)) {
+            f->err = FRAME_EBADMARKER;
+            return 0;
+        }
+    }
+
+    uint16_t len;
+    memcpy(&len, &hdr[BGP_LENOFF], sizeof(len));
+    len = beswap16(len);
+    if (unlikely(len < BGP_HDRSIZ)) {
+        f->err = FRAME_EBADLEN;
+        return 0;
+    }
+
+    return len;
+}
+
+static bool stash(framer_t *f, const byte *data, size_t n)
+{
+    if (unlikely(f->len + n > f->cap)) {
+        size_t cap = MAX(2 * f->cap, f->len + n);
+
+        byte *buf = realloc(f->buf, cap);
+        if (unlikely(!buf)) {
+            f->err = FRAME_ENOMEM;
+            return false;
+        }
+
+        f->buf = buf;
+        f->cap = cap;
+    }
+
+    memcpy(&f->buf[f->len], data, n);
+    f->len += n;
+    return true;
+}
+
+UBGP_API void framerinit(framer_t *f, frame_kind_t kind)
+{
+    memset(f, 0, sizeof(*f));
+    f->kind = kind;
+}
+
+UBGP_API void framerfeed(framer_t *f, const void *data, size_t n)
+{
+    f->ptr = data;
+    f->end = f->ptr + n;
+}
+
+UBGP_API const void *framernext(framer_t *f, size_t *pn)
+{
+    if (unlikely(f->err))
+        return NULL;
+
+    size_t hdrsiz = hdrsize(f);
+    size_t avail  = f->end - f->ptr;
+    if (f->len > 0) {
+        // complete the buffered record, its header first
+        size_t want = ((f->need > 0) ? f->need : hdrsiz) - f->len;
+        size_t n    = MIN(want, avail);
+        if (unlikely(!stash(f, f->ptr, n)))
+            return NULL;
+
+        f->ptr += n;
+        avail  -= n;
+        if (f->len < hdrsiz)
+            return NULL;
+
+        if (f->need == 0) {
+            f->need = recsize(f, f->buf);
+            if (unlikely(f->need == 0))
+                return NULL;
+
+            n = MIN(f->need - f->len, avail);
+            if (unlikely(!stash(f, f->ptr, n)))
+                return NULL;
+
+            f->ptr += n;
+        }
+        if (f->len < f->need)
+            return NULL;
+
+        // the buffer is only overwritten by the next stash()
+        if (pn)
+            *pn = f->need;
+
+        f->len  = 0;
+        f->need = 0;
+        return f->buf;
+    }
+
+    if (avail == 0)
+        return NULL;
+
+    size_t size = 0;
+    if (avail >= hdrsiz) {
+        size = recsize(f, f->ptr);
+        if (unlikely(size == 0))
+            return NULL;
+
+        if (likely(size <= avail)) {
+            // whole record available, return it in place
+            const byte *rec = f->ptr;
+
+            f->ptr += size;
+            if (pn)
+                *pn = size;
+
+            return rec;
+        }
+    }
+
+    // record spans multiple chunks, keep what we have
+    if (unlikely(!stash(f, f->ptr, avail)))
+        return NULL;
+
+    f->ptr  = f->end;
+    f->need = size;
+    return NULL;
+}
+
+UBGP_API frame_err framererror(const framer_t *f)
+{
+    return f->err;
+}
+
+UBGP_API size_t framerpending(const framer_t *f)
+{
+    return f->len;
+}
+
+UBGP_API void framerdestroy(framer_t *f)
+{
+    free(f->buf);
+}
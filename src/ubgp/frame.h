@@ -0,0 +1,152 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#ifndef UBGP_FRAME_H_
+#define UBGP_FRAME_H_
+
+#include "funcattribs.h"
+#include "ubgpdef.h"
+
+#include <stddef.h>
+
+/**
+ * SECTION: frame
+ * @title: Incremental Record Framing
+ * @include: frame.h
+ *
+ * Split a byte stream into MRT records, BGP or BMP messages, as the stream
+ * arrives in chunks of any size. Data is pushed into a #framer_t as soon
+ * as it is available, so records can be extracted from an event loop
+ * without ever blocking.
+ *
+ * Records lying entirely inside a chunk are returned in place, without
+ * copies, only records spanning multiple chunks are buffered.
+ * Framing only checks record boundaries, records are then
+ * decoded by setmrtread() or setbgpread() as usual.
+ */
+
+/**
+ * frame_kind_t:
+ * @FRAME_MRT: MRT records, as in RFC 6396
+ * @FRAME_BGP: BGP messages, with their 16 bytes marker, as in RFC 4271
+ * @FRAME_BMP: BMP messages, as in RFC 7854
+ *
+ * Record framing of a stream.
+ */
+typedef enum {
+    FRAME_MRT,
+    FRAME_BGP,
+    FRAME_BMP
+} frame_kind_t;
+
+/**
+ * frame_err:
+ * @FRAME_ENOERR:      no error (success) guaranteed to be zero
+ * @FRAME_ENOMEM:      out of memory
+ * @FRAME_EBADMARKER:  bad BGP marker
+ * @FRAME_EBADLEN:     record length out of bounds
+ * @FRAME_EBADVERSION: unsupported BMP version
+ *
+ * Framing error codes, any error means the stream lost sync
+ * with record boundaries.
+ */
+typedef enum {
+    FRAME_ENOERR = 0,
+    FRAME_ENOMEM,
+    FRAME_EBADMARKER,
+    FRAME_EBADLEN,
+    FRAME_EBADVERSION
+} frame_err;
+
+static inline const char *framestrerror(frame_err err)
+{
+    switch (err) {
+    case FRAME_ENOERR:
+        return "Success";
+    case FRAME_ENOMEM:
+        return "Out of memory";
+    case FRAME_EBADMARKER:
+        return "Bad BGP marker";
+    case FRAME_EBADLEN:
+        return "Bad record length";
+    case FRAME_EBADVERSION:
+        return "Unsupported BMP version";
+    default:
+        return "Unknown error";
+    }
+}
+
+/**
+ * framer_t:
+ *
+ * Push parser state, splitting a stream into records.
+ */
+typedef struct {
+    /*< private >*/
+    frame_kind_t kind;
+    frame_err    err;
+    const byte  *ptr, *end;   // unread portion of the last chunk
+    byte        *buf;         // record spanning multiple chunks
+    size_t       len, cap;
+    size_t       need;        // size of the buffered record, 0 until its header is complete
+} framer_t;
+
+UBGP_API CHECK_NONNULL(1) void framerinit(framer_t *f, frame_kind_t kind);
+
+/**
+ * framerfeed:
+ * @f:    a #framer_t
+ * @data: next chunk of the stream
+ * @n:    @data size in bytes
+ *
+ * Push the next chunk of the stream, records are then extracted by
+ * framernext(). @data must remain valid until framernext() returns %NULL,
+ * that is until the whole chunk is consumed, whatever is left
+ * of an incomplete record at that point is buffered by @f.
+ */
+UBGP_API CHECK_NONNULL(1) void framerfeed(framer_t *f, const void *data, size_t n);
+
+/**
+ * framernext:
+ * @f:              a #framer_t
+ * @pn: (nullable): if not %NULL, storage where record size should be stored
+ *
+ * Extract the next complete record.
+ *
+ * Returns: the next record, including its header, valid until the next
+ *          call to framernext() or framerfeed(), %NULL if more data
+ *          is needed or on error, see framererror().
+ */
+UBGP_API CHECK_NONNULL(1) const void *framernext(framer_t *f, size_t *pn);
+
+UBGP_API CHECK_NONNULL(1) PUREFUNC frame_err framererror(const framer_t *f);
+
+/**
+ * framerpending:
+ * @f: a #framer_t
+ *
+ * Returns: number of bytes buffered by @f, belonging to an incomplete record.
+ */
+UBGP_API CHECK_NONNULL(1) PUREFUNC size_t framerpending(const framer_t *f);
+
+UBGP_API CHECK_NONNULL(1) void framerdestroy(framer_t *f);
+
+#endif
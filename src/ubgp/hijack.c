@@ -0,0 +1,237 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#include "branch.h"
+#include "hijack.h"
+#include "ubgpdef.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    uint32_t as;
+    time_t   seen;
+} hijack_origin_t;
+
+struct hijack_entry_s {
+    hijack_entry_t *prev, *next;
+    netaddr_t       pfx;
+    time_t          lastseen;
+    uint            n;
+    hijack_origin_t origins[HIJACK_ORIGINS_MAX];  // least recently seen first
+};
+
+UBGP_API void hijackinit(hijack_detector_t *det, time_t ttl)
+{
+    memset(det, 0, sizeof(*det));
+    patinit(&det->monitored[0], AF_INET);
+    patinit(&det->monitored[1], AF_INET6);
+    patinit(&det->state[0], AF_INET);
+    patinit(&det->state[1], AF_INET6);
+    det->ttl = ttl;
+}
+
+UBGP_API void hijackdestroy(hijack_detector_t *det)
+{
+    for (hijack_entry_t *e = det->oldest, *next; e; e = next) {
+        next = e->next;
+        free(e);
+    }
+
+    patdestroy(&det->monitored[0]);
+    patdestroy(&det->monitored[1]);
+    patdestroy(&det->state[0]);
+    patdestroy(&det->state[1]);
+}
+
+UBGP_API bool hijackmonitor(hijack_detector_t *det, const netaddr_t *pfx)
+{
+    return patinsert(&det->monitored[pfx->family == AF_INET6], pfx, NULL) != NULL;
+}
+
+static void unlinkentry(hijack_detector_t *det, hijack_entry_t *e)
+{
+    if (e->prev)
+        e->prev->next = e->next;
+    else
+        det->oldest = e->next;
+
+    if (e->next)
+        e->next->prev = e->prev;
+    else
+        det->newest = e->prev;
+}
+
+static void appendentry(hijack_detector_t *det, hijack_entry_t *e)
+{
+    e->prev = det->newest;
+    e->next = NULL;
+    if (det->newest)
+        det->newest->next = e;
+    else
+        det->oldest = e;
+
+    det->newest = e;
+}
+
+static bool isexpired(const hijack_detector_t *det, time_t seen, time_t now)
+{
+    return det->ttl > 0 && now - seen > det->ttl;
+}
+
+UBGP_API size_t hijackexpire(hijack_detector_t *det, time_t now)
+{
+    size_t n = 0;
+
+    hijack_entry_t *e;
+    while ((e = det->oldest) != NULL && isexpired(det, e->lastseen, now)) {
+        patremove(&det->state[e->pfx.family == AF_INET6], &e->pfx);
+        unlinkentry(det, e);
+        free(e);
+        n++;
+    }
+
+    det->nentries -= n;
+    return n;
+}
+
+static void copyorigins(hijack_event_t *ev, const hijack_entry_t *e)
+{
+    ev->norigins = 0;
+    if (!e)
+        return;
+
+    for (uint i = 0; i < e->n; i++)
+        ev->origins[i] = e->origins[i].as;
+
+    ev->norigins = e->n;
+}
+
+// raise a sub-prefix event if pfx is a strict subnet of a monitored prefix
+static int checksubprefix(hijack_detector_t *det,
+                          const netaddr_t   *pfx,
+                          hijack_event_t    *ev)
+{
+    uint fam = (pfx->family == AF_INET6);
+    if (!patissubnetof(&det->monitored[fam], pfx))
+        return 0;
+
+    trienode_t **supernets = patgetsupernetsof(&det->monitored[fam], pfx);
+    if (unlikely(!supernets))
+        return -1;
+
+    // supernets come least specific first
+    const trienode_t *covering = NULL;
+    for (uint i = 0; supernets[i]; i++) {
+        if (supernets[i]->prefix.bitlen < pfx->bitlen)
+            covering = supernets[i];
+    }
+
+    int nev = 0;
+    if (covering) {
+        ev->type     = HIJACK_SUBPREFIX;
+        ev->covering = covering->prefix;
+
+        const trienode_t *n = patsearchexact(&det->state[fam], &covering->prefix);
+        copyorigins(ev, n ? n->payload : NULL);
+        nev = 1;
+    }
+
+    free(supernets);
+    return nev;
+}
+
+UBGP_API int hijackannounce(hijack_detector_t *det,
+                            const netaddr_t   *pfx,
+                            uint32_t           origin,
+                            time_t             stamp,
+                            hijack_event_t     events[HIJACK_EVENTS_MAX])
+{
+    hijackexpire(det, stamp);
+
+    patricia_trie_t *pt = &det->state[pfx->family == AF_INET6];
+
+    trienode_t *n = patinsert(pt, pfx, NULL);
+    if (unlikely(!n))
+        return -1;
+
+    int nev = 0;
+
+    hijack_entry_t *e = n->payload;
+    if (!e) {
+        e = malloc(sizeof(*e));
+        if (unlikely(!e)) {
+            patremove(pt, pfx);
+            return -1;
+        }
+
+        e->pfx      = n->prefix;
+        e->lastseen = stamp;
+        e->n        = 0;
+        n->payload  = e;
+        appendentry(det, e);
+        det->nentries++;
+
+        nev = checksubprefix(det, pfx, &events[0]);
+        if (unlikely(nev < 0))
+            return -1;
+
+    } else {
+        // drop origins that went stale while the prefix was kept alive by others
+        uint j = 0;
+        for (uint i = 0; i < e->n; i++) {
+            if (!isexpired(det, e->origins[i].seen, stamp))
+                e->origins[j++] = e->origins[i];
+        }
+        e->n = j;
+
+        e->lastseen = MAX(e->lastseen, stamp);
+        unlinkentry(det, e);
+        appendentry(det, e);
+    }
+
+    uint i;
+    for (i = 0; i < e->n && e->origins[i].as != origin; i++);
+
+    if (i == e->n && e->n > 0) {
+        hijack_event_t *ev = &events[nev++];
+
+        ev->type     = HIJACK_MOAS;
+        ev->covering = e->pfx;
+        copyorigins(ev, e);
+    }
+    if (i == HIJACK_ORIGINS_MAX)
+        i = 0;  // evict the least recently seen origin
+    else if (i == e->n)
+        e->n++;
+
+    // keep origins sorted by last seen, moving this one last
+    memmove(&e->origins[i], &e->origins[i + 1], (e->n - i - 1) * sizeof(*e->origins));
+    e->origins[e->n - 1].as   = origin;
+    e->origins[e->n - 1].seen = stamp;
+
+    for (int k = 0; k < nev; k++) {
+        events[k].stamp  = stamp;
+        events[k].pfx    = e->pfx;
+        events[k].origin = origin;
+    }
+    return nev;
+}
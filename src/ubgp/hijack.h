@@ -0,0 +1,175 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#ifndef UBGP_HIJACK_H_
+#define UBGP_HIJACK_H_
+
+#include "funcattribs.h"
+#include "netaddr.h"
+#include "patriciatrie.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * SECTION: hijack
+ * @title: MOAS and Sub-prefix Hijack Detection
+ * @include: hijack.h
+ *
+ * Detect suspicious announcements on a stream of routes, as they happen:
+ *
+ * - Multiple Origin AS (MOAS) conflicts, raised whenever a known prefix
+ *   is announced by an origin not currently associated with it;
+ * - sub-prefix announcements, raised whenever a new strict subnet of
+ *   a monitored prefix appears.
+ *
+ * Origins of every announced prefix are kept in a #patricia_trie_t,
+ * and forgotten once they're not announced again for a time-to-live,
+ * so state remains bounded over arbitrarily long streams.
+ * Prefixes are kept in least recently announced order, expiration
+ * only ever looks at the oldest ones, each announcement costs
+ * amortized constant time on top of the trie lookup.
+ */
+
+enum {
+    HIJACK_ORIGINS_MAX = 4,  // origins tracked per prefix, least recently seen is evicted beyond that
+    HIJACK_EVENTS_MAX  = 2   // events raised by a single announcement
+};
+
+/**
+ * hijack_type_t:
+ * @HIJACK_MOAS:      a prefix was announced by a new origin
+ * @HIJACK_SUBPREFIX: a new subnet of a monitored prefix was announced
+ *
+ * Event types.
+ */
+typedef enum {
+    HIJACK_MOAS,
+    HIJACK_SUBPREFIX
+} hijack_type_t;
+
+/**
+ * hijack_event_t:
+ * @type:     event type
+ * @stamp:    timestamp of the announcement raising the event
+ * @pfx:      the announced prefix
+ * @origin:   the announced origin
+ * @covering: the prefix the event refers to, the announced prefix itself
+ *            for %HIJACK_MOAS, the most specific monitored prefix covering
+ *            it for %HIJACK_SUBPREFIX
+ * @norigins: number of @origins
+ * @origins:  origins of @covering known at the time of the announcement,
+ *            least recently seen first
+ *
+ * A detection event.
+ */
+typedef struct {
+    hijack_type_t type;
+    time_t        stamp;
+    netaddr_t     pfx;
+    uint32_t      origin;
+    netaddr_t     covering;
+    uint          norigins;
+    uint32_t      origins[HIJACK_ORIGINS_MAX];
+} hijack_event_t;
+
+typedef struct hijack_entry_s hijack_entry_t;
+
+/**
+ * hijack_detector_t:
+ *
+ * A hijack detector.
+ */
+typedef struct {
+    /*< private >*/
+    patricia_trie_t monitored[2];    // AF_INET and AF_INET6 monitored prefixes
+    patricia_trie_t state[2];        // announced prefixes, payload is a hijack_entry_t
+    hijack_entry_t *oldest, *newest; // entries, least recently announced first
+    size_t          nentries;
+    time_t          ttl;
+} hijack_detector_t;
+
+/**
+ * hijackinit:
+ * @det: detector to be initialized
+ * @ttl: seconds after which an origin that wasn't announced again
+ *       is forgotten, 0 to never forget
+ *
+ * Initialize a detector with no monitored prefixes and no known origin.
+ */
+UBGP_API CHECK_NONNULL(1) void hijackinit(hijack_detector_t *det, time_t ttl);
+
+UBGP_API CHECK_NONNULL(1) void hijackdestroy(hijack_detector_t *det);
+
+/**
+ * hijackmonitor:
+ * @det: a #hijack_detector_t
+ * @pfx: a prefix to be monitored for sub-prefix announcements
+ *
+ * Returns: %true on success, %false on out of memory.
+ */
+UBGP_API CHECK_NONNULL(1, 2) bool hijackmonitor(hijack_detector_t *det, const netaddr_t *pfx);
+
+/**
+ * hijackannounce:
+ * @det:    a #hijack_detector_t
+ * @pfx:    an announced prefix
+ * @origin: its origin AS
+ * @stamp:  timestamp of the announcement
+ * @events: storage for the raised events
+ *
+ * Account an announcement, expiring stale state first, see hijackexpire().
+ * Timestamps are expected to be roughly non-decreasing, as expiration
+ * follows the announcements order.
+ *
+ * Returns: number of events stored in @events, -1 on out of memory.
+ */
+UBGP_API CHECK_NONNULL(1, 2, 5) int hijackannounce(hijack_detector_t *det,
+                                                   const netaddr_t   *pfx,
+                                                   uint32_t           origin,
+                                                   time_t             stamp,
+                                                   hijack_event_t     events[HIJACK_EVENTS_MAX]);
+
+/**
+ * hijackexpire:
+ * @det: a #hijack_detector_t
+ * @now: current time
+ *
+ * Forget every prefix that wasn't announced during the last time-to-live
+ * seconds.
+ *
+ * Returns: number of forgotten prefixes.
+ */
+UBGP_API CHECK_NONNULL(1) size_t hijackexpire(hijack_detector_t *det, time_t now);
+
+/**
+ * hijackcount:
+ * @det: a #hijack_detector_t
+ *
+ * Returns: number of prefixes whose origins are currently known.
+ */
+static inline PUREFUNC CHECK_NONNULL(1) size_t hijackcount(const hijack_detector_t *det)
+{
+    return det->nentries;
+}
+
+#endif
@@ -0,0 +1,87 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#include "branch.h"
+#include "hll.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+UBGP_API bool hllinit(hll_t *hll, uint precision)
+{
+    hll->regs      = NULL;
+    hll->precision = precision;
+    if (unlikely(precision < HLL_MIN_PRECISION || precision > HLL_MAX_PRECISION))
+        return false;
+
+    hll->regs = calloc(1u << precision, sizeof(*hll->regs));
+    return hll->regs != NULL;
+}
+
+UBGP_API void hllclear(hll_t *hll)
+{
+    memset(hll->regs, 0, (1u << hll->precision) * sizeof(*hll->regs));
+}
+
+UBGP_API void hlldestroy(hll_t *hll)
+{
+    free(hll->regs);
+}
+
+UBGP_API uint64_t hllcount(const hll_t *hll)
+{
+    uint m = 1u << hll->precision;
+
+    double alpha;
+    switch (m) {
+    case 16: alpha = 0.673; break;
+    case 32: alpha = 0.697; break;
+    case 64: alpha = 0.709; break;
+    default: alpha = 0.7213 / (1.0 + 1.079 / m); break;
+    }
+
+    double sum   = 0.0;
+    uint   zeros = 0;
+    for (uint i = 0; i < m; i++) {
+        sum += ldexp(1.0, -(int) hll->regs[i]);
+        zeros += (hll->regs[i] == 0);
+    }
+
+    double est = alpha * m * m / sum;
+    if (est <= 2.5 * m && zeros > 0)
+        est = m * log((double) m / zeros);  // linear counting, more accurate on small sets
+
+    // 64 bits hashes make the large range correction unnecessary
+    return (uint64_t) (est + 0.5);
+}
+
+UBGP_API bool hllmerge(hll_t *dst, const hll_t *src)
+{
+    if (unlikely(dst->precision != src->precision))
+        return false;
+
+    uint m = 1u << dst->precision;
+    for (uint i = 0; i < m; i++)
+        dst->regs[i] = MAX(dst->regs[i], src->regs[i]);
+
+    return true;
+}
@@ -0,0 +1,127 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#ifndef UBGP_HLL_H_
+#define UBGP_HLL_H_
+
+#include "bitops.h"
+#include "funcattribs.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * SECTION: hll
+ * @title: HyperLogLog Sketch
+ * @include: hll.h
+ *
+ * Estimate the number of distinct keys in a stream using constant memory,
+ * following Flajolet et al., HyperLogLog: the analysis of a near-optimal
+ * cardinality estimation algorithm, with linear counting for small
+ * cardinalities.
+ *
+ * A sketch of precision p keeps 2^p one byte registers, and has
+ * a standard error around 1.04/sqrt(2^p), that is about 3% for
+ * %HLL_DEFAULT_PRECISION.
+ * Keys are added by their 64 bits hash, which must be well mixed,
+ * see bloomhash() for network addresses.
+ */
+
+enum {
+    HLL_MIN_PRECISION     = 4,
+    HLL_MAX_PRECISION     = 16,
+    HLL_DEFAULT_PRECISION = 10   // 1KiB registers, ~3% standard error
+};
+
+/**
+ * hll_t:
+ * @regs:      the registers, 2^@precision of them
+ * @precision: number of hash bits selecting a register
+ *
+ * A HyperLogLog sketch.
+ */
+typedef struct {
+    uint8_t *regs;
+    uint     precision;
+} hll_t;
+
+/**
+ * hllinit:
+ * @hll:       sketch to be initialized
+ * @precision: sketch precision, between %HLL_MIN_PRECISION and %HLL_MAX_PRECISION
+ *
+ * Initialize an empty sketch.
+ *
+ * Returns: %true on success, %false on out of memory or bad precision.
+ */
+UBGP_API CHECK_NONNULL(1) bool hllinit(hll_t *hll, uint precision);
+
+/**
+ * hllclear:
+ * @hll: an initialized #hll_t
+ *
+ * Forget every key in @hll, preserving its memory.
+ */
+UBGP_API CHECK_NONNULL(1) void hllclear(hll_t *hll);
+
+UBGP_API CHECK_NONNULL(1) void hlldestroy(hll_t *hll);
+
+/**
+ * hlladd:
+ * @hll: an initialized #hll_t
+ * @h:   hash of the key to be added
+ *
+ * Add a key to @hll.
+ */
+static inline CHECK_NONNULL(1) void hlladd(hll_t *hll, uint64_t h)
+{
+    uint p = hll->precision;
+
+    // top bits select the register, the rest is ranked by leading zeros,
+    // the sentinel bit bounds the rank to 64 - p + 1
+    uint64_t w    = (h << p) | (1ull << (p - 1));
+    uint8_t  rank = 64 - bsr64(w) + 1;
+
+    uint8_t *reg = &hll->regs[h >> (64 - p)];
+    if (rank > *reg)
+        *reg = rank;
+}
+
+/**
+ * hllcount:
+ * @hll: an initialized #hll_t
+ *
+ * Returns: an estimate of the number of distinct keys added to @hll.
+ */
+UBGP_API PUREFUNC CHECK_NONNULL(1) uint64_t hllcount(const hll_t *hll);
+
+/**
+ * hllmerge:
+ * @dst: sketch receiving the union
+ * @src: a sketch to be merged into @dst, left untouched
+ *
+ * Turn @dst into a sketch of the union of the keys in @dst and @src.
+ *
+ * Returns: %true on success, %false if sketches have a different precision.
+ */
+UBGP_API CHECK_NONNULL(1, 2) bool hllmerge(hll_t *dst, const hll_t *src);
+
+#endif
@@ -0,0 +1,452 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#include "bgpparams.h"
+#include "branch.h"
+#include "ingest.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+enum {
+    EVENTSIZ  = 64,  // events served per wakeup
+    ACCEPTMAX = 64   // sessions accepted per wakeup from each listening socket
+};
+
+static int setnonblock(int fd)
+{
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1)
+        return -1;
+
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static void listinsert(ingest_session_t **head, ingest_session_t *s)
+{
+    s->prev = NULL;
+    s->next = *head;
+    if (*head)
+        (*head)->prev = s;
+
+    *head = s;
+}
+
+static void listremove(ingest_session_t **head, ingest_session_t *s)
+{
+    if (s->prev)
+        s->prev->next = s->next;
+    else
+        *head = s->next;
+
+    if (s->next)
+        s->next->prev = s->prev;
+}
+
+static ingest_session_t *newsession(ingest_t *ing, int fd, bool listening)
+{
+    ingest_session_t *s = calloc(1, sizeof(*s));
+    if (unlikely(!s))
+        return NULL;
+
+    s->fd        = fd;
+    s->listening = listening;
+
+    // sessions are drained on every wakeup, listening sockets
+    // may have connections left over, see acceptall()
+    struct epoll_event ev;
+    ev.events   = listening ? EPOLLIN : EPOLLIN | EPOLLET;
+    ev.data.ptr = s;
+    if (setnonblock(fd) != 0 || epoll_ctl(ing->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        free(s);
+        return NULL;
+    }
+
+    return s;
+}
+
+static void freesession(ingest_t *ing, ingest_session_t *s)
+{
+    epoll_ctl(ing->epfd, EPOLL_CTL_DEL, s->fd, NULL);
+    close(s->fd);
+    if (!s->listening)
+        framerdestroy(&s->framer);
+
+    free(s);
+}
+
+static void getpeer(ingest_session_t *s)
+{
+    struct sockaddr_storage ss;
+    socklen_t len = sizeof(ss);
+
+    memset(&s->addr, 0, sizeof(s->addr));
+    s->port = 0;
+    if (getpeername(s->fd, (struct sockaddr *) &ss, &len) != 0)
+        return;  // pipe or unnamed socket
+
+    if (ss.ss_family == AF_INET) {
+        const struct sockaddr_in *sin = (const struct sockaddr_in *) &ss;
+
+        makenaddr(&s->addr, AF_INET, &sin->sin_addr, 32);
+        s->port = ntohs(sin->sin_port);
+    } else if (ss.ss_family == AF_INET6) {
+        const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *) &ss;
+
+        makenaddr(&s->addr, AF_INET6, &sin6->sin6_addr, 128);
+        s->port = ntohs(sin6->sin6_port);
+    }
+}
+
+// learn peer AS and decoding flags from an OPEN message
+static void learnopen(ingest_session_t *s, const void *data, size_t n)
+{
+    ubgp_msg_s open;
+    setbgpread(&open, data, n, BGPF_NOCOPY);
+
+    const bgp_open_t *op = getbgpopen(&open);
+    if (!op) {
+        bgpclose(&open);
+        return;
+    }
+
+    s->as = op->my_as;
+    if (startbgpcaps(&open) == BGP_ENOERR) {
+        afi_safi_t tuples[CAPABILITY_LENGTH_MAX / sizeof(afi_safi_t)];
+        bgpcap_t *cap;
+
+        while ((cap = nextbgpcap(&open)) != NULL) {
+            if (cap->code == ASN32BIT_CODE && cap->len == ASN32BIT_LENGTH) {
+                s->as        = getasn32bit(cap);
+                s->bgpflags |= BGPF_ASN32BIT;
+            } else if (cap->code == ADD_PATH_CODE) {
+                size_t ntuples = getaddpathtuples(tuples, countof(tuples), cap);
+                if (ntuples > countof(tuples))
+                    ntuples = countof(tuples);
+
+                // the peer sends path identifiers
+                for (size_t i = 0; i < ntuples; i++) {
+                    if (tuples[i].flags & ADD_PATH_TX)
+                        s->bgpflags |= BGPF_ADDPATH;
+                }
+            }
+        }
+        endbgpcaps(&open);
+    }
+
+    bgpclose(&open);
+}
+
+// filter and deliver pending messages of s, then recycle them
+static int flush(ingest_t *ing, ingest_session_t *s)
+{
+    size_t n = ing->nbatch;
+    if (n == 0)
+        return 0;
+
+    uint64_t results[(INGEST_BATCHSIZ + 63) / 64];
+    if (ing->prog) {
+        // batch holds UPDATE messages during filtering...
+        size_t nupdates = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (getbgptype(&ing->pool[i]) == BGP_UPDATE)
+                ing->batch[nupdates++] = &ing->pool[i];
+        }
+        if (nupdates > 0) {
+            if (ing->ops->known)
+                ing->ops->known(s, ing->ctx, ing->user);
+
+            bgp_filter_batch(ing->batch, nupdates, ing->prog, ing->ctx, results);
+        }
+    }
+
+    // ...and delivered messages afterwards
+    size_t npass = 0, j = 0;
+    for (size_t i = 0; i < n; i++) {
+        ubgp_msg_s *msg = &ing->pool[i];
+        if (ing->prog && getbgptype(msg) == BGP_UPDATE) {
+            bool pass = (results[j / 64] >> (j % 64)) & 1;
+
+            j++;
+            if (!pass)
+                continue;
+        }
+
+        ing->batch[npass++] = msg;
+    }
+
+    if (npass > 0)
+        ing->ops->batch(s, ing->batch, npass, ing->user);
+
+    for (size_t i = 0; i < n; i++)
+        bgpclose(&ing->pool[i]);
+
+    ing->nbatch = 0;
+    return npass;
+}
+
+// read s until its socket is drained, as required by edge-triggered
+// notification, closing it on end of stream or error
+static int serve(ingest_t *ing, ingest_session_t *s)
+{
+    int ndelivered = 0;
+
+    while (true) {
+        ssize_t n = read(s->fd, ing->rbuf, INGEST_BUFSIZ);
+        if (n == 0)
+            break;  // end of stream
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return ndelivered + flush(ing, s);  // drained
+
+            s->err = errno;
+            break;
+        }
+
+        framerfeed(&s->framer, ing->rbuf, n);
+
+        const void *rec;
+        size_t size;
+        while ((rec = framernext(&s->framer, &size)) != NULL) {
+            if (ing->nbatch == INGEST_BATCHSIZ)
+                ndelivered += flush(ing, s);
+
+            // copy, records are only valid until the next framernext()
+            ubgp_msg_s *msg = &ing->pool[ing->nbatch];
+            if (unlikely(setbgpread(msg, rec, size, s->bgpflags) != BGP_ENOERR)) {
+                s->err = ENOMEM;
+                goto out;
+            }
+
+            ing->nbatch++;
+            s->nmsgs++;
+
+            // affects decoding of the following messages
+            if (getbgptype(msg) == BGP_OPEN)
+                learnopen(s, rec, size);
+        }
+        if (unlikely(framererror(&s->framer) != FRAME_ENOERR)) {
+            s->err = EPROTO;
+            break;
+        }
+    }
+
+out:
+    // deliver whatever was received up to the end of the session
+    ndelivered += flush(ing, s);
+    ingestclose(ing, s);
+    return ndelivered;
+}
+
+static void acceptall(ingest_t *ing, ingest_session_t *l)
+{
+    // bounded, so that a flood of connections can't starve open sessions,
+    // listening sockets are level-triggered, leftovers are accepted
+    // on the next wakeup
+    for (int i = 0; i < ACCEPTMAX; i++) {
+        int fd = accept(l->fd, NULL, NULL);
+        if (fd == -1)
+            return;
+
+        if (!ingestadd(ing, fd))
+            close(fd);
+    }
+}
+
+UBGP_API int ingestinit(ingest_t *ing, const ingest_ops_t *ops, void *user)
+{
+    memset(ing, 0, sizeof(*ing));
+
+    ing->ops  = ops;
+    ing->user = user;
+    ing->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (ing->epfd == -1)
+        return -1;
+
+    ing->rbuf = malloc(INGEST_BUFSIZ);
+    ing->pool = malloc(INGEST_BATCHSIZ * sizeof(*ing->pool));
+    if (unlikely(!ing->rbuf || !ing->pool)) {
+        free(ing->rbuf);
+        free(ing->pool);
+        close(ing->epfd);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return 0;
+}
+
+UBGP_API void ingestfilter(ingest_t *ing, const filter_prog_t *prog, filter_ctx_t *ctx)
+{
+    assert(!prog || ctx);
+
+    ing->prog = prog;
+    ing->ctx  = ctx;
+}
+
+UBGP_API int ingestlisten(ingest_t *ing, int fd)
+{
+    ingest_session_t *l = newsession(ing, fd, true);
+    if (unlikely(!l))
+        return -1;
+
+    listinsert(&ing->listeners, l);
+    return 0;
+}
+
+UBGP_API ingest_session_t *ingestadd(ingest_t *ing, int fd)
+{
+    ingest_session_t *s = newsession(ing, fd, false);
+    if (unlikely(!s))
+        return NULL;
+
+    s->id = ing->nextid++;
+    getpeer(s);
+    framerinit(&s->framer, FRAME_BGP);
+    listinsert(&ing->sessions, s);
+    ing->nsessions++;
+
+    if (ing->ops->open)
+        ing->ops->open(s, ing->user);
+
+    return s;
+}
+
+UBGP_API int ingestpoll(ingest_t *ing, int timeout)
+{
+    struct epoll_event events[EVENTSIZ];
+
+    int n = epoll_wait(ing->epfd, events, countof(events), timeout);
+    if (n == -1)
+        return (errno == EINTR) ? 0 : -1;
+
+    int ndelivered = 0;
+    for (int i = 0; i < n; i++) {
+        ingest_session_t *s = events[i].data.ptr;
+
+        if (s->listening)
+            acceptall(ing, s);
+        else
+            ndelivered += serve(ing, s);
+    }
+
+    return ndelivered;
+}
+
+UBGP_API void ingestclose(ingest_t *ing, ingest_session_t *s)
+{
+    assert(!s->listening);
+
+    if (ing->ops->close)
+        ing->ops->close(s, ing->user);
+
+    listremove(&ing->sessions, s);
+    ing->nsessions--;
+    freesession(ing, s);
+}
+
+UBGP_API void ingestdestroy(ingest_t *ing)
+{
+    while (ing->sessions)
+        ingestclose(ing, ing->sessions);
+
+    while (ing->listeners) {
+        ingest_session_t *l = ing->listeners;
+
+        listremove(&ing->listeners, l);
+        freesession(ing, l);
+    }
+
+    close(ing->epfd);
+    free(ing->rbuf);
+    free(ing->pool);
+}
+
+#else
+
+UBGP_API int ingestinit(ingest_t *ing, const ingest_ops_t *ops, void *user)
+{
+    memset(ing, 0, sizeof(*ing));
+
+    ing->ops  = ops;
+    ing->user = user;
+    ing->epfd = -1;
+    errno = ENOSYS;
+    return -1;
+}
+
+UBGP_API void ingestfilter(ingest_t *ing, const filter_prog_t *prog, filter_ctx_t *ctx)
+{
+    ing->prog = prog;
+    ing->ctx  = ctx;
+}
+
+UBGP_API int ingestlisten(ingest_t *ing, int fd)
+{
+    USED(ing);
+    USED(fd);
+
+    errno = ENOSYS;
+    return -1;
+}
+
+UBGP_API ingest_session_t *ingestadd(ingest_t *ing, int fd)
+{
+    USED(ing);
+    USED(fd);
+
+    errno = ENOSYS;
+    return NULL;
+}
+
+UBGP_API int ingestpoll(ingest_t *ing, int timeout)
+{
+    USED(ing);
+    USED(timeout);
+
+    errno = ENOSYS;
+    return -1;
+}
+
+UBGP_API void ingestclose(ingest_t *ing, ingest_session_t *s)
+{
+    USED(ing);
+    USED(s);
+}
+
+UBGP_API void ingestdestroy(ingest_t *ing)
+{
+    USED(ing);
+}
+
+#endif
@@ -0,0 +1,232 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#ifndef UBGP_INGEST_H_
+#define UBGP_INGEST_H_
+
+#include "bgp.h"
+#include "filterpacket.h"
+#include "frame.h"
+#include "funcattribs.h"
+#include "netaddr.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * SECTION: ingest
+ * @title: Multi-session BGP Ingestion
+ * @include: ingest.h
+ *
+ * Event-driven reception of BGP message streams from many connections
+ * at once, such as BGP speakers or collectors mirroring their sessions,
+ * or replay clients. Sessions are accepted from listening sockets,
+ * or added as already connected stream sockets, then read with
+ * edge-triggered non-blocking reads, so that a single thread can serve
+ * any number of them.
+ *
+ * Each session stream is split into BGP messages by a #framer_t,
+ * messages are decoded into a recycled message pool and UPDATE messages
+ * are run through a compiled filter, column-wise, see bgp_filter_batch().
+ * Messages are delivered in batches, once per session for every wakeup.
+ *
+ * Ingestion is passive, no BGP message is ever sent back to the peer:
+ * sessions only learn ASN32BIT and ADD_PATH capabilities and peer AS
+ * from OPEN messages in the stream, if any.
+ *
+ * Ingestion requires epoll(7), on other platforms ingestinit()
+ * fails with %ENOSYS.
+ */
+
+enum {
+    INGEST_BUFSIZ   = 64 * 1024,               // read buffer size
+    INGEST_BATCHSIZ = 2 * FILTER_BATCH_LANES   // maximum messages in a batch
+};
+
+/**
+ * ingest_session_t:
+ * @id:       unique session identifier, assigned in creation order
+ * @fd:       session socket
+ * @addr:     remote address, unspecified for non-IP sockets
+ * @port:     remote port, 0 for non-IP sockets
+ * @as:       peer AS, learnt from its OPEN message, 0 if unknown
+ * @bgpflags: flags for setbgpread(), %BGPF_ASN32BIT and %BGPF_ADDPATH
+ *            are set as soon as the peer OPEN message advertises them,
+ *            may be set by the user before any message is received
+ * @nmsgs:    total messages received on this session
+ * @err:      reason the session was closed, 0 on end of stream,
+ *            %EPROTO if the stream lost sync with BGP message boundaries
+ *            (see framererror()), an errno value on read failure
+ * @user:     user data, not used by the library
+ *
+ * A BGP message stream.
+ */
+typedef struct ingest_session ingest_session_t;
+struct ingest_session {
+    uint32_t   id;
+    int        fd;
+    netaddr_t  addr;
+    uint16_t   port;
+    uint32_t   as;
+    uint       bgpflags;
+    uint64_t   nmsgs;
+    int        err;
+    void      *user;
+
+    /*< private >*/
+    framer_t framer;
+    bool listening;  // a listening socket, not a session
+    ingest_session_t *prev, *next;
+};
+
+/**
+ * ingest_ops_t:
+ * @batch: invoked with the messages of @s that passed the filter,
+ *         in stream order, messages and their buffers are recycled
+ *         as soon as @batch returns
+ * @known: (nullable): invoked before filtering messages of @s,
+ *         to load @s specific known variables into @ctx
+ * @open:  (nullable): invoked when a session is created
+ * @close: (nullable): invoked right before a session is closed,
+ *         see #ingest_session_t err field
+ *
+ * Callbacks of an ingestion loop, every callback is invoked with
+ * the @user pointer registered with ingestinit().
+ */
+typedef struct {
+    void (*batch)(ingest_session_t *s, ubgp_msg_s *const *msgs, size_t n, void *user);
+    void (*known)(ingest_session_t *s, filter_ctx_t *ctx, void *user);
+    void (*open)(ingest_session_t *s, void *user);
+    void (*close)(ingest_session_t *s, void *user);
+} ingest_ops_t;
+
+/**
+ * ingest_t:
+ * @nsessions: number of open sessions
+ *
+ * Ingestion loop state.
+ */
+typedef struct {
+    size_t nsessions;
+
+    /*< private >*/
+    int epfd;
+    uint32_t nextid;
+    const ingest_ops_t *ops;
+    void *user;
+    const filter_prog_t *prog;
+    filter_ctx_t *ctx;
+    ingest_session_t *sessions;   // open sessions list
+    ingest_session_t *listeners;  // listening sockets list
+    byte *rbuf;                   // read buffer, shared by every session
+    ubgp_msg_s *pool;             // recycled messages
+    size_t nbatch;                // messages in pool waiting for delivery
+    ubgp_msg_s *batch[INGEST_BATCHSIZ];
+} ingest_t;
+
+/**
+ * ingestinit:
+ * @ing:  ingestion loop to be initialized
+ * @ops:  callbacks, must remain valid as long as @ing is in use
+ * @user: (nullable): user pointer for @ops callbacks
+ *
+ * Returns: 0 on success, -1 on error, and errno is set.
+ */
+UBGP_API CHECK_NONNULL(1, 2) int ingestinit(ingest_t           *ing,
+                                            const ingest_ops_t *ops,
+                                            void               *user);
+
+/**
+ * ingestfilter:
+ * @ing:  an initialized #ingest_t
+ * @prog: (nullable): compiled filter for UPDATE messages,
+ *        %NULL to deliver every message
+ * @ctx:  (nullable): execution context for @prog, required if @prog
+ *        isn't %NULL
+ *
+ * Set the filter applied to UPDATE messages, other messages are always
+ * delivered.
+ */
+UBGP_API CHECK_NONNULL(1) void ingestfilter(ingest_t            *ing,
+                                            const filter_prog_t *prog,
+                                            filter_ctx_t        *ctx);
+
+/**
+ * ingestlisten:
+ * @ing: an initialized #ingest_t
+ * @fd:  a bound and listening stream socket, of any family
+ *
+ * Accept sessions from @fd, @ing takes ownership of @fd
+ * on success, and closes it on ingestdestroy().
+ *
+ * Returns: 0 on success, -1 on error, and errno is set.
+ */
+UBGP_API CHECK_NONNULL(1) int ingestlisten(ingest_t *ing, int fd);
+
+/**
+ * ingestadd:
+ * @ing: an initialized #ingest_t
+ * @fd:  a connected stream socket or a pipe, carrying BGP messages
+ *
+ * Add a session reading from @fd, on success @ing takes ownership
+ * of @fd and closes it along with the session.
+ *
+ * Returns: the new session on success, %NULL on error, and errno is set.
+ */
+UBGP_API CHECK_NONNULL(1) ingest_session_t *ingestadd(ingest_t *ing, int fd);
+
+/**
+ * ingestpoll:
+ * @ing:     an initialized #ingest_t
+ * @timeout: maximum wait in milliseconds, -1 to wait indefinitely,
+ *           0 to return immediately
+ *
+ * Wait for activity on any session or listening socket and serve
+ * it: accept new sessions, read each ready session until its socket is
+ * drained, delivering its messages to the batch callback.
+ *
+ * Returns: the number of messages delivered, 0 on timeout or signal
+ *          interruption, -1 on error, and errno is set.
+ */
+UBGP_API CHECK_NONNULL(1) int ingestpoll(ingest_t *ing, int timeout);
+
+/**
+ * ingestclose:
+ * @ing: an initialized #ingest_t
+ * @s:   an open session of @ing
+ *
+ * Close @s, invoking the close callback, @s is no longer valid
+ * afterwards. Must not be invoked from inside any #ingest_ops_t
+ * callback, sessions are closed by ingestpoll() on end of stream
+ * and by ingestdestroy().
+ */
+UBGP_API CHECK_NONNULL(1, 2) void ingestclose(ingest_t *ing, ingest_session_t *s);
+
+/**
+ * ingestdestroy:
+ * @ing: an initialized #ingest_t
+ *
+ * Close every session and listening socket, and free every resource.
+ */
+UBGP_API CHECK_NONNULL(1) void ingestdestroy(ingest_t *ing);
+
+#endif
@@ -100,6 +100,7 @@ static const uint16_t masktab[][MAX_MRT_SUBTYPE + 1] = {
     [SHIFT(MRT_BGP4MP)][BGP4MP_STATE_CHANGE_AS4]          = F_VALID | F_AS32 | F_IS_BGP | F_HAS_STATE,
     [SHIFT(MRT_BGP4MP)][BGP4MP_MESSAGE_LOCAL]             = F_VALID | F_IS_BGP | F_WRAPS_BGP,
     [SHIFT(MRT_BGP4MP)][BGP4MP_MESSAGE_AS4_LOCAL]         = F_VALID | F_AS32 | F_IS_BGP | F_WRAPS_BGP,
+    [SHIFT(MRT_BGP4MP)][BGP4MP_MESSAGE_ADDPATH]           = F_VALID | F_IS_BGP | F_WRAPS_BGP | F_ADDPATH,
     [SHIFT(MRT_BGP4MP)][BGP4MP_MESSAGE_AS4_ADDPATH]       = F_VALID | F_AS32 | F_IS_BGP | F_WRAPS_BGP | F_ADDPATH,
     [SHIFT(MRT_BGP4MP)][BGP4MP_MESSAGE_LOCAL_ADDPATH]     = F_VALID | F_IS_BGP | F_WRAPS_BGP | F_ADDPATH,
     [SHIFT(MRT_BGP4MP)][BGP4MP_MESSAGE_AS4_LOCAL_ADDPATH] = F_VALID | F_AS32 | F_IS_BGP | F_WRAPS_BGP | F_ADDPATH,
@@ -110,6 +111,7 @@ static const uint16_t masktab[][MAX_MRT_SUBTYPE + 1] = {
     [SHIFT(MRT_BGP4MP_ET)][BGP4MP_STATE_CHANGE_AS4]          = F_VALID | F_IS_EXT | F_AS32 | F_IS_BGP | F_HAS_STATE,
     [SHIFT(MRT_BGP4MP_ET)][BGP4MP_MESSAGE_LOCAL]             = F_VALID | F_IS_EXT | F_IS_BGP | F_WRAPS_BGP,
     [SHIFT(MRT_BGP4MP_ET)][BGP4MP_MESSAGE_AS4_LOCAL]         = F_VALID | F_IS_EXT | F_AS32 | F_IS_BGP | F_WRAPS_BGP,
+    [SHIFT(MRT_BGP4MP_ET)][BGP4MP_MESSAGE_ADDPATH]           = F_VALID | F_IS_EXT | F_IS_BGP | F_WRAPS_BGP | F_ADDPATH,
     [SHIFT(MRT_BGP4MP_ET)][BGP4MP_MESSAGE_AS4_ADDPATH]       = F_VALID | F_IS_EXT | F_AS32 | F_IS_BGP | F_WRAPS_BGP | F_ADDPATH,
     [SHIFT(MRT_BGP4MP_ET)][BGP4MP_MESSAGE_LOCAL_ADDPATH]     = F_VALID | F_IS_EXT | F_IS_BGP | F_WRAPS_BGP | F_ADDPATH,
     [SHIFT(MRT_BGP4MP_ET)][BGP4MP_MESSAGE_AS4_LOCAL_ADDPATH] = F_VALID | F_IS_EXT | F_AS32 | F_IS_BGP | F_WRAPS_BGP | F_ADDPATH
@@ -936,6 +938,139 @@ UBGP_API umrt_err endribents(umrt_msg_s *msg)
     return MRT_ENOERR;
 }
 
+static bool ribbatchfit(rib_batch_t *batch, size_t count)
+{
+    if (likely(count <= batch->capacity))
+        return true;
+
+    // one block for every array, 32-bit arrays first to keep them aligned
+    size_t cap = MAX(count, 2 * batch->capacity);
+    byte *block = malloc(cap * (3 * sizeof(uint32_t) + 2 * sizeof(uint16_t)));
+    if (unlikely(!block))
+        return false;
+
+    free(batch->block);
+
+    batch->block      = block;
+    batch->capacity   = cap;
+    batch->originated = (uint32_t *) block;
+    batch->pathid     = batch->originated + cap;
+    batch->attr_off   = batch->pathid + cap;
+    batch->peer_idx   = (uint16_t *) (batch->attr_off + cap);
+    batch->attr_len   = batch->peer_idx + cap;
+    return true;
+}
+
+UBGP_API umrt_err getribbatch(umrt_msg_s *msg, rib_batch_t *batch)
+{
+    CHECKTYPER(MRT_TABLE_DUMPV2, msg->err);
+    CHECKPEERIDX();
+
+    size_t count, n;
+
+    byte *ptr = getribents(msg, &count, &n);
+    if (unlikely(!ptr))
+        return msg->err;
+
+    // entry header: peer index, originated time, [path id], attributes length
+    size_t hdrsiz = sizeof(uint16_t) + sizeof(uint32_t) + sizeof(uint16_t);
+    if (msg->flags & F_ADDPATH)
+        hdrsiz += sizeof(uint32_t);
+
+    // the advertised count is only a hint, just like nextribent(),
+    // trust the entries actually inside the record
+    if (unlikely(!ribbatchfit(batch, count))) {
+        msg->err = MRT_ENOMEM;
+        return msg->err;
+    }
+
+    // chase entry boundaries, the only sequential dependency
+    size_t i   = 0;
+    size_t pos = 0;
+    while (pos < n) {
+        if (unlikely(i == batch->capacity && !ribbatchfit(batch, i + 1))) {
+            msg->err = MRT_ENOMEM;
+            return msg->err;
+        }
+
+        CHECKBOUNDS(ptr + pos, ptr + n, hdrsiz, MRT_EBADRIBENT);
+
+        uint16_t len;
+        memcpy(&len, ptr + pos + hdrsiz - sizeof(len), sizeof(len));
+
+        pos += hdrsiz;
+        batch->attr_off[i] = pos;
+        batch->attr_len[i] = beswap16(len);
+        pos += batch->attr_len[i];
+        i++;
+    }
+
+    // last attributes field may overflow the record
+    CHECKBOUNDS(ptr, ptr + n, pos, MRT_EBADRIBENT);
+
+    count = i;
+
+    // independent per entry decoding
+    uint16_t *restrict peer_idx   = batch->peer_idx;
+    uint32_t *restrict originated = batch->originated;
+    uint32_t *restrict pathid     = batch->pathid;
+
+    const uint32_t *restrict attr_off = batch->attr_off;
+    for (i = 0; i < count; i++) {
+        const byte *ent = ptr + attr_off[i] - hdrsiz;
+
+        uint16_t idx;
+        uint32_t stamp;
+        memcpy(&idx, ent, sizeof(idx));
+        memcpy(&stamp, ent + sizeof(idx), sizeof(stamp));
+
+        peer_idx[i]   = beswap16(idx);
+        originated[i] = beswap32(stamp);
+    }
+
+    if (msg->flags & F_ADDPATH) {
+        for (i = 0; i < count; i++) {
+            uint32_t id;
+            memcpy(&id, ptr + attr_off[i] - sizeof(uint16_t) - sizeof(id), sizeof(id));
+            pathid[i] = beswap32(id);
+        }
+    } else {
+        memset(pathid, 0, count * sizeof(*pathid));
+    }
+
+    // validate peer indexes with a branchless reduction
+    uint picount = msg->peer_index->picount;
+    uint bad     = 0;
+    for (i = 0; i < count; i++)
+        bad |= (peer_idx[i] >= picount);
+
+    if (unlikely(bad)) {
+        msg->err = MRT_EBADPEERIDX;
+        return msg->err;
+    }
+
+    memcpy(&batch->hdr, &msg->ribhdr, sizeof(batch->hdr));
+    batch->count = count;
+    batch->base  = ptr;
+    return MRT_ENOERR;
+}
+
+UBGP_API peer_entry_t *getribpeer(umrt_msg_s *msg, uint16_t idx, peer_entry_t *dst)
+{
+    umrt_msg_s *pi = msg->peer_index;
+    if (unlikely(!pi || idx >= pi->picount))
+        return NULL;
+
+    decodepeerent(dst, &pi->buf[pi->pitab[idx] + MESSAGE_OFFSET]);
+    return dst;
+}
+
+UBGP_API void ribbatchclose(rib_batch_t *batch)
+{
+    free(batch->block);
+    memset(batch, 0, sizeof(*batch));
+}
+
 UBGP_API bgp4mp_header_t *getbgp4mpheader(umrt_msg_s *msg)
 {
     CHECKFLAGSR(F_RD | F_IS_BGP, NULL);
@@ -1120,3 +1255,381 @@ UBGP_API void *unwrapzebra(umrt_msg_s *msg, size_t *pn)
     return ptr;
 }
 
+
+// writer section
+
+#define MRTWRGROWSTEP (64 * 1024)
+
+static byte *put16(byte *ptr, uint16_t v)
+{
+    v = beswap16(v);
+    memcpy(ptr, &v, sizeof(v));
+    return ptr + sizeof(v);
+}
+
+static byte *put32(byte *ptr, uint32_t v)
+{
+    v = beswap32(v);
+    memcpy(ptr, &v, sizeof(v));
+    return ptr + sizeof(v);
+}
+
+static byte *putmrtheader(byte *ptr, time_t stamp, int type, int subtype, size_t len)
+{
+    ptr = put32(ptr, (uint32_t) stamp);
+    ptr = put16(ptr, type);
+    ptr = put16(ptr, subtype);
+    return put32(ptr, len);
+}
+
+UBGP_API void mrtwriterinit(mrt_writer_t *w, void *buf, size_t size, io_rw_t *io)
+{
+    memset(w, 0, sizeof(*w));
+    if (buf) {
+        w->buf = w->usrbuf = buf;
+        w->cap = size;
+    }
+
+    w->io = io;
+}
+
+// size of the complete records inside the buffer
+static size_t wrcomplete(const mrt_writer_t *w)
+{
+    return (w->flags & F_RE) ? w->rec : w->len;
+}
+
+static umrt_err wrflush(mrt_writer_t *w)
+{
+    size_t n = wrcomplete(w);
+    if (n == 0 || !w->io)
+        return MRT_ENOERR;
+
+    if (unlikely(w->io->write(w->io, w->buf, n) != n)) {
+        w->err = MRT_EIO;
+        return w->err;
+    }
+
+    // keep the RIB record being encoded, if any
+    memmove(w->buf, &w->buf[n], w->len - n);
+    w->len -= n;
+    if (w->flags & F_RE) {
+        w->rec      -= n;
+        w->countoff -= n;
+    }
+
+    return MRT_ENOERR;
+}
+
+// reserve n bytes at the end of the buffer
+static byte *wrensure(mrt_writer_t *w, size_t n)
+{
+    if (unlikely(w->len + n > w->cap)) {
+        if (w->io && wrflush(w) != MRT_ENOERR)
+            return NULL;
+
+        if (w->len + n > w->cap) {
+            // grow geometrically, so encoding is amortized linear time
+            size_t cap = MAX(2 * w->cap, w->len + n);
+            cap = MAX(cap, MRTWRGROWSTEP);
+
+            byte *buf = w->buf;
+            if (buf == w->usrbuf)
+                buf = NULL;
+
+            byte *larger = realloc(buf, cap);
+            if (unlikely(!larger)) {
+                w->err = MRT_ENOMEM;
+                return NULL;
+            }
+
+            if (!buf && w->len > 0)
+                memcpy(larger, w->buf, w->len);
+
+            w->buf = larger;
+            w->cap = cap;
+        }
+    }
+
+    byte *ptr = &w->buf[w->len];
+    w->len += n;
+    return ptr;
+}
+
+static bool aspeerent(const peer_entry_t *pe)
+{
+    return pe->as_size == sizeof(uint32_t) || pe->as > UINT16_MAX;
+}
+
+static byte *encodepeerent(byte *ptr, const peer_entry_t *pe)
+{
+    bool as32 = aspeerent(pe);
+
+    *ptr++ = ((pe->addr.family == AF_INET6) ? PT_IPV6 : 0) | (as32 ? PT_AS32 : 0);
+
+    memcpy(ptr, &pe->id, sizeof(pe->id));
+    ptr += sizeof(pe->id);
+    if (pe->addr.family == AF_INET6) {
+        memcpy(ptr, &pe->addr.sin6, sizeof(pe->addr.sin6));
+        ptr += sizeof(pe->addr.sin6);
+    } else {
+        memcpy(ptr, &pe->addr.sin, sizeof(pe->addr.sin));
+        ptr += sizeof(pe->addr.sin);
+    }
+
+    return as32 ? put32(ptr, pe->as) : put16(ptr, pe->as);
+}
+
+UBGP_API umrt_err mrtputpeeridx(mrt_writer_t       *w,
+                                time_t              stamp,
+                                struct in_addr      collector,
+                                const char         *viewname,
+                                const peer_entry_t *peers,
+                                size_t              count)
+{
+    if (unlikely(w->err))
+        return w->err;
+    if (unlikely(w->flags & F_RE))
+        return MRT_EINVOP;
+
+    size_t namelen = viewname ? strlen(viewname) : 0;
+    if (unlikely(namelen > UINT16_MAX || count > UINT16_MAX))
+        return MRT_EINVOP;
+
+    size_t len = sizeof(collector) + sizeof(uint16_t) + namelen + sizeof(uint16_t);
+    for (size_t i = 0; i < count; i++) {
+        const peer_entry_t *pe = &peers[i];
+        if (unlikely(pe->addr.family != AF_INET && pe->addr.family != AF_INET6))
+            return MRT_EAFINOTSUP;
+
+        len += sizeof(uint8_t) + sizeof(pe->id);
+        len += (pe->addr.family == AF_INET6) ? sizeof(pe->addr.sin6) : sizeof(pe->addr.sin);
+        len += aspeerent(pe) ? sizeof(uint32_t) : sizeof(uint16_t);
+    }
+
+    byte *ptr = wrensure(w, MRT_HDRSIZ + len);
+    if (unlikely(!ptr))
+        return w->err;
+
+    ptr = putmrtheader(ptr, stamp, MRT_TABLE_DUMPV2, MRT_TABLE_DUMPV2_PEER_INDEX_TABLE, len);
+
+    memcpy(ptr, &collector, sizeof(collector));
+    ptr += sizeof(collector);
+    ptr = put16(ptr, namelen);
+    if (namelen > 0)
+        memcpy(ptr, viewname, namelen);
+
+    ptr += namelen;
+    ptr = put16(ptr, count);
+    for (size_t i = 0; i < count; i++)
+        ptr = encodepeerent(ptr, &peers[i]);
+
+    return MRT_ENOERR;
+}
+
+UBGP_API umrt_err mrtstartrib(mrt_writer_t    *w,
+                              time_t           stamp,
+                              int              subtype,
+                              uint32_t         seqno,
+                              const netaddr_t *nlri)
+{
+    if (unlikely(w->err))
+        return w->err;
+    if (unlikely(w->flags & F_RE))
+        return MRT_EINVOP;
+
+    sa_family_t fam;
+    switch (subtype) {
+    case MRT_TABLE_DUMPV2_RIB_IPV4_UNICAST:
+    case MRT_TABLE_DUMPV2_RIB_IPV4_UNICAST_ADDPATH:
+    case MRT_TABLE_DUMPV2_RIB_IPV4_MULTICAST:
+    case MRT_TABLE_DUMPV2_RIB_IPV4_MULTICAST_ADDPATH:
+        fam = AF_INET;
+        break;
+    case MRT_TABLE_DUMPV2_RIB_IPV6_UNICAST:
+    case MRT_TABLE_DUMPV2_RIB_IPV6_UNICAST_ADDPATH:
+    case MRT_TABLE_DUMPV2_RIB_IPV6_MULTICAST:
+    case MRT_TABLE_DUMPV2_RIB_IPV6_MULTICAST_ADDPATH:
+        fam = AF_INET6;
+        break;
+    default:
+        return MRT_ERIBNOTSUP;
+    }
+    if (unlikely(nlri->family != fam))
+        return MRT_EAFINOTSUP;
+
+    size_t n = naddrsize(nlri->bitlen);
+
+    byte *ptr = wrensure(w, MRT_HDRSIZ + sizeof(seqno) + sizeof(uint8_t) + n + sizeof(uint16_t));
+    if (unlikely(!ptr))
+        return w->err;
+
+    w->rec = ptr - w->buf;
+
+    ptr = putmrtheader(ptr, stamp, MRT_TABLE_DUMPV2, subtype, 0);  // length is known at mrtendrib()
+    ptr = put32(ptr, seqno);
+    *ptr++ = nlri->bitlen;
+    memcpy(ptr, nlri->bytes, n);
+    ptr += n;
+
+    w->countoff = ptr - w->buf;
+    put16(ptr, 0);
+
+    w->count = 0;
+    w->flags = F_RE | (masktab[SHIFT(MRT_TABLE_DUMPV2)][subtype] & F_ADDPATH);
+    return MRT_ENOERR;
+}
+
+UBGP_API umrt_err mrtputribent(mrt_writer_t *w,
+                               uint16_t      idx,
+                               time_t        originated,
+                               uint32_t      pathid,
+                               const void   *attrs,
+                               size_t        n)
+{
+    if (unlikely(w->err))
+        return w->err;
+    if (unlikely((w->flags & F_RE) == 0 || w->count == UINT16_MAX || n > UINT16_MAX))
+        return MRT_EINVOP;
+
+    size_t len = sizeof(idx) + sizeof(uint32_t) + sizeof(uint16_t) + n;
+    if (w->flags & F_ADDPATH)
+        len += sizeof(pathid);
+
+    byte *ptr = wrensure(w, len);
+    if (unlikely(!ptr))
+        return w->err;
+
+    ptr = put16(ptr, idx);
+    ptr = put32(ptr, (uint32_t) originated);
+    if (w->flags & F_ADDPATH)
+        ptr = put32(ptr, pathid);
+
+    ptr = put16(ptr, n);
+    if (n > 0)
+        memcpy(ptr, attrs, n);
+
+    w->count++;
+    return MRT_ENOERR;
+}
+
+UBGP_API umrt_err mrtendrib(mrt_writer_t *w)
+{
+    if (unlikely(w->err))
+        return w->err;
+    if (unlikely((w->flags & F_RE) == 0))
+        return MRT_EINVOP;
+
+    put32(&w->buf[w->rec + LENGTH_OFFSET], w->len - w->rec - MRT_HDRSIZ);
+    put16(&w->buf[w->countoff], w->count);
+
+    w->flags = 0;
+    return MRT_ENOERR;
+}
+
+UBGP_API umrt_err mrtputbgp4mp(mrt_writer_t          *w,
+                               const struct timespec *stamp,
+                               int                    type,
+                               int                    subtype,
+                               const bgp4mp_header_t *hdr,
+                               const void            *data,
+                               size_t                 n)
+{
+    if (unlikely(w->err))
+        return w->err;
+    if (unlikely(w->flags & F_RE))
+        return MRT_EINVOP;
+    if (unlikely(type != MRT_BGP4MP && type != MRT_BGP4MP_ET))
+        return MRT_ETYPENOTSUP;
+    if (unlikely(subtype < 0 || subtype > MAX_MRT_SUBTYPE))
+        return MRT_ETYPENOTSUP;
+
+    uint flags = masktab[SHIFT(type)][subtype];
+    if (unlikely((flags & F_IS_BGP) == 0))
+        return MRT_ETYPENOTSUP;
+
+    int fam = hdr->peer_addr.family;
+    if (unlikely((fam != AF_INET && fam != AF_INET6) || hdr->local_addr.family != fam))
+        return MRT_EAFINOTSUP;
+
+    size_t addrsize = (fam == AF_INET6) ? sizeof(struct in6_addr) : sizeof(struct in_addr);
+    if (flags & F_HAS_STATE)
+        n = 0;
+
+    size_t len = 2 * ((flags & F_AS32) ? sizeof(uint32_t) : sizeof(uint16_t));
+    len += sizeof(hdr->iface) + sizeof(uint16_t) + 2 * addrsize;
+    if (flags & F_IS_EXT)
+        len += sizeof(uint32_t);
+    if (flags & F_HAS_STATE)
+        len += sizeof(hdr->old_state) + sizeof(hdr->new_state);
+
+    len += n;
+
+    byte *ptr = wrensure(w, MRT_HDRSIZ + len);
+    if (unlikely(!ptr))
+        return w->err;
+
+    ptr = putmrtheader(ptr, stamp->tv_sec, type, subtype, len);
+    if (flags & F_IS_EXT)
+        ptr = put32(ptr, stamp->tv_nsec / 1000);
+
+    if (flags & F_AS32) {
+        ptr = put32(ptr, hdr->peer_as);
+        ptr = put32(ptr, hdr->local_as);
+    } else {
+        // RFC 6793 mandates AS_TRANS for ASes that don't fit in 2 bytes
+        ptr = put16(ptr, (hdr->peer_as > UINT16_MAX) ? AS_TRANS : hdr->peer_as);
+        ptr = put16(ptr, (hdr->local_as > UINT16_MAX) ? AS_TRANS : hdr->local_as);
+    }
+
+    ptr = put16(ptr, hdr->iface);
+    ptr = put16(ptr, (fam == AF_INET6) ? AFI_IPV6 : AFI_IPV4);
+    memcpy(ptr, hdr->peer_addr.bytes, addrsize);
+    ptr += addrsize;
+    memcpy(ptr, hdr->local_addr.bytes, addrsize);
+    ptr += addrsize;
+
+    if (flags & F_HAS_STATE) {
+        ptr = put16(ptr, hdr->old_state);
+        put16(ptr, hdr->new_state);
+    } else if (n > 0) {
+        memcpy(ptr, data, n);
+    }
+
+    return MRT_ENOERR;
+}
+
+UBGP_API umrt_err mrtflush(mrt_writer_t *w)
+{
+    if (unlikely(w->err))
+        return w->err;
+
+    return wrflush(w);
+}
+
+UBGP_API void *mrtwriterdata(mrt_writer_t *w, size_t *pn)
+{
+    if (pn)
+        *pn = wrcomplete(w);
+
+    return w->buf;
+}
+
+UBGP_API umrt_err mrtwritererror(const mrt_writer_t *w)
+{
+    return w->err;
+}
+
+UBGP_API umrt_err mrtwriterclose(mrt_writer_t *w)
+{
+    // drop any incomplete record
+    w->len    = wrcomplete(w);
+    w->flags &= ~F_RE;
+
+    umrt_err err = mrtflush(w);
+    if (w->buf != w->usrbuf)
+        free(w->buf);
+
+    memset(w, 0, sizeof(*w));
+    return err;
+}
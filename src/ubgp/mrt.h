@@ -143,6 +143,37 @@ typedef struct {
     bgpattr_t *attrs;
 } rib_entry_t;
 
+/**
+ * rib_batch_t:
+ * @hdr:        RIB record header
+ * @count:      number of decoded entries
+ * @peer_idx:   peer index number of each entry
+ * @originated: originated time of each entry
+ * @pathid:     path identifier of each entry, 0 unless ADDPATH subtype
+ * @attr_off:   offset of each entry attributes, relative to @base
+ * @attr_len:   attributes length in bytes of each entry
+ * @base:       raw RIB entries bytes inside the decoded message
+ *
+ * Structure of arrays holding every entry of a TABLE_DUMPV2 RIB record,
+ * filled by getribbatch(). Arrays are owned by the batch, and are
+ * reused by subsequent getribbatch() calls, release them with
+ * ribbatchclose(). A zero initialized batch is ready for use.
+ */
+typedef struct {
+    rib_header_t hdr;
+    size_t count;
+    uint16_t *peer_idx;
+    uint32_t *originated;
+    uint32_t *pathid;
+    uint32_t *attr_off;
+    uint16_t *attr_len;
+    byte *base;
+
+    /*< private >*/
+    size_t capacity;
+    void *block;
+} rib_batch_t;
+
 /**
  * @MRT_TABLE_DUMPV2_PEER_INDEX_TABLE: RFC6396
  * @MRT_TABLE_DUMPV2_RIB_IPV4_UNICAST: RFC6396
@@ -413,8 +444,6 @@ UBGP_API CHECK_NONNULL(1) umrt_err startpeerents(umrt_msg_s *msg, size_t *pcount
 
 UBGP_API CHECK_NONNULL(1) peer_entry_t *nextpeerent(umrt_msg_s *msg);
 
-UBGP_API CHECK_NONNULL(1, 2) umrt_err putpeerent(umrt_msg_s *msg, const peer_entry_t *pe);
-
 UBGP_API CHECK_NONNULL(1) umrt_err endpeerents(umrt_msg_s *msg);
 
 // RIB subtypes
@@ -441,16 +470,43 @@ UBGP_API CHECK_NONNULL(1) rib_header_t *startribents(umrt_msg_s *msg, size_t *pc
 
 UBGP_API CHECK_NONNULL(1) rib_entry_t *nextribent(umrt_msg_s *msg);
 
-UBGP_API CHECK_NONNULL(1, 2, 5)
-umrt_err putribent(umrt_msg_s        *msg,
-                   const rib_entry_t *pe,
-                   uint16_t           idx,
-                   time_t             seconds,
-                   const bgpattr_t   *attrs,
-                   size_t             attrs_size);
-
 UBGP_API CHECK_NONNULL(1) umrt_err endribents(umrt_msg_s *msg);
 
+/**
+ * getribbatch:
+ * @msg:   a #umrt_msg_s of type %MRT_TABLE_DUMPV2, with a RIB subtype
+ * @batch: batch to be filled
+ *
+ * Decode every RIB entry inside @msg at once. Entry boundaries are
+ * chased in a single tight loop, fields are then decoded and validated
+ * in independent per entry loops, so consumers can process them in
+ * vectorizable loops too. The RIB entries iterator is not affected.
+ *
+ * Attributes of entry `i` are `batch->base + batch->attr_off[i]`,
+ * they remain valid as long as @msg is open.
+ *
+ * Returns: %MRT_ENOERR on success, an error code otherwise (mrterror() is set),
+ *          on error @batch contents are undefined.
+ */
+UBGP_API CHECK_NONNULL(1, 2) umrt_err getribbatch(umrt_msg_s *msg, rib_batch_t *batch);
+
+/**
+ * getribpeer:
+ * @msg: a #umrt_msg_s of type %MRT_TABLE_DUMPV2, with a RIB subtype
+ * @idx: a peer index number, as found in #rib_batch_t or #rib_entry_t
+ * @dst: storage for the decoded peer entry
+ *
+ * Decode a peer entry from the PEER_INDEX associated with @msg.
+ *
+ * Returns: @dst on success, %NULL if no PEER_INDEX is associated
+ *          with @msg, or @idx is out of bounds.
+ */
+UBGP_API CHECK_NONNULL(1, 3) peer_entry_t *getribpeer(umrt_msg_s   *msg,
+                                                      uint16_t      idx,
+                                                      peer_entry_t *dst);
+
+UBGP_API CHECK_NONNULL(1) void ribbatchclose(rib_batch_t *batch);
+
 // BGP4MP
 
 UBGP_API CHECK_NONNULL(1) bgp4mp_header_t *getbgp4mpheader(umrt_msg_s *msg);
@@ -463,5 +519,169 @@ UBGP_API CHECK_NONNULL(1) zebra_header_t *getzebraheader(umrt_msg_s *msg);
 
 UBGP_API CHECK_NONNULL(1) void *unwrapzebra(umrt_msg_s *msg, size_t *pn);
 
+// writer section
+
+/**
+ * mrt_writer_t:
+ *
+ * MRT records encoder, records are encoded back to back into a single
+ * buffer, which is flushed to an #io_rw_t whenever it fills up.
+ * Without an #io_rw_t, the buffer grows to hold every record instead.
+ */
+typedef struct {
+    /*< private >*/
+    byte    *buf;
+    size_t   len, cap;
+    byte    *usrbuf;    // caller provided buffer, never free()d
+    io_rw_t *io;
+    size_t   rec;       // offset of the RIB record being encoded
+    size_t   countoff;  // offset of its entry count
+    uint     count;
+    uint     flags;
+    umrt_err err;
+} mrt_writer_t;
+
+/**
+ * mrtwriterinit:
+ * @w:               writer to be initialized
+ * @buf: (nullable): initial encoding buffer, %NULL to allocate one as needed
+ * @size:            @buf size in bytes
+ * @io: (nullable):  output, %NULL to keep every record in memory
+ *
+ * Initialize an MRT writer. @buf is never free()d, and is abandoned
+ * in favor of a larger allocated buffer if it turns out to be
+ * too small. A buffer large enough for many records avoids most
+ * copies and write calls, so a whole table may be written
+ * at memory bandwidth.
+ */
+UBGP_API CHECK_NONNULL(1) void mrtwriterinit(mrt_writer_t *w,
+                                             void         *buf,
+                                             size_t        size,
+                                             io_rw_t      *io);
+
+/**
+ * mrtputpeeridx:
+ * @w:                   an MRT writer
+ * @stamp:               record timestamp
+ * @collector:           collector BGP identifier
+ * @viewname: (nullable): view name, %NULL for none
+ * @peers:               peer entries, in peer index order
+ * @count:               number of @peers
+ *
+ * Encode a %MRT_TABLE_DUMPV2_PEER_INDEX_TABLE record. Peer AS numbers
+ * are encoded in 4 bytes when `as_size` is 4, or they don't fit 2 bytes.
+ *
+ * Returns: %MRT_ENOERR on success, an error code otherwise.
+ */
+UBGP_API CHECK_NONNULL(1) umrt_err mrtputpeeridx(mrt_writer_t       *w,
+                                                 time_t              stamp,
+                                                 struct in_addr      collector,
+                                                 const char         *viewname,
+                                                 const peer_entry_t *peers,
+                                                 size_t              count);
+
+/**
+ * mrtstartrib:
+ * @w:       an MRT writer
+ * @stamp:   record timestamp
+ * @subtype: one of the %MRT_TABLE_DUMPV2 IPv4 or IPv6, unicast or multicast
+ *           subtypes, possibly ADDPATH
+ * @seqno:   record sequence number
+ * @nlri:    prefix, its family must match @subtype
+ *
+ * Start encoding a RIB record, entries are added with mrtputribent(),
+ * and the record is complete once mrtendrib() is called.
+ *
+ * Returns: %MRT_ENOERR on success, an error code otherwise.
+ */
+UBGP_API CHECK_NONNULL(1, 5) umrt_err mrtstartrib(mrt_writer_t    *w,
+                                                  time_t           stamp,
+                                                  int              subtype,
+                                                  uint32_t         seqno,
+                                                  const netaddr_t *nlri);
+
+/**
+ * mrtputribent:
+ * @w:          an MRT writer, with a RIB record started
+ * @idx:        peer index number
+ * @originated: entry originated time
+ * @pathid:     path identifier, ignored unless the record is ADDPATH
+ * @attrs:      raw BGP path attributes, as found in RIB entries
+ * @n:          @attrs size in bytes
+ *
+ * Append an entry to the current RIB record.
+ *
+ * Returns: %MRT_ENOERR on success, an error code otherwise.
+ */
+UBGP_API CHECK_NONNULL(1) umrt_err mrtputribent(mrt_writer_t *w,
+                                                uint16_t      idx,
+                                                time_t        originated,
+                                                uint32_t      pathid,
+                                                const void   *attrs,
+                                                size_t        n);
+
+UBGP_API CHECK_NONNULL(1) umrt_err mrtendrib(mrt_writer_t *w);
+
+/**
+ * mrtputbgp4mp:
+ * @w:              an MRT writer
+ * @stamp:          record timestamp, microseconds are only encoded
+ *                  for %MRT_BGP4MP_ET
+ * @type:           either %MRT_BGP4MP or %MRT_BGP4MP_ET
+ * @subtype:        a BGP4MP message or state change subtype
+ * @hdr:            BGP4MP header, addresses must share the same family,
+ *                  states are only encoded for state changes
+ * @data: (nullable): BGP message, ignored for state changes
+ * @n:              @data size in bytes
+ *
+ * Encode a BGP4MP record.
+ *
+ * Returns: %MRT_ENOERR on success, an error code otherwise.
+ */
+UBGP_API CHECK_NONNULL(1, 2, 5) umrt_err mrtputbgp4mp(mrt_writer_t          *w,
+                                                      const struct timespec *stamp,
+                                                      int                    type,
+                                                      int                    subtype,
+                                                      const bgp4mp_header_t *hdr,
+                                                      const void            *data,
+                                                      size_t                 n);
+
+/**
+ * mrtflush:
+ * @w: an MRT writer
+ *
+ * Write every complete record to the writer output, does nothing
+ * if the writer has none.
+ *
+ * Returns: %MRT_ENOERR on success, an error code otherwise.
+ */
+UBGP_API CHECK_NONNULL(1) umrt_err mrtflush(mrt_writer_t *w);
+
+/**
+ * mrtwriterdata:
+ * @w:               an MRT writer
+ * @pn: (nullable):  if not %NULL, storage where data size should be stored
+ *
+ * Retrieve the complete records encoded and not flushed yet,
+ * that is every record when the writer has no output.
+ *
+ * Returns: encoded records, valid until the next writer call.
+ */
+UBGP_API CHECK_NONNULL(1) void *mrtwriterdata(mrt_writer_t *w, size_t *pn);
+
+UBGP_API CHECK_NONNULL(1) PUREFUNC umrt_err mrtwritererror(const mrt_writer_t *w);
+
+/**
+ * mrtwriterclose:
+ * @w: an MRT writer
+ *
+ * Flush every complete record and release the writer resources,
+ * a RIB record still being encoded is discarded. The writer output
+ * is not closed.
+ *
+ * Returns: the first error encountered by the writer, if any.
+ */
+UBGP_API CHECK_NONNULL(1) umrt_err mrtwriterclose(mrt_writer_t *w);
+
 #endif
 
@@ -48,11 +48,29 @@ union pnode_s {
     union pnode_s *next;             // used when the node is a free node (to create a linked list of free nodes)
 };
 
+#define PAT_PAGE_SIZE 8192
+
+// pages are aligned to their size, so the page of a node is found by masking its address
 struct nodepage_s {
     struct nodepage_s *next;
-    pnode_t block[128];
+    uint nused;
+    u128 *cover;  // subtree coverage of each node in block, in augmented mode
+    pnode_t block[(PAT_PAGE_SIZE - 3 * sizeof(void *)) / sizeof(pnode_t)];
 };
 
+_Static_assert(sizeof(nodepage_t) <= PAT_PAGE_SIZE, "node page exceeds PAT_PAGE_SIZE");
+
+static nodepage_t *getpnodepage(pnode_t *n)
+{
+    return (nodepage_t *) ((uintptr_t) n & ~(uintptr_t) (PAT_PAGE_SIZE - 1));
+}
+
+static u128 *getpnodecover(pnode_t *n)
+{
+    nodepage_t *p = getpnodepage(n);
+    return &p->cover[n - p->block];
+}
+
 static void pnodeinit(pnode_t *n, const netaddr_t *prefix)
 {
     memset(n, 0, sizeof(*n));
@@ -89,9 +107,56 @@ static void resetpnodeglue(pnode_t* n)
     n->parent = (pnode_t *)((uintptr_t) n->parent & ~PATRICIA_GLUE_NODE);
 }
 
+static u128 pnodecover(const patricia_trie_t *pt, pnode_t *n)
+{
+    // outermost prefixes cover their whole address space, the default route is ignored
+    if (!ispnodeglue(n) && n->prefix.bitlen != 0)
+        return u128shl(U128_ONE, pt->maxbitlen - n->prefix.bitlen);
+
+    u128 cover = U128_ZERO;
+    for (int i = 0; i < 2; i++) {
+        if (n->children[i])
+            cover = u128add(cover, *getpnodecover(n->children[i]));
+    }
+
+    return cover;
+}
+
+// refresh cached coverage from n up to the root, after n or its children changed
+static void patfixcover(const patricia_trie_t *pt, pnode_t *n)
+{
+    if (!pt->augmented)
+        return;
+
+    for (; n; n = getpnodeparent(n))
+        *getpnodecover(n) = pnodecover(pt, n);
+}
+
+static nodepage_t *patnewpage(patricia_trie_t *pt)
+{
+    nodepage_t *p = aligned_alloc(PAT_PAGE_SIZE, PAT_PAGE_SIZE);
+    if (unlikely(!p))
+        return NULL;
+
+    p->cover = NULL;
+    if (pt->augmented) {
+        p->cover = malloc(countof(p->block) * sizeof(*p->cover));
+        if (unlikely(!p->cover)) {
+            free(p);
+            return NULL;
+        }
+    }
+
+    p->nused = 0;
+    p->next  = pt->pages;
+    pt->pages = p;
+    pt->npages++;
+    return p;
+}
+
 static void patallocpage(patricia_trie_t *pt)
 {
-    nodepage_t *p = malloc(sizeof(*p));
+    nodepage_t *p = patnewpage(pt);
     if (unlikely(!p))
         return;
 
@@ -101,9 +166,6 @@ static void patallocpage(patricia_trie_t *pt)
         n->next = pt->freenodes;
         pt->freenodes = n;
     }
-
-    p->next = pt->pages;
-    pt->pages = p;
 }
 
 static pnode_t* getfreenode(patricia_trie_t *pt)
@@ -117,6 +179,8 @@ static pnode_t* getfreenode(patricia_trie_t *pt)
     }
     pt->freenodes = pt->freenodes->next;
 
+    getpnodepage(n)->nused++;
+    pt->nnodes++;
     return n;
 }
 
@@ -125,6 +189,341 @@ static void putfreenode(patricia_trie_t *pt, pnode_t *n)
     pnode_t* save = pt->freenodes;
     pt->freenodes = n;
     n->next = save;
+
+    getpnodepage(n)->nused--;
+    pt->nnodes--;
+}
+
+/*
+ * Packed nodes, see patpack().
+ *
+ * Nodes are stored in depth-first order, so the root is always at index 0,
+ * and index 0 doubles as the "no child" marker.
+ * Keys are kept in native byte order, glue nodes keep the prefix of
+ * the regular node they were copied from, so lookups on packed nodes mirror
+ * the regular ones step by step.
+ */
+typedef struct {
+    uint32_t key;
+    uint8_t bitlen;
+    uint8_t glue;
+    uint32_t children[2];
+} pat4node_t;
+
+typedef struct {
+    uint64_t hi, lo;
+} pat6key_t;
+
+typedef struct {
+    pat6key_t key;
+    uint8_t bitlen;
+    uint8_t glue;
+    uint32_t children[2];
+} pat6node_t;
+
+struct patpacked_s {
+    union {
+        pat4node_t *nodes4;
+        pat6node_t *nodes6;
+    };
+    pnode_t **refs;  // regular node for each packed one, returned by lookups
+    uint32_t nnodes;
+};
+
+static uint32_t pat4key(const netaddr_t *prefix)
+{
+    return beswap32(prefix->u32[0]);
+}
+
+static int pat4bit(uint32_t key, uint bit)
+{
+    return (key >> (31 - bit)) & 1;
+}
+
+static bool pat4eqwithmask(uint32_t a, uint32_t b, uint mask)
+{
+    return mask == 0 || ((a ^ b) >> (32 - mask)) == 0;
+}
+
+static pat6key_t pat6key(const netaddr_t *prefix)
+{
+    pat6key_t key;
+    key.hi = ((uint64_t) beswap32(prefix->u32[0]) << 32) | beswap32(prefix->u32[1]);
+    key.lo = ((uint64_t) beswap32(prefix->u32[2]) << 32) | beswap32(prefix->u32[3]);
+    return key;
+}
+
+static int pat6bit(pat6key_t key, uint bit)
+{
+    return (bit < 64) ? (key.hi >> (63 - bit)) & 1 : (key.lo >> (127 - bit)) & 1;
+}
+
+static bool pat6eqwithmask(pat6key_t a, pat6key_t b, uint mask)
+{
+    if (mask == 0)
+        return true;
+    if (mask <= 64)
+        return ((a.hi ^ b.hi) >> (64 - mask)) == 0;
+
+    return a.hi == b.hi && ((a.lo ^ b.lo) >> (128 - mask)) == 0;
+}
+
+#define PATCHILD(nodes, n, bit)                                                        \
+    ((n)->children[bit] ? &(nodes)[(n)->children[bit]] : NULL)
+
+#define DEFINE_PACKED_LOOKUPS(fam, node_t, key_t, nodes)                               \
+    static trienode_t *pat##fam##searchexact(const patpacked_t *pk,                    \
+                                             const netaddr_t   *prefix)                \
+    {                                                                                  \
+        const node_t *n = (pk->nnodes) ? &pk->nodes[0] : NULL;                         \
+        key_t key = pat##fam##key(prefix);                                             \
+        uint bitlen = prefix->bitlen;                                                  \
+                                                                                       \
+        while (n && n->bitlen < bitlen)                                                \
+            n = PATCHILD(pk->nodes, n, pat##fam##bit(key, n->bitlen));                 \
+                                                                                       \
+        if (!n || n->bitlen > bitlen || n->glue)                                       \
+            return NULL;                                                               \
+        if (!pat##fam##eqwithmask(n->key, key, bitlen))                                \
+            return NULL;                                                               \
+                                                                                       \
+        return &pk->refs[n - pk->nodes]->pub;                                          \
+    }                                                                                  \
+                                                                                       \
+    static trienode_t *pat##fam##searchbest(const patpacked_t *pk,                     \
+                                            const netaddr_t   *prefix)                 \
+    {                                                                                  \
+        const node_t *n = (pk->nnodes) ? &pk->nodes[0] : NULL;                         \
+        const node_t *last = NULL;                                                     \
+        key_t key = pat##fam##key(prefix);                                             \
+        uint bitlen = prefix->bitlen;                                                  \
+                                                                                       \
+        while (n && n->bitlen < bitlen) {                                              \
+            if (!n->glue) {                                                            \
+                if (!pat##fam##eqwithmask(n->key, key, n->bitlen))                     \
+                    break;                                                             \
+                                                                                       \
+                last = n;                                                              \
+            }                                                                          \
+                                                                                       \
+            n = PATCHILD(pk->nodes, n, pat##fam##bit(key, n->bitlen));                 \
+        }                                                                              \
+                                                                                       \
+        return (last) ? &pk->refs[last - pk->nodes]->pub : NULL;                       \
+    }                                                                                  \
+                                                                                       \
+    static bool pat##fam##issubnetof(const patpacked_t *pk, const netaddr_t *prefix)   \
+    {                                                                                  \
+        const node_t *n = (pk->nnodes) ? &pk->nodes[0] : NULL;                         \
+        key_t key = pat##fam##key(prefix);                                             \
+        uint bitlen = prefix->bitlen;                                                  \
+                                                                                       \
+        while (n && n->bitlen < bitlen) {                                              \
+            if (!n->glue)                                                              \
+                return pat##fam##eqwithmask(n->key, key, n->bitlen);                   \
+                                                                                       \
+            n = PATCHILD(pk->nodes, n, pat##fam##bit(key, n->bitlen));                 \
+        }                                                                              \
+                                                                                       \
+        return n && !n->glue && n->bitlen == bitlen                                    \
+                 && pat##fam##eqwithmask(n->key, key, bitlen);                         \
+    }                                                                                  \
+                                                                                       \
+    /* walk the subtree below prefix, looking for a match, see patissupernetof() */    \
+    static bool pat##fam##matchsubtree(const patpacked_t *pk,                          \
+                                       const node_t      *n,                           \
+                                       key_t              key,                         \
+                                       uint               bitlen,                      \
+                                       bool               firstonly)                   \
+    {                                                                                  \
+        const node_t *stack[129];                                                      \
+        const node_t **sp = stack;                                                     \
+                                                                                       \
+        while (n) {                                                                    \
+            if (!n->glue) {                                                            \
+                if (pat##fam##eqwithmask(n->key, key, bitlen))                         \
+                    return true;                                                       \
+                if (firstonly)                                                         \
+                    return false;                                                      \
+            }                                                                          \
+                                                                                       \
+            const node_t *left  = PATCHILD(pk->nodes, n, 0);                           \
+            const node_t *right = PATCHILD(pk->nodes, n, 1);                           \
+            if (left) {                                                                \
+                if (right)                                                             \
+                    *sp++ = right;                                                     \
+                                                                                       \
+                n = left;                                                              \
+            } else if (right) {                                                        \
+                n = right;                                                             \
+            } else {                                                                   \
+                n = (sp != stack) ? *--sp : NULL;                                      \
+            }                                                                          \
+        }                                                                              \
+                                                                                       \
+        return false;                                                                  \
+    }                                                                                  \
+                                                                                       \
+    static bool pat##fam##issupernetof(const patpacked_t *pk, const netaddr_t *prefix) \
+    {                                                                                  \
+        const node_t *n = (pk->nnodes) ? &pk->nodes[0] : NULL;                         \
+        key_t key = pat##fam##key(prefix);                                             \
+        uint bitlen = prefix->bitlen;                                                  \
+                                                                                       \
+        while (n && n->bitlen < bitlen)                                                \
+            n = PATCHILD(pk->nodes, n, pat##fam##bit(key, n->bitlen));                 \
+                                                                                       \
+        return pat##fam##matchsubtree(pk, n, key, bitlen, true);                       \
+    }                                                                                  \
+                                                                                       \
+    static bool pat##fam##isrelatedof(const patpacked_t *pk, const netaddr_t *prefix)  \
+    {                                                                                  \
+        const node_t *n = (pk->nnodes) ? &pk->nodes[0] : NULL;                         \
+        key_t key = pat##fam##key(prefix);                                             \
+        uint bitlen = prefix->bitlen;                                                  \
+                                                                                       \
+        while (n && n->bitlen < bitlen) {                                              \
+            if (!n->glue && pat##fam##eqwithmask(n->key, key, n->bitlen))              \
+                return true;                                                           \
+                                                                                       \
+            n = PATCHILD(pk->nodes, n, pat##fam##bit(key, n->bitlen));                 \
+        }                                                                              \
+                                                                                       \
+        return pat##fam##matchsubtree(pk, n, key, bitlen, false);                      \
+    }
+
+DEFINE_PACKED_LOOKUPS(4, pat4node_t, uint32_t,  nodes4)
+DEFINE_PACKED_LOOKUPS(6, pat6node_t, pat6key_t, nodes6)
+
+#undef DEFINE_PACKED_LOOKUPS
+
+static void patunpack(patricia_trie_t *pt)
+{
+    if (likely(!pt->packed))
+        return;
+
+    free(pt->packed->nodes4);  // same storage as nodes6
+    free(pt->packed->refs);
+    free(pt->packed);
+    pt->packed = NULL;
+}
+
+static uint32_t patcountnodes(const patricia_trie_t *pt)
+{
+    pnode_t *stack[129];
+    pnode_t **sp = stack;
+
+    uint32_t nnodes = 0;
+    for (pnode_t *n = pt->head; n; ) {
+        nnodes++;
+        if (n->children[0]) {
+            if (n->children[1])
+                *sp++ = n->children[1];
+
+            n = n->children[0];
+        } else if (n->children[1]) {
+            n = n->children[1];
+        } else {
+            n = (sp != stack) ? *--sp : NULL;
+        }
+    }
+
+    return nnodes;
+}
+
+UBGP_API bool patpack(patricia_trie_t *pt)
+{
+    patunpack(pt);
+
+    uint32_t nnodes = patcountnodes(pt);
+
+    patpacked_t *pk = malloc(sizeof(*pk));
+    if (unlikely(!pk))
+        return false;
+
+    size_t nodesize = (pt->maxbitlen == 32) ? sizeof(pat4node_t) : sizeof(pat6node_t);
+
+    pk->nnodes = nnodes;
+    pk->nodes4 = malloc(nnodes * nodesize + 1);
+    pk->refs   = malloc(nnodes * sizeof(*pk->refs) + 1);
+    if (unlikely(!pk->nodes4 || !pk->refs)) {
+        free(pk->nodes4);
+        free(pk->refs);
+        free(pk);
+        return false;
+    }
+
+    // depth-first, left child first, so left children immediately follow
+    // their parent, while the right ones are patched as they get an index
+    struct {
+        pnode_t *n;
+        uint32_t parent;
+        int bit;
+    } stack[2 * 129], *sp = stack;
+
+    if (pt->head) {
+        sp->n = pt->head;
+        sp->parent = 0;
+        sp->bit = -1;
+        sp++;
+    }
+
+    uint32_t idx = 0;
+    while (sp != stack) {
+        sp--;
+
+        pnode_t *n = sp->n;
+        if (sp->bit >= 0) {
+            if (pt->maxbitlen == 32)
+                pk->nodes4[sp->parent].children[sp->bit] = idx;
+            else
+                pk->nodes6[sp->parent].children[sp->bit] = idx;
+        }
+
+        pk->refs[idx] = n;
+        if (pt->maxbitlen == 32) {
+            pat4node_t *p = &pk->nodes4[idx];
+
+            p->key         = pat4key(&n->prefix);
+            p->bitlen      = n->prefix.bitlen;
+            p->glue        = ispnodeglue(n) != 0;
+            p->children[0] = 0;
+            p->children[1] = 0;
+        } else {
+            pat6node_t *p = &pk->nodes6[idx];
+
+            p->key         = pat6key(&n->prefix);
+            p->bitlen      = n->prefix.bitlen;
+            p->glue        = ispnodeglue(n) != 0;
+            p->children[0] = 0;
+            p->children[1] = 0;
+        }
+
+        for (int bit = 1; bit >= 0; bit--) {
+            if (n->children[bit]) {
+                sp->n      = n->children[bit];
+                sp->parent = idx;
+                sp->bit    = bit;
+                sp++;
+            }
+        }
+
+        idx++;
+    }
+
+    assert(idx == nnodes);
+
+    pt->packed = pk;
+    return true;
+}
+
+static size_t patpackedsize(const patricia_trie_t *pt)
+{
+    if (!pt->packed)
+        return 0;
+
+    size_t nodesize = (pt->maxbitlen == 32) ? sizeof(pat4node_t) : sizeof(pat6node_t);
+    return pt->packed->nnodes * (nodesize + sizeof(*pt->packed->refs));
 }
 
 UBGP_API void patinit(patricia_trie_t *pt, sa_family_t family)
@@ -136,6 +535,16 @@ UBGP_API void patinit(patricia_trie_t *pt, sa_family_t family)
     pt->nprefs    = 0;
     pt->pages     = NULL;
     pt->freenodes = NULL;
+    pt->bloom     = NULL;
+    pt->packed    = NULL;
+    pt->nnodes    = 0;
+    pt->npages    = 0;
+
+    pt->compactcur = NULL;
+    pt->fill       = NULL;
+    pt->fillidx    = 0;
+    pt->compacting = false;
+    pt->augmented  = false;
 }
 
 UBGP_API void patclear(patricia_trie_t *pt)
@@ -143,10 +552,23 @@ UBGP_API void patclear(patricia_trie_t *pt)
     pt->head      = NULL;
     pt->nprefs    = 0;
     pt->freenodes = NULL;
+    if (pt->bloom)
+        bloomclear(pt->bloom);
+
+    patunpack(pt);
 
+    pt->nnodes     = 0;
+    pt->compactcur = NULL;
+    pt->fill       = NULL;
+    pt->compacting = false;
     for (nodepage_t *p = pt->pages; p; p = p->next) {
-        for (size_t i = 0; i < countof(p->block); i++)
-            putfreenode(pt, &p->block[i]);
+        p->nused = 0;
+        for (size_t i = 0; i < countof(p->block); i++) {
+            pnode_t *n = &p->block[i];
+
+            n->next = pt->freenodes;
+            pt->freenodes = n;
+        }
     }
 }
 
@@ -156,10 +578,225 @@ UBGP_API void patdestroy(patricia_trie_t *pt)
 
     while (ptr) {
         nodepage_t* next = ptr->next;
+        free(ptr->cover);
         free(ptr);
 
         ptr = next;
     }
+    if (pt->bloom) {
+        bloomdestroy(pt->bloom);
+        free(pt->bloom);
+    }
+
+    patunpack(pt);
+}
+
+// depth-first successor of n, or the first node when n is NULL
+static pnode_t *patdfsnext(const patricia_trie_t *pt, pnode_t *n)
+{
+    if (!n)
+        return pt->head;
+    if (n->children[0])
+        return n->children[0];
+    if (n->children[1])
+        return n->children[1];
+
+    for (pnode_t *parent = getpnodeparent(n); parent; n = parent, parent = getpnodeparent(parent)) {
+        if (parent->children[0] == n && parent->children[1])
+            return parent->children[1];
+    }
+
+    return NULL;
+}
+
+// depth-first predecessor of n, NULL if n is the first node
+static pnode_t *patdfsprev(pnode_t *n)
+{
+    pnode_t *parent = getpnodeparent(n);
+    if (!parent || parent->children[0] == n || !parent->children[0])
+        return parent;
+
+    // the last node in the left sibling subtree
+    n = parent->children[0];
+    while (n->children[0] || n->children[1])
+        n = (n->children[1]) ? n->children[1] : n->children[0];
+
+    return n;
+}
+
+// move n into the free slot m, relinking its parent and children
+static void patrelocate(patricia_trie_t *pt, pnode_t *n, pnode_t *m)
+{
+    *m = *n;
+
+    pnode_t *parent = getpnodeparent(n);
+    if (!parent)
+        pt->head = m;
+    else
+        parent->children[parent->children[1] == n] = m;
+
+    for (int i = 0; i < 2; i++) {
+        if (m->children[i])
+            setpnodeparent(m->children[i], m);
+    }
+
+    if (pt->augmented)
+        *getpnodecover(m) = *getpnodecover(n);
+
+    getpnodepage(m)->nused++;
+    pt->nnodes++;
+    putfreenode(pt, n);
+}
+
+static void patendcompact(patricia_trie_t *pt)
+{
+    // give back the unused tail of the last fresh page
+    nodepage_t *fill = pt->fill;
+    if (fill) {
+        for (size_t i = pt->fillidx; i < countof(fill->block); i++) {
+            pnode_t *n = &fill->block[i];
+
+            n->next = pt->freenodes;
+            pt->freenodes = n;
+        }
+    }
+
+    // drop the free nodes living in empty pages, then the pages themselves
+    pnode_t **pn = &pt->freenodes;
+    while (*pn) {
+        if (getpnodepage(*pn)->nused == 0)
+            *pn = (*pn)->next;
+        else
+            pn = &(*pn)->next;
+    }
+
+    nodepage_t **pp = &pt->pages;
+    while (*pp) {
+        nodepage_t *p = *pp;
+        if (p->nused == 0) {
+            *pp = p->next;
+            free(p->cover);
+            free(p);
+            pt->npages--;
+        } else {
+            pp = &p->next;
+        }
+    }
+
+    pt->compactcur = NULL;
+    pt->fill       = NULL;
+    pt->fillidx    = 0;
+    pt->compacting = false;
+}
+
+// keep patcompact() cursor valid when n is about to be removed
+static void patcompactforget(patricia_trie_t *pt, pnode_t *n)
+{
+    // a leaf takes its parent away too, when that is glue
+    pnode_t *parent = getpnodeparent(n);
+    pnode_t *glue = NULL;
+    if (!n->children[0] && !n->children[1] && parent && ispnodeglue(parent))
+        glue = parent;
+
+    pnode_t *cur = pt->compactcur;
+    while (cur && (cur == n || cur == glue))
+        cur = patdfsprev(cur);
+
+    pt->compactcur = cur;
+}
+
+UBGP_API bool patcompact(patricia_trie_t *pt, size_t budget)
+{
+    if (!pt->compacting) {
+        patunpack(pt);
+
+        pt->compactcur = NULL;
+        pt->fill       = NULL;
+        pt->fillidx    = 0;
+        pt->compacting = true;
+    }
+
+    pnode_t *n = patdfsnext(pt, pt->compactcur);
+    for (size_t moved = 0; n && (budget == 0 || moved < budget); moved++) {
+        if (!pt->fill || pt->fillidx == countof(pt->fill->block)) {
+            pt->fill = patnewpage(pt);
+            pt->fillidx = 0;
+            if (unlikely(!pt->fill))
+                break;
+        }
+
+        pnode_t *m = &pt->fill->block[pt->fillidx++];
+        patrelocate(pt, n, m);
+        pt->compactcur = m;
+
+        n = patdfsnext(pt, m);
+    }
+
+    if (n && pt->fill)
+        return false;
+
+    patendcompact(pt);
+    return true;
+}
+
+UBGP_API bool pataugment(patricia_trie_t *pt)
+{
+    if (pt->augmented)
+        return true;
+
+    for (nodepage_t *p = pt->pages; p; p = p->next) {
+        p->cover = malloc(countof(p->block) * sizeof(*p->cover));
+        if (unlikely(!p->cover)) {
+            for (nodepage_t *q = pt->pages; q != p; q = q->next) {
+                free(q->cover);
+                q->cover = NULL;
+            }
+            return false;
+        }
+    }
+
+    // reverse depth-first order visits children before their parent
+    pnode_t *n = pt->head;
+    while (n && (n->children[0] || n->children[1]))
+        n = (n->children[1]) ? n->children[1] : n->children[0];
+
+    for (; n; n = patdfsprev(n))
+        *getpnodecover(n) = pnodecover(pt, n);
+
+    pt->augmented = true;
+    return true;
+}
+
+UBGP_API void patmemusage(const patricia_trie_t *pt, size_t *inuse, size_t *reserved)
+{
+    size_t packed = patpackedsize(pt);
+    if (inuse)
+        *inuse = pt->nnodes * sizeof(pnode_t) + packed;
+    if (reserved)
+        *reserved = pt->npages * (size_t) PAT_PAGE_SIZE + packed;
+}
+
+UBGP_API bool patbloom(patricia_trie_t *pt)
+{
+    if (pt->bloom) {
+        bloomdestroy(pt->bloom);
+        free(pt->bloom);
+    }
+
+    pt->bloom = malloc(sizeof(*pt->bloom));
+    if (unlikely(!pt->bloom))
+        return false;
+    if (unlikely(!bloominit(pt->bloom, pt->nprefs))) {
+        free(pt->bloom);
+        pt->bloom = NULL;
+        return false;
+    }
+
+    patiterator_t it;
+    for (patiteratorinit(&it, pt); !patiteratorend(&it); patiteratornext(&it))
+        bloomadd(pt->bloom, &patiteratorget(&it)->prefix);
+
+    return true;
 }
 
 static bool patcompwithmask(const netaddr_t *addr,
@@ -188,6 +825,10 @@ UBGP_API trienode_t *patinsert(patricia_trie_t *pt,
     pnode_t *n;
 
     *inserted = PREFIX_ALREADY_PRESENT;
+    if (pt->bloom)
+        bloomadd(pt->bloom, prefix);
+
+    patunpack(pt);
 
     if (pt->head == NULL) {
         pnode_t *n = getfreenode(pt);
@@ -197,6 +838,7 @@ UBGP_API trienode_t *patinsert(patricia_trie_t *pt,
         pnodeinit(n, prefix);
         pt->head = n;
         pt->nprefs++;
+        patfixcover(pt, n);
         *inserted = PREFIX_INSERTED;
 
         return &n->pub;
@@ -272,13 +914,16 @@ UBGP_API trienode_t *patinsert(patricia_trie_t *pt,
     }
 
     if (differ_bit == prefix->bitlen && n->prefix.bitlen == prefix->bitlen) {
-        if (ispnodeglue(n))
+        if (!ispnodeglue(n))
             return &n->pub;
 
         pt->nprefs++;
         n->prefix = *prefix;
+        n->payload = NULL;
         resetpnodeglue(n);
+        patfixcover(pt, n);
 
+        *inserted = PREFIX_INSERTED;
         return &n->pub;
     }
 
@@ -294,22 +939,24 @@ UBGP_API trienode_t *patinsert(patricia_trie_t *pt,
 
         int bit = (n->prefix.bitlen < maxbits) && (prefix->bytes[n->prefix.bitlen >> 3] & (0x80 >> (n->prefix.bitlen & 0x07)));
         n->children[bit != 0] = newnode;
+        patfixcover(pt, newnode);
 
         *inserted = PREFIX_INSERTED;
 
         return &newnode->pub;
     }
 
-    if (n->prefix.bitlen == differ_bit) {
+    if (prefix->bitlen == differ_bit) {
+        // newnode is a supernet of n, place it right above
         int bit = (prefix->bitlen < maxbits) && (test_addr[prefix->bitlen >> 3] & (0x80 >> (prefix->bitlen & 0x07)));
         newnode->children[bit] = n;
-        setpnodeparent(newnode, n);
+        setpnodeparent(newnode, getpnodeparent(n));
 
         if (!getpnodeparent(n)) {
             pt->head = newnode;
-        } else if (getpnodeparent(n)->children[1] == n) {
+        } else {
             int b = (getpnodeparent(n)->children[1] == n);
-            getpnodeparent(n)->children[b] = n;
+            getpnodeparent(n)->children[b] = newnode;
         }
         setpnodeparent(n, newnode);
     } else {
@@ -317,7 +964,8 @@ UBGP_API trienode_t *patinsert(patricia_trie_t *pt,
         if (unlikely(!glue))
             return NULL;
 
-        pnodeinit(glue, NULL);
+        // glue shares the first differ_bit bits with both children
+        pnodeinit(glue, prefix);
         glue->prefix.bitlen = differ_bit;
         setpnodeglue(glue);
         setpnodeparent(glue, getpnodeparent(n));
@@ -338,6 +986,8 @@ UBGP_API trienode_t *patinsert(patricia_trie_t *pt,
         setpnodeparent(n, glue);
     }
 
+    patfixcover(pt, newnode);
+
     *inserted = PREFIX_INSERTED;
     return &newnode->pub;
 }
@@ -345,6 +995,9 @@ UBGP_API trienode_t *patinsert(patricia_trie_t *pt,
 UBGP_API trienode_t *patsearchexact(const patricia_trie_t *pt,
                                     const netaddr_t       *prefix)
 {
+    if (pt->packed)
+        return (pt->maxbitlen == 32) ? pat4searchexact(pt->packed, prefix) : pat6searchexact(pt->packed, prefix);
+
     if (!pt->head)
         return NULL;
 
@@ -369,6 +1022,9 @@ UBGP_API trienode_t *patsearchexact(const patricia_trie_t *pt,
 UBGP_API trienode_t *patsearchbest(const patricia_trie_t *pt,
                                    const netaddr_t       *prefix)
 {
+    if (pt->packed)
+        return (pt->maxbitlen == 32) ? pat4searchbest(pt->packed, prefix) : pat6searchbest(pt->packed, prefix);
+
     if (!pt->head)
         return NULL;
 
@@ -390,26 +1046,31 @@ UBGP_API trienode_t *patsearchbest(const patricia_trie_t *pt,
             break;
     }
 
-    return &last->pub;
+    return (last) ? &last->pub : NULL;
 }
 
 UBGP_API void *patremove(patricia_trie_t *pt, const netaddr_t *prefix)
 {
-    pnode_t *n = (pnode_t*)patsearchexact(pt, prefix);
-
-    pt->nprefs--;
+    patunpack(pt);
 
+    pnode_t *n = (pnode_t*)patsearchexact(pt, prefix);
     if (!n)
         return NULL;
 
+    pt->nprefs--;
+
     void *payload = n->payload;
 
     if (n->children[0] && n->children[1]) {
-        putfreenode(pt, n);
+        // node is still needed to hold its children
         setpnodeglue(n);
+        patfixcover(pt, n);
         return payload;
     }
 
+    if (pt->compacting)
+        patcompactforget(pt, n);
+
     pnode_t *parent;
     pnode_t *child;
 
@@ -426,8 +1087,10 @@ UBGP_API void *patremove(patricia_trie_t *pt, const netaddr_t *prefix)
         parent->children[bit] = NULL;
         child = parent->children[!bit];
 
-        if (!ispnodeglue(parent))
+        if (!ispnodeglue(parent)) {
+            patfixcover(pt, parent);
             return payload;
+        }
 
         // if here, the parent is glue then we need to remove the parent too
         if (!getpnodeparent(parent)) {
@@ -438,6 +1101,7 @@ UBGP_API void *patremove(patricia_trie_t *pt, const netaddr_t *prefix)
         }
         setpnodeparent(child, getpnodeparent(parent));
         putfreenode(pt, parent);
+        patfixcover(pt, getpnodeparent(child));
 
         return payload;
     }
@@ -457,6 +1121,7 @@ UBGP_API void *patremove(patricia_trie_t *pt, const netaddr_t *prefix)
 
     bit = (parent->children[1] == n);
     parent->children[bit] = child;
+    patfixcover(pt, parent);
 
     return payload;
 }
@@ -499,6 +1164,9 @@ UBGP_API trienode_t **patgetsupernetsof(const patricia_trie_t *pt,
 
 UBGP_API bool patissubnetof(const patricia_trie_t *pt, const netaddr_t *prefix)
 {
+    if (pt->packed)
+        return (pt->maxbitlen == 32) ? pat4issubnetof(pt->packed, prefix) : pat6issubnetof(pt->packed, prefix);
+
     pnode_t *n = pt->head;
     while (n && n->prefix.bitlen < prefix->bitlen) {
         if (!ispnodeglue(n))
@@ -562,7 +1230,7 @@ UBGP_API trienode_t **patgetsubnetsof(const patricia_trie_t *pt,
         } else if (next->children[1]) {
             next = next->children[1];
         } else if (sp != stack) {
-            next = *(sp--);
+            next = *(--sp);
         } else {
             next = NULL;
         }
@@ -576,6 +1244,9 @@ UBGP_API trienode_t **patgetsubnetsof(const patricia_trie_t *pt,
 UBGP_API bool patissupernetof(const patricia_trie_t *pt,
                               const netaddr_t       *prefix)
 {
+    if (pt->packed)
+        return (pt->maxbitlen == 32) ? pat4issupernetof(pt->packed, prefix) : pat6issupernetof(pt->packed, prefix);
+
     pnode_t *start = pt->head;
     while (start && start->prefix.bitlen < prefix->bitlen) {
         int bit = prefix->bytes[start->prefix.bitlen >> 3] & (0x80 >> (start->prefix.bitlen & 0x07));
@@ -603,7 +1274,7 @@ UBGP_API bool patissupernetof(const patricia_trie_t *pt,
         } else if (next->children[1]) {
             next = next->children[1];
         } else if (sp != stack) {
-            next = *(sp--);
+            next = *(--sp);
         } else {
             next = NULL;
         }
@@ -668,7 +1339,7 @@ UBGP_API trienode_t **patgetrelatedof(const patricia_trie_t *pt,
         } else if (next->children[1]) {
             next = next->children[1];
         } else if (sp != stack) {
-            next = *(sp--);
+            next = *(--sp);
         } else {
             next = NULL;
         }
@@ -682,6 +1353,9 @@ UBGP_API trienode_t **patgetrelatedof(const patricia_trie_t *pt,
 UBGP_API bool patisrelatedof(const patricia_trie_t *pt,
                              const netaddr_t       *prefix)
 {
+    if (pt->packed)
+        return (pt->maxbitlen == 32) ? pat4isrelatedof(pt->packed, prefix) : pat6isrelatedof(pt->packed, prefix);
+
     pnode_t *start = pt->head;
     while (start && start->prefix.bitlen < prefix->bitlen) {
         if (!ispnodeglue(start) && patcompwithmask(&start->prefix, prefix, start->prefix.bitlen))
@@ -707,7 +1381,7 @@ UBGP_API bool patisrelatedof(const patricia_trie_t *pt,
         } else if (next->children[1]) {
             next = next->children[1];
         } else if (sp != stack) {
-            next = *(sp--);
+            next = *(--sp);
         } else {
             next = NULL;
         }
@@ -716,14 +1390,14 @@ UBGP_API bool patisrelatedof(const patricia_trie_t *pt,
     return false;
 }
 
-UBGP_API u128 patcoverage(const patricia_trie_t *pt)
+static u128 patwalkcover(const patricia_trie_t *pt, pnode_t *head)
 {
     u128 coverage = U128_ZERO;
 
     pnode_t *n;
     pnode_t *stack[pt->maxbitlen + 1];
     pnode_t **sp = stack;
-    pnode_t *next = pt->head;
+    pnode_t *next = head;
 
     while ((n = next)) {
         if (!ispnodeglue(n) && n->prefix.bitlen != 0) {
@@ -752,6 +1426,365 @@ UBGP_API u128 patcoverage(const patricia_trie_t *pt)
     return coverage;
 }
 
+UBGP_API u128 patcoverage(const patricia_trie_t *pt)
+{
+    if (!pt->head)
+        return U128_ZERO;
+    if (pt->augmented)
+        return *getpnodecover(pt->head);
+
+    return patwalkcover(pt, pt->head);
+}
+
+UBGP_API u128 patcoverageof(const patricia_trie_t *pt, const netaddr_t *prefix)
+{
+    pnode_t *n = pt->head;
+    while (n && n->prefix.bitlen < prefix->bitlen) {
+        if (!patcompwithmask(&n->prefix, prefix, n->prefix.bitlen))
+            return U128_ZERO;
+
+        // a supernet covers the whole prefix
+        if (!ispnodeglue(n) && n->prefix.bitlen != 0)
+            return u128shl(U128_ONE, pt->maxbitlen - prefix->bitlen);
+
+        int bit = (prefix->bytes[n->prefix.bitlen >> 3] & (0x80 >> (n->prefix.bitlen & 0x07)));
+        n = n->children[bit != 0];
+    }
+
+    if (!n || !patcompwithmask(&n->prefix, prefix, prefix->bitlen))
+        return U128_ZERO;
+    if (pt->augmented)
+        return *getpnodecover(n);
+
+    return patwalkcover(pt, n);
+}
+
+/* Set algebra */
+
+typedef struct {
+    pat6key_t key;
+    uint bitlen;
+} patblock_t;
+
+typedef struct {
+    patblock_t *blocks;
+    size_t n, cap;
+} patblockvec_t;
+
+// any prefix as a left aligned 128 bits key, so both families sort alike
+static pat6key_t patsortkey(const patricia_trie_t *pt, const netaddr_t *prefix)
+{
+    if (pt->maxbitlen == 32) {
+        pat6key_t key = { (uint64_t) pat4key(prefix) << 32, 0 };
+        return key;
+    }
+
+    return pat6key(prefix);
+}
+
+static pat6key_t patkeymask(pat6key_t key, uint bitlen)
+{
+    if (bitlen == 0) {
+        key.hi = key.lo = 0;
+    } else if (bitlen <= 64) {
+        key.hi &= ~0ull << (64 - bitlen);
+        key.lo  = 0;
+    } else {
+        key.lo &= ~0ull << (128 - bitlen);
+    }
+
+    return key;
+}
+
+// trie depth-first order: by address, supernets before their subnets
+static int patblockcmp(const patblock_t *a, const patblock_t *b)
+{
+    uint bitlen = MIN(a->bitlen, b->bitlen);
+
+    pat6key_t ka = patkeymask(a->key, bitlen);
+    pat6key_t kb = patkeymask(b->key, bitlen);
+    if (ka.hi != kb.hi)
+        return (ka.hi < kb.hi) ? -1 : 1;
+    if (ka.lo != kb.lo)
+        return (ka.lo < kb.lo) ? -1 : 1;
+
+    return (a->bitlen > b->bitlen) - (a->bitlen < b->bitlen);
+}
+
+static bool patblockcontains(const patblock_t *a, const patblock_t *b)
+{
+    return a->bitlen <= b->bitlen && pat6eqwithmask(a->key, b->key, a->bitlen);
+}
+
+static void patblockof(patblock_t *block, const patricia_trie_t *pt, const trienode_t *n)
+{
+    block->key    = patkeymask(patsortkey(pt, &n->prefix), n->prefix.bitlen);
+    block->bitlen = n->prefix.bitlen;
+}
+
+static bool patblockpush(patblockvec_t *v, const patblock_t *block)
+{
+    if (v->n == v->cap) {
+        size_t cap = (v->cap) ? v->cap * 2 : 64;
+
+        patblock_t *blocks = realloc(v->blocks, cap * sizeof(*blocks));
+        if (unlikely(!blocks))
+            return false;
+
+        v->blocks = blocks;
+        v->cap    = cap;
+    }
+
+    v->blocks[v->n++] = *block;
+    return true;
+}
+
+static trienode_t *patappend(patricia_trie_t *dst, const trienode_t *n)
+{
+    trienode_t *res = patinsert(dst, &n->prefix, NULL);
+    if (likely(res))
+        res->payload = n->payload;
+
+    return res;
+}
+
+enum {
+    PAT_UNION,
+    PAT_INTERSECT,
+    PAT_DIFFERENCE
+};
+
+// merge both tries visiting them in depth-first order, like two sorted lists
+static bool patmerge(patricia_trie_t       *dst,
+                     const patricia_trie_t *a,
+                     const patricia_trie_t *b,
+                     int                    op)
+{
+    assert(dst != a && dst != b);
+    assert(dst->maxbitlen == a->maxbitlen && a->maxbitlen == b->maxbitlen);
+
+    patiterator_t ia, ib;
+    patblock_t ka, kb;
+
+    patiteratorinit(&ia, a);
+    patiteratorinit(&ib, b);
+    if (!patiteratorend(&ia))
+        patblockof(&ka, a, patiteratorget(&ia));
+    if (!patiteratorend(&ib))
+        patblockof(&kb, b, patiteratorget(&ib));
+
+    while (!patiteratorend(&ia)) {
+        int cmp = patiteratorend(&ib) ? -1 : patblockcmp(&ka, &kb);
+
+        const trienode_t *n = NULL;
+        if (cmp <= 0) {
+            if ((cmp < 0 && op != PAT_INTERSECT) || (cmp == 0 && op != PAT_DIFFERENCE))
+                n = patiteratorget(&ia);
+
+            patiteratornext(&ia);
+            if (!patiteratorend(&ia))
+                patblockof(&ka, a, patiteratorget(&ia));
+        }
+        if (cmp >= 0) {
+            if (cmp > 0 && op == PAT_UNION)
+                n = patiteratorget(&ib);
+
+            patiteratornext(&ib);
+            if (!patiteratorend(&ib))
+                patblockof(&kb, b, patiteratorget(&ib));
+        }
+
+        if (n && unlikely(!patappend(dst, n)))
+            return false;
+    }
+
+    // only the union cares about the rest of b
+    for (; op == PAT_UNION && !patiteratorend(&ib); patiteratornext(&ib)) {
+        if (unlikely(!patappend(dst, patiteratorget(&ib))))
+            return false;
+    }
+
+    return true;
+}
+
+UBGP_API bool patunion(patricia_trie_t       *dst,
+                       const patricia_trie_t *a,
+                       const patricia_trie_t *b)
+{
+    return patmerge(dst, a, b, PAT_UNION);
+}
+
+UBGP_API bool patintersect(patricia_trie_t       *dst,
+                           const patricia_trie_t *a,
+                           const patricia_trie_t *b)
+{
+    return patmerge(dst, a, b, PAT_INTERSECT);
+}
+
+UBGP_API bool patdifference(patricia_trie_t       *dst,
+                            const patricia_trie_t *a,
+                            const patricia_trie_t *b)
+{
+    return patmerge(dst, a, b, PAT_DIFFERENCE);
+}
+
+/*
+ * Outermost prefixes of a trie, in depth-first order,
+ * any prefix is skipped when covered by the previous one.
+ */
+typedef struct {
+    patiterator_t it;
+    const patricia_trie_t *pt;
+    patblock_t block;
+    bool end;
+} pattopiterator_t;
+
+static void pattopnext(pattopiterator_t *top)
+{
+    patblock_t block;
+
+    while (!patiteratorend(&top->it)) {
+        patblockof(&block, top->pt, patiteratorget(&top->it));
+        patiteratornext(&top->it);
+
+        if (top->end || !patblockcontains(&top->block, &block)) {
+            top->block = block;
+            top->end   = false;
+            return;
+        }
+    }
+
+    top->end = true;
+}
+
+static void pattopinit(pattopiterator_t *top, const patricia_trie_t *pt)
+{
+    patiteratorinit(&top->it, pt);
+    top->pt  = pt;
+    top->end = true;
+    pattopnext(top);
+}
+
+// append a block to an ordered list, merging sibling blocks as they complete
+static bool patemitblock(patblockvec_t *out, const patblock_t *block)
+{
+    if (unlikely(!patblockpush(out, block)))
+        return false;
+
+    while (out->n >= 2) {
+        patblock_t *l = &out->blocks[out->n - 2];
+        patblock_t *r = &out->blocks[out->n - 1];
+        if (l->bitlen != r->bitlen || l->bitlen == 0)
+            break;
+
+        patblock_t parent = { patkeymask(l->key, l->bitlen - 1), l->bitlen - 1 };
+        if (!pat6eqwithmask(parent.key, r->key, parent.bitlen) || pat6bit(l->key, parent.bitlen) != 0)
+            break;
+
+        out->n--;
+        *l = parent;
+    }
+
+    return true;
+}
+
+// emit the blocks making up block minus any of the (disjoint and sorted) holes
+static bool patcarve(patblockvec_t    *out,
+                     const patblock_t *block,
+                     const patblock_t *holes,
+                     size_t            nholes)
+{
+    if (nholes == 0)
+        return patemitblock(out, block);
+    if (holes[0].bitlen == block->bitlen)
+        return true;  // entirely covered
+
+    patblock_t half = { block->key, block->bitlen + 1 };
+
+    size_t i = 0;
+    while (i < nholes && pat6bit(holes[i].key, block->bitlen) == 0)
+        i++;
+
+    if (!patcarve(out, &half, holes, i))
+        return false;
+
+    if (half.bitlen <= 64)
+        half.key.hi |= 1ull << (64 - half.bitlen);
+    else
+        half.key.lo |= 1ull << (128 - half.bitlen);
+
+    return patcarve(out, &half, holes + i, nholes - i);
+}
+
+static void patkeytonaddr(const patricia_trie_t *pt, const patblock_t *block, netaddr_t *prefix)
+{
+    uint32_t words[4] = {
+        beswap32(block->key.hi >> 32), beswap32(block->key.hi),
+        beswap32(block->key.lo >> 32), beswap32(block->key.lo)
+    };
+
+    makenaddr(prefix, (pt->maxbitlen == 32) ? AF_INET : AF_INET6, words, block->bitlen);
+}
+
+UBGP_API bool patuncovered(patricia_trie_t       *dst,
+                           const patricia_trie_t *a,
+                           const patricia_trie_t *b,
+                           u128                  *amount)
+{
+    assert(dst != a && dst != b);
+    assert(!dst || dst->maxbitlen == a->maxbitlen);
+    assert(a->maxbitlen == b->maxbitlen);
+
+    patblockvec_t out   = { NULL, 0, 0 };
+    patblockvec_t holes = { NULL, 0, 0 };
+
+    bool ok = true;
+
+    pattopiterator_t ta, tb;
+    pattopinit(&ta, a);
+    pattopinit(&tb, b);
+    for (; !ta.end && ok; pattopnext(&ta)) {
+        // skip b space entirely preceding the current a block
+        while (!tb.end && patblockcmp(&tb.block, &ta.block) < 0 && !patblockcontains(&tb.block, &ta.block))
+            pattopnext(&tb);
+
+        if (!tb.end && patblockcontains(&tb.block, &ta.block))
+            continue;
+
+        holes.n = 0;
+        while (ok && !tb.end && patblockcontains(&ta.block, &tb.block)) {
+            ok = patblockpush(&holes, &tb.block);
+            pattopnext(&tb);
+        }
+
+        ok = ok && patcarve(&out, &ta.block, holes.blocks, holes.n);
+    }
+
+    u128 total = U128_ZERO;
+    for (size_t i = 0; i < out.n && ok; i++) {
+        const patblock_t *block = &out.blocks[i];
+
+        if (block->bitlen == 0 && a->maxbitlen == 128)
+            total = U128_MAX;  // saturate on the whole IPv6 space
+        else
+            total = u128add(total, u128shl(U128_ONE, a->maxbitlen - block->bitlen));
+
+        if (dst) {
+            netaddr_t prefix;
+
+            patkeytonaddr(a, block, &prefix);
+            ok = (patinsert(dst, &prefix, NULL) != NULL);
+        }
+    }
+
+    if (amount)
+        *amount = total;
+
+    free(out.blocks);
+    free(holes.blocks);
+    return ok;
+}
+
 UBGP_API trienode_t **patgetfirstsubnetsof(const patricia_trie_t *pt,
                                            const netaddr_t       *prefix)
 {
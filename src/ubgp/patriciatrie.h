@@ -22,6 +22,7 @@
 #ifndef UBGP_PATRICIA_TRIE_H_
 #define UBGP_PATRICIA_TRIE_H_
 
+#include "bloom.h"
 #include "funcattribs.h"
 #include "netaddr.h"
 #include "u128.h"
@@ -51,15 +52,22 @@ typedef struct {
 
 typedef union pnode_s pnode_t;
 typedef struct nodepage_s nodepage_t;
+typedef struct patpacked_s patpacked_t;
 
 /**
  * patricia_trie_t:
  *
  * The patricia memory is allocated in pages.
  * A list of pages is maintained.
- * Each page is a block of 256 nodes.
+ * Each page is a block of nodes filling 8KB.
  * Each node can be free or not. Each node has the possibility to be in a list
  * of free nodes. When no more free nodes are available, a new page is allocated.
+ * Pages are only returned to the system by patcompact() and patdestroy().
+ *
+ * A trie may optionally own a Bloom filter of its prefixes, see patbloom(),
+ * and a packed copy of its nodes, see patpack().
+ * In augmented mode, see pataugment(), each page also keeps the address
+ * space covered by the subtree of each of its nodes.
 */
 typedef struct patricia_trie {
     /*< private >*/
@@ -68,6 +76,16 @@ typedef struct patricia_trie {
     uint nprefs;
     nodepage_t* pages;
     pnode_t* freenodes;
+    bloom_filter_t *bloom;
+    patpacked_t *packed;
+    uint nnodes;
+    uint npages;
+    // patcompact() state
+    pnode_t *compactcur;
+    nodepage_t *fill;
+    uint fillidx;
+    bool compacting;
+    bool augmented;
 } patricia_trie_t;
 
 UBGP_API CHECK_NONNULL(1) void patinit(patricia_trie_t* pt, sa_family_t family);
@@ -108,6 +126,102 @@ UBGP_API CHECK_NONNULL(1, 2) trienode_t* patinsert(patricia_trie_t *pt,
 UBGP_API CHECK_NONNULL(1, 2)
 trienode_t* patsearchexact(const patricia_trie_t *pt, const netaddr_t *prefix);
 
+/**
+ * patbloom:
+ * @pt: a #patricia_trie_t
+ *
+ * Attach a Bloom filter to @pt, sized from its current prefix count,
+ * replacing any previous one. Prefixes inserted afterwards are
+ * added to the filter as well, at the price of a higher false positive
+ * rate, removed prefixes are not, so patbloom() may be called again
+ * to rebuild the filter once @pt is populated.
+ *
+ * See also: patmaybeexact()
+ *
+ * Returns: %true on success, %false on out of memory,
+ *          in which case @pt is left without a Bloom filter.
+ */
+UBGP_API CHECK_NONNULL(1) bool patbloom(patricia_trie_t *pt);
+
+/**
+ * patmaybeexact:
+ * @pt:     a #patricia_trie_t
+ * @prefix: prefix to be tested
+ *
+ * Cheap test preceding patsearchexact(), using @pt Bloom filter,
+ * if any.
+ *
+ * Returns: %false if @prefix is definitely not inside @pt,
+ *          %true if patsearchexact() might find it.
+ */
+static inline PUREFUNC CHECK_NONNULL(1, 2) bool patmaybeexact(const patricia_trie_t *pt,
+                                                              const netaddr_t       *prefix)
+{
+    return !pt->bloom || bloommaycontain(pt->bloom, prefix);
+}
+
+/**
+ * patpack:
+ * @pt: a #patricia_trie_t
+ *
+ * Attach to @pt a packed, read-only, copy of its nodes, stored
+ * in depth-first order into a contiguous array and linked by 32-bit indexes.
+ * %AF_INET tries use 16 bytes nodes keyed on a single 32-bit word,
+ * %AF_INET6 tries 32 bytes nodes keyed on two 64-bit words, compared to the
+ * 56 bytes of a regular node.
+ *
+ * As long as the copy is available, patsearchexact(), patsearchbest(),
+ * patissubnetof(), patissupernetof() and patisrelatedof() transparently
+ * use it. Any update to @pt discards it, so patpack() should be called
+ * once @pt is populated.
+ *
+ * The copy trades memory for lookup speed: the regular nodes are kept,
+ * and each packed node also stores a pointer to its regular node, which
+ * lookups return. A packed trie thus takes its regular nodes, plus
+ * 24 (%AF_INET) or 40 (%AF_INET6) bytes per node, see patmemusage().
+ *
+ * Returns: %true on success, %false on out of memory, in which case
+ *          @pt keeps working on its regular nodes.
+ */
+UBGP_API CHECK_NONNULL(1) bool patpack(patricia_trie_t *pt);
+
+/**
+ * patcompact:
+ * @pt: a #patricia_trie_t
+ * @budget: maximum number of nodes to move, 0 for no limit
+ *
+ * Move the nodes of @pt into fresh pages, in depth-first order, so that
+ * lookups walk memory mostly forward, and return to the system every
+ * page left with no nodes in use.
+ *
+ * Compaction may be carried out in steps of at most @budget nodes,
+ * to amortize it across updates: the trie stays fully usable between
+ * calls, and patinsert() or patremove() may be freely interleaved.
+ * Nodes inserted behind the point reached by compaction are left
+ * where they are, until the next pass.
+ *
+ * Compaction invalidates any #trienode_t pointer previously obtained
+ * from @pt, as well as any iterator on it, and discards the copy made by
+ * patpack().
+ *
+ * Returns: %true once the pass is complete, %false if more calls
+ *          are needed. On out of memory the pass is ended early,
+ *          and %true is returned.
+ */
+UBGP_API CHECK_NONNULL(1) bool patcompact(patricia_trie_t *pt, size_t budget);
+
+/**
+ * patmemusage:
+ * @pt: a #patricia_trie_t
+ * @inuse: if not %NULL, stores the bytes occupied by the nodes of @pt
+ * @reserved: if not %NULL, stores the bytes reserved by the pages of @pt
+ *
+ * Report the memory usage of @pt, the gap between @reserved and @inuse
+ * is what patcompact() may give back. The copy made by patpack(),
+ * walked by lookups in place of the nodes, is accounted in both.
+ */
+UBGP_API CHECK_NONNULL(1) void patmemusage(const patricia_trie_t *pt, size_t *inuse, size_t *reserved);
+
 UBGP_API CHECK_NONNULL(1, 2)
 trienode_t* patsearchbest(const patricia_trie_t *pt, const netaddr_t *prefix);
 
@@ -196,12 +310,118 @@ bool patisrelatedof(const patricia_trie_t *pt, const netaddr_t *prefix);
  *
  * Coverage of prefixes.
  * **The default route is ignored. **
+ * Takes constant time on tries in augmented mode, see pataugment(),
+ * otherwise it walks the whole trie.
  *
  * Returns: amount of address space covered by the prefixes insrted into the
  *          patricia
  */
 UBGP_API PUREFUNC CHECK_NONNULL(1) u128 patcoverage(const patricia_trie_t *pt);
 
+/**
+ * patcoverageof:
+ * @pt: a #patricia_trie_t
+ * @prefix: a prefix
+ *
+ * Coverage of the prefixes inserted into @pt, restricted to the address
+ * space of @prefix. As with patcoverage(), the default route is ignored.
+ * Takes time proportional to the depth of @prefix on tries in augmented mode,
+ * otherwise it walks the subtree of @prefix.
+ *
+ * Returns: amount of address space inside @prefix covered by the prefixes
+ *          of @pt.
+ */
+UBGP_API PUREFUNC CHECK_NONNULL(1, 2)
+u128 patcoverageof(const patricia_trie_t *pt, const netaddr_t *prefix);
+
+/**
+ * pataugment:
+ * @pt: a #patricia_trie_t
+ *
+ * Switch @pt to augmented mode, where every node caches the address space
+ * covered by its subtree. patinsert() and patremove() keep the cache
+ * up to date along the path they touch, so that patcoverage() and
+ * patcoverageof() no longer need to walk the trie.
+ * Each node costs 16 more bytes. The mode lasts until patdestroy().
+ *
+ * Returns: %true on success, %false on out of memory, in which case
+ *          @pt is left in its regular mode.
+ */
+UBGP_API CHECK_NONNULL(1) bool pataugment(patricia_trie_t *pt);
+
+/**
+ * patunion:
+ * @dst: a #patricia_trie_t receiving the result
+ * @a:   a #patricia_trie_t
+ * @b:   a #patricia_trie_t
+ *
+ * Insert into @dst any prefix of @a or @b, visiting both tries once.
+ * Inserted nodes take the payload of the corresponding node in @a, or in @b
+ * if the prefix is missing from @a.
+ * All tries must share the same family, and @dst must be distinct from
+ * @a and @b, though it needn't be empty.
+ *
+ * Returns: %true on success, %false on out of memory, in which case
+ *          @dst contains only part of the result.
+ */
+UBGP_API CHECK_NONNULL(1, 2, 3) bool patunion(patricia_trie_t       *dst,
+                                              const patricia_trie_t *a,
+                                              const patricia_trie_t *b);
+
+/**
+ * patintersect:
+ * @dst: a #patricia_trie_t receiving the result
+ * @a:   a #patricia_trie_t
+ * @b:   a #patricia_trie_t
+ *
+ * Insert into @dst any prefix both in @a and @b, with its payload in @a,
+ * see patunion().
+ *
+ * Returns: %true on success, %false on out of memory.
+ */
+UBGP_API CHECK_NONNULL(1, 2, 3) bool patintersect(patricia_trie_t       *dst,
+                                                  const patricia_trie_t *a,
+                                                  const patricia_trie_t *b);
+
+/**
+ * patdifference:
+ * @dst: a #patricia_trie_t receiving the result
+ * @a:   a #patricia_trie_t
+ * @b:   a #patricia_trie_t
+ *
+ * Insert into @dst any prefix in @a and not in @b, with its payload,
+ * see patunion().
+ * Prefixes are compared exactly, see patuncovered() to compare
+ * the address space they cover.
+ *
+ * Returns: %true on success, %false on out of memory.
+ */
+UBGP_API CHECK_NONNULL(1, 2, 3) bool patdifference(patricia_trie_t       *dst,
+                                                   const patricia_trie_t *a,
+                                                   const patricia_trie_t *b);
+
+/**
+ * patuncovered:
+ * @dst:    a #patricia_trie_t receiving the result, may be %NULL
+ * @a:      a #patricia_trie_t
+ * @b:      a #patricia_trie_t
+ * @amount: if not %NULL, set to the amount of address space in the result
+ *
+ * Compute the address space covered by @a and not covered by @b,
+ * as the minimal list of prefixes, inserted into @dst with a %NULL payload.
+ * For example, 10.0.0.0/8 minus 10.0.0.0/9 and 10.192.0.0/10
+ * is 10.128.0.0/10.
+ *
+ * Unlike patcoverage(), the default route is accounted for,
+ * the whole IPv6 space saturates @amount to %U128_MAX.
+ *
+ * Returns: %true on success, %false on out of memory.
+ */
+UBGP_API CHECK_NONNULL(2, 3) bool patuncovered(patricia_trie_t       *dst,
+                                               const patricia_trie_t *a,
+                                               const patricia_trie_t *b,
+                                               u128                  *amount);
+
 /**
  * patgetfirstsubnetsof:
  * @pt:     a patricia trie.
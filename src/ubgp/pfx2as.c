@@ -0,0 +1,488 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#include "branch.h"
+#include "pfx2as.h"
+#include "ubgpdef.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+    PFX2AS_CHUNK_ENTRIES = 1024,
+    PFX2AS_SET_MAX       = 0xff,  // AS_SET can't be larger than a segment
+    PFX2AS_NPEERS_MAX    = 0x7fffffff
+};
+
+struct pfx2as_entry_s {
+    uint32_t n;    // origins count
+    uint32_t cap;  // capacity of ext, 0 while origins are inline
+    union {
+        pfx2as_origin_t  inl[PFX2AS_INLINE];
+        pfx2as_origin_t *ext;
+    };
+};
+
+// entries are never freed one by one, so they're carved out of chunks
+struct pfx2as_chunk_s {
+    struct pfx2as_chunk_s *next;
+    pfx2as_entry_t ents[PFX2AS_CHUNK_ENTRIES];
+};
+
+UBGP_API void pfx2asinit(pfx2as_t *tab)
+{
+    memset(tab, 0, sizeof(*tab));
+    patinit(&tab->tries[0], AF_INET);
+    patinit(&tab->tries[1], AF_INET6);
+    tab->chunkused = PFX2AS_CHUNK_ENTRIES;  // force allocation on first entry
+}
+
+UBGP_API void pfx2asdestroy(pfx2as_t *tab)
+{
+    uint used = tab->chunkused;
+    for (pfx2as_chunk_t *c = tab->chunks, *next; c; c = next) {
+        next = c->next;
+
+        for (uint i = 0; i < used; i++) {
+            if (c->ents[i].cap > 0)
+                free(c->ents[i].ext);
+        }
+
+        free(c);
+        used = PFX2AS_CHUNK_ENTRIES;  // every chunk but the first is full
+    }
+
+    patdestroy(&tab->tries[0]);
+    patdestroy(&tab->tries[1]);
+    free(tab->setpool);
+    free(tab->setoffs);
+    free(tab->sethash);
+    free(tab->seen);
+}
+
+static pfx2as_entry_t *newentry(pfx2as_t *tab)
+{
+    if (tab->chunkused == PFX2AS_CHUNK_ENTRIES) {
+        pfx2as_chunk_t *c = malloc(sizeof(*c));
+        if (unlikely(!c))
+            return NULL;
+
+        c->next = tab->chunks;
+        tab->chunks = c;
+        tab->chunkused = 0;
+    }
+
+    pfx2as_entry_t *ent = &tab->chunks->ents[tab->chunkused++];
+    ent->n   = 0;
+    ent->cap = 0;
+    return ent;
+}
+
+static pfx2as_origin_t *entryorigins(pfx2as_entry_t *ent)
+{
+    return (ent->cap > 0) ? ent->ext : ent->inl;
+}
+
+static pfx2as_entry_t *getentry(pfx2as_t *tab, const netaddr_t *pfx)
+{
+    patricia_trie_t *pt = &tab->tries[pfx->family == AF_INET6];
+
+    trienode_t *n = patinsert(pt, pfx, NULL);
+    if (unlikely(!n))
+        return NULL;
+
+    if (!n->payload) {
+        n->payload = newentry(tab);
+        if (unlikely(!n->payload))
+            patremove(pt, pfx);
+    }
+
+    return n->payload;
+}
+
+// returns the identifier of the origin, adding it with no peers if needed, 0 on out of memory
+static uint32_t addorigin(pfx2as_t *tab, pfx2as_entry_t *ent, uint32_t as, bool isset)
+{
+    pfx2as_origin_t *origins = entryorigins(ent);
+    for (uint i = 0; i < ent->n; i++) {
+        if (origins[i].as == as && origins[i].isset == isset)
+            return origins[i].id;
+    }
+
+    uint cap = (ent->cap > 0) ? ent->cap : PFX2AS_INLINE;
+    if (ent->n == cap) {
+        // grow, moving inline origins out of the entry if needed
+        pfx2as_origin_t *ext = malloc(2 * cap * sizeof(*ext));
+        if (unlikely(!ext))
+            return 0;
+
+        memcpy(ext, origins, ent->n * sizeof(*ext));
+        if (ent->cap > 0)
+            free(ent->ext);
+
+        ent->ext = ext;
+        ent->cap = 2 * cap;
+        origins  = ext;
+    }
+
+    pfx2as_origin_t *o = &origins[ent->n++];
+    o->as     = as;
+    o->isset  = isset;
+    o->npeers = 0;
+    o->id     = ++tab->norigins;
+    return o->id;
+}
+
+/* distinct peers of each origin */
+
+static uint64_t mix64(uint64_t x)
+{
+    // splitmix64 finalizer, origin identifiers and peers are small integers
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+static bool rehashseen(pfx2as_t *tab)
+{
+    size_t cap = (tab->seencap > 0) ? 2 * tab->seencap : 1024;
+
+    uint64_t *seen = calloc(cap, sizeof(*seen));
+    if (unlikely(!seen))
+        return false;
+
+    for (size_t i = 0; i < tab->seencap; i++) {
+        if (tab->seen[i] == 0)
+            continue;
+
+        size_t h = mix64(tab->seen[i]) & (cap - 1);
+        while (seen[h] != 0)
+            h = (h + 1) & (cap - 1);
+
+        seen[h] = tab->seen[i];
+    }
+
+    free(tab->seen);
+    tab->seen    = seen;
+    tab->seencap = cap;
+    return true;
+}
+
+// count peer on the origin id of ent, unless it was already counted, returns false on out of memory
+static bool addpeer(pfx2as_t *tab, pfx2as_entry_t *ent, uint32_t id, uint32_t peer)
+{
+    if (2 * (tab->nseen + 1) > tab->seencap && !rehashseen(tab))
+        return false;
+
+    uint64_t key  = ((uint64_t) id << 32) | peer;
+    size_t   mask = tab->seencap - 1;
+    size_t   h    = mix64(key) & mask;
+    while (tab->seen[h] != 0) {
+        if (tab->seen[h] == key)
+            return true;
+
+        h = (h + 1) & mask;
+    }
+
+    tab->seen[h] = key;
+    tab->nseen++;
+
+    pfx2as_origin_t *origins = entryorigins(ent);
+    for (uint i = 0; i < ent->n; i++) {
+        if (origins[i].id == id) {
+            if (origins[i].npeers < PFX2AS_NPEERS_MAX)
+                origins[i].npeers++;
+
+            break;
+        }
+    }
+    return true;
+}
+
+/* AS_SET interning */
+
+static uint32_t hashset(const uint32_t *set, size_t n)
+{
+    uint32_t h = 2166136261u;  // FNV-1a over the members
+    for (size_t i = 0; i < n; i++) {
+        h ^= set[i];
+        h *= 16777619u;
+    }
+    return h ^ n;
+}
+
+static bool equalset(const pfx2as_t *tab, uint32_t idx, const uint32_t *set, size_t n)
+{
+    const uint32_t *ent = &tab->setpool[tab->setoffs[idx]];
+    return ent[0] == n && memcmp(&ent[1], set, n * sizeof(*set)) == 0;
+}
+
+static bool rehashsets(pfx2as_t *tab)
+{
+    uint cap = (tab->hashcap > 0) ? 2 * tab->hashcap : 64;
+
+    uint32_t *hash = calloc(cap, sizeof(*hash));
+    if (unlikely(!hash))
+        return false;
+
+    for (uint i = 0; i < tab->nsets; i++) {
+        const uint32_t *set = &tab->setpool[tab->setoffs[i]];
+
+        uint32_t h = hashset(&set[1], set[0]) & (cap - 1);
+        while (hash[h] != 0)
+            h = (h + 1) & (cap - 1);
+
+        hash[h] = i + 1;
+    }
+
+    free(tab->sethash);
+    tab->sethash = hash;
+    tab->hashcap = cap;
+    return true;
+}
+
+// returns the index of the sorted, duplicate free, set, -1 on out of memory
+static int64_t internset(pfx2as_t *tab, const uint32_t *set, size_t n)
+{
+    // keep load factor under 1/2
+    if (2 * (tab->nsets + 1) > tab->hashcap && !rehashsets(tab))
+        return -1;
+
+    uint mask = tab->hashcap - 1;
+    uint32_t h = hashset(set, n) & mask;
+    while (tab->sethash[h] != 0) {
+        uint32_t idx = tab->sethash[h] - 1;
+        if (equalset(tab, idx, set, n))
+            return idx;
+
+        h = (h + 1) & mask;
+    }
+
+    if (tab->poolsiz + n + 1 > tab->poolcap) {
+        size_t cap = MAX(2 * tab->poolcap, tab->poolsiz + n + 1);
+
+        uint32_t *pool = realloc(tab->setpool, cap * sizeof(*pool));
+        if (unlikely(!pool))
+            return -1;
+
+        tab->setpool = pool;
+        tab->poolcap = cap;
+    }
+    if (tab->nsets == tab->setscap) {
+        uint cap = (tab->setscap > 0) ? 2 * tab->setscap : 64;
+
+        uint32_t *offs = realloc(tab->setoffs, cap * sizeof(*offs));
+        if (unlikely(!offs))
+            return -1;
+
+        tab->setoffs = offs;
+        tab->setscap = cap;
+    }
+
+    tab->setoffs[tab->nsets] = tab->poolsiz;
+    tab->setpool[tab->poolsiz++] = n;
+    memcpy(&tab->setpool[tab->poolsiz], set, n * sizeof(*set));
+    tab->poolsiz += n;
+
+    tab->sethash[h] = tab->nsets + 1;
+    return tab->nsets++;
+}
+
+static int cmpas(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a;
+    uint32_t y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+UBGP_API bool pfx2asadd(pfx2as_t *tab, const netaddr_t *pfx, const as_origin_t *origin, uint32_t peer)
+{
+    uint32_t as    = origin->as;
+    bool     isset = false;
+
+    switch (origin->type) {
+    case AS_SEGMENT_SEQ:
+        break;
+
+    case AS_SEGMENT_SET: {
+        uint32_t set[PFX2AS_SET_MAX];
+        size_t n = 0;
+
+        assert(origin->count <= countof(set));
+        for (uint i = 0; i < origin->count; i++)
+            set[n++] = getasoriginset(origin, i);
+
+        qsort(set, n, sizeof(*set), cmpas);
+
+        size_t j = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (j == 0 || set[j - 1] != set[i])
+                set[j++] = set[i];
+        }
+
+        int64_t idx = internset(tab, set, j);
+        if (unlikely(idx < 0))
+            return false;
+
+        as    = idx;
+        isset = true;
+        break;
+    }
+
+    default:
+        return true;  // no origin
+    }
+
+    pfx2as_entry_t *ent = getentry(tab, pfx);
+    if (unlikely(!ent))
+        return false;
+
+    uint32_t id = addorigin(tab, ent, as, isset);
+    if (unlikely(id == 0))
+        return false;
+
+    return addpeer(tab, ent, id, peer);
+}
+
+// origin identifiers of src, mapped to their dst entries and identifiers
+typedef struct {
+    pfx2as_entry_t *ent;
+    uint32_t        id;
+} originmap_t;
+
+static bool mergetrie(pfx2as_t *dst, const pfx2as_t *src, const patricia_trie_t *pt, originmap_t *map)
+{
+    patiterator_t it;
+    for (patiteratorinit(&it, pt); !patiteratorend(&it); patiteratornext(&it)) {
+        trienode_t *n = patiteratorget(&it);
+
+        pfx2as_entry_t *from = n->payload;
+        pfx2as_entry_t *to   = getentry(dst, &n->prefix);
+        if (unlikely(!to))
+            return false;
+
+        const pfx2as_origin_t *origins = entryorigins(from);
+        for (uint i = 0; i < from->n; i++) {
+            uint32_t as = origins[i].as;
+            if (origins[i].isset) {
+                // set indexes are local to each table
+                size_t count;
+                const uint32_t *set = pfx2asset(src, as, &count);
+
+                int64_t idx = internset(dst, set, count);
+                if (unlikely(idx < 0))
+                    return false;
+
+                as = idx;
+            }
+
+            uint32_t id = addorigin(dst, to, as, origins[i].isset);
+            if (unlikely(id == 0))
+                return false;
+
+            // entries are never moved, so the mapping stays valid
+            map[origins[i].id].ent = to;
+            map[origins[i].id].id  = id;
+        }
+    }
+
+    return true;
+}
+
+UBGP_API bool pfx2asmerge(pfx2as_t *dst, const pfx2as_t *src)
+{
+    if (src->norigins == 0)
+        return true;
+
+    originmap_t *map = malloc((src->norigins + 1) * sizeof(*map));
+    if (unlikely(!map))
+        return false;
+
+    bool ok = false;
+    if (unlikely(!mergetrie(dst, src, &src->tries[0], map) || !mergetrie(dst, src, &src->tries[1], map)))
+        goto out;
+
+    // translate seen pairs, so peers found in both tables are counted once
+    for (size_t i = 0; i < src->seencap; i++) {
+        if (src->seen[i] == 0)
+            continue;
+
+        uint32_t id   = src->seen[i] >> 32;
+        uint32_t peer = src->seen[i] & 0xffffffffu;
+        if (unlikely(!addpeer(dst, map[id].ent, map[id].id, peer)))
+            goto out;
+    }
+
+    ok = true;
+
+out:
+    free(map);
+    return ok;
+}
+
+UBGP_API void pfx2asiterinit(pfx2as_iterator_t *it, pfx2as_t *tab)
+{
+    it->tab = tab;
+    it->fam = 0;
+    patiteratorinit(&it->it, &tab->tries[0]);
+}
+
+static int cmporigin(const void *a, const void *b)
+{
+    const pfx2as_origin_t *x = a;
+    const pfx2as_origin_t *y = b;
+
+    if (x->npeers != y->npeers)
+        return (x->npeers < y->npeers) ? 1 : -1;
+    if (x->isset != y->isset)
+        return x->isset - y->isset;
+
+    return (x->as > y->as) - (x->as < y->as);
+}
+
+UBGP_API const netaddr_t *pfx2asiternext(pfx2as_iterator_t      *it,
+                                         const pfx2as_origin_t **porigins,
+                                         size_t                 *pn)
+{
+    while (patiteratorend(&it->it)) {
+        if (it->fam == countof(it->tab->tries) - 1)
+            return NULL;
+
+        patiteratorinit(&it->it, &it->tab->tries[++it->fam]);
+    }
+
+    trienode_t *n = patiteratorget(&it->it);
+    patiteratornext(&it->it);
+
+    pfx2as_entry_t *ent = n->payload;
+
+    pfx2as_origin_t *origins = entryorigins(ent);
+    if (ent->n > 1)
+        qsort(origins, ent->n, sizeof(*origins), cmporigin);
+
+    *porigins = origins;
+    *pn       = ent->n;
+    return &n->prefix;
+}
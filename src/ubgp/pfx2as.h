@@ -0,0 +1,204 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+#ifndef UBGP_PFX2AS_H_
+#define UBGP_PFX2AS_H_
+
+#include "bgp.h"
+#include "funcattribs.h"
+#include "netaddr.h"
+#include "patriciatrie.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * SECTION: pfx2as
+ * @title: Prefix to Origin AS Aggregation
+ * @include: pfx2as.h
+ *
+ * Aggregate (prefix, origin AS) pairs along with the number of distinct peers
+ * announcing each of them, as seen in a RIB.
+ *
+ * Prefixes are kept in a #patricia_trie_t per address family, each node
+ * refers to a small origin vector, stored inline as long as a prefix has
+ * no more than %PFX2AS_INLINE origins (as is the case for all but
+ * a handful of MOAS prefixes).
+ * AS_SET origins are sorted, deduplicated and interned, so each distinct
+ * set is stored once and compared as a single integer.
+ * Peers are counted once per origin of each prefix, regardless of how many
+ * paths or RIB dumps they announce it in, at the cost of 8 bytes per distinct
+ * (prefix, origin, peer) triple, as aslinks_t does for its links.
+ *
+ * Tables are meant to be filled independently by each worker,
+ * and combined once done by pfx2asmerge().
+ */
+
+enum {
+    PFX2AS_INLINE = 2  // origins stored inline in each prefix entry
+};
+
+/**
+ * pfx2as_origin_t:
+ * @as:     the origin AS, or an interned AS_SET index if @isset is set,
+ *          see pfx2asset()
+ * @npeers: number of distinct peers announcing the prefix from this origin
+ * @isset:  whether @as is an AS_SET index
+ *
+ * An origin of a prefix.
+ */
+typedef struct {
+    uint32_t as;
+    uint32_t npeers : 31;
+    uint32_t isset  : 1;
+
+    /*< private >*/
+    uint32_t id;  // identifier in seen pairs, starting from 1
+} pfx2as_origin_t;
+
+typedef struct pfx2as_entry_s pfx2as_entry_t;
+typedef struct pfx2as_chunk_s pfx2as_chunk_t;
+
+/**
+ * pfx2as_t:
+ *
+ * A prefix to origin AS table.
+ */
+typedef struct {
+    /*< private >*/
+    patricia_trie_t tries[2];   // AF_INET and AF_INET6 prefixes
+    pfx2as_chunk_t *chunks;     // prefix entries storage
+    uint            chunkused;  // entries in use in the first chunk
+
+    // interned AS_SETs, setpool holds each set as its size followed by its members
+    uint32_t *setpool;
+    size_t    poolsiz, poolcap;
+    uint32_t *setoffs;
+    uint      nsets, setscap;
+    uint32_t *sethash;          // open addressing, set index + 1, 0 marks a free slot
+    uint      hashcap;
+
+    uint32_t  norigins;         // last origin identifier
+    uint64_t *seen;             // distinct (origin id << 32) | peer pairs, 0 marks a free slot
+    size_t    nseen, seencap;
+} pfx2as_t;
+
+UBGP_API CHECK_NONNULL(1) void pfx2asinit(pfx2as_t *tab);
+
+UBGP_API CHECK_NONNULL(1) void pfx2asdestroy(pfx2as_t *tab);
+
+/**
+ * pfx2asadd:
+ * @tab:    a #pfx2as_t
+ * @pfx:    an announced prefix
+ * @origin: its origin, as returned by getrealoriginas()
+ * @peer:   identifier of the peer announcing @pfx
+ *
+ * Count @peer among the peers announcing @pfx from @origin, unless it
+ * already was, e.g. through another ADD-PATH path or an earlier RIB.
+ * Routes with an empty AS path have no origin and are ignored.
+ *
+ * Returns: %true on success, %false on out of memory.
+ */
+UBGP_API CHECK_NONNULL(1, 2, 3) bool pfx2asadd(pfx2as_t          *tab,
+                                               const netaddr_t   *pfx,
+                                               const as_origin_t *origin,
+                                               uint32_t           peer);
+
+/**
+ * pfx2asmerge:
+ * @dst: table receiving the merged data
+ * @src: a table to be merged into @dst, left untouched
+ *
+ * Add every prefix and origin in @src to @dst, joining the peer sets
+ * of the origins found in both.
+ *
+ * Returns: %true on success, %false on out of memory, in which case @dst
+ *          may contain part of @src.
+ */
+UBGP_API CHECK_NONNULL(1, 2) bool pfx2asmerge(pfx2as_t *dst, const pfx2as_t *src);
+
+/**
+ * pfx2ascount:
+ * @tab: a #pfx2as_t
+ *
+ * Returns: number of distinct prefixes in @tab.
+ */
+static inline PUREFUNC CHECK_NONNULL(1) uint pfx2ascount(const pfx2as_t *tab)
+{
+    return tab->tries[0].nprefs + tab->tries[1].nprefs;
+}
+
+/**
+ * pfx2asset:
+ * @tab: a #pfx2as_t
+ * @idx: an interned AS_SET index, as found in a #pfx2as_origin_t
+ * @pn:  storage for the number of ASes in the set
+ *
+ * Returns: the sorted members of the AS_SET.
+ */
+static inline CHECK_NONNULL(1, 3) const uint32_t *pfx2asset(const pfx2as_t *tab, uint32_t idx, size_t *pn)
+{
+    const uint32_t *set = &tab->setpool[tab->setoffs[idx]];
+
+    *pn = set[0];
+    return &set[1];
+}
+
+/**
+ * pfx2as_iterator_t:
+ *
+ * Iterates a #pfx2as_t table, see pfx2asiterinit().
+ */
+typedef struct {
+    /*< private >*/
+    pfx2as_t *tab;
+    uint fam;
+    patiterator_t it;
+} pfx2as_iterator_t;
+
+/**
+ * pfx2asiterinit:
+ * @it:  iterator to be initialized
+ * @tab: table to iterate
+ *
+ * Start iterating @tab in sorted order: %AF_INET prefixes come first,
+ * then %AF_INET6 ones, each family ordered by address and then
+ * by prefix length.
+ */
+UBGP_API CHECK_NONNULL(1, 2) void pfx2asiterinit(pfx2as_iterator_t *it, pfx2as_t *tab);
+
+/**
+ * pfx2asiternext:
+ * @it:       an iterator
+ * @porigins: storage for the origins of the returned prefix
+ * @pn:       storage for the number of origins
+ *
+ * Advance the iterator. Origins are returned sorted by decreasing number
+ * of peers, then by AS, with AS_SETs last.
+ *
+ * Returns: the next prefix, %NULL once the iteration is over.
+ */
+UBGP_API CHECK_NONNULL(1, 2, 3) const netaddr_t *pfx2asiternext(pfx2as_iterator_t      *it,
+                                                                const pfx2as_origin_t **porigins,
+                                                                size_t                 *pn);
+
+#endif
@@ -0,0 +1,360 @@
+/* Copyright (C) 2019 Alpha Cogs S.R.L.
+ *
+ * The ubgp library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The ubgp library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with the ubgp library.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * This work is based upon work authored by the Institute of Informatics
+ * and Telematics of the Italian National Research Council (IIT-CNR) licensed
+ * under the BSD 3-Clause license. See AKNOWLEDGEMENT and AUTHORS for more
+ * details.
+ */
+
+// =====================================================================
+// NOTE: THIS FILE HAS NO INCLUDE GUARDS, BECAUSE IT IS INCLUDED TWICE BY
+//       filterpacket.c TO INSTANTIATE THE PLAIN AND PROFILING INTERPRETERS
+//
+// Define VM_INTERP_NAME to the interpreter function name and
+// VM_INTERP_PROFILE to 0 or 1 before including it.
+// =====================================================================
+
+static int VM_INTERP_NAME(ubgp_msg_s *msg, const filter_prog_t *prog, filter_ctx_t *vm)
+{
+#if VM_INTERP_PROFILE
+#define PROFILE_TICK()         vm_profile_tick(vm->prof, vm->pc - 1, vm_getopcode(ip))
+#define PROFILE_SHORTCIRCUIT() (vm->prof->shortcircuits[vm->pc - 1]++)
+#define PROFILE_END(res)       vm_profile_end(vm->prof, res)
+#else
+#define PROFILE_TICK()         (void) 0
+#define PROFILE_SHORTCIRCUIT() (void) 0
+#define PROFILE_END(res)       (void) 0
+#endif
+
+// disable pedantic diagnostic about taking address label
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+#if defined(__GNUC__) && !defined(ISOLARIO_VM_PLAIN_SWITCH)
+// use computed goto to speed-up bytecode interpreter
+#include "vm_opcodes.h"
+
+#define FETCH() ip = code[vm->pc++];                                       \
+                np = likely(vm->pc < codesiz) ? code[vm->pc] : BAD_OPCODE; \
+                (void) np;                                                 \
+                PROFILE_TICK();                                            \
+                goto *vm_opcode_table[vm_getopcode(ip)]
+
+#define PREDICT(opcode) do {                                             \
+        if (likely(vm_getopcode(np) == FOPC_##opcode)) {                 \
+            ip = np;                                                     \
+            np = likely(vm->pc < codesiz) ? code[++vm->pc] : BAD_OPCODE; \
+            PROFILE_TICK();                                              \
+            goto *vm_opcode_table[FOPC_##opcode];                        \
+        }                                                                \
+    } while (false)
+
+#define DISPATCH() break
+
+#define EXECUTE(opcode) case FOPC_##opcode: \
+                        EX_##opcode
+
+#define EXECUTE_SIGILL default: \
+                       EX_SIGILL
+
+#else
+// portable C
+
+#define FETCH() ip = code[vm->pc++];                                       \
+                np = likely(vm->pc < codesiz) ? code[vm->pc] : BAD_OPCODE; \
+                (void) np;                                                 \
+                PROFILE_TICK()
+
+#define PREDICT(opcode) do (void) 0; while (false)
+
+#define DISPATCH() break
+
+#define EXECUTE(opcode) case FOPC_##opcode
+
+#define EXECUTE_SIGILL  default
+#endif
+
+    const bytecode_t *code = prog->code;
+    const ushort codesiz   = prog->codesiz;
+
+    vm->prog = prog;
+    vm->bgp  = msg;
+    if (setjmp(vm->except) != 0) {
+        // TODO cleanup temporary patricias!
+        vm_exec_settle(vm);
+        PROFILE_END(vm->error);
+        return vm->error;
+    }
+
+    bytecode_t ip, np;
+    int arg, exarg;
+    stack_cell_t *cell;
+
+#if VM_INTERP_PROFILE
+    if (unlikely(!vm_profile_fit(vm->prof, codesiz)))
+        vm_abort(vm, VM_OUT_OF_MEMORY);
+
+    vm_profile_start(vm->prof);
+#endif
+
+    vm->pc     = 0;
+    vm->curblk = 0;
+    vm_clearstack(vm);
+    vm->dynmarker = 0;
+    vm->error     = 0;
+    exarg         = 0;
+
+    vm_exec_settrie(vm, VM_TMPTRIE);
+    vm_exec_settrie6(vm, VM_TMPTRIE6);
+    vm_exec_clrtrie(vm);
+    vm_exec_clrtrie6(vm);
+
+    while (vm->pc < codesiz) {
+        FETCH();
+
+        switch (vm_getopcode(ip)) {
+        EXECUTE(NOP):
+            DISPATCH();
+
+        EXECUTE(BLK):
+            vm->curblk++;
+            DISPATCH();
+
+        EXECUTE(ENDBLK):
+            if (unlikely(vm->curblk == 0))
+                vm_abort(vm, VM_SPURIOUS_ENDBLK);
+
+            vm->curblk--;
+            PREDICT(CPASS); // OR chain case
+            PREDICT(NOT);   // usually at end of chain
+            DISPATCH();
+
+        EXECUTE(LOAD):
+            vm_pushvalue(vm, vm_extendarg(vm_getarg(ip), exarg));
+            exarg = 0;
+            DISPATCH();
+
+        EXECUTE(LOADK):
+            arg = vm_extendarg(vm_getarg(ip), exarg);
+            vm_exec_loadk(vm, arg);
+            exarg = 0;
+            DISPATCH();
+
+        EXECUTE(UNPACK):
+            vm_exec_unpack(vm);
+            DISPATCH();
+
+        EXECUTE(EXARG):
+            arg = vm_getarg(ip);
+            exarg <<= 8;
+            exarg  |= arg;
+
+            PREDICT(LOADK);
+            PREDICT(LOAD);
+            PREDICT(CALL);
+
+            DISPATCH();
+
+        EXECUTE(STORE):
+            vm_exec_store(vm);
+            DISPATCH();
+
+        EXECUTE(DISCARD):
+            vm_exec_discard(vm);
+            DISPATCH();
+
+        EXECUTE(NOT):
+            vm_exec_not(vm);
+            PREDICT(CFAIL);
+            PREDICT(CPASS);
+            DISPATCH();
+
+        EXECUTE(CPASS):
+            cell = vm_peek(vm);
+            if (cell->value) {
+                PROFILE_SHORTCIRCUIT();
+                if (vm->curblk == 0)
+                    goto done; // no more blocks, we're done
+
+                // advance up to the next ENDBLK
+                vm_exec_break(vm);
+            } else {
+                vm->si--;  // discard and proceed
+            }
+            DISPATCH();
+
+        EXECUTE(CFAIL):
+            cell = vm_peek(vm);
+            if (cell->value) {
+                PROFILE_SHORTCIRCUIT();
+                cell->value = 0;  // negate existing value
+                if (vm->curblk == 0)
+                    goto done;    // no more blocks, we're done
+
+                // advance up to the next ENDBLK
+                vm_exec_break(vm);
+            } else {
+                vm->si--;  // discard and proceed
+            }
+            DISPATCH();
+
+        EXECUTE(ASPMATCH):
+            vm_exec_aspmatch(vm, vm_getarg(ip));
+            DISPATCH();
+
+        EXECUTE(ASPSTARTS):
+            vm_exec_aspstarts(vm, vm_getarg(ip));
+            DISPATCH();
+
+        EXECUTE(ASPENDS):
+            vm_exec_aspends(vm, vm_getarg(ip));
+            DISPATCH();
+
+        EXECUTE(ASPEXACT):
+            vm_exec_aspexact(vm, vm_getarg(ip));
+            DISPATCH();
+
+        EXECUTE(COMMEXACT):
+            vm_exec_commexact(vm);
+            DISPATCH();
+            
+        EXECUTE(CALL):
+            arg = vm_extendarg(vm_getarg(ip), exarg);
+            if (unlikely(arg >= VM_FUNCS_COUNT))
+                vm_abort(vm, VM_FUNC_UNDEFINED);
+            if (unlikely(!prog->funcs[arg]))
+                vm_abort(vm, VM_FUNC_UNDEFINED);
+
+            prog->funcs[arg](vm);
+            exarg = 0;
+            DISPATCH();
+
+        EXECUTE(SETTLE):
+            vm_exec_settle(vm);
+            DISPATCH();
+
+        EXECUTE(HASATTR):
+            vm_exec_hasattr(vm, vm_getarg(ip));
+            PREDICT(NOT);
+            DISPATCH();
+
+        EXECUTE(HASANYATTR):
+            arg = vm_extendarg(vm_getarg(ip), exarg);
+            vm_exec_hasanyattr(vm, arg);
+            exarg = 0;
+            PREDICT(NOT);
+            DISPATCH();
+
+        EXECUTE(EXACT):
+            vm_exec_exact(vm, vm_getarg(ip));
+            DISPATCH();
+
+        EXECUTE(SUBNET):
+            vm_exec_subnet(vm, vm_getarg(ip));
+            DISPATCH();
+
+        EXECUTE(SUPERNET):
+            vm_exec_supernet(vm, vm_getarg(ip));
+            DISPATCH();
+
+        EXECUTE(RELATED):
+            vm_exec_related(vm, vm_getarg(ip));
+            DISPATCH();
+
+        EXECUTE(PFXCONTAINS):
+            arg = vm_extendarg(vm_getarg(ip), exarg);
+            vm_exec_pfxcontains(vm, arg);
+            exarg = 0;
+            DISPATCH();
+
+        EXECUTE(ADDRCONTAINS):
+            arg = vm_extendarg(vm_getarg(ip), exarg);
+            vm_exec_addrcontains(vm, arg);
+            exarg = 0;
+            DISPATCH();
+
+        EXECUTE(ASCONTAINS):
+            arg = vm_extendarg(vm_getarg(ip), exarg);
+            vm_exec_ascontains(vm, arg);
+            exarg = 0;
+            DISPATCH();
+
+        EXECUTE(SETTRIE):
+            arg = vm_extendarg(vm_getarg(ip), exarg);
+            vm_exec_settrie(vm, arg);
+            exarg = 0;
+            DISPATCH();
+
+        EXECUTE(SETTRIE6):
+            arg = vm_extendarg(vm_getarg(ip), exarg);
+            vm_exec_settrie6(vm, arg);
+            exarg = 0;
+            DISPATCH();
+
+        EXECUTE(CLRTRIE):
+            vm_exec_clrtrie(vm);
+            DISPATCH();
+
+        EXECUTE(CLRTRIE6):
+            vm_exec_clrtrie6(vm);
+            DISPATCH();
+
+        EXECUTE(ADDRCMP):
+            arg = vm_extendarg(vm_getarg(ip), exarg);
+            vm_exec_addrcmp(vm, arg);
+            exarg = 0;
+            DISPATCH();
+
+        EXECUTE(PFXCMP):
+            arg = vm_extendarg(vm_getarg(ip), exarg);
+            vm_exec_pfxcmp(vm, arg);
+            exarg = 0;
+            DISPATCH();
+
+        EXECUTE(ASCMP):
+            arg = vm_extendarg(vm_getarg(ip), exarg);
+            vm_exec_ascmp(vm, arg);
+            exarg = 0;
+            DISPATCH();
+
+        EXECUTE_SIGILL:
+            vm_abort(vm, VM_ILLEGAL_OPCODE);
+            DISPATCH();  // unreachable
+        }
+    }
+
+done:
+    vm_exec_settle(vm);
+    if (unlikely(vm->curblk > 0))
+        vm_abort(vm, VM_DANGLING_BLK);
+
+    cell = vm_pop(vm);
+    PROFILE_END(cell->value != 0);
+    return cell->value != 0;
+
+#undef FETCH
+#undef DISPATCH
+#undef PREDICT
+#undef EXECUTE
+#undef EXECUTE_SIGILL
+#undef PROFILE_TICK
+#undef PROFILE_SHORTCIRCUIT
+#undef PROFILE_END
+#pragma GCC diagnostic pop
+}
+
+#undef VM_INTERP_NAME
+#undef VM_INTERP_PROFILE
@@ -69,6 +69,7 @@ static const void *const vm_opcode_table[256] = {
     [FOPC_ASCMP]        = &&EX_ASCMP,
     [FOPC_ADDRCMP]      = &&EX_ADDRCMP,
     [FOPC_PFXCMP]       = &&EX_PFXCMP,
+    [FOPC_HASANYATTR]   = &&EX_HASANYATTR,
 
     [OPCODES_COUNT]     = &&EX_SIGILL,
 
@@ -126,7 +127,6 @@ static const void *const vm_opcode_table[256] = {
     &&EX_SIGILL, &&EX_SIGILL, &&EX_SIGILL, &&EX_SIGILL,
     &&EX_SIGILL, &&EX_SIGILL, &&EX_SIGILL, &&EX_SIGILL,
     &&EX_SIGILL, &&EX_SIGILL, &&EX_SIGILL, &&EX_SIGILL,
-    &&EX_SIGILL, &&EX_SIGILL, &&EX_SIGILL, &&EX_SIGILL,
-    &&EX_SIGILL
+    &&EX_SIGILL, &&EX_SIGILL, &&EX_SIGILL, &&EX_SIGILL
 };
 